@@ -0,0 +1,42 @@
+#include "binarycache.h"
+
+#include <cstring>
+
+#include <sys/stat.h>
+
+namespace BinaryCache
+{
+
+static const size_t MAGIC_SIZE = 8;
+
+bool getSourceStamp(const std::string &sourcePath, SourceStamp &stamp)
+{
+    struct stat fileStatus;
+    if (stat(sourcePath.c_str(), &fileStatus) != 0) {
+        return false;
+    }
+    stamp.size = uint64_t(fileStatus.st_size);
+    stamp.modificationTime = int64_t(fileStatus.st_mtime);
+    return true;
+}
+
+void writeHeader(std::ofstream &file, const char magic[8], uint32_t version, const SourceStamp &stamp)
+{
+    file.write(magic, MAGIC_SIZE);
+    writeValue(file, version);
+    writeValue(file, stamp.size);
+    writeValue(file, stamp.modificationTime);
+}
+
+bool readHeader(std::ifstream &file, const char magic[8], uint32_t version, const SourceStamp &stamp)
+{
+    char fileMagic[MAGIC_SIZE];
+    uint32_t fileVersion;
+    SourceStamp fileStamp;
+    return file.read(fileMagic, MAGIC_SIZE) && std::memcmp(fileMagic, magic, MAGIC_SIZE) == 0
+        && readValue(file, fileVersion) && fileVersion == version
+        && readValue(file, fileStamp.size) && readValue(file, fileStamp.modificationTime)
+        && fileStamp.size == stamp.size && fileStamp.modificationTime == stamp.modificationTime;
+}
+
+}
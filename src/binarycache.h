@@ -0,0 +1,62 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <stdint.h>
+
+
+/**
+ * @brief Shared helpers of the binary cache files written next to their source files (see MeshCache and TextureCache).
+ * Each cache file starts with a header of an 8 character magic, the cache version and the stamp of the source file,
+ * so a cache is only used if it was written from a source file of the same size and modification time by the same version.
+ */
+namespace BinaryCache
+{
+
+    //! identifies the state of the source file a cache was written from
+    struct SourceStamp
+    {
+        uint64_t size = 0;
+        int64_t modificationTime = 0;
+    };
+
+    //! Get the stamp of a source file.
+    /// \return false if the file does not exist
+    bool getSourceStamp(
+        const std::string &sourcePath, //!< [in] path of the source file
+        SourceStamp &stamp //!< [out] the size and modification time of the file
+    );
+
+    //! Write the header of a cache file.
+    void writeHeader(
+        std::ofstream &file, //!< [in] the cache file opened for binary writing
+        const char magic[8], //!< [in] identifies the kind of cache
+        uint32_t version, //!< [in] the cache version
+        const SourceStamp &stamp //!< [in] the stamp of the source file the cache is written from
+    );
+
+    //! Read the header of a cache file.
+    /// \return whether the header is complete and matches the magic, the version and the stamp of the current source file
+    bool readHeader(
+        std::ifstream &file, //!< [in] the cache file opened for binary reading
+        const char magic[8], //!< [in] identifies the kind of cache
+        uint32_t version, //!< [in] the current cache version
+        const SourceStamp &stamp //!< [in] the stamp of the current source file
+    );
+
+    //! Write the bytes of a plain value.
+    template <typename T>
+    void writeValue(std::ofstream &file, const T &value)
+    {
+        file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    //! Read the bytes of a plain value.
+    /// \return false if the file ended
+    template <typename T>
+    bool readValue(std::ifstream &file, T &value)
+    {
+        return bool(file.read(reinterpret_cast<char *>(&value), sizeof(T)));
+    }
+
+}
@@ -115,20 +115,47 @@ bool Camera::checkSphereInFrustum(const glm::vec3 &sphereCenterWorldSpace, const
 	center /= center.w;
 	sphereFarthestPoint /= sphereFarthestPoint.w;
 
+	// the depth extent is tested in view space with the world space radius, since the farthest point
+	// may lie in any direction from the center, e.g. orthogonal to the view direction where its depth equals the center's
+	float viewDepth = -(viewMat * glm::vec4(sphereCenterWorldSpace, 1)).z;
+	float worldRadius = glm::length(sphereFarthestPointWorldSpace - sphereCenterWorldSpace);
+	if (viewDepth + worldRadius < nearPlane || viewDepth - worldRadius > farPlane) return false;
+
+	// the projection of spheres reaching through the near plane is not bounded by their projected points,
+	// e.g. if the center lies behind the camera, so they are kept
+	if (viewDepth - worldRadius <= nearPlane) return true;
+
 	// note: if needed, use a greater radius to avoid that objects disappear
 	// whose shadows are still in view, as well as to compensate the rough bounding sphere approximation
 	float radius = glm::length(sphereFarthestPoint.xy() - center.xy());
-	float distanceZ = abs(sphereFarthestPoint.z - center.z);
 
-	// check if the sphere lies beyond any of the 6 view frustum planes
+	// check if the sphere lies beyond any of the 4 side planes of the view frustum
 	float plane = 1.0f;
 	if (center.x - radius > plane || center.x + radius < -plane) return false;
 	if (center.y - radius > plane || center.y + radius < -plane) return false;
-	if (center.z - distanceZ > plane || center.z + distanceZ < -plane) return false;
 
 	return true;
 }
 
+void Camera::getFrustumPlanes(const glm::mat4 &viewMat, glm::vec4 planes[6]) const
+{
+	// extract the planes from the rows of the view projection matrix (Gribb and Hartmann),
+	// since a clip space point lies inside if -w <= x,y,z <= w
+	glm::mat4 viewProjMat = getProjMat() * viewMat;
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i) {
+		rows[i] = glm::vec4(viewProjMat[0][i], viewProjMat[1][i], viewProjMat[2][i], viewProjMat[3][i]);
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		planes[i * 2] = rows[3] + rows[i];
+		planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (int i = 0; i < 6; ++i) {
+		planes[i] /= glm::length(planes[i].xyz());
+	}
+}
+
 /* FOLLOW PATH MODE */
 
 void Camera::appendPath(std::vector<std::vector<glm::vec3> > newPath)
@@ -192,18 +219,21 @@ void Camera::handleInputFreeCamera(GLFWwindow *window, float timeDelta)
 	// camera movement
 	// note: we apply rotation before translation since we dont want the distance from the origin
 	// to affect how we rotate
+	// the local axes are not changed by translations, so they are taken once before moving
+	glm::vec3 localX = getMatrix()[0].xyz;
+	glm::vec3 localZ = getMatrix()[2].xyz;
 	if (glfwGetKey(window, 'W')) {
-		translate(getMatrix()[2].xyz * -timeDelta * moveSpeed, SceneObject::LEFT);
+		translate(localZ * -timeDelta * moveSpeed, SceneObject::LEFT);
 	}
 	else if (glfwGetKey(window, 'S')) {
-		translate(getMatrix()[2].xyz * timeDelta * moveSpeed, SceneObject::LEFT);
+		translate(localZ * timeDelta * moveSpeed, SceneObject::LEFT);
 	}
 
 	if (glfwGetKey(window, 'A')) {
-		translate(getMatrix()[0].xyz * -timeDelta * moveSpeed, SceneObject::LEFT);
+		translate(localX * -timeDelta * moveSpeed, SceneObject::LEFT);
 	}
 	else if (glfwGetKey(window, 'D')) {
-		translate(getMatrix()[0].xyz * timeDelta * moveSpeed, SceneObject::LEFT);
+		translate(localX * timeDelta * moveSpeed, SceneObject::LEFT);
 	}
 
 	if (glfwGetKey(window, 'Q')) {
@@ -88,7 +88,8 @@ class Camera : public SceneObject
     //! Determine whether a sphere with given center and farthest point in
     //! world space lies completely within the view frustum. Note that the
     //! farthest point is passed instead of the radius to apply matrices
-    //! to do the checks in clip space.
+    //! to do the checks of the side planes in clip space. The near and far planes are checked in view space,
+    //! and spheres reaching through the near plane are always kept.
     /// \return whether the sphere lies completely within the view frustum
     bool checkSphereInFrustum(
         const glm::vec3 &sphereCenterWorldSpace, //!< [in] the center of the sphere in world space
@@ -96,6 +97,14 @@ class Camera : public SceneObject
         const glm::mat4 &viewMat //!< [in] Viewing matrix
     );
 
+    //! Get the 6 view frustum planes in world space with normals pointing into the frustum,
+    //! such that a point p lies inside of a plane if dot(plane.xyz, p) + plane.w >= 0.
+    //! Unlike checkSphereInFrustum this allows testing many spheres against the same view.
+    void getFrustumPlanes(
+        const glm::mat4 &viewMat, //!< [in] Viewing matrix
+        glm::vec4 planes[6] //!< [out] normalized planes in the order left, right, bottom, top, near, far
+    ) const;
+
     //! Toggle the camera navigation mode
     void toggleNavMode();
     
@@ -1,5 +1,7 @@
 #include "particlesystem.h"
 
+#include "../resourcemanager.h"
+
 // vertex positions and uvs defining a quad, used to render particles.
 static const GLfloat quadVertices[] = {
     // positions   // uvs
@@ -31,8 +33,7 @@ ParticleSystem::ParticleSystem(const glm::mat4 &matrix_, const std::string &text
 {
 
 	particleShader = new Shader("shaders/particles.vert", "shaders/particles.frag");
-	particleTexture = new Texture(texturePath);
-	std::cout << "loaded texture: " << texturePath << std::endl;
+	particleTexture = ResourceManager::getInstance()->getTexture(texturePath);
 
 
 	// generate vertex array object (vao) bindings. the vao simply stores the state of the subsequent bindings
@@ -80,7 +81,6 @@ ParticleSystem::~ParticleSystem()
 	glDeleteBuffers(1, &particleInstanceDataVBO);
 
 	delete particleShader;
-	delete particleTexture;
 }
 
 void ParticleSystem::draw(const glm::mat4 &viewMat, const glm::mat4 &projMat, const glm::vec3 &color)
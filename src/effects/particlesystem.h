@@ -52,7 +52,7 @@ private:
     GLuint particleInstanceDataVBO;
 
     Shader *particleShader = nullptr;
-    Texture *particleTexture = nullptr;
+    std::shared_ptr<Texture> particleTexture;
 
     unsigned int maxParticleCount = 1000; // maximum total particle count
     bool spawningPaused = true;
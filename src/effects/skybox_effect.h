@@ -3,14 +3,15 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <memory>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <FreeImagePlus.h>
 
 #include "../shader.h"
+#include "../texture.hpp"
 
 /// SkyboxEffect
 /// This is used to draw a skybox using a cubemap texture
@@ -20,27 +21,18 @@ class SkyboxEffect
 private:
 
 	GLuint skyboxVAO, skyboxVBO; // skybox cube geometry
-	GLuint cubeMap; // cubemap consisting of 6 texture faces that are sampled via a direction vector
+	std::shared_ptr<CubemapTexture> cubeMap; // cubemap consisting of 6 texture faces that are sampled via a direction vector
 	Shader *skyboxShader = nullptr;
 
 public:
 
+	/// the cubemap image paths should be given in the order +X, -X, +Y, -Y, +Z, -Z
 	SkyboxEffect(const std::vector<const GLchar *> &cubemapImgPaths);
 	~SkyboxEffect();
 
 	void drawSkybox(const glm::mat4 &viewMat, const glm::mat4 &projMat);
 
-private:
-
-	/// load cubemap texture from 6 individual image files
-	/// image paths should be given in following order:
-	/// +X (right)
-	/// -X (left)
-	/// +Y (top)
-	/// -Y (bottom)
-	/// +Z (front)
-	/// -Z (back)
-	GLuint loadCubemap(const std::vector<const GLchar *> &cubemapImgPaths);
+	/// the cubemap of the sky, e.g. to sample reflections that miss the scene
+	std::shared_ptr<CubemapTexture> getCubemap() const { return cubeMap; }
 
 };
-
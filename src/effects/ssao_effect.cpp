@@ -1,5 +1,9 @@
 #include "ssao_effect.h"
 
+#include <algorithm>
+
+#include <FreeImagePlus.h>
+
 // vertex positions and uvs defining a quad. used to render the screen texture.
 static const GLfloat quadVertices[] = {
     // positions   // uvs
@@ -12,8 +16,24 @@ static const GLfloat quadVertices[] = {
      1.0f,  1.0f,  1.0f, 1.0f
 };
 
-SSAOEffect::SSAOEffect(int windowWidth, int windowHeight, int samples_)
-    : samples(samples_)
+const GLuint SSAOEffect::MAX_SAMPLES;
+const int SSAOEffect::REJECTION_COUNTER_COUNT;
+
+// uniform buffer binding point of the random vectors. 0 and 1 hold the matrices and the light and camera uniforms of the scene shaders.
+static const GLuint RANDOM_VECTORS_BINDING = 2;
+
+// work group size of the depth chain compute shader, see ssao_depth_chain.comp
+static const int DEPTH_CHAIN_GROUP_SIZE = 8;
+
+// work group size of the horizon search and denoise compute shaders, see gtao.comp and gtao_denoise.comp
+static const int HORIZON_GROUP_SIZE = 8;
+
+// the kernel rotation pattern repeats after this many frames
+static const int KERNEL_ROTATION_FRAMES = 64;
+
+SSAOEffect::SSAOEffect(int windowWidth, int windowHeight, int samples_, SSAOTier tier_)
+    : samples(std::min(std::max(GLuint(samples_), 1u), MAX_SAMPLES))
+    , tier(tier_)
 {
 
     ////////////////////////////////////
@@ -53,7 +73,30 @@ SSAOEffect::SSAOEffect(int windowWidth, int windowHeight, int samples_)
 
 	ssaoShader = new Shader("shaders/ssao.vert", "shaders/ssao.frag");
 	blurShader = new Shader("shaders/blur.vert", "shaders/blur.frag");
+	depthChainShader = new Shader("shaders/ssao_depth_chain.comp");
+	upsampleShader = new Shader("shaders/ssao.vert", "shaders/ssao_upsample.frag");
+	temporalShader = new Shader("shaders/ssao.vert", "shaders/ssao_temporal.frag");
+	horizonShader = new Shader("shaders/gtao.comp");
+	horizonDenoiseShader = new Shader("shaders/gtao_denoise.comp");
+
+    // use uniform buffer object to pass random vectors to ssao shader for better performance
+    glUniformBlockBinding(ssaoShader->programHandle, glGetUniformBlockIndex(ssaoShader->programHandle, "RandomVectors"), RANDOM_VECTORS_BINDING);
+    glGenBuffers(1, &uboRandomVectors);
+    createRandomVectors();
+
+    // counters of the rejected history pixels, one per frame in flight
+    glGenBuffers(REJECTION_COUNTER_COUNT, rejectionCounters);
+    for (int i = 0; i < REJECTION_COUNTER_COUNT; ++i) {
+        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, rejectionCounters[i]);
+        glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_READ);
+        rejectionFences[i] = 0;
+    }
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
 
+}
+
+void SSAOEffect::createRandomVectors()
+{
     // create array of random vectors for depth sampling in ssao shader
     std::vector<glm::vec3> randomVectors;
     for (GLuint i = 0; i < samples; ++i) {
@@ -72,48 +115,76 @@ SSAOEffect::SSAOEffect(int windowWidth, int windowHeight, int samples_)
         //std::cout << "x: " << randomVector.x << ", y: " << randomVector.y << ", z: " << randomVector.z << std::endl;
     }
 
-    // use uniform buffer object to pass random vectors to ssao shader for better performance
-    glUniformBlockBinding(ssaoShader->programHandle, glGetUniformBlockIndex(ssaoShader->programHandle, "RandomVectors"), 0);
-    GLuint uboRandomVectors;
-    glGenBuffers(1, &uboRandomVectors);
+    // std140 pads each vec3 of the array to 16 bytes
+    std::vector<glm::vec4> paddedVectors;
+    for (const glm::vec3 &randomVector : randomVectors) {
+        paddedVectors.push_back(glm::vec4(randomVector, 0.0f));
+    }
     glBindBuffer(GL_UNIFORM_BUFFER, uboRandomVectors);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::vec3) * randomVectors.size(), &randomVectors[0], GL_STATIC_DRAW);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::vec4) * MAX_SAMPLES, NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::vec4) * paddedVectors.size(), &paddedVectors[0]);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, uboRandomVectors, 0, sizeof(glm::vec3) * randomVectors.size());
-
 }
 
 SSAOEffect::~SSAOEffect()
 {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    glDeleteFramebuffers(1, &fboScreenData);
-    glDeleteTextures(1, &screenColorTexture);
-    glDeleteTextures(1, &viewPosTexture);
-    glDeleteRenderbuffers(1, &screenDepthBuffer);
-
-    glDeleteFramebuffers(1, &fboSSAO);
-    glDeleteTextures(1, &ssaoTexture);
+    deleteFramebuffers();
 
+    glDeleteBuffers(1, &uboRandomVectors);
+    glDeleteBuffers(REJECTION_COUNTER_COUNT, rejectionCounters);
+    for (int i = 0; i < REJECTION_COUNTER_COUNT; ++i) {
+        glDeleteSync(rejectionFences[i]);
+    }
     glDeleteBuffers(1, &screenQuadVBO);
     glDeleteVertexArrays(1, &screenQuadVAO);
 
     delete ssaoShader; ssaoShader = nullptr;
     delete blurShader; blurShader = nullptr;
+    delete depthChainShader; depthChainShader = nullptr;
+    delete upsampleShader; upsampleShader = nullptr;
+    delete temporalShader; temporalShader = nullptr;
+    delete horizonShader; horizonShader = nullptr;
+    delete horizonDenoiseShader; horizonDenoiseShader = nullptr;
 
 }
 
-void SSAOEffect::setupFramebuffers(int windowWidth, int windowHeight)
+void SSAOEffect::deleteFramebuffers()
 {
-
     glDeleteFramebuffers(1, &fboScreenData);
     glDeleteTextures(1, &screenColorTexture);
-    glDeleteTextures(1, &viewPosTexture);
-    glDeleteRenderbuffers(1, &screenDepthBuffer);
+    glDeleteTextures(1, &screenDepthTexture);
 
     glDeleteFramebuffers(1, &fboSSAO);
     glDeleteTextures(1, &ssaoTexture);
 
+    glDeleteFramebuffers(1, &fboSSAOBlurPingpong);
+    glDeleteTextures(1, &ssaoBlurredTexturePingpong);
+
+    glDeleteTextures(1, &depthChainTexture);
+    glDeleteFramebuffers(1, &fboLowResSSAO);
+    glDeleteTextures(1, &lowResSSAOTexture);
+
+    glDeleteTextures(1, &horizonAOTexture);
+
+    glDeleteFramebuffers(1, &fboRawSSAO);
+    glDeleteTextures(1, &rawSSAOTexture);
+    glDeleteFramebuffers(2, fboTemporal);
+    glDeleteTextures(2, historyTextures);
+
+    // names that are not generated again must not be deleted twice
+    fboLowResSSAO = lowResSSAOTexture = 0;
+    fboRawSSAO = rawSSAOTexture = 0;
+    fboTemporal[0] = fboTemporal[1] = historyTextures[0] = historyTextures[1] = 0;
+}
+
+void SSAOEffect::setupFramebuffers(int windowWidth, int windowHeight)
+{
+    width = windowWidth;
+    height = windowHeight;
+
+    deleteFramebuffers();
 
     // generate screen color texture
     // note: GL_NEAREST interpolation is ok since there is no subpixel sampling anyway
@@ -125,27 +196,20 @@ void SSAOEffect::setupFramebuffers(int windowWidth, int windowHeight)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, windowWidth, windowHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
 
-    // generate vertex view space position texture
-    glGenTextures(1, &viewPosTexture);
-    glBindTexture(GL_TEXTURE_2D, viewPosTexture);
+    // generate depth texture. it is used for depth testing, and sampled to reconstruct the view space positions.
+    glGenTextures(1, &screenDepthTexture);
+    glBindTexture(GL_TEXTURE_2D, screenDepthTexture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, windowWidth, windowHeight, 0, GL_BGR, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, windowWidth, windowHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 
-    // generate depth renderbuffer. without this, depth testing wont work.
-    // we use a renderbuffer since we wont have to sample this, opengl uses it directly.
-    glGenRenderbuffers(1, &screenDepthBuffer);
-    glBindRenderbuffer(GL_RENDERBUFFER, screenDepthBuffer);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, windowWidth, windowHeight);
-
-    // generate framebuffer to attach color texture + view space positions texture + depth renderbuffer
+    // generate framebuffer to attach color texture + depth texture
 	glGenFramebuffers(1, &fboScreenData); // generate 1 framebuffer object id
 	glBindFramebuffer(GL_FRAMEBUFFER, fboScreenData); // first bind initializes the fbo
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenColorTexture, 0);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, viewPosTexture, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, screenDepthBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, screenDepthTexture, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
 		std::cerr << "ERROR in SSAOEffect: ScreenData Framebuffer not complete" << std::endl;
     }
@@ -158,7 +222,7 @@ void SSAOEffect::setupFramebuffers(int windowWidth, int windowHeight)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, windowWidth, windowHeight, 0, GL_RED, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, windowWidth, windowHeight, 0, GL_RED, GL_FLOAT, NULL); // sized to be written as image in the horizon mode
 
     // generate framebuffer to attach ssao texture
     glGenFramebuffers(1, &fboSSAO); // generate framebuffer object layout in vram and associate handle
@@ -182,6 +246,89 @@ void SSAOEffect::setupFramebuffers(int windowWidth, int windowHeight)
     glDrawBuffer(GL_COLOR_ATTACHMENT0);
 
 
+    // generate the nearest depth chain from half resolution down to 1x1.
+    // immutable storage is required to bind single mip levels as images.
+    depthChainLevelCount = 1;
+    while ((std::max(windowWidth, windowHeight) >> (depthChainLevelCount + 1)) > 0) {
+        ++depthChainLevelCount;
+    }
+    glGenTextures(1, &depthChainTexture);
+    glBindTexture(GL_TEXTURE_2D, depthChainTexture);
+    glTexStorage2D(GL_TEXTURE_2D, depthChainLevelCount, GL_R32F, std::max(windowWidth / 2, 1), std::max(windowHeight / 2, 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // at the lower tiers, the ssao is computed at the tier resolution and upsampled afterwards.
+    if (tier != SSAO_TIER_FULL) {
+        glGenTextures(1, &lowResSSAOTexture);
+        glBindTexture(GL_TEXTURE_2D, lowResSSAOTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, getSSAOWidth(), getSSAOHeight(), 0, GL_RED, GL_FLOAT, NULL);
+
+        glGenFramebuffers(1, &fboLowResSSAO);
+        glBindFramebuffer(GL_FRAMEBUFFER, fboLowResSSAO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lowResSSAOTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "ERROR in SSAOEffect: Low Resolution SSAO Framebuffer not complete" << std::endl;
+        }
+    }
+
+    // the horizon mode writes the occlusion to this texture before denoising it
+    glGenTextures(1, &horizonAOTexture);
+    glBindTexture(GL_TEXTURE_2D, horizonAOTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, getSSAOWidth(), getSSAOHeight(), 0, GL_RED, GL_FLOAT, NULL);
+
+    // with temporal accumulation, the ssao of the frame is blended with the history into the texture the ssao is written to otherwise.
+    // the histories are filtered linearly, since they are reprojected to subpixel positions.
+    if (temporalEnabled) {
+        glGenTextures(1, &rawSSAOTexture);
+        glBindTexture(GL_TEXTURE_2D, rawSSAOTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, getSSAOWidth(), getSSAOHeight(), 0, GL_RED, GL_FLOAT, NULL);
+
+        glGenFramebuffers(1, &fboRawSSAO);
+        glBindFramebuffer(GL_FRAMEBUFFER, fboRawSSAO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, rawSSAOTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "ERROR in SSAOEffect: Raw SSAO Framebuffer not complete" << std::endl;
+        }
+
+        GLuint resultTexture = tier != SSAO_TIER_FULL ? lowResSSAOTexture : ssaoTexture;
+        GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glGenTextures(2, historyTextures);
+        glGenFramebuffers(2, fboTemporal);
+        for (int i = 0; i < 2; ++i) {
+            glBindTexture(GL_TEXTURE_2D, historyTextures[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, getSSAOWidth(), getSSAOHeight(), 0, GL_RG, GL_FLOAT, NULL);
+
+            glBindFramebuffer(GL_FRAMEBUFFER, fboTemporal[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resultTexture, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, historyTextures[i], 0);
+            glDrawBuffers(2, drawBuffers);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cerr << "ERROR in SSAOEffect: Temporal SSAO Framebuffer not complete" << std::endl;
+            }
+        }
+    }
+    historyValid = false;
+
+
     // bind back to default framebuffer (as created by glfw)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -191,28 +338,240 @@ void SSAOEffect::bindScreenDataFramebuffer()
 {
     glEnable(GL_DEPTH_TEST);
     glBindFramebuffer(GL_FRAMEBUFFER, fboScreenData);
-    GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 }; // shader output locations
-    glDrawBuffers(2, buffers);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
 }
 
-void SSAOEffect::calulateSSAOValues(const glm::mat4 &projMat)
+void SSAOEffect::buildDepthChain(int levelCount)
+{
+    depthChainShader->useShader();
+
+    glActiveTexture(GL_TEXTURE0 + 0);
+    glBindTexture(GL_TEXTURE_2D, screenDepthTexture);
+    glUniform1i(depthChainShader->getUniformLocation("depthTexture"), 0);
+    GLint fromDepthLocation = depthChainShader->getUniformLocation("fromDepthTexture");
+    GLint srcSizeLocation = depthChainShader->getUniformLocation("srcSize");
+    GLint dstSizeLocation = depthChainShader->getUniformLocation("dstSize");
+
+    // level 0 reduces the depth buffer, every further level reduces the one above
+    for (int level = 0; level < levelCount; ++level) {
+        int dstWidth = std::max(width >> (level + 1), 1);
+        int dstHeight = std::max(height >> (level + 1), 1);
+
+        glUniform1i(fromDepthLocation, level == 0);
+        glUniform2i(srcSizeLocation, std::max(width >> level, 1), std::max(height >> level, 1));
+        glUniform2i(dstSizeLocation, dstWidth, dstHeight);
+        if (level > 0) {
+            glBindImageTexture(0, depthChainTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            // wait for the previous level to be written
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+        else {
+            glBindImageTexture(0, depthChainTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F); // unused
+        }
+        glBindImageTexture(1, depthChainTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        glDispatchCompute((dstWidth + DEPTH_CHAIN_GROUP_SIZE - 1) / DEPTH_CHAIN_GROUP_SIZE,
+                          (dstHeight + DEPTH_CHAIN_GROUP_SIZE - 1) / DEPTH_CHAIN_GROUP_SIZE, 1);
+    }
+
+    // the chain is sampled by the following fragment shaders
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void SSAOEffect::computeSampledAO(const glm::mat4 &projMat, int chainLevelCount, GLuint resultFramebuffer)
 {
     ssaoShader->useShader();
 
 	glUniformMatrix4fv(ssaoShader->getUniformLocation("projMat"), 1, GL_FALSE, glm::value_ptr(projMat));
+	glUniformMatrix4fv(ssaoShader->getUniformLocation("invProjMat"), 1, GL_FALSE, glm::value_ptr(invProjMat));
+	glUniform1i(ssaoShader->getUniformLocation("tierLevel"), tier);
+	glUniform1i(ssaoShader->getUniformLocation("maxLevel"), chainLevelCount);
+	glUniform1i(ssaoShader->getUniformLocation("rotateKernel"), temporalEnabled);
+	glUniform1i(ssaoShader->getUniformLocation("frameIndex"), frameIndex);
 
 	GLint sampleCountLocation = ssaoShader->getUniformLocation("random_vector_array_size");
     glUniform1i(sampleCountLocation, samples);
+    glBindBufferBase(GL_UNIFORM_BUFFER, RANDOM_VECTORS_BINDING, uboRandomVectors);
 
-	GLint viewPosTexLocation = ssaoShader->getUniformLocation("viewPosTexture");
-    glBindFramebuffer(GL_FRAMEBUFFER, fboScreenData);
-	glUniform1i(viewPosTexLocation, 0); // bind texture unit 0 to texture location 0 of ssao shader
+	glUniform1i(ssaoShader->getUniformLocation("depthTexture"), 0); // bind texture unit 0 to texture location 0 of ssao shader
+	glUniform1i(ssaoShader->getUniformLocation("depthChainTexture"), 1);
 	glActiveTexture(GL_TEXTURE0 + 0); // activate texture unit 0
-    glBindTexture(GL_TEXTURE_2D, viewPosTexture); // bind texture to active texture unit
+    glBindTexture(GL_TEXTURE_2D, screenDepthTexture); // bind texture to active texture unit
+	glActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D, depthChainTexture);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, fboSSAO);
+    glBindFramebuffer(GL_FRAMEBUFFER, resultFramebuffer);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     drawQuad();
+}
+
+void SSAOEffect::computeHorizonAO(const glm::mat4 &projMat, GLuint resultTexture)
+{
+    int ssaoWidth = getSSAOWidth(), ssaoHeight = getSSAOHeight();
+    GLuint groupsX = (ssaoWidth + HORIZON_GROUP_SIZE - 1) / HORIZON_GROUP_SIZE;
+    GLuint groupsY = (ssaoHeight + HORIZON_GROUP_SIZE - 1) / HORIZON_GROUP_SIZE;
+
+    glActiveTexture(GL_TEXTURE0 + 0);
+    glBindTexture(GL_TEXTURE_2D, screenDepthTexture);
+    glActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D, depthChainTexture);
+
+    // search the horizons, the noise only changes per frame with temporal accumulation
+    horizonShader->useShader();
+    glUniform1i(horizonShader->getUniformLocation("depthTexture"), 0);
+    glUniform1i(horizonShader->getUniformLocation("depthChainTexture"), 1);
+    glUniform1i(horizonShader->getUniformLocation("tierLevel"), tier);
+    glUniform2i(horizonShader->getUniformLocation("ssaoSize"), ssaoWidth, ssaoHeight);
+    glUniformMatrix4fv(horizonShader->getUniformLocation("projMat"), 1, GL_FALSE, glm::value_ptr(projMat));
+    glUniformMatrix4fv(horizonShader->getUniformLocation("invProjMat"), 1, GL_FALSE, glm::value_ptr(invProjMat));
+    glUniform1i(horizonShader->getUniformLocation("frameIndex"), temporalEnabled ? frameIndex : 0);
+    glBindImageTexture(0, horizonAOTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+    glDispatchCompute(groupsX, groupsY, 1);
+
+    // the denoise pass samples the noisy occlusion
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    horizonDenoiseShader->useShader();
+    glUniform1i(horizonDenoiseShader->getUniformLocation("depthTexture"), 0);
+    glUniform1i(horizonDenoiseShader->getUniformLocation("depthChainTexture"), 1);
+    glUniform1i(horizonDenoiseShader->getUniformLocation("aoTexture"), 2);
+    glUniform1i(horizonDenoiseShader->getUniformLocation("tierLevel"), tier);
+    glUniform2i(horizonDenoiseShader->getUniformLocation("ssaoSize"), ssaoWidth, ssaoHeight);
+    glUniformMatrix4fv(horizonDenoiseShader->getUniformLocation("invProjMat"), 1, GL_FALSE, glm::value_ptr(invProjMat));
+    glActiveTexture(GL_TEXTURE0 + 2);
+    glBindTexture(GL_TEXTURE_2D, horizonAOTexture);
+    glBindImageTexture(0, resultTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+    glDispatchCompute(groupsX, groupsY, 1);
+
+    // the result is sampled by the following fragment shaders, and the blur renders into it
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+    glActiveTexture(GL_TEXTURE0 + 0);
+}
+
+void SSAOEffect::accumulateTemporally(const glm::mat4 &viewMat)
+{
+    int previousHistory = currentHistory;
+    currentHistory = 1 - currentHistory;
+
+    temporalShader->useShader();
+    glUniformMatrix4fv(temporalShader->getUniformLocation("invProjMat"), 1, GL_FALSE, glm::value_ptr(invProjMat));
+    glUniformMatrix4fv(temporalShader->getUniformLocation("invViewMat"), 1, GL_FALSE, glm::value_ptr(glm::inverse(viewMat)));
+    glUniformMatrix4fv(temporalShader->getUniformLocation("prevViewMat"), 1, GL_FALSE, glm::value_ptr(prevViewMat));
+    glUniformMatrix4fv(temporalShader->getUniformLocation("prevProjMat"), 1, GL_FALSE, glm::value_ptr(prevProjMat));
+    glUniform1i(temporalShader->getUniformLocation("tierLevel"), tier);
+    glUniform1i(temporalShader->getUniformLocation("historyValid"), historyValid);
+
+    glUniform1i(temporalShader->getUniformLocation("ssaoTexture"), 0);
+    glUniform1i(temporalShader->getUniformLocation("historyTexture"), 1);
+    glUniform1i(temporalShader->getUniformLocation("depthTexture"), 2);
+    glUniform1i(temporalShader->getUniformLocation("depthChainTexture"), 3);
+    glActiveTexture(GL_TEXTURE0 + 0);
+    glBindTexture(GL_TEXTURE_2D, rawSSAOTexture);
+    glActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D, historyTextures[previousHistory]);
+    glActiveTexture(GL_TEXTURE0 + 2);
+    glBindTexture(GL_TEXTURE_2D, screenDepthTexture);
+    glActiveTexture(GL_TEXTURE0 + 3);
+    glBindTexture(GL_TEXTURE_2D, depthChainTexture);
+
+    // reset the counter of this frame, its previous value was read or dropped in an earlier frame
+    GLuint zero = 0;
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, rejectionCounters[currentRejectionCounter]);
+    glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &zero);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fboTemporal[currentHistory]);
+    drawQuad();
+
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, 0);
+    if (historyValid) {
+        rejectionFences[currentRejectionCounter] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    currentRejectionCounter = (currentRejectionCounter + 1) % REJECTION_COUNTER_COUNT;
+
+    // the next counter in the ring is the oldest one
+    readRejectionCounter();
+
+    historyValid = true;
+}
+
+void SSAOEffect::readRejectionCounter()
+{
+    GLsync &fence = rejectionFences[currentRejectionCounter];
+    if (!fence) {
+        return;
+    }
+
+    // the counter is reused anyway, so its result is lost if the gpu did not finish it yet
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    glDeleteSync(fence);
+    fence = 0;
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        return;
+    }
+
+    GLuint rejectedCount = 0;
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, rejectionCounters[currentRejectionCounter]);
+    glGetBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &rejectedCount);
+    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+    // smooth over roughly the last 20 frames
+    float rate = float(rejectedCount) / float(getSSAOWidth() * getSSAOHeight());
+    historyRejectionRate += 0.05f * (rate - historyRejectionRate);
+}
+
+void SSAOEffect::calulateSSAOValues(const glm::mat4 &projMat, const glm::mat4 &viewMat)
+{
+    invProjMat = glm::inverse(projMat);
+
+    // the lower tiers read the chain level of their resolution, large radii read coarser levels
+    int chainLevelCount = largeRadiusChainEnabled ? depthChainLevelCount : std::min(int(tier), depthChainLevelCount);
+    if (chainLevelCount > 0) {
+        buildDepthChain(chainLevelCount);
+    }
+
+    if (tier != SSAO_TIER_FULL) {
+        glViewport(0, 0, getSSAOWidth(), getSSAOHeight());
+    }
+
+    // the result is written to the texture the temporal accumulation, the upsampling or the blur read next
+    GLuint resultFramebuffer = temporalEnabled ? fboRawSSAO : tier != SSAO_TIER_FULL ? fboLowResSSAO : fboSSAO;
+    GLuint resultTexture = temporalEnabled ? rawSSAOTexture : tier != SSAO_TIER_FULL ? lowResSSAOTexture : ssaoTexture;
+    if (mode == SSAO_MODE_HORIZON) {
+        computeHorizonAO(projMat, resultTexture);
+    }
+    else {
+        computeSampledAO(projMat, chainLevelCount, resultFramebuffer);
+    }
+
+    // blend into the history, which writes the texture the upsampling and the blur read
+    if (temporalEnabled) {
+        accumulateTemporally(viewMat);
+    }
+    prevViewMat = viewMat;
+    prevProjMat = projMat;
+    frameIndex = (frameIndex + 1) % KERNEL_ROTATION_FRAMES;
+
+    // upsample to the window resolution, weighting the low resolution samples by their depth
+    if (tier != SSAO_TIER_FULL) {
+        glViewport(0, 0, width, height);
+
+        upsampleShader->useShader();
+        glUniformMatrix4fv(upsampleShader->getUniformLocation("invProjMat"), 1, GL_FALSE, glm::value_ptr(invProjMat));
+        glUniform1i(upsampleShader->getUniformLocation("lowResLevel"), tier - 1);
+        glUniform1i(upsampleShader->getUniformLocation("lowResSSAOTexture"), 0);
+        glUniform1i(upsampleShader->getUniformLocation("depthChainTexture"), 1);
+        glUniform1i(upsampleShader->getUniformLocation("depthTexture"), 2);
+        glActiveTexture(GL_TEXTURE0 + 0);
+        glBindTexture(GL_TEXTURE_2D, lowResSSAOTexture);
+        glActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_2D, depthChainTexture);
+        glActiveTexture(GL_TEXTURE0 + 2);
+        glBindTexture(GL_TEXTURE_2D, screenDepthTexture);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fboSSAO);
+        drawQuad();
+    }
+    glActiveTexture(GL_TEXTURE0 + 0);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
@@ -220,6 +579,10 @@ void SSAOEffect::calulateSSAOValues(const glm::mat4 &projMat)
 void SSAOEffect::blurSSAOResultTexture()
 {
     blurShader->useShader();
+	glUniformMatrix4fv(blurShader->getUniformLocation("invProjMat"), 1, GL_FALSE, glm::value_ptr(invProjMat));
+	glUniform1i(blurShader->getUniformLocation("depthTexture"), 1);
+	glActiveTexture(GL_TEXTURE0 + 1);
+    glBindTexture(GL_TEXTURE_2D, screenDepthTexture);
 
     // filter horizontally
     glBindFramebuffer(GL_FRAMEBUFFER, fboSSAOBlurPingpong);
@@ -242,6 +605,21 @@ void SSAOEffect::blurSSAOResultTexture()
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+bool SSAOEffect::saveResultImage(const std::string &filePath)
+{
+    // the rows of FreeImage are bottom up like in opengl, and padded to 4 bytes like with the default pack alignment
+    fipImage image(FIT_BITMAP, width, height, 8);
+    glBindTexture(GL_TEXTURE_2D, ssaoTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_UNSIGNED_BYTE, image.accessPixels());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (!image.save(filePath.c_str())) {
+        std::cerr << "ERROR in SSAOEffect: could not save the ssao results to '" << filePath << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 void SSAOEffect::bindSSAOResultTexture(GLint ssaoTexShaderLocation, GLuint textureUnit)
 {
     glBindFramebuffer(GL_FRAMEBUFFER, fboSSAO);
@@ -251,6 +629,83 @@ void SSAOEffect::bindSSAOResultTexture(GLint ssaoTexShaderLocation, GLuint textu
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void SSAOEffect::setTier(SSAOTier tier_)
+{
+    if (tier != tier_) {
+        tier = tier_;
+        setupFramebuffers(width, height);
+    }
+}
+
+SSAOTier SSAOEffect::getTier() const
+{
+    return tier;
+}
+
+void SSAOEffect::setSampleCount(GLuint samples_)
+{
+    samples = std::min(std::max(samples_, 1u), MAX_SAMPLES);
+    createRandomVectors();
+}
+
+GLuint SSAOEffect::getSampleCount() const
+{
+    return samples;
+}
+
+void SSAOEffect::setLargeRadiusChainEnabled(bool enabled)
+{
+    largeRadiusChainEnabled = enabled;
+}
+
+bool SSAOEffect::isLargeRadiusChainEnabled() const
+{
+    return largeRadiusChainEnabled;
+}
+
+void SSAOEffect::setMode(SSAOMode mode_)
+{
+    if (mode != mode_) {
+        mode = mode_;
+        // the history holds the occlusion of the other mode
+        historyValid = false;
+    }
+}
+
+SSAOMode SSAOEffect::getMode() const
+{
+    return mode;
+}
+
+void SSAOEffect::setTemporalEnabled(bool enabled)
+{
+    if (temporalEnabled != enabled) {
+        temporalEnabled = enabled;
+        historyRejectionRate = 0.0f;
+        setupFramebuffers(width, height);
+    }
+}
+
+bool SSAOEffect::isTemporalEnabled() const
+{
+    return temporalEnabled;
+}
+
+float SSAOEffect::getHistoryRejectionRate() const
+{
+    return historyRejectionRate;
+}
+
+int SSAOEffect::getSSAOWidth() const
+{
+    return std::max(width >> tier, 1);
+}
+
+int SSAOEffect::getSSAOHeight() const
+{
+    return std::max(height >> tier, 1);
+}
+
 void SSAOEffect::drawQuad()
 {
     glDisable(GL_DEPTH_TEST); // no need for depth testing since we just draw a single quad
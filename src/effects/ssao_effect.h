@@ -12,24 +12,141 @@
 #include "../shader.h"
 
 
+/// the resolution ambient occlusion is computed at, relative to the window
+enum SSAOTier
+{
+	SSAO_TIER_FULL    = 0, ///< every pixel
+	SSAO_TIER_HALF    = 1, ///< half width and height, a quarter of the pixels
+	SSAO_TIER_QUARTER = 2  ///< quarter width and height, a sixteenth of the pixels
+};
+
+/// how the ambient occlusion is computed
+enum SSAOMode
+{
+	SSAO_MODE_SAMPLED = 0, ///< compare the depth of random points around the pixel, in a fragment shader
+	SSAO_MODE_HORIZON = 1, ///< integrate the visible arcs between the horizons in a few directions (gtao), in a compute shader
+	SSAO_MODE_COUNT
+};
+
 /**
  * @brief The SSAOEffect class facilitates Screen Space Ambient Occlusion
  * using a two pass rendering pipeline, where in the first pass the screen colors
  * and other information are rendered to textures to allow for postprocessing,
  * and in the second pass the postprocessed texture is rendered to a screen filling quad.
+ *
+ * The view space positions are reconstructed from the depth buffer and the inverse projection,
+ * so no position buffer is written or read. The depth is reduced into a chain of mip levels
+ * keeping the nearest depth of each block, starting at half resolution.
+ *
+ * At the half and quarter tiers, the ambient occlusion is computed from the chain level of the tier resolution.
+ * A joint bilateral filter then upsamples it to the window resolution, weighting the low resolution samples
+ * by how close their depth is to the depth of the pixel, so occlusion does not bleed across silhouettes.
+ * The blur weights the neighbors by their depth as well.
+ * Optionally, samples far from the pixel read coarser levels of the chain, which keeps large radii cache friendly.
+ *
+ * With temporal accumulation, the sample kernel is rotated per pixel and per frame by interleaved gradient noise,
+ * and the ambient occlusion of each frame is blended into a history at the tier resolution.
+ * The history is reprojected with the view and projection matrices of the previous frame,
+ * and rejected where the reprojected depth does not match the depth stored with it (disocclusions)
+ * or left the screen, or moved too fast. Moving pixels weight the current frame higher to limit ghosting.
+ * Few samples per pixel and frame thus converge to the quality of many samples.
+ *
+ * In the horizon mode, a compute shader loads the view depth of each group of pixels and its apron into shared memory,
+ * and searches the highest occluder on both sides of a few screen directions per pixel. The cosine weighted arc between
+ * the horizons is visible (ground truth ambient occlusion, Jimenez et al. 2016). The directions are rotated per pixel
+ * by interleaved gradient noise, which a depth aware filter in a second compute pass averages out.
+ * The sample count only applies to the sampled mode.
  */
 class SSAOEffect
 {
-    GLuint fboScreenData, screenColorTexture, viewPosTexture, screenDepthBuffer;
-    GLuint fboSSAO, ssaoTexture;
-    GLuint fboSSAOBlurPingpong, ssaoBlurredTexturePingpong;
+    GLuint fboScreenData = 0, screenColorTexture = 0, screenDepthTexture = 0;
+    GLuint fboSSAO = 0, ssaoTexture = 0;
+    GLuint fboSSAOBlurPingpong = 0, ssaoBlurredTexturePingpong = 0;
+
+    // the nearest depth of blocks of 2x2, 4x4, ... pixels in the mip levels, and the ambient occlusion at the resolution of the tier
+    GLuint depthChainTexture = 0;
+    int depthChainLevelCount = 0;
+    GLuint fboLowResSSAO = 0, lowResSSAOTexture = 0;
+
+    // the noisy occlusion of the horizon mode at the resolution of the tier, before the denoise pass
+    GLuint horizonAOTexture = 0;
+
+    // with temporal accumulation: the ambient occlusion of the current frame, and two histories of the accumulated
+    // ambient occlusion and its view space depth, read and written alternately. fboTemporal[i] writes the result and history i.
+    GLuint fboRawSSAO = 0, rawSSAOTexture = 0;
+    GLuint fboTemporal[2] = { 0, 0 }, historyTextures[2] = { 0, 0 };
+    int currentHistory = 0;
+    bool historyValid = false;
+
+    // atomic counters of the pixels whose history was rejected, read back a few frames later like the GpuTimer queries
+    static const int REJECTION_COUNTER_COUNT = 4;
+    GLuint rejectionCounters[REJECTION_COUNTER_COUNT];
+    GLsync rejectionFences[REJECTION_COUNTER_COUNT];
+    int currentRejectionCounter = 0;
+    float historyRejectionRate = 0.0f;
 
     GLuint screenQuadVAO, screenQuadVBO;
+    GLuint uboRandomVectors;
 
     Shader *ssaoShader = nullptr;
     Shader *blurShader = nullptr;
+    Shader *depthChainShader = nullptr;
+    Shader *upsampleShader = nullptr;
+    Shader *temporalShader = nullptr;
+    Shader *horizonShader = nullptr;
+    Shader *horizonDenoiseShader = nullptr;
 
     GLuint samples; // reference uses 64 [increase for better quality]
+    SSAOTier tier;
+    SSAOMode mode = SSAO_MODE_SAMPLED;
+    bool largeRadiusChainEnabled = false;
+    bool temporalEnabled = false;
+    int width, height; // window resolution
+    glm::mat4 invProjMat; // of the last ssao calculation, to reconstruct view space depth in the filters
+    glm::mat4 prevViewMat, prevProjMat; // of the previous ssao calculation, to reproject the history
+    int frameIndex = 0; // selects the kernel rotation of the frame
+
+    /**
+     * @brief reduce the depth buffer into the levels of the depth chain
+     * @param levelCount the number of levels to build, starting at the finest
+     */
+    void buildDepthChain(int levelCount);
+
+    /**
+     * @brief compute the occlusion by comparing the depth of random points around each pixel
+     * @param projMat the projection matrix of this frame
+     * @param chainLevelCount the number of levels of the depth chain built for this frame
+     * @param resultFramebuffer the framebuffer at the resolution of the tier to write to
+     */
+    void computeSampledAO(const glm::mat4 &projMat, int chainLevelCount, GLuint resultFramebuffer);
+
+    /**
+     * @brief compute the occlusion with the horizon search and denoise it into the given texture
+     * @param projMat the projection matrix of this frame
+     * @param resultTexture an r8 texture at the resolution of the tier
+     */
+    void computeHorizonAO(const glm::mat4 &projMat, GLuint resultTexture);
+
+    /**
+     * @brief blend the ambient occlusion of this frame into the reprojected history
+     * @param viewMat the view matrix of this frame
+     */
+    void accumulateTemporally(const glm::mat4 &viewMat);
+
+    /**
+     * @brief read the rejection counter of the oldest frame in the ring if the gpu finished it
+     */
+    void readRejectionCounter();
+
+    /**
+     * @brief fill the uniform buffer with random sample vectors for the current sample count
+     */
+    void createRandomVectors();
+
+    /**
+     * @brief delete the framebuffers and their attachments
+     */
+    void deleteFramebuffers();
 
     /**
      * @brief draw a screen filling quad
@@ -37,9 +154,86 @@ class SSAOEffect
     void drawQuad();
 
 public:
-	SSAOEffect(int windowWidth, int windowHeight, int samples_);
+	/// the sample count is clamped to MAX_SAMPLES
+	SSAOEffect(int windowWidth, int windowHeight, int samples_, SSAOTier tier_ = SSAO_TIER_HALF);
 	~SSAOEffect();
 
+	/// the size of the random vector array in the ssao shader
+	static const GLuint MAX_SAMPLES = 128;
+
+    /**
+     * @brief set the resolution ambient occlusion is computed at. recreates the low resolution framebuffers.
+     * @param tier_ the resolution tier
+     */
+    void setTier(SSAOTier tier_);
+
+    /**
+     * @return the resolution ambient occlusion is computed at
+     */
+    SSAOTier getTier() const;
+
+    /**
+     * @brief set the number of random samples per pixel, clamped to [1, MAX_SAMPLES]
+     * @param samples_ the sample count
+     */
+    void setSampleCount(GLuint samples_);
+
+    /**
+     * @return the number of random samples per pixel
+     */
+    GLuint getSampleCount() const;
+
+    /**
+     * @brief set whether samples far from the pixel read coarser levels of the depth chain
+     * instead of the level of the tier resolution. this builds the whole chain every frame.
+     * @param enabled whether to use the coarser levels
+     */
+    void setLargeRadiusChainEnabled(bool enabled);
+
+    /**
+     * @return whether samples far from the pixel read coarser levels of the depth chain
+     */
+    bool isLargeRadiusChainEnabled() const;
+
+    /**
+     * @brief set how the ambient occlusion is computed. discards the history of temporal accumulation.
+     * @param mode_ the mode
+     */
+    void setMode(SSAOMode mode_);
+
+    /**
+     * @return how the ambient occlusion is computed
+     */
+    SSAOMode getMode() const;
+
+    /**
+     * @brief set whether the ambient occlusion is accumulated over frames with a rotating kernel.
+     * recreates the framebuffers, which discards the history.
+     * @param enabled whether to accumulate temporally
+     */
+    void setTemporalEnabled(bool enabled);
+
+    /**
+     * @return whether the ambient occlusion is accumulated over frames
+     */
+    bool isTemporalEnabled() const;
+
+    /**
+     * @return the ratio of ssao pixels whose history was rejected because of disocclusion, leaving the screen or fast motion,
+     * smoothed over the recent frames. high while the camera moves fast, near zero when it stands still.
+     */
+    float getHistoryRejectionRate() const;
+
+    /**
+     * @return the width of the resolution ambient occlusion is computed at
+     */
+    int getSSAOWidth() const;
+
+    /**
+     * @return the height of the resolution ambient occlusion is computed at
+     */
+    int getSSAOHeight() const;
+
     /**
      * @brief setup framebuffers and their screen filling texture or renderbuffer attachments
      * @param windowWidth buffer width
@@ -48,7 +242,7 @@ public:
     void setupFramebuffers(int windowWidth, int windowHeight);
 
     /**
-     * @brief bind framebuffer in which screen colors and view space vertex positions should be stored for ssao postprocessing.
+     * @brief bind framebuffer in which screen colors and depth should be stored for ssao postprocessing.
      * after binding this, execute the required draw calls using appropriate shaders.
      */
     void bindScreenDataFramebuffer();
@@ -57,9 +251,10 @@ public:
      * @brief calulate the resulting ssao factors for each fragment
      * and store it in a texture attached to the fboSSAO
      * @param projMat the projection matrix to use in the render pipeline
+     * @param viewMat the view matrix to use in the render pipeline, to reproject the history of temporal accumulation
      * this needs certain information rendered to textures after binding via the bindScreenDataFramebuffer.
      */
-    void calulateSSAOValues(const glm::mat4 &projMat);
+    void calulateSSAOValues(const glm::mat4 &projMat, const glm::mat4 &viewMat);
 
     /**
      * @brief bind the texture which stores the ssao results after calulateSSAOValues
@@ -69,8 +264,19 @@ public:
      */
     void bindSSAOResultTexture(GLint ssaoTexShaderLocation, GLuint textureUnit);
 
+    /**
+     * @brief blur the ssao results with a separable filter, weighting the neighbors by their depth
+     * such that the occlusion of surfaces in front does not blur onto the surfaces behind them.
+     */
     void blurSSAOResultTexture();
 
+    /**
+     * @brief save the ssao results as greyscale image, white where occluded, e.g. to compare the modes side by side
+     * @param filePath the image file, its extension selects the format
+     * @return whether the image was saved
+     */
+    bool saveResultImage(const std::string &filePath);
+
 private:
 };
 
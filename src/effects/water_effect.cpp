@@ -1,5 +1,56 @@
 #include "water_effect.h"
 
+#include "../resourcemanager.h"
+
+#include <algorithm>
+#include <cmath>
+
+// the textures are rendered at full resolution once the water covers this part of the screen,
+// below the resolution is scaled with the square root of the coverage, down to the minimum scale
+static const float FULL_RESOLUTION_COVERAGE = 0.5f;
+static const float MIN_RESOLUTION_SCALE = 0.25f;
+
+// the scale is rounded up to steps of 1 / RESOLUTION_STEPS, so the resolution does not change with every small camera motion
+static const float RESOLUTION_STEPS = 8.0f;
+
+// work group size of the depth pyramid compute shader, see ssao_depth_chain.comp
+static const int DEPTH_PYRAMID_GROUP_SIZE = 8;
+
+// texture units of the screen space reflection inputs in the water shader, after the reflection, refraction and du/dv textures
+static const GLuint SCENE_COLOR_UNIT = 3;
+static const GLuint SCENE_DEPTH_UNIT = 4;
+static const GLuint DEPTH_PYRAMID_UNIT = 5;
+static const GLuint SKY_CUBEMAP_UNIT = 6;
+
+// a texture rendered on the previous frame is reprojected, so its scissor rectangle is enlarged by this part of the screen
+static const float REPROJECTION_MARGIN = 0.05f;
+
+/// clip a convex polygon in homogeneous clip space to the view frustum (sutherland-hodgman)
+static std::vector<glm::vec4> clipToFrustum(std::vector<glm::vec4> polygon)
+{
+	// the inside of each frustum plane is where w + x, w - x, w + y, ... is positive
+	for (int plane = 0; plane < 6 && !polygon.empty(); ++plane) {
+		int axis = plane / 2;
+		float sign = (plane % 2 == 0) ? 1.0f : -1.0f;
+
+		std::vector<glm::vec4> clipped;
+		for (size_t i = 0; i < polygon.size(); ++i) {
+			const glm::vec4 &a = polygon[i];
+			const glm::vec4 &b = polygon[(i + 1) % polygon.size()];
+			float distanceA = a.w + sign * a[axis];
+			float distanceB = b.w + sign * b[axis];
+			if (distanceA >= 0) {
+				clipped.push_back(a);
+			}
+			if ((distanceA >= 0) != (distanceB >= 0)) {
+				clipped.push_back(a + (b - a) * (distanceA / (distanceA - distanceB)));
+			}
+		}
+		polygon.swap(clipped);
+	}
+	return polygon;
+}
+
 WaterEffect::WaterEffect(int windowWidth, int windowHeight, float reflectionResolutionFactor, float refractionResolutionFactor,
                          const std::string& waterDistortionDuDvMapPath, float waveAmplitude, float waveSpeed)
     : windowWidth(windowWidth)
@@ -35,15 +86,17 @@ WaterEffect::WaterEffect(int windowWidth, int windowHeight, float reflectionReso
 		std::cerr << "ERROR in WaterEffect: Refraction Framebuffer not complete" << std::endl;
 	bindDefaultFrameBuffer();
 
+	createScreenSpaceReflectionTargets();
+
 	////////////////////////////////////
 	/// SETUP WATER SHADERS
 	/// uniforms are not assigned here since they are updated each frame
 	////////////////////////////////////
 
 	waterShader = new Shader("shaders/water.vert", "shaders/water.frag");
+	depthPyramidShader = new Shader("shaders/ssao_depth_chain.comp");
 
-	waterDistortionDuDvMap = new Texture(waterDistortionDuDvMapPath);
-	std::cout << "loaded texture: " << waterDistortionDuDvMapPath << std::endl;
+	waterDistortionDuDvMap = ResourceManager::getInstance()->getTexture(waterDistortionDuDvMapPath);
 
 	waveTimeBasedShift = 0;
 
@@ -61,7 +114,13 @@ WaterEffect::~WaterEffect()
 	glDeleteTextures(1, &refractionColorTexture);
 	glDeleteRenderbuffers(1, &refractionDepthTexture);
 
+	glDeleteFramebuffers(1, &fboScene);
+	glDeleteTextures(1, &sceneColorTexture);
+	glDeleteTextures(1, &sceneDepthTexture);
+	glDeleteTextures(1, &depthPyramidTexture);
+
 	delete waterShader; waterShader = nullptr;
+	delete depthPyramidShader; depthPyramidShader = nullptr;
 
 }
 
@@ -73,8 +132,41 @@ void WaterEffect::bindFrameBuffer(GLuint frameBuffer, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
+void WaterEffect::bindReflectionFrameBuffer()
+{
+	reflectionViewportSize = bindScaledFrameBuffer(fboReflection, reflectionResolutionX, reflectionResolutionY);
+	reflectionViewProjMat = viewProjMat;
+	reflectionValid = true;
+}
+
+void WaterEffect::bindRefractionFrameBuffer()
+{
+	refractionViewportSize = bindScaledFrameBuffer(fboRefraction, refractionResolutionX, refractionResolutionY);
+	refractionViewProjMat = viewProjMat;
+	refractionValid = true;
+}
+
+glm::ivec2 WaterEffect::bindScaledFrameBuffer(GLuint frameBuffer, int width, int height)
+{
+	glm::ivec2 viewportSize(std::max(int(std::ceil(width * resolutionScale)), 1), std::max(int(std::ceil(height * resolutionScale)), 1));
+	bindFrameBuffer(frameBuffer, viewportSize.x, viewportSize.y);
+
+	// only the pixels around the water are sampled, distorted by the waves by up to twice the amplitude
+	float margin = 2.0f * waveAmplitude + (alternateUpdatesEnabled ? REPROJECTION_MARGIN : 0.0f);
+	glm::vec2 viewportSizeF(float(viewportSize.x), float(viewportSize.y));
+	glm::vec2 rectMin = glm::clamp(glm::vec2(screenRect.x, screenRect.y) - margin, 0.0f, 1.0f) * viewportSizeF;
+	glm::vec2 rectMax = glm::clamp(glm::vec2(screenRect.z, screenRect.w) + margin, 0.0f, 1.0f) * viewportSizeF;
+	glm::ivec2 scissorMin = glm::ivec2(glm::floor(rectMin));
+	glm::ivec2 scissorMax = glm::ivec2(glm::ceil(rectMax));
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(scissorMin.x, scissorMin.y, scissorMax.x - scissorMin.x, scissorMax.y - scissorMin.y);
+
+	return viewportSize;
+}
+
 void WaterEffect::bindDefaultFrameBuffer()
 {
+	glDisable(GL_SCISSOR_TEST);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glViewport(0, 0, windowWidth, windowHeight);
 }
@@ -105,6 +197,33 @@ Shader *WaterEffect::setupWaterShader()
 	glUniform1f(waterShader->getUniformLocation("waveAmplitude"), waveAmplitude);
 	glUniform1f(waterShader->getUniformLocation("waveTimeBasedShift"), waveTimeBasedShift);
 
+	// screen space reflections. the samplers are assigned distinct units in either mode,
+	// since samplers of different types must not share a unit even if they are not sampled.
+	glUniform1i(waterShader->getUniformLocation("screenSpaceReflections"), reflectionMode == WATER_REFLECTION_SCREEN_SPACE);
+	glUniform1i(waterShader->getUniformLocation("sceneColorTexture"), SCENE_COLOR_UNIT);
+	glUniform1i(waterShader->getUniformLocation("sceneDepthTexture"), SCENE_DEPTH_UNIT);
+	glUniform1i(waterShader->getUniformLocation("depthPyramidTexture"), DEPTH_PYRAMID_UNIT);
+	glUniform1i(waterShader->getUniformLocation("skyCubemap"), SKY_CUBEMAP_UNIT);
+	glUniform1i(waterShader->getUniformLocation("depthPyramidLevelCount"), depthPyramidLevelCount);
+	glUniform1i(waterShader->getUniformLocation("useSkyCubemap"), skyboxEnabled && skyCubemap);
+	glUniform3f(waterShader->getUniformLocation("skyColor"), skyColor.x, skyColor.y, skyColor.z);
+	glActiveTexture(GL_TEXTURE0 + SCENE_COLOR_UNIT);
+	glBindTexture(GL_TEXTURE_2D, sceneColorTexture);
+	glActiveTexture(GL_TEXTURE0 + SCENE_DEPTH_UNIT);
+	glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+	glActiveTexture(GL_TEXTURE0 + DEPTH_PYRAMID_UNIT);
+	glBindTexture(GL_TEXTURE_2D, depthPyramidTexture);
+	if (skyCubemap) {
+		skyCubemap->bind(SKY_CUBEMAP_UNIT);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	// each texture is sampled where the water was on the screen when it was rendered, and only in its rendered part
+	glUniformMatrix4fv(waterShader->getUniformLocation("reflectionViewProjMat"), 1, GL_FALSE, glm::value_ptr(reflectionViewProjMat));
+	glUniformMatrix4fv(waterShader->getUniformLocation("refractionViewProjMat"), 1, GL_FALSE, glm::value_ptr(refractionViewProjMat));
+	glUniform2f(waterShader->getUniformLocation("reflectionScale"), float(reflectionViewportSize.x) / reflectionResolutionX, float(reflectionViewportSize.y) / reflectionResolutionY);
+	glUniform2f(waterShader->getUniformLocation("refractionScale"), float(refractionViewportSize.x) / refractionResolutionX, float(refractionViewportSize.y) / refractionResolutionY);
+
 	return waterShader;
 }
 
@@ -114,6 +233,183 @@ void WaterEffect::updateWaves(float deltaT)
 	waveTimeBasedShift = std::fmod(waveTimeBasedShift, 1.0f); // floating point modulo, % is only for integers
 }
 
+void WaterEffect::setPlaneBounds(const std::vector<glm::vec3> &planePositions)
+{
+	if (planePositions.empty()) {
+		hasPlaneBounds = false;
+		return;
+	}
+
+	planeMin = planeMax = planePositions[0];
+	for (const glm::vec3 &position : planePositions) {
+		planeMin = glm::min(planeMin, position);
+		planeMax = glm::max(planeMax, position);
+	}
+	hasPlaneBounds = true;
+}
+
+void WaterEffect::updateCoverage(const glm::mat4 &viewProjMat_)
+{
+	viewProjMat = viewProjMat_;
+
+	// clip the water rectangle at its mean height to the frustum, its area in normalized device coordinates is 4 for the whole screen
+	coverage = 1.0f;
+	screenRect = glm::vec4(0, 0, 1, 1);
+	if (hasPlaneBounds) {
+		float height = 0.5f * (planeMin.y + planeMax.y);
+		std::vector<glm::vec4> polygon = clipToFrustum({
+			viewProjMat * glm::vec4(planeMin.x, height, planeMin.z, 1.0f),
+			viewProjMat * glm::vec4(planeMax.x, height, planeMin.z, 1.0f),
+			viewProjMat * glm::vec4(planeMax.x, height, planeMax.z, 1.0f),
+			viewProjMat * glm::vec4(planeMin.x, height, planeMax.z, 1.0f)
+		});
+
+		float area = 0.0f;
+		glm::vec2 rectMin(1.0f), rectMax(0.0f);
+		for (size_t i = 0; i < polygon.size(); ++i) {
+			glm::vec2 a = glm::vec2(polygon[i]) / polygon[i].w;
+			glm::vec2 b = glm::vec2(polygon[(i + 1) % polygon.size()]) / polygon[(i + 1) % polygon.size()].w;
+			area += a.x * b.y - b.x * a.y;
+			rectMin = glm::min(rectMin, a * 0.5f + 0.5f);
+			rectMax = glm::max(rectMax, a * 0.5f + 0.5f);
+		}
+		coverage = polygon.size() >= 3 ? std::min(0.5f * std::abs(area) / 4.0f, 1.0f) : 0.0f;
+		screenRect = glm::vec4(rectMin, rectMax);
+	}
+
+	resolutionScale = 1.0f;
+	if (adaptiveResolutionEnabled) {
+		resolutionScale = glm::clamp(std::sqrt(coverage / FULL_RESOLUTION_COVERAGE), MIN_RESOLUTION_SCALE, 1.0f);
+		resolutionScale = std::ceil(resolutionScale * RESOLUTION_STEPS) / RESOLUTION_STEPS;
+	}
+
+	// textures not rendered while the water was off screen are outdated, so both are rendered once it is visible again
+	if (!isVisible()) {
+		updateReflection = updateRefraction = false;
+		reflectionValid = refractionValid = false;
+	}
+	else if (reflectionMode == WATER_REFLECTION_SCREEN_SPACE) {
+		// the reflection is traced in the main pass, so only the refraction is rendered
+		updateReflection = false;
+		updateRefraction = true;
+		reflectionValid = false;
+	}
+	else if (!alternateUpdatesEnabled || !reflectionValid || !refractionValid) {
+		updateReflection = updateRefraction = true;
+	}
+	else {
+		updateReflection = reflectionNext;
+		updateRefraction = !reflectionNext;
+		reflectionNext = !reflectionNext;
+	}
+}
+
+void WaterEffect::setReflectionMode(WaterReflectionMode mode)
+{
+	reflectionMode = mode;
+}
+
+void WaterEffect::setSky(std::shared_ptr<CubemapTexture> skyCubemap_, bool skyboxEnabled_, const glm::vec3 &skyColor_)
+{
+	skyCubemap = skyCubemap_;
+	skyboxEnabled = skyboxEnabled_;
+	skyColor = skyColor_;
+}
+
+void WaterEffect::setupFramebuffers(int windowWidth_, int windowHeight_)
+{
+	windowWidth = windowWidth_;
+	windowHeight = windowHeight_;
+	createScreenSpaceReflectionTargets();
+}
+
+void WaterEffect::createScreenSpaceReflectionTargets()
+{
+	// delete the targets of the previous window size, if any
+	glDeleteFramebuffers(1, &fboScene);
+	glDeleteTextures(1, &sceneColorTexture);
+	glDeleteTextures(1, &sceneDepthTexture);
+	glDeleteTextures(1, &depthPyramidTexture);
+
+	// the formats match the default framebuffer, since blitting depth and resolving samples require equal formats
+	fboScene = createFrameBuffer();
+	glGenTextures(1, &sceneColorTexture);
+	glBindTexture(GL_TEXTURE_2D, sceneColorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, windowWidth, windowHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColorTexture, 0);
+	glGenTextures(1, &sceneDepthTexture);
+	glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, windowWidth, windowHeight, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, sceneDepthTexture, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "ERROR in WaterEffect: Scene Framebuffer not complete" << std::endl;
+	bindDefaultFrameBuffer();
+
+	// the nearest depth pyramid from half resolution down to 1x1.
+	// immutable storage is required to bind single mip levels as images.
+	depthPyramidLevelCount = 1;
+	while ((std::max(windowWidth, windowHeight) >> (depthPyramidLevelCount + 1)) > 0) {
+		++depthPyramidLevelCount;
+	}
+	glGenTextures(1, &depthPyramidTexture);
+	glBindTexture(GL_TEXTURE_2D, depthPyramidTexture);
+	glTexStorage2D(GL_TEXTURE_2D, depthPyramidLevelCount, GL_R32F, std::max(windowWidth / 2, 1), std::max(windowHeight / 2, 1));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void WaterEffect::captureMainPass()
+{
+	// the default framebuffer is multisampled, so it is resolved by blitting instead of copied
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fboScene);
+	glBlitFramebuffer(0, 0, windowWidth, windowHeight, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// level 0 reduces the depth of the main pass, every further level reduces the one above
+	depthPyramidShader->useShader();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+	glUniform1i(depthPyramidShader->getUniformLocation("depthTexture"), 0);
+	GLint fromDepthLocation = depthPyramidShader->getUniformLocation("fromDepthTexture");
+	GLint srcSizeLocation = depthPyramidShader->getUniformLocation("srcSize");
+	GLint dstSizeLocation = depthPyramidShader->getUniformLocation("dstSize");
+
+	for (int level = 0; level < depthPyramidLevelCount; ++level) {
+		int dstWidth = std::max(windowWidth >> (level + 1), 1);
+		int dstHeight = std::max(windowHeight >> (level + 1), 1);
+
+		glUniform1i(fromDepthLocation, level == 0);
+		glUniform2i(srcSizeLocation, std::max(windowWidth >> level, 1), std::max(windowHeight >> level, 1));
+		glUniform2i(dstSizeLocation, dstWidth, dstHeight);
+		// level 0 does not read an image, the binding is unused
+		glBindImageTexture(0, depthPyramidTexture, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		if (level > 0) {
+			// wait for the previous level to be written
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+		glBindImageTexture(1, depthPyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		glDispatchCompute((dstWidth + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+		                  (dstHeight + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE, 1);
+	}
+
+	// the pyramid is sampled by the water shader
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 GLuint WaterEffect::createFrameBuffer()
 {
 	GLuint fbo;
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <memory>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -12,6 +13,14 @@
 #include "../shader.h"
 #include "../texture.hpp"
 
+/// how the reflection on the water is created
+enum WaterReflectionMode
+{
+	WATER_REFLECTION_PLANAR = 0,       ///< render the scene mirrored at the water plane into the reflection texture
+	WATER_REFLECTION_SCREEN_SPACE = 1, ///< trace the reflected rays through the depth of the main pass, the sky where they miss
+	WATER_REFLECTION_MODE_COUNT
+};
+
 /// WaterEffect
 /// This is used to create a real-time reflecting and refracting
 /// horizontal water surface with small rippling waves.
@@ -21,6 +30,17 @@
 /// For the refraction texture we render the scene below the water surface from above (maybe at an inclined angle).
 /// The texture sampling is distorted to create a rippling effect.
 /// The fresnel effect is modelled to attenuate reflection based on viewing angle to surface normal.
+///
+/// Each frame, the water plane is clipped to the view frustum to find the part of the screen it covers.
+/// While it is off screen, neither texture is rendered. Otherwise the textures are rendered at a resolution
+/// scaled down with the coverage, into the lower left part of their framebuffers, and only within the
+/// screen rectangle of the water. Optionally, the reflection and refraction are rendered on alternate frames,
+/// and the one not rendered is reprojected with the camera it was rendered with.
+///
+/// With screen space reflections, the reflection pass is skipped. Instead, the color and depth of the main pass
+/// are copied before the water is drawn, and the depth is reduced into a pyramid of the nearest depth of 2x2, 4x4, ... pixel blocks.
+/// The water shader traces its reflected rays through the pyramid, skipping blocks that lie behind the ray (hi-z tracing).
+/// Rays leaving the screen or the depth range sample the skybox cubemap instead.
 class WaterEffect
 {
 
@@ -36,11 +56,39 @@ private:
 	GLuint fboRefraction, refractionColorTexture, refractionDepthTexture;
 
 	Shader *waterShader = nullptr;
-	Texture *waterDistortionDuDvMap = nullptr;
+	std::shared_ptr<Texture> waterDistortionDuDvMap;
 	float waveAmplitude, waveSpeed, waveTimeBasedShift;
 
 	int windowWidth, windowHeight;
 
+	// the world space bounds of the water plane, its screen coverage and screen rectangle (min xy, max xy in [0,1]) this frame
+	glm::vec3 planeMin, planeMax;
+	bool hasPlaneBounds = false;
+	float coverage = 1.0f;
+	glm::vec4 screenRect = glm::vec4(0, 0, 1, 1);
+	float resolutionScale = 1.0f;
+	glm::mat4 viewProjMat;
+
+	bool adaptiveResolutionEnabled = true;
+	bool alternateUpdatesEnabled = false;
+	bool updateReflection = true, updateRefraction = true; // which textures are rendered this frame
+	bool reflectionNext = true; // which texture is rendered next with alternate updates
+
+	// the camera and the rendered size of each texture when it was rendered last, to sample it where it was rendered
+	glm::mat4 reflectionViewProjMat, refractionViewProjMat;
+	glm::ivec2 reflectionViewportSize, refractionViewportSize;
+	bool reflectionValid = false, refractionValid = false;
+
+	// the copy of the main pass and its nearest depth pyramid for screen space reflections
+	WaterReflectionMode reflectionMode = WATER_REFLECTION_PLANAR;
+	GLuint fboScene = 0, sceneColorTexture = 0, sceneDepthTexture = 0;
+	GLuint depthPyramidTexture = 0;
+	int depthPyramidLevelCount = 0;
+	Shader *depthPyramidShader = nullptr;
+	std::shared_ptr<CubemapTexture> skyCubemap;
+	bool skyboxEnabled = true;
+	glm::vec3 skyColor;
+
 
 public:
 	/// reflectionResolutionFactor and refractionResolutionFactor will be used to determine
@@ -49,8 +97,11 @@ public:
 	            const std::string& waterDistortionDuDvMapPath, float waveAmplitude, float waveSpeed);
 	~WaterEffect();
 
-	inline void bindReflectionFrameBuffer() { bindFrameBuffer(fboReflection, reflectionResolutionX, reflectionResolutionY); }
-	inline void bindRefractionFrameBuffer() { bindFrameBuffer(fboRefraction, refractionResolutionX, refractionResolutionY); }
+	/// bind the reflection framebuffer with the viewport and scissor rectangle of this frame
+	void bindReflectionFrameBuffer();
+
+	/// bind the refraction framebuffer with the viewport and scissor rectangle of this frame
+	void bindRefractionFrameBuffer();
 
 	void bindFrameBuffer(GLuint frameBuffer, int width, int height);
 	void bindDefaultFrameBuffer();
@@ -59,9 +110,67 @@ public:
 
 	void updateWaves(float deltaT);
 
+	/// set the world space bounds of the water plane from its vertices, to estimate its screen coverage.
+	/// without bounds, the water is assumed to cover the whole screen.
+	void setPlaneBounds(const std::vector<glm::vec3> &planePositions);
+
+	/// estimate the screen coverage of the water plane for the camera of this frame,
+	/// and decide which textures are rendered at which resolution
+	void updateCoverage(const glm::mat4 &viewProjMat_);
+
+	/// \return whether any part of the water plane is on screen this frame
+	inline bool isVisible() const { return coverage > 0.0f; }
+
+	/// \return whether the reflection texture is rendered this frame
+	inline bool needsReflectionUpdate() const { return updateReflection; }
+
+	/// \return whether the refraction texture is rendered this frame
+	inline bool needsRefractionUpdate() const { return updateRefraction; }
+
+	/// \return the part of the screen the water plane covers this frame, in [0,1]
+	inline float getCoverage() const { return coverage; }
+
+	/// \return the size the reflection texture was rendered at last
+	inline glm::ivec2 getReflectionViewportSize() const { return reflectionViewportSize; }
+
+	/// \return the size the refraction texture was rendered at last
+	inline glm::ivec2 getRefractionViewportSize() const { return refractionViewportSize; }
+
+	/// set whether the resolution scales with the screen coverage of the water, else the full resolution is used
+	inline void setAdaptiveResolutionEnabled(bool enabled) { adaptiveResolutionEnabled = enabled; }
+
+	/// set whether the reflection and refraction are rendered on alternate frames, reprojecting the other one
+	inline void setAlternateUpdatesEnabled(bool enabled) { alternateUpdatesEnabled = enabled; }
+
+	/// recreate the copy of the main pass and its depth pyramid for screen space reflections at the new window size.
+	/// call when the window is resized, since the main pass is copied with equal source and destination rectangles.
+	void setupFramebuffers(int windowWidth_, int windowHeight_);
+
+	/// set how the reflection is created. screen space reflections skip the reflection pass.
+	void setReflectionMode(WaterReflectionMode mode);
+
+	/// \return how the reflection is created
+	inline WaterReflectionMode getReflectionMode() const { return reflectionMode; }
+
+	/// set the sky that screen space reflections show where their rays miss:
+	/// the cubemap if the skybox is enabled, else the uniform sky color
+	void setSky(std::shared_ptr<CubemapTexture> skyCubemap_, bool skyboxEnabled_, const glm::vec3 &skyColor_);
+
+	/// copy the color and depth of the main pass from the default framebuffer and build the nearest depth pyramid,
+	/// which the screen space reflections are traced through. call after the main pass, before drawing the water.
+	void captureMainPass();
+
 
 private:
 
+	/// bind a framebuffer with the viewport scaled to the resolution of this frame,
+	/// and the scissor rectangle around the water within it
+	/// \return the size of the viewport
+	glm::ivec2 bindScaledFrameBuffer(GLuint frameBuffer, int width, int height);
+
+	/// create the framebuffer the main pass is copied to for screen space reflections, and its depth pyramid
+	void createScreenSpaceReflectionTargets();
+
 	/// create new framebuffer object and return its handle
 	GLuint createFrameBuffer();
 
@@ -1,24 +1,97 @@
 #include "geometry.h"
 
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+#include "meshoptimize.h"
+#include "resourcemanager.h"
+
 
 int Geometry::drawnSurfaceCount = 0;
-std::vector<std::shared_ptr<Texture>> Geometry::loadedTextures = {};
+int Geometry::occlusionCulledSurfaceCount = 0;
+bool Geometry::meshletCullingEnabled = true;
+int Geometry::testedMeshletCount = 0;
+int Geometry::frustumCulledMeshletCount = 0;
+int Geometry::backFacingMeshletCount = 0;
+int Geometry::meshletCulledTriangleCount = 0;
 glm::vec3 boundingBoxMin;
 glm::vec3 boundingBoxMax;
 
+// levels of detail generated per surface including the full resolution one,
+// and how far each level may move the surface relative to the diagonal of its bounding box
+static const int LOD_COUNT = 4;
+static const float LOD_MAX_ERRORS[LOD_COUNT] = { 0.0f, 0.005f, 0.01f, 0.02f };
+
+// surfaces of at least this many triangles are partitioned into meshlets, to cull them in parts
+static const size_t MESHLET_MIN_SURFACE_TRIANGLES = 1024;
+static const size_t MESHLET_MAX_VERTICES = 64;
+static const size_t MESHLET_MAX_TRIANGLES = 124;
+
 Geometry::Geometry(const glm::mat4 &matrix_, const std::string &filePath)
     : SceneObject(matrix_)
+    , sceneGraph(nullptr)
+    , sceneNode(-1)
 {
     std::cout << "LOADING MODEL " << filePath << std::endl;
     loadSurfaces(filePath);
+
+    ownSceneGraph.reset(new SceneGraph());
+    attachToSceneGraph(ownSceneGraph.get(), SceneGraph::ROOT);
 }
 
 Geometry::~Geometry()
-{}
+{
+    // the node was already removed if the geometry it is attached below was deleted first, which removeNode ignores
+    if (sceneGraph != ownSceneGraph.get()) {
+        sceneGraph->removeNode(sceneNode);
+    }
+}
+
+void Geometry::attachToSceneGraph(SceneGraph *sceneGraph_, SceneGraph::NodeId parent)
+{
+    if (sceneGraph) {
+        sceneGraph->removeNode(sceneNode);
+    }
+    if (sceneGraph_ != ownSceneGraph.get()) {
+        ownSceneGraph.reset();
+    }
+    sceneGraph = sceneGraph_;
+
+    sceneNode = sceneGraph->addNode(parent, getMatrix());
+    modelSceneNodes.resize(modelNodes.size());
+    for (size_t i = 0; i < modelNodes.size(); ++i) {
+        SceneGraph::NodeId modelParent = modelNodes[i].parent < 0 ? sceneNode : modelSceneNodes[modelNodes[i].parent];
+        modelSceneNodes[i] = sceneGraph->addNode(modelParent, modelNodes[i].transform);
+    }
+    sceneGraph->update();
+}
+
+SceneGraph::NodeId Geometry::getSceneNode() const
+{
+    return sceneNode;
+}
+
+void Geometry::updateSceneNode()
+{
+    sceneGraph->setLocalMatrix(sceneNode, getMatrix());
+}
 
-glm::mat3 Geometry::getNormalMatrix() const
+void Geometry::updateSurfaceMatrices()
 {
-    return glm::transpose(glm::mat3(getInverseMatrix()));
+    // the scene graph update is skipped if no transform changed since the last one
+    updateSceneNode();
+    sceneGraph->update();
+}
+
+const glm::mat4& Geometry::getSurfaceMatrix(size_t surface) const
+{
+    return sceneGraph->getWorldMatrix(modelSceneNodes[surfaceModelNodes[surface]]);
+}
+
+const glm::mat3& Geometry::getSurfaceNormalMatrix(size_t surface) const
+{
+    return sceneGraph->getNormalMatrix(modelSceneNodes[surfaceModelNodes[surface]]);
 }
 
 glm::vec3 Geometry::getBBMin()
@@ -31,6 +104,31 @@ glm::vec3 Geometry::getBBMax()
     return boundingBoxMax;
 }
 
+std::vector<glm::vec3> Geometry::getLargestSurfacePositions()
+{
+    std::vector<glm::vec3> positions;
+
+    int largestSurface = -1;
+    float largestRadius = -1;
+    for (size_t i = 0; i < surfaces.size(); ++i) {
+        float radius = glm::length(surfaces[i]->getBoundingSphereFarthestPoint() - surfaces[i]->getBoundingSphereCenter());
+        if (radius > largestRadius) {
+            largestRadius = radius;
+            largestSurface = int(i);
+        }
+    }
+
+    if (largestSurface >= 0) {
+        updateSurfaceMatrices();
+        const glm::mat4 &modelMatrix = getSurfaceMatrix(largestSurface);
+        for (const Vertex &vertex : surfaces[largestSurface]->getVertices()) {
+            positions.push_back((modelMatrix * glm::vec4(vertex.position, 1)).xyz);
+        }
+    }
+
+    return positions;
+}
+
 void Geometry::update(float timeDelta)
 {}
 
@@ -40,82 +138,392 @@ void Geometry::draw(Shader *shader, Camera *camera, bool useFrustumCulling, Text
 	// The following uniforms are those used by most such shaders.
 	// For very specific shaders consider subtyping Geometry.
 
-    // pass model matrix to shader
-    GLint modelMatLocation = glGetUniformLocation(shader->programHandle, "modelMat"); // get uniform location in shader
-    glUniformMatrix4fv(modelMatLocation, 1, GL_FALSE, glm::value_ptr(getMatrix())); // shader location, count, transpose?, value pointer
+    updateSurfaceMatrices();
 
-    // pass normal matrix to shader
+    // get model and normal matrix uniform locations in shader, the matrices are set per surface
+    GLint modelMatLocation = glGetUniformLocation(shader->programHandle, "modelMat");
     GLint normalMatLocation = glGetUniformLocation(shader->programHandle, "normalMat");
-    glUniformMatrix3fv(normalMatLocation, 1, GL_FALSE, glm::value_ptr(getNormalMatrix()));
 
     // draw surfaces
     for (GLuint i = 0; i < surfaces.size(); ++i) {
 
+        const glm::mat4 &surfaceMatrix = getSurfaceMatrix(i);
+
         // view frustum culling using bounding spheres
         if (useFrustumCulling) {
-            glm::vec3 boundingSphereCenter = (getMatrix() * glm::vec4(surfaces[i]->getBoundingSphereCenter(), 1)).xyz;
-            glm::vec3 boundingSphereFarthestPoint = (getMatrix() * glm::vec4(surfaces[i]->getBoundingSphereFarthestPoint(), 1)).xyz;
+            glm::vec3 boundingSphereCenter = (surfaceMatrix * glm::vec4(surfaces[i]->getBoundingSphereCenter(), 1)).xyz;
+            glm::vec3 boundingSphereFarthestPoint = (surfaceMatrix * glm::vec4(surfaces[i]->getBoundingSphereFarthestPoint(), 1)).xyz;
 
             if (!camera->checkSphereInFrustum(boundingSphereCenter, boundingSphereFarthestPoint, viewMat)) {
                 continue;
             }
         }
         drawnSurfaceCount += 1;
+
+        // pass model matrix to shader, including the dequantization of the vertex positions of the surface
+        glm::mat4 modelMatrix = surfaceMatrix * surfaces[i]->getDequantizationMatrix();
+        glUniformMatrix4fv(modelMatLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix)); // shader location, count, transpose?, value pointer
+        glUniformMatrix3fv(normalMatLocation, 1, GL_FALSE, glm::value_ptr(getSurfaceNormalMatrix(i)));
+
         surfaces[i]->draw(shader, filterType);
     }
 }
 
-void Geometry::loadSurfaces(const std::string &filePath)
+void Geometry::submit(RenderQueue *queue, Camera *camera, bool useFrustumCulling, const glm::mat4 &viewMat,
+                      const OcclusionRasterizer *occlusionRasterizer)
+{
+    updateSurfaceMatrices();
+
+    // if the queue culls on the gpu, all surfaces are submitted and counted as drawn
+    bool cullOnCpu = useFrustumCulling && !queue->isCullingOnGpu();
+
+    // meshlets are only culled in the passes drawn from the camera, since the shadow pass is drawn from the light
+    // and the reflection pass mirrors the camera in the shader. the back facing test requires back face culling.
+    bool cullMeshletsOfPass = meshletCullingEnabled && queue->getPass() != PASS_SHADOW && queue->getPass() != PASS_REFLECTION;
+    glm::vec4 objectSpacePlanes[6];
+    glm::vec3 objectSpaceViewerPosition;
+    std::vector<MeshletRange> visibleRanges;
+
+    // view space x axis in world space, to place the farthest point of meshlet spheres orthogonal to the view direction
+    glm::vec3 cameraRight = glm::vec3(viewMat[0][0], viewMat[1][0], viewMat[2][0]);
+
+    for (GLuint i = 0; i < surfaces.size(); ++i) {
+
+        const glm::mat4 &surfaceMatrix = getSurfaceMatrix(i);
+        glm::vec3 boundingSphereCenter = (surfaceMatrix * glm::vec4(surfaces[i]->getBoundingSphereCenter(), 1)).xyz;
+        glm::vec3 boundingSphereFarthestPoint = (surfaceMatrix * glm::vec4(surfaces[i]->getBoundingSphereFarthestPoint(), 1)).xyz;
+
+        // view frustum culling using bounding spheres
+        if (cullOnCpu && !camera->checkSphereInFrustum(boundingSphereCenter, boundingSphereFarthestPoint, viewMat)) {
+            continue;
+        }
+
+        // occlusion culling against the occluder depth rasterized on the cpu
+        if (occlusionRasterizer && !occlusionRasterizer->isSphereVisible(boundingSphereCenter, glm::length(boundingSphereFarthestPoint - boundingSphereCenter))) {
+            occlusionCulledSurfaceCount += 1;
+            continue;
+        }
+        drawnSurfaceCount += 1;
+
+        // the scale of the surface along its axes, for the meshlet spheres and the texel density
+        glm::vec3 axisScales(glm::length(surfaceMatrix[0].xyz()), glm::length(surfaceMatrix[1].xyz()), glm::length(surfaceMatrix[2].xyz()));
+
+        // the view space z axis points towards the camera, so the depth is the negated z
+        glm::vec3 viewSpaceCenter = (viewMat * glm::vec4(boundingSphereCenter, 1)).xyz;
+        float viewDepth = -viewSpaceCenter.z;
+
+        // choose the level of detail by the projected size of the bounding sphere, relative to the screen height.
+        // the bias of the pass selects coarser levels for passes of lower resolution.
+        int lod = 0;
+        if (queue->isLodEnabled() && surfaces[i]->getLodCount() > 1) {
+            float radius = glm::length(boundingSphereFarthestPoint - boundingSphereCenter);
+            float distance = std::max(glm::length(viewSpaceCenter), radius);
+            float projectedSize = radius / (distance * std::tan(camera->getFieldOfView() / 2));
+            lod = surfaces[i]->selectLod(projectedSize * std::exp2(-queue->getLodBias()));
+        }
+
+        // request the texture detail the surface is drawn with from its streamed diffuse texture array.
+        // the nearest point of the bounding sphere is assumed, the uv density gives the texels per world unit.
+        // the least stretched axis of the surface has the finest density, which is requested.
+        TextureArray *diffuseArray = surfaces[i]->getDiffuseTextureArray().get();
+        if (queue->getPass() == PASS_MAIN && diffuseArray && diffuseArray->isStreamable()) {
+            float radius = glm::length(boundingSphereFarthestPoint - boundingSphereCenter);
+            float distance = std::max(glm::length(viewSpaceCenter) - radius, camera->getNearPlane());
+            float minScale = std::min(axisScales.x, std::min(axisScales.y, axisScales.z));
+            float texelsPerUnit = surfaces[i]->getUvDensity() / minScale * diffuseArray->getWidth();
+            diffuseArray->requestTexelDensity(texelsPerUnit * 2 * distance * std::tan(camera->getFieldOfView() / 2));
+        }
+
+        glm::mat4 modelMatrix = surfaceMatrix * surfaces[i]->getDequantizationMatrix();
+        const glm::mat3 &normalMatrix = getSurfaceNormalMatrix(i);
+
+        // large surfaces drawn at full resolution are drawn in parts, by the ranges of their visible meshlets.
+        // the ranges are submitted with their own bounding spheres, such that gpu culling can still reject them.
+        if (cullMeshletsOfPass && lod == 0 && !surfaces[i]->getMeshlets().empty()) {
+            getObjectSpaceView(camera, viewMat, surfaceMatrix, objectSpacePlanes, objectSpaceViewerPosition);
+            float maxScale = std::max(axisScales.x, std::max(axisScales.y, axisScales.z));
+            cullMeshlets(*surfaces[i], objectSpacePlanes, objectSpaceViewerPosition, backFaceCulling, visibleRanges,
+                         frustumCulledMeshletCount, backFacingMeshletCount, meshletCulledTriangleCount);
+            testedMeshletCount += int(surfaces[i]->getMeshlets().size());
+
+            for (const MeshletRange &range : visibleRanges) {
+                glm::vec3 rangeCenter = (surfaceMatrix * glm::vec4(range.center, 1)).xyz;
+                glm::vec3 rangeFarthestPoint = rangeCenter + cameraRight * (range.radius * maxScale);
+                float rangeViewDepth = -(viewMat * glm::vec4(rangeCenter, 1)).z;
+                queue->submit(surfaces[i].get(), modelMatrix, normalMatrix, rangeCenter, rangeFarthestPoint, rangeViewDepth, shininess, backFaceCulling,
+                              0, range.firstIndex, range.indexCount);
+            }
+            continue;
+        }
+
+        queue->submit(surfaces[i].get(), modelMatrix, normalMatrix, boundingSphereCenter, boundingSphereFarthestPoint, viewDepth, shininess, backFaceCulling, lod);
+    }
+}
+
+void Geometry::measureMeshletCulling(Camera *camera, const glm::mat4 &viewMat, int &surfaceCullingTriangleCount, int &meshletCullingTriangleCount)
+{
+    updateSurfaceMatrices();
+
+    glm::vec4 objectSpacePlanes[6];
+    glm::vec3 objectSpaceViewerPosition;
+    std::vector<MeshletRange> visibleRanges;
+
+    for (size_t i = 0; i < surfaces.size(); ++i) {
+
+        const std::shared_ptr<Surface> &surface = surfaces[i];
+        getObjectSpaceView(camera, viewMat, getSurfaceMatrix(i), objectSpacePlanes, objectSpaceViewerPosition);
+
+        // the same test as for meshlets, so that only the granularity differs
+        glm::vec3 center = surface->getBoundingSphereCenter();
+        float radius = glm::length(surface->getBoundingSphereFarthestPoint() - center);
+        bool inFrustum = true;
+        for (int p = 0; p < 6; ++p) {
+            inFrustum = inFrustum && glm::dot(objectSpacePlanes[p].xyz(), center) + objectSpacePlanes[p].w >= -radius;
+        }
+        if (!inFrustum) {
+            continue;
+        }
+
+        int triangleCount = int(surface->getMeshRange(0).indexCount / 3);
+        surfaceCullingTriangleCount += triangleCount;
+
+        if (surface->getMeshlets().empty()) {
+            meshletCullingTriangleCount += triangleCount;
+            continue;
+        }
+        int frustumCulled = 0, backFacing = 0, culledTriangles = 0;
+        cullMeshlets(*surface, objectSpacePlanes, objectSpaceViewerPosition, backFaceCulling, visibleRanges, frustumCulled, backFacing, culledTriangles);
+        meshletCullingTriangleCount += triangleCount - culledTriangles;
+    }
+}
+
+void Geometry::getObjectSpaceView(Camera *camera, const glm::mat4 &viewMat, const glm::mat4 &modelMatrix,
+                                  glm::vec4 objectSpacePlanes[6], glm::vec3 &objectSpaceViewerPosition) const
+{
+    // the meshlet bounds are in object space. planes are transformed by the transposed model matrix,
+    // and since an affine transformation maps half spaces to half spaces and preserves which side of a triangle a point is on,
+    // culling in object space gives the same results as in world space, also for non-uniform scaling.
+    camera->getFrustumPlanes(viewMat, objectSpacePlanes);
+    glm::mat4 transposedModelMatrix = glm::transpose(modelMatrix);
+    for (int p = 0; p < 6; ++p) {
+        objectSpacePlanes[p] = transposedModelMatrix * objectSpacePlanes[p];
+        objectSpacePlanes[p] /= glm::length(objectSpacePlanes[p].xyz());
+    }
+    objectSpaceViewerPosition = (glm::inverse(modelMatrix) * glm::inverse(viewMat)[3]).xyz;
+}
+
+void Geometry::cullMeshlets(const Surface &surface, const glm::vec4 objectSpacePlanes[6], const glm::vec3 &objectSpaceViewerPosition, bool cullBackFacing,
+                            std::vector<MeshletRange> &visibleRanges, int &frustumCulledCount, int &backFacingCount, int &culledTriangleCount) const
 {
-    // read surface data from file using Assimp.
-    //
-    // IMPORTANT ASSIMP POSTPROCESS FLAGS
-    // - aiProcess_PreTransformVertices: to load vertices in world space i.e. apply transformation matrices, which we dont load
-    // - aiProcess_Triangulate: needed for OpenGL
-    // if there are problems with the uvs, try aiProcess_FlipUVs
-    // note: experiment with flags like aiProcess_SplitLargeMeshes, aiProcess_OptimizeMeshes, when using bigger models.
+    visibleRanges.clear();
+    bool lastVisible = false;
 
-    Assimp::Importer importer;
-	const aiScene *scene = importer.ReadFile(filePath, aiProcess_PreTransformVertices | aiProcess_Triangulate);
+    for (const Meshlet &meshlet : surface.getMeshlets()) {
 
-    // check for errors
-    if (!scene || !scene->mRootNode || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE) {
-        std::cerr << "ERROR ASSIMP: " << importer.GetErrorString() << std::endl;
+        bool inFrustum = true;
+        for (int p = 0; p < 6 && inFrustum; ++p) {
+            inFrustum = glm::dot(objectSpacePlanes[p].xyz(), meshlet.center) + objectSpacePlanes[p].w >= -meshlet.radius;
+        }
+        bool backFacing = inFrustum && cullBackFacing
+                && MeshOptimize::isMeshletBackFacing(meshlet.center, meshlet.radius, meshlet.coneAxis, meshlet.coneCutoff, objectSpaceViewerPosition);
+
+        if (!inFrustum || backFacing) {
+            frustumCulledCount += inFrustum ? 0 : 1;
+            backFacingCount += backFacing ? 1 : 0;
+            culledTriangleCount += int(meshlet.indexCount / 3);
+            lastVisible = false;
+            continue;
+        }
+
+        // meshlets are stored in index order, so consecutive visible meshlets form one range
+        if (lastVisible) {
+            MeshletRange &range = visibleRanges.back();
+            range.indexCount += meshlet.indexCount;
+            mergeBoundingSpheres(range.center, range.radius, meshlet.center, meshlet.radius);
+        }
+        else {
+            MeshletRange range;
+            range.firstIndex = meshlet.firstIndex;
+            range.indexCount = meshlet.indexCount;
+            range.center = meshlet.center;
+            range.radius = meshlet.radius;
+            visibleRanges.push_back(range);
+        }
+        lastVisible = true;
+    }
+}
+
+void Geometry::mergeBoundingSpheres(glm::vec3 &center, float &radius, const glm::vec3 &otherCenter, float otherRadius)
+{
+    glm::vec3 offset = otherCenter - center;
+    float distance = glm::length(offset);
+    if (distance + otherRadius <= radius) {
+        return;
+    }
+    if (distance + radius <= otherRadius) {
+        center = otherCenter;
+        radius = otherRadius;
         return;
     }
+    float mergedRadius = (distance + radius + otherRadius) / 2;
+    center += offset * ((mergedRadius - radius) / distance);
+    radius = mergedRadius;
+}
+
+void Geometry::setShininess(float shininess_)
+{
+    shininess = shininess_;
+}
+
+void Geometry::setBackFaceCulling(bool enabled)
+{
+    backFaceCulling = enabled;
+}
+
+void Geometry::loadSurfaces(const std::string &filePath)
+{
+    std::vector<CachedSurface> meshes;
+
+    // the optimized mesh data of a previous run is reused while the model file is unchanged
+    if (MeshCache::load(filePath, meshes, modelNodes)) {
+        std::cout << "loaded mesh cache " << MeshCache::getCachePath(filePath) << std::endl;
+    }
+    else {
+
+        // read surface data from file using Assimp.
+        //
+        // IMPORTANT ASSIMP POSTPROCESS FLAGS
+        // - aiProcess_Triangulate: needed for OpenGL
+        // the vertices are not pre-transformed (aiProcess_PreTransformVertices), since the node hierarchy is loaded
+        // into the scene graph. this way a mesh referenced by several nodes is stored only once.
+        // if there are problems with the uvs, try aiProcess_FlipUVs
+        // note: experiment with flags like aiProcess_SplitLargeMeshes, aiProcess_OptimizeMeshes, when using bigger models.
+
+        Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(filePath, aiProcess_Triangulate);
+
+        // check for errors
+        if (!scene || !scene->mRootNode || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE) {
+            std::cerr << "ERROR ASSIMP: " << importer.GetErrorString() << std::endl;
+            return;
+        }
+
+        // save path to the directory containing the file
+        directoryPath = filePath.substr(0, filePath.find_last_of('/'));
+
+        // process all meshes, then recursively process Assimp root node referencing them
+        for (GLuint i = 0; i < scene->mNumMeshes; ++i) {
+            meshes.push_back(processMesh(scene->mMeshes[i], scene));
+        }
+        processNode(scene->mRootNode, -1, modelNodes);
+
+        MeshCache::save(filePath, meshes, modelNodes);
+    }
 
-    // save path to the directory containing the file
-    directoryPath = filePath.substr(0, filePath.find_last_of('/'));
+    // triangles per level of detail over all surfaces, surfaces without a level count with their coarsest one
+    std::vector<size_t> lodTriangleCounts(LOD_COUNT, 0);
+
+    // triangle weighted averages of the vertex pipeline metrics over all surfaces
+    size_t triangleCount = 0, meshletCount = 0, meshletSurfaceCount = 0;
+    float acmrBefore = 0, acmrAfter = 0, overdrawBefore = 0, overdrawAfter = 0;
+
+    std::vector<std::shared_ptr<Surface>> meshSurfaces;
+    for (const CachedSurface &mesh : meshes) {
+        meshSurfaces.push_back(createSurface(mesh));
+
+        size_t meshTriangleCount = mesh.indices.size() / 3;
+        triangleCount += meshTriangleCount;
+        acmrBefore += mesh.acmrBefore * meshTriangleCount;
+        acmrAfter += mesh.acmrAfter * meshTriangleCount;
+        overdrawBefore += mesh.overdrawBefore * meshTriangleCount;
+        overdrawAfter += mesh.overdrawAfter * meshTriangleCount;
+        meshletCount += mesh.meshlets.size();
+        meshletSurfaceCount += mesh.meshlets.empty() ? 0 : 1;
+
+        for (int level = 0; level < LOD_COUNT; ++level) {
+            const std::vector<GLuint> &lodIndices = level == 0 || mesh.lodIndices.empty() ? mesh.indices : mesh.lodIndices[std::min<size_t>(level, mesh.lodIndices.size()) - 1];
+            lodTriangleCounts[level] += lodIndices.size() / 3;
+        }
+    }
 
-    // recursively process Assimp root node
-    processNode(scene->mRootNode, scene);
+    buildTextureArrays(meshSurfaces);
 
-    std::cout << "loaded " << surfaces.size() << " surfaces." << std::endl;
-    std::cout << "loaded " << loadedTextures.size() << " textures." << std::endl;
+    // each surface is drawn at the model nodes referencing it
+    for (size_t i = 0; i < modelNodes.size(); ++i) {
+        for (uint32_t surface : modelNodes[i].surfaces) {
+            if (surface < meshSurfaces.size()) {
+                surfaces.push_back(meshSurfaces[surface]);
+                surfaceModelNodes.push_back(i);
+            }
+        }
+    }
+
+    std::cout << "loaded " << meshSurfaces.size() << " surfaces in " << modelNodes.size() << " nodes." << std::endl;
+    ResourceManager *resourceManager = ResourceManager::getInstance();
+    std::cout << resourceManager->getResourceCount() << " texture resources loaded in total, " << resourceManager->getVramSize() / 1024 << " KB texture memory." << std::endl;
+
+    // report the error and memory savings of the compact vertex layout
+    if (MeshArena::getInstance()->getVertexFormat() == VERTEX_FORMAT_QUANTIZED) {
+        size_t vertexCount = 0;
+        QuantizationError maxError;
+        for (const auto &surface : meshSurfaces) {
+            const QuantizationError &error = surface->getQuantizationError();
+            maxError.maxPositionError = std::max(maxError.maxPositionError, error.maxPositionError);
+            maxError.maxNormalError = std::max(maxError.maxNormalError, error.maxNormalError);
+            maxError.maxUvError = std::max(maxError.maxUvError, error.maxUvError);
+            vertexCount += surface->getMeshRange().vertexCount;
+        }
+        std::cout << "quantized vertices: max error position " << maxError.maxPositionError
+                  << ", normal " << maxError.maxNormalError << " deg, uv " << maxError.maxUvError
+                  << ". vertex memory " << vertexCount * sizeof(Vertex) / 1024 << " KB -> "
+                  << vertexCount * sizeof(QuantizedVertex) / 1024 << " KB" << std::endl;
+    }
+    if (triangleCount > 0) {
+        std::cout << "vertex cache ACMR " << acmrBefore / triangleCount << " -> " << acmrAfter / triangleCount
+                  << ", overdraw " << overdrawBefore / triangleCount << " -> " << overdrawAfter / triangleCount
+                  << " (" << triangleCount << " triangles)" << std::endl;
+        std::cout << "levels of detail:";
+        for (int level = 0; level < LOD_COUNT; ++level) {
+            std::cout << " " << lodTriangleCounts[level];
+        }
+        std::cout << " triangles" << std::endl;
+        std::cout << meshletCount << " meshlets in " << meshletSurfaceCount << " surfaces" << std::endl;
+    }
 }
 
-void Geometry::processNode(aiNode *node, const aiScene *scene)
+void Geometry::processNode(aiNode *node, int parent, std::vector<CachedNode> &nodes)
 {
-    // process all meshes contained in this node.
+    // store the transform of this node relative to its parent.
+    // assimp matrices are row major, glm matrices column major.
+    CachedNode result;
+    result.parent = parent;
+    for (int row = 0; row < 4; ++row) {
+        for (int col = 0; col < 4; ++col) {
+            result.transform[col][row] = node->mTransformation[row][col];
+        }
+    }
+
     // note that the node->mMeshes just define the hierarchy
-    // and store indices to the actual data in scene->mMeshes
+    // and store indices to the actual data in scene->mMeshes, in the same order as the processed meshes
     for (GLuint i = 0; i < node->mNumMeshes; ++i) {
-        aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-        processMesh(mesh, scene);
+        result.surfaces.push_back(node->mMeshes[i]);
     }
 
+    int index = int(nodes.size());
+    nodes.push_back(result);
+
     // then process all child nodes
     for (GLuint i = 0; i < node->mNumChildren; ++i) {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], index, nodes);
     }
 
 }
 
-void Geometry::processMesh(aiMesh *mesh, const aiScene *scene)
+CachedSurface Geometry::processMesh(aiMesh *mesh, const aiScene *scene)
 {
-    std::vector<Vertex> vertices;
-    std::vector<GLuint> indices;
-    std::shared_ptr<Texture> surfaceTextureDiffuse, surfaceTextureSpecular, surfaceTextureNormal;
+    CachedSurface result;
+    std::vector<Vertex> &vertices = result.vertices;
+    std::vector<GLuint> &indices = result.indices;
 
     // process mesh vertices (positions, normals, uvs)
     for (GLuint i = 0; i < mesh->mNumVertices; ++i) {
@@ -147,14 +555,6 @@ void Geometry::processMesh(aiMesh *mesh, const aiScene *scene)
             vertex.uv = glm::vec2(0.0f, 0.0f);
         }
 
-        // update axis aligned bounding box
-        if (glm::all(glm::lessThan(vertex.position, boundingBoxMin))) {
-            boundingBoxMin = vertex.position;
-        }
-        else if (glm::all(glm::greaterThan(vertex.position, boundingBoxMax))) {
-            boundingBoxMax = vertex.position;
-        }
-
         vertices.push_back(vertex);
     }
 
@@ -167,49 +567,141 @@ void Geometry::processMesh(aiMesh *mesh, const aiScene *scene)
         }
     }
 
-    // process material and store textures
+    // reorder triangles for the post-transform vertex cache and for less overdraw,
+    // then reorder vertices for locality of vertex fetches
+    result.acmrBefore = MeshOptimize::calculateACMR(indices, vertices.size());
+    result.overdrawBefore = MeshOptimize::calculateOverdraw(indices, vertices);
+
+    MeshOptimize::optimizeVertexCache(indices, vertices.size());
+    MeshOptimize::optimizeOverdraw(indices, vertices, 1.05f);
+
+    // large surfaces are regrouped into spatially compact meshlets, which keeps them in cache friendly runs
+    if (indices.size() / 3 >= MESHLET_MIN_SURFACE_TRIANGLES) {
+        result.meshlets = MeshOptimize::buildMeshlets(indices, vertices, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+    }
+    MeshOptimize::optimizeVertexFetch(vertices, indices);
+
+    result.acmrAfter = MeshOptimize::calculateACMR(indices, vertices.size());
+    result.overdrawAfter = MeshOptimize::calculateOverdraw(indices, vertices);
+
+    // simplified levels of detail, each halving the triangles of the previous one
+    glm::vec3 bbMin, bbMax;
+    VertexQuantize::calculateBounds(vertices, bbMin, bbMax);
+    float meshSize = glm::length(bbMax - bbMin);
+
+    std::vector<GLuint> lod = indices;
+    for (int level = 1; level < LOD_COUNT; ++level) {
+        float lodError;
+        std::vector<GLuint> simplified = MeshOptimize::simplify(vertices, lod, lod.size() / 2, meshSize * LOD_MAX_ERRORS[level], &lodError);
+
+        // stop when the mesh cannot be simplified much further, e.g. when it consists of borders and seams only
+        if (simplified.size() > lod.size() * 3 / 4) {
+            break;
+        }
+        MeshOptimize::optimizeVertexCache(simplified, vertices.size());
+        result.lodIndices.push_back(simplified);
+        result.lodErrors.push_back(lodError);
+        lod.swap(simplified);
+    }
+
+    // process material and store texture paths
     // note: we only load the first diffuse, specular and normal texture reffered to by the assimp material
     // and store them in this order
     if (mesh->mMaterialIndex >= 0) {
 
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
-        surfaceTextureDiffuse = loadMaterialTexture(material, aiTextureType_DIFFUSE);
-        surfaceTextureSpecular = loadMaterialTexture(material, aiTextureType_SPECULAR);
-        surfaceTextureNormal = loadMaterialTexture(material, aiTextureType_NORMALS);
+        result.texturePathDiffuse = getMaterialTexturePath(material, aiTextureType_DIFFUSE);
+        result.texturePathSpecular = getMaterialTexturePath(material, aiTextureType_SPECULAR);
+        result.texturePathNormal = getMaterialTexturePath(material, aiTextureType_NORMALS);
     }
 
-    // return a Surface object created from the extracted aiMesh data
-    surfaces.push_back(std::make_shared<Surface>(vertices, indices, surfaceTextureDiffuse, surfaceTextureSpecular, surfaceTextureNormal));
-
+    return result;
 }
 
-std::shared_ptr<Texture> Geometry::loadMaterialTexture(aiMaterial *mat, aiTextureType type)
+std::shared_ptr<Surface> Geometry::createSurface(const CachedSurface &mesh)
 {
-    aiString texturePath;
-    std::shared_ptr<Texture> texture = nullptr;
+    for (const Vertex &vertex : mesh.vertices) {
 
-    if (mat->GetTexture(type, 0, &texturePath) == AI_SUCCESS) {
+        // update axis aligned bounding box
+        if (glm::all(glm::lessThan(vertex.position, boundingBoxMin))) {
+            boundingBoxMin = vertex.position;
+        }
+        else if (glm::all(glm::greaterThan(vertex.position, boundingBoxMax))) {
+            boundingBoxMax = vertex.position;
+        }
+    }
+
+    std::shared_ptr<Texture> surfaceTextureDiffuse = loadTexture(mesh.texturePathDiffuse);
+    std::shared_ptr<Texture> surfaceTextureSpecular = loadTexture(mesh.texturePathSpecular);
+    std::shared_ptr<Texture> surfaceTextureNormal = loadTexture(mesh.texturePathNormal);
+
+    return std::make_shared<Surface>(mesh.vertices, mesh.indices, surfaceTextureDiffuse, surfaceTextureSpecular, surfaceTextureNormal, mesh.lodIndices, mesh.meshlets);
+}
 
-        // check if we already loaded the texture of the given path for another mesh
-        bool skip = false;
-        for (auto existingTexture : loadedTextures) {
+void Geometry::buildTextureArrays(const std::vector<std::shared_ptr<Surface>> &meshSurfaces)
+{
+    // group the distinct diffuse textures by size, format and mip level count, in order of first use
+    std::vector<std::vector<std::shared_ptr<Texture>>> groups;
+    for (const auto &surface : meshSurfaces) {
+        const std::shared_ptr<Texture> &texture = surface->getDiffuseTexture();
+        if (!texture) {
+            continue;
+        }
 
-            if (existingTexture->getFilePath() == (directoryPath + '/' + texturePath.C_Str())) {
-                skip = true;
-                texture = existingTexture; // use pointer to existing texture
-                break;
+        auto group = std::find_if(groups.begin(), groups.end(), [&texture](const std::vector<std::shared_ptr<Texture>> &g) {
+            return g[0]->getWidth() == texture->getWidth() && g[0]->getHeight() == texture->getHeight()
+                && g[0]->getInternalFormat() == texture->getInternalFormat() && g[0]->getLevelCount() == texture->getLevelCount();
+        });
+        if (group == groups.end()) {
+            groups.push_back({ texture });
+        }
+        else if (std::find(group->begin(), group->end(), texture) == group->end()) {
+            group->push_back(texture);
+        }
+    }
+
+    GLint maxLayerCount = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayerCount);
+
+    // copy each group into the layers of texture arrays, which are shared with other geometry importing the same textures
+    std::unordered_map<const Texture*, std::pair<std::shared_ptr<TextureArray>, GLuint>> layers;
+    size_t arrayCount = 0;
+    for (const std::vector<std::shared_ptr<Texture>> &group : groups) {
+        for (size_t first = 0; first < group.size(); first += size_t(maxLayerCount)) {
+            std::vector<std::shared_ptr<Texture>> arrayLayers(group.begin() + first, group.begin() + std::min(group.size(), first + size_t(maxLayerCount)));
+            std::shared_ptr<TextureArray> textureArray = ResourceManager::getInstance()->getTextureArray(arrayLayers);
+            for (size_t layer = 0; layer < arrayLayers.size(); ++layer) {
+                layers[arrayLayers[layer].get()] = std::make_pair(textureArray, GLuint(layer));
             }
+            arrayCount += 1;
         }
+    }
 
-        // otherwise load the texture from the file
-        if (!skip) {
-			loadedTextures.push_back(std::make_shared<Texture>(directoryPath + '/' + texturePath.C_Str()));
-            std::cout << "loaded texture: " << directoryPath + '/' + texturePath.C_Str() << std::endl;
-            texture = loadedTextures.back();
+    size_t textureCount = layers.size();
+    for (const auto &surface : meshSurfaces) {
+        auto layer = layers.find(surface->getDiffuseTexture().get());
+        if (layer != layers.end()) {
+            surface->setDiffuseTextureArray(layer->second.first, layer->second.second);
         }
+    }
+
+    std::cout << "packed " << textureCount << " diffuse textures into " << arrayCount << " texture arrays." << std::endl;
+}
+
+std::string Geometry::getMaterialTexturePath(aiMaterial *mat, aiTextureType type)
+{
+    aiString texturePath;
 
+    if (mat->GetTexture(type, 0, &texturePath) == AI_SUCCESS) {
+        return directoryPath + '/' + texturePath.C_Str();
     }
 
-    return texture;
+    return "";
+}
+
+std::shared_ptr<Texture> Geometry::loadTexture(const std::string &filePath)
+{
+    // textures already loaded for another mesh or subsystem are shared
+    return ResourceManager::getInstance()->getTexture(filePath);
 }
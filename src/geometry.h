@@ -13,15 +13,37 @@
 #include "shader.h"
 #include "texture.hpp"
 #include "camera.h"
+#include "renderqueue.h"
+#include "occlusionrasterizer.h"
+#include "meshcache.h"
+#include "scenegraph.h"
 
 
 //! A SceneObject that holds Surfaces containing mesh data and textures.
+
+//! The node hierarchy of the model file is kept in a scene graph below the node of the SceneObject,
+//! each surface is drawn with the world matrix of the node it belongs to.
+//! The transform of the SceneObject is relative to the parent node it is attached to.
 class Geometry : public SceneObject
 {
 public:
     Geometry(const glm::mat4 &matrix_, const std::string &filePath);
     virtual ~Geometry();
 
+    //! Attach the SceneObject and the node hierarchy of its model to a scene graph.
+    //! Until attached, the geometry uses a scene graph of its own.
+    void attachToSceneGraph(
+        SceneGraph *sceneGraph_, //!< [in] the scene graph to add the nodes to, must outlive the geometry
+        SceneGraph::NodeId parent //!< [in] the node the SceneObject is attached to
+    );
+
+    //! \return the scene graph node holding the transform of the SceneObject
+    SceneGraph::NodeId getSceneNode() const;
+
+    //! Copy the transform of the SceneObject to its scene graph node, if it changed.
+    //! The world matrices follow on the next update of the scene graph.
+    void updateSceneNode();
+
     //! Update the state of the SceneObject
     virtual void update(
         float timeDelta //!< [in] time passed since last frame in seconds
@@ -30,16 +52,18 @@ public:
     //! draw the SceneObject using given shader
     virtual void draw(Shader *shader, Camera *camera, bool useFrustumCulling, Texture::FilterType filterType, const glm::mat4 &viewMat);
 
-    /**
-     * @brief return a the transposed inverse of the modelMatrix.
-     * this should be used to transform normals into world space.
-     * the inverse is used since the normals of a scaled vector are inversely scaled,
-     * the transpose is used to revert the inversion of the rotational components
-     * while not affecting the scale factors which lie on the main diagonal.
-     * mat3 is used since the translational component is irrelevant for normals.
-     * @return the matrix to transform normals into world space.
-     */
-    glm::mat3 getNormalMatrix() const;
+    //! submit the visible surfaces of the SceneObject to a render queue instead of drawing them directly.
+    //! if an occlusion rasterizer is given, surfaces hidden behind its occluders are not submitted.
+    //! it must have been rendered from the same view.
+    virtual void submit(RenderQueue *queue, Camera *camera, bool useFrustumCulling, const glm::mat4 &viewMat,
+                        const OcclusionRasterizer *occlusionRasterizer = nullptr);
+
+    //! Set the blinn-phong shininess used when drawing via a render queue
+    void setShininess(float shininess_);
+
+    //! Set whether back faces are culled when drawing via a render queue.
+    //! this should be disabled for surfaces that are not closed meshes (e.g. palm leaves).
+    void setBackFaceCulling(bool enabled);
 
     //! Returns min vertex of axis-aligned bounding box enclosing all surfaces.
     /// \return min vertex of axis-aligned bounding box enclosing all surfaces.
@@ -48,17 +72,75 @@ public:
     /// \return max vertex of axis-aligned bounding box enclosing all surfaces.
     glm::vec3 getBBMax();
 
+    //! Returns the world space vertex positions of the surface with the largest bounding sphere.
+    //! For a terrain model like the island this is the ground, from which occluders can be derived.
+    /// \return world space vertex positions of the largest surface
+    std::vector<glm::vec3> getLargestSurfacePositions();
+
     //! The number of surfaces being drawn
     static int drawnSurfaceCount;
-private:
-    //!< surfaces store mesh data and textures
+
+    //! The number of surfaces rejected by the occlusion rasterizer
+    static int occlusionCulledSurfaceCount;
+
+    //! Count the full resolution triangles submitted from the given view when culling whole surfaces
+    //! against the view frustum, and when additionally culling their meshlets.
+    //! The occlusion and level of detail selection are not applied. Meant for comparing the culling granularity.
+    void measureMeshletCulling(
+        Camera *camera, //!< [in] the camera whose projection is used
+        const glm::mat4 &viewMat, //!< [in] the view matrix to cull with
+        int &surfaceCullingTriangleCount, //!< [in,out] triangles of the surfaces intersecting the frustum are added
+        int &meshletCullingTriangleCount //!< [in,out] triangles of the visible meshlets of these surfaces are added
+    );
+
+    //! Whether large surfaces are culled per meshlet in the passes drawn from the camera
+    static bool meshletCullingEnabled;
+
+    //! The number of meshlets tested, and rejected by the frustum and by the back facing test
+    static int testedMeshletCount;
+    static int frustumCulledMeshletCount;
+    static int backFacingMeshletCount;
+
+    //! The number of triangles of the rejected meshlets
+    static int meshletCulledTriangleCount;
+protected:
+    //!< surfaces store mesh data and textures. a surface drawn at several nodes of the model appears once per node.
     std::vector<std::shared_ptr<Surface>> surfaces;
 
+    //! Bring the world matrices of the surfaces up to date with the transform of the SceneObject
+    void updateSurfaceMatrices();
+
+    //! \return the world matrix of the model node of a surface, as of the last update
+    const glm::mat4& getSurfaceMatrix(size_t surface) const;
+
+    //! \return the matrix to transform normals of a surface into world space
+    const glm::mat3& getSurfaceNormalMatrix(size_t surface) const;
+
+    //!< render state used when submitting to a render queue
+    float shininess = 32.f;
+    bool backFaceCulling = true;
+
+    //! Grow a sphere such that it also encloses another sphere
+    static void mergeBoundingSpheres(
+        glm::vec3 &center, //!< [in,out] center of the sphere to grow
+        float &radius, //!< [in,out] radius of the sphere to grow
+        const glm::vec3 &otherCenter, //!< [in] center of the sphere to enclose
+        float otherRadius //!< [in] radius of the sphere to enclose
+    );
+
+private:
     //!< the path of the directory containing the model file to load
     std::string directoryPath;
 
-    // pointers to all textures loaded by the surfaces of this geometry, to avoid loading twice
-    static std::vector<std::shared_ptr<Texture>> loadedTextures;
+    // the scene graph holding the nodes of this geometry, and the one owned until attached to another
+    SceneGraph *sceneGraph;
+    std::unique_ptr<SceneGraph> ownSceneGraph;
+    SceneGraph::NodeId sceneNode;
+
+    // the node hierarchy of the model, the scene graph node of each model node, and the model node of each surface
+    std::vector<CachedNode> modelNodes;
+    std::vector<SceneGraph::NodeId> modelSceneNodes;
+    std::vector<size_t> surfaceModelNodes;
 
     //! Load surfaces from file
 
@@ -68,28 +150,81 @@ private:
         const std::string &filePath //!< [in] file path to load surfaces from
     );
 
-    //! Process all meshes contained in given node and recursively process all child nodes
+    //! Store given node with the meshes it references and recursively process all child nodes
     void processNode(
         aiNode *node, //!< the current node to process
-        const aiScene *scene //!< the aiScene containing the node
+        int parent, //!< index of the already processed parent node, -1 for the root node
+        std::vector<CachedNode> &nodes //!< [out] the processed nodes are appended here, parents before children
     );
 
-    //! Load data from assimp aiMesh to new Surface object
+    //! Load data from assimp aiMesh and optimize it for the gpu vertex pipeline
 
-    //! This loads only the first diffuse, specular and normal texture for
-    //! each surface and stores them in this order in the surface
-    void processMesh(
+    //! This stores only the paths of the first diffuse, specular and normal texture
+    //! of each surface, in this order
+    /// \return the optimized mesh data, as stored in the mesh cache
+    CachedSurface processMesh(
         aiMesh *mesh, //!< [in] the assimp mesh to process
         const aiScene *scene //!< [in] the assimp scene containing the mesh
     );
 
-    //! Load assimp aiMesh texture of given type.
-    
-    //! Textures of same filePath are reused among the geometry object.
-    //! \return a pointer to the texture
-    std::shared_ptr<Texture> loadMaterialTexture(
+    //! A range of consecutive visible meshlets of a surface, drawn as one part of the surface
+    struct MeshletRange
+    {
+        GLuint firstIndex;
+        GLuint indexCount;
+        glm::vec3 center; // object space bounding sphere of the meshlets
+        float radius;
+    };
+
+    //! Cull the meshlets of a surface in object space and merge consecutive visible meshlets to ranges.
+    void cullMeshlets(
+        const Surface &surface, //!< [in] the surface whose meshlets to cull
+        const glm::vec4 objectSpacePlanes[6], //!< [in] normalized frustum planes in object space, see Camera::getFrustumPlanes
+        const glm::vec3 &objectSpaceViewerPosition, //!< [in] the camera position in object space
+        bool cullBackFacing, //!< [in] whether meshlets whose triangles all face away from the camera are culled
+        std::vector<MeshletRange> &visibleRanges, //!< [out] the ranges of visible meshlets, in index order
+        int &frustumCulledCount, //!< [in,out] the number of meshlets outside of the frustum is added
+        int &backFacingCount, //!< [in,out] the number of back facing meshlets is added
+        int &culledTriangleCount //!< [in,out] the number of triangles of culled meshlets is added
+    ) const;
+
+    //! Transform frustum planes and the camera position of the given view to object space.
+    void getObjectSpaceView(
+        Camera *camera, //!< [in] the camera whose projection is used
+        const glm::mat4 &viewMat, //!< [in] the view matrix
+        const glm::mat4 &modelMatrix, //!< [in] the matrix from object to world space
+        glm::vec4 objectSpacePlanes[6], //!< [out] normalized frustum planes in object space
+        glm::vec3 &objectSpaceViewerPosition //!< [out] the camera position in object space
+    ) const;
+
+    //! Create a new Surface object from processed mesh data and load its textures
+    /// \return the new surface
+    std::shared_ptr<Surface> createSurface(
+        const CachedSurface &mesh //!< [in] the processed mesh data
+    );
+
+    //! Copy the diffuse textures of the given surfaces into texture arrays, one per distinct size, format and mip level count.
+
+    //! The surfaces then sample their diffuse texture from a layer of an array,
+    //! so surfaces of the same array are drawn without binding another texture,
+    //! and the individual textures are released.
+    void buildTextureArrays(
+        const std::vector<std::shared_ptr<Surface>> &meshSurfaces //!< [in] the surfaces of each mesh of the model
+    );
+
+    //! Get the path of the assimp aiMesh texture of given type.
+    /// \return the path relative to the working directory, empty if the material has no such texture
+    std::string getMaterialTexturePath(
         aiMaterial *mat, //!< [in] the assimp mesh material
         aiTextureType type //!< [in] the assimp texture type
     );
+
+    //! Load the texture of given path.
+
+    //! Textures of same filePath are shared with all other geometry and subsystems via the ResourceManager.
+    //! \return a pointer to the texture, nullptr if the path is empty
+    std::shared_ptr<Texture> loadTexture(
+        const std::string &filePath //!< [in] the path of the texture file
+    );
 };
 
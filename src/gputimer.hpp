@@ -0,0 +1,119 @@
+#pragma once
+
+#include <GL/glew.h>
+
+
+/// GpuTimer class.
+/// Measures the gpu time of a sequence of gl commands with GL_TIME_ELAPSED queries.
+/// Results are read a few frames later from a ring of queries, so measuring never stalls the pipeline.
+/// Note that GL_TIME_ELAPSED queries must not be nested, so timed ranges must not overlap.
+class GpuTimer
+{
+	static const int QUERY_COUNT = 4;
+
+	GLuint queries[QUERY_COUNT];
+	bool issued[QUERY_COUNT];
+	int current = 0;
+
+	float averageMs = 0;
+	float lastMs = 0;
+	bool hasResult = false;
+
+	/// read the oldest query of the ring if its result is available
+	void readResult();
+
+public:
+	GpuTimer();
+	~GpuTimer();
+
+	/// start timing the following gl commands
+	void begin();
+
+	/// stop timing, the result becomes available a few frames later
+	void end();
+
+	/// discard the accumulated average, e.g. after the timed work changed
+	void reset();
+
+	/// \return the exponential moving average of the measured times in milliseconds
+	float getAverageMs() const;
+
+	/// \return the most recent measured time in milliseconds
+	float getLastMs() const;
+
+	/// \return whether any measurement has completed since the last reset
+	bool hasMeasurement() const;
+};
+
+
+inline GpuTimer::GpuTimer()
+{
+	glGenQueries(QUERY_COUNT, queries);
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		issued[i] = false;
+	}
+}
+
+inline GpuTimer::~GpuTimer()
+{
+	glDeleteQueries(QUERY_COUNT, queries);
+}
+
+inline void GpuTimer::begin()
+{
+	glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+}
+
+inline void GpuTimer::end()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	issued[current] = true;
+	current = (current + 1) % QUERY_COUNT;
+
+	// the next query in the ring is the oldest one
+	readResult();
+}
+
+inline void GpuTimer::readResult()
+{
+	if (!issued[current]) {
+		return;
+	}
+
+	GLint available = 0;
+	glGetQueryObjectiv(queries[current], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		return; // the query is reused anyway, its result is lost
+	}
+
+	GLuint64 elapsedNs = 0;
+	glGetQueryObjectui64v(queries[current], GL_QUERY_RESULT, &elapsedNs);
+	issued[current] = false;
+
+	lastMs = float(elapsedNs) * 1e-6f;
+	// smooth over roughly the last 20 measurements
+	averageMs = hasResult ? averageMs + 0.05f * (lastMs - averageMs) : lastMs;
+	hasResult = true;
+}
+
+inline void GpuTimer::reset()
+{
+	hasResult = false;
+	averageMs = 0;
+	lastMs = 0;
+}
+
+inline float GpuTimer::getAverageMs() const
+{
+	return averageMs;
+}
+
+inline float GpuTimer::getLastMs() const
+{
+	return lastMs;
+}
+
+inline bool GpuTimer::hasMeasurement() const
+{
+	return hasResult;
+}
@@ -0,0 +1,127 @@
+#include "hizbuffer.h"
+
+#include <algorithm>
+
+// work group size of the downsample compute shader, see hiz_downsample.comp
+static const int DOWNSAMPLE_GROUP_SIZE = 8;
+
+// texture unit the occluder depth is read from while building the pyramid,
+// chosen above the units used by the scene shaders, so their textures stay bound
+static const int DEPTH_TEXTURE_UNIT = 3;
+
+HiZBuffer::HiZBuffer(int width_, int height_)
+{
+    downsampleShader = new Shader("shaders/hiz_downsample.comp");
+    setupFramebuffers(width_, height_);
+}
+
+HiZBuffer::~HiZBuffer()
+{
+    deleteFramebuffers();
+    delete downsampleShader; downsampleShader = nullptr;
+}
+
+void HiZBuffer::deleteFramebuffers()
+{
+    if (fbo) glDeleteFramebuffers(1, &fbo);
+    if (depthTexture) glDeleteTextures(1, &depthTexture);
+    if (pyramidTexture) glDeleteTextures(1, &pyramidTexture);
+    fbo = depthTexture = pyramidTexture = 0;
+}
+
+void HiZBuffer::setupFramebuffers(int width_, int height_)
+{
+    deleteFramebuffers();
+
+    width = std::max(width_, 1);
+    height = std::max(height_, 1);
+
+    // number of mip levels down to 1x1
+    levelCount = 1;
+    while ((std::max(width, height) >> levelCount) > 0) {
+        ++levelCount;
+    }
+
+    // OCCLUDER DEPTH PREPASS TARGET
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR in HiZBuffer: Occluder depth framebuffer not complete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // MAX DEPTH PYRAMID
+    // immutable storage is required to bind single mip levels as images
+    glGenTextures(1, &pyramidTexture);
+    glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, GL_R32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void HiZBuffer::bindOccluderFramebuffer()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void HiZBuffer::buildPyramid()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    downsampleShader->useShader();
+
+    glActiveTexture(GL_TEXTURE0 + DEPTH_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glUniform1i(downsampleShader->getUniformLocation("depthTexture"), DEPTH_TEXTURE_UNIT);
+    GLint copyDepthLocation = downsampleShader->getUniformLocation("copyDepth");
+    GLint srcSizeLocation = downsampleShader->getUniformLocation("srcSize");
+    GLint dstSizeLocation = downsampleShader->getUniformLocation("dstSize");
+
+    for (int level = 0; level < levelCount; ++level) {
+
+        int dstWidth = std::max(width >> level, 1);
+        int dstHeight = std::max(height >> level, 1);
+
+        // level 0 is a copy of the occluder depth, every further level reduces the one above
+        if (level == 0) {
+            glUniform1i(copyDepthLocation, true);
+            glBindImageTexture(0, pyramidTexture, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F); // unused
+            glUniform2i(srcSizeLocation, width, height);
+        }
+        else {
+            glUniform1i(copyDepthLocation, false);
+            glBindImageTexture(0, pyramidTexture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glUniform2i(srcSizeLocation, std::max(width >> (level - 1), 1), std::max(height >> (level - 1), 1));
+
+            // wait for the previous level to be written
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+        glBindImageTexture(1, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glUniform2i(dstSizeLocation, dstWidth, dstHeight);
+
+        glDispatchCompute((dstWidth + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE,
+                          (dstHeight + DOWNSAMPLE_GROUP_SIZE - 1) / DOWNSAMPLE_GROUP_SIZE, 1);
+    }
+
+    // the pyramid is read with texel fetches by the culling compute shader
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <iostream>
+
+#include <GL/glew.h>
+
+#include "shader.h"
+
+
+/**
+ * @brief A HiZBuffer holds a hierarchical depth pyramid used for occlusion culling.
+ *
+ * The depth of a set of large occluders is rendered into a low resolution depth prepass,
+ * which is then reduced into a mip chain where each texel stores the maximum (farthest) depth
+ * of the texels it covers in the level below. A bounding volume is occluded if its nearest depth
+ * lies behind the pyramid depth of all texels its screen rectangle overlaps.
+ * Since a mip level is chosen where the rectangle spans at most 2x2 texels, the test needs only 4 fetches.
+ */
+class HiZBuffer
+{
+public:
+
+    //! Create the depth prepass framebuffer and pyramid of the given base resolution.
+    HiZBuffer(int width, int height);
+    ~HiZBuffer();
+
+    //! (Re)create the framebuffer and pyramid textures, e.g. when the window is resized.
+    void setupFramebuffers(int width, int height);
+
+    //! Bind the occluder depth framebuffer, set the viewport to its size and clear it.
+    //! Color writes are not needed, only the depth of the occluders is rendered.
+    void bindOccluderFramebuffer();
+
+    //! Reduce the occluder depth into the max depth pyramid.
+    //! The caller has to restore its framebuffer and viewport afterwards.
+    void buildPyramid();
+
+    //! \return the R32F texture storing the max depth pyramid in its mip levels
+    inline GLuint getPyramidTexture() const { return pyramidTexture; }
+
+    inline int getWidth() const { return width; }
+    inline int getHeight() const { return height; }
+    inline int getLevelCount() const { return levelCount; }
+
+private:
+
+    int width = 0, height = 0;
+    int levelCount = 0;
+
+    GLuint fbo = 0;
+    GLuint depthTexture = 0;
+    GLuint pyramidTexture = 0;
+
+    Shader *downsampleShader;
+
+    //! Delete the framebuffer and textures if they exist.
+    void deleteFramebuffers();
+};
@@ -0,0 +1,174 @@
+#include "instancedgeometry.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+int InstancedGeometry::drawnInstanceCount = 0;
+int InstancedGeometry::culledInstanceCount = 0;
+
+const int InstancedGeometry::GRID_CELLS_PER_AXIS;
+
+InstancedGeometry::InstancedGeometry(const std::string &filePath, const std::vector<glm::mat4> &instanceMatrices)
+    : Geometry(glm::mat4(1.0f), filePath)
+    , boundingSphereCenter(0)
+    , boundingSphereRadius(0)
+{
+    // bounding sphere of the whole model, such that instances are culled as a whole
+    for (size_t i = 0; i < surfaces.size(); ++i) {
+        const glm::mat4 &surfaceMatrix = getSurfaceMatrix(i);
+        glm::vec3 center = (surfaceMatrix * glm::vec4(surfaces[i]->getBoundingSphereCenter(), 1)).xyz;
+        float radius = glm::length((surfaceMatrix * glm::vec4(surfaces[i]->getBoundingSphereFarthestPoint(), 1)).xyz() - center);
+        if (i == 0) {
+            boundingSphereCenter = center;
+            boundingSphereRadius = radius;
+        }
+        else {
+            mergeBoundingSpheres(boundingSphereCenter, boundingSphereRadius, center, radius);
+        }
+    }
+
+    // one batch per level of detail of each surface in each grid cell
+    batchesPerCell = 0;
+    for (const auto &surface : surfaces) {
+        surfaceBatchOffsets.push_back(batchesPerCell);
+        batchesPerCell += surface->getLodCount();
+    }
+    batches.resize(GRID_CELLS_PER_AXIS * GRID_CELLS_PER_AXIS * batchesPerCell);
+
+    setInstances(instanceMatrices);
+}
+
+InstancedGeometry::~InstancedGeometry()
+{}
+
+void InstancedGeometry::setInstances(const std::vector<glm::mat4> &instanceMatrices)
+{
+    instances.resize(instanceMatrices.size());
+    instanceCenters.resize(instanceMatrices.size());
+    instanceRadii.resize(instanceMatrices.size());
+
+    for (size_t i = 0; i < instanceMatrices.size(); ++i) {
+        const glm::mat4 &matrix = instanceMatrices[i];
+        instances[i].modelMatrix = matrix;
+        instances[i].normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(matrix))));
+
+        // the radius grows with the largest scale factor of the instance
+        float maxScale = std::max(glm::length(glm::vec3(matrix[0])), std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+        instanceCenters[i] = (matrix * glm::vec4(boundingSphereCenter, 1)).xyz;
+        instanceRadii[i] = boundingSphereRadius * maxScale;
+    }
+
+    // assign each instance to the grid cell of its center
+    glm::vec2 gridMin(0), gridMax(0);
+    for (size_t i = 0; i < instanceCenters.size(); ++i) {
+        glm::vec2 position(instanceCenters[i].x, instanceCenters[i].z);
+        gridMin = i == 0 ? position : glm::min(gridMin, position);
+        gridMax = i == 0 ? position : glm::max(gridMax, position);
+    }
+    glm::vec2 cellSize = glm::max((gridMax - gridMin) / float(GRID_CELLS_PER_AXIS), glm::vec2(1e-6f));
+
+    instanceCells.resize(instanceCenters.size());
+    for (size_t i = 0; i < instanceCenters.size(); ++i) {
+        int cellX = std::min(int((instanceCenters[i].x - gridMin.x) / cellSize.x), GRID_CELLS_PER_AXIS - 1);
+        int cellZ = std::min(int((instanceCenters[i].z - gridMin.y) / cellSize.y), GRID_CELLS_PER_AXIS - 1);
+        instanceCells[i] = cellZ * GRID_CELLS_PER_AXIS + cellX;
+    }
+}
+
+size_t InstancedGeometry::getInstanceCount() const
+{
+    return instances.size();
+}
+
+void InstancedGeometry::draw(Shader *shader, Camera *camera, bool useFrustumCulling, Texture::FilterType filterType, const glm::mat4 &viewMat)
+{
+    for (const InstanceData &instance : instances) {
+        setTransform(instance.modelMatrix);
+        Geometry::draw(shader, camera, useFrustumCulling, filterType, viewMat);
+    }
+    setTransform(glm::mat4(1.0f));
+}
+
+void InstancedGeometry::submit(RenderQueue *queue, Camera *camera, bool useFrustumCulling, const glm::mat4 &viewMat,
+                               const OcclusionRasterizer *occlusionRasterizer)
+{
+    updateSurfaceMatrices();
+
+    glm::vec4 frustumPlanes[6];
+    camera->getFrustumPlanes(viewMat, frustumPlanes);
+
+    for (InstanceBatch &batch : batches) {
+        batch.instances.clear();
+    }
+
+    float lodScale = std::exp2(-queue->getLodBias()) / std::tan(camera->getFieldOfView() / 2);
+
+    for (size_t i = 0; i < instances.size(); ++i) {
+
+        const glm::vec3 &center = instanceCenters[i];
+        float radius = instanceRadii[i];
+
+        // view frustum culling of the instance, in world space since each instance has its own transform
+        if (useFrustumCulling) {
+            bool inFrustum = true;
+            for (int p = 0; p < 6 && inFrustum; ++p) {
+                inFrustum = glm::dot(frustumPlanes[p].xyz(), center) + frustumPlanes[p].w >= -radius;
+            }
+            if (!inFrustum) {
+                culledInstanceCount += 1;
+                continue;
+            }
+        }
+
+        // occlusion culling against the occluder depth rasterized on the cpu
+        if (occlusionRasterizer && !occlusionRasterizer->isSphereVisible(center, radius)) {
+            culledInstanceCount += 1;
+            continue;
+        }
+        drawnInstanceCount += 1;
+
+        glm::vec3 viewSpaceCenter = (viewMat * glm::vec4(center, 1)).xyz;
+        float viewDepth = -viewSpaceCenter.z;
+        float projectedSize = radius / std::max(glm::length(viewSpaceCenter), radius) * lodScale;
+
+        // add the instance to the batch of its grid cell and the level of detail each surface is drawn with
+        size_t cellBatchOffset = instanceCells[i] * batchesPerCell;
+        for (size_t s = 0; s < surfaces.size(); ++s) {
+            int lod = queue->isLodEnabled() ? surfaces[s]->selectLod(projectedSize) : 0;
+            InstanceBatch &batch = batches[cellBatchOffset + surfaceBatchOffsets[s] + lod];
+
+            if (batch.instances.empty()) {
+                batch.boundingSphereCenter = center;
+                batch.boundingSphereRadius = radius;
+                batch.viewDepth = viewDepth;
+            }
+            else {
+                mergeBoundingSpheres(batch.boundingSphereCenter, batch.boundingSphereRadius, center, radius);
+                batch.viewDepth = std::min(batch.viewDepth, viewDepth);
+            }
+            batch.instances.push_back(instances[i]);
+        }
+    }
+
+    // the farthest point of a batch is placed orthogonal to the view direction, see Geometry::submit
+    glm::vec3 cameraRight = glm::vec3(viewMat[0][0], viewMat[1][0], viewMat[2][0]);
+
+    for (size_t cellBatchOffset = 0; cellBatchOffset < batches.size(); cellBatchOffset += batchesPerCell) {
+        for (size_t s = 0; s < surfaces.size(); ++s) {
+            for (int lod = 0; lod < surfaces[s]->getLodCount(); ++lod) {
+
+                const InstanceBatch &batch = batches[cellBatchOffset + surfaceBatchOffsets[s] + lod];
+                if (batch.instances.empty()) {
+                    continue;
+                }
+
+                // the instance matrices are applied after the model node matrix and the dequantization of the surface
+                GLuint baseInstance = queue->addInstances(batch.instances);
+                queue->submitInstanced(surfaces[s].get(), getSurfaceMatrix(s) * surfaces[s]->getDequantizationMatrix(), getSurfaceNormalMatrix(s),
+                                       batch.boundingSphereCenter, batch.boundingSphereCenter + cameraRight * batch.boundingSphereRadius,
+                                       batch.viewDepth, shininess, backFaceCulling, lod, baseInstance, GLuint(batch.instances.size()));
+            }
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+
+#include "geometry.h"
+
+
+/**
+ * @brief An InstancedGeometry draws the surfaces of one model at many world transforms.
+ * Each surface is drawn with one instanced draw per level of detail and cell of a coarse grid over the instance positions,
+ * reading the instance transforms from the instance data of the render queue instead of setting a model matrix per copy.
+ * The instances are culled individually against the view frustum and the occlusion rasterizer before submitting.
+ * The grid keeps the bounding sphere of each draw tight, so the gpu culling can still reject the draws of whole cells.
+ */
+class InstancedGeometry : public Geometry
+{
+public:
+    InstancedGeometry(const std::string &filePath, const std::vector<glm::mat4> &instanceMatrices);
+    virtual ~InstancedGeometry();
+
+    //! Replace the world transforms of all instances
+    void setInstances(
+        const std::vector<glm::mat4> &instanceMatrices //!< [in] the model matrix of each instance
+    );
+
+    //! \return the number of instances
+    size_t getInstanceCount() const;
+
+    //! draw all instances one by one using given shader, without instancing
+    virtual void draw(Shader *shader, Camera *camera, bool useFrustumCulling, Texture::FilterType filterType, const glm::mat4 &viewMat);
+
+    //! submit one instanced draw per grid cell, surface and level of detail for the visible instances.
+    //! if frustum culling is used, instances outside of the view frustum are not submitted.
+    virtual void submit(RenderQueue *queue, Camera *camera, bool useFrustumCulling, const glm::mat4 &viewMat,
+                        const OcclusionRasterizer *occlusionRasterizer = nullptr);
+
+    //! The number of instances submitted and culled since the last reset
+    static int drawnInstanceCount;
+    static int culledInstanceCount;
+
+private:
+    //! instances of one surface at one level of detail within one grid cell, drawn by one instanced draw
+    struct InstanceBatch
+    {
+        std::vector<InstanceData> instances;
+        glm::vec3 boundingSphereCenter; // world space, enclosing all instances of the batch
+        float boundingSphereRadius;
+        float viewDepth; // of the closest instance
+    };
+
+    std::vector<InstanceData> instances;
+
+    // world space bounding spheres of the instances, enclosing all surfaces
+    std::vector<glm::vec3> instanceCenters;
+    std::vector<float> instanceRadii;
+
+    // the instances are split by a grid of cells over the horizontal extent of their centers
+    static const int GRID_CELLS_PER_AXIS = 8;
+    std::vector<int> instanceCells;
+
+    // object space bounding sphere enclosing all surfaces
+    glm::vec3 boundingSphereCenter;
+    float boundingSphereRadius;
+
+    // batches of all grid cells, surfaces and levels of detail.
+    // the batches of a cell start at cell * batchesPerCell, followed by those of each surface at its offset
+    std::vector<InstanceBatch> batches;
+    std::vector<size_t> surfaceBatchOffsets;
+    size_t batchesPerCell;
+};
@@ -5,6 +5,7 @@
 #include <memory>
 #include <random>
 #include <ctime>
+#include <algorithm>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -18,8 +19,16 @@
 #include "sceneobject.hpp"
 #include "camera.h"
 #include "eagle.h"
+#include "instancedgeometry.h"
 #include "light.h"
 #include "textrenderer.h"
+#include "renderqueue.h"
+#include "mesharena.h"
+#include "resourcemanager.h"
+#include "texturestreamer.h"
+#include "textureuploadring.h"
+#include "hizbuffer.h"
+#include "gputimer.hpp"
 #include "effects/ssao_effect.h"
 #include "effects/water_effect.h"
 #include "effects/lightbeams_effect.h"
@@ -35,19 +44,26 @@ void shadowPrepass(glm::mat4 &lightViewPro);
 void vsmBlurPass();
 void debugShadowPass();
 void ssaoPrepass();
+void resetSSAOTimers();
+void captureSSAOModes();
 void waterPrepass();
+void resetWaterTimers();
 void lightbeamsPrepass();
+void hiZPrepass();
+bool isHiZCullingActive();
 void mainGeometryDrawPass();
 void update(float timeDelta);
 void draw();
 void setActiveShader(Shader *shader);
-void drawGeometry();
+void drawGeometry(RenderPass pass);
 void drawWater();
 void drawLightbeams();
 void drawText();
 void drawScreenFillingQuad();
 void cleanup();
 void newGame();
+void benchmarkMeshletCulling();
+void getFrameTimeStats(float &averageMs, float &maxMs, int &spikeCount);
 
 GLFWwindow *window;
 int windowWidth, windowHeight;
@@ -57,6 +73,12 @@ bool paused                     = false;
 bool debugInfoEnabled           = false;
 bool ssaoEnabled                = false;
 bool ssaoBlurEnabled            = false;
+SSAOTier ssaoTier               = SSAO_TIER_HALF;
+GLuint ssaoSampleCount          = 32;
+bool ssaoLargeRadiusChainEnabled = false;
+bool ssaoTemporalEnabled        = false;
+SSAOMode ssaoMode               = SSAO_MODE_SAMPLED;
+const GLuint SSAO_TEMPORAL_SAMPLE_COUNT = 8; // samples per pixel and frame with temporal accumulation
 bool shadowsEnabled             = true;
 bool vsmShadowsEnabled          = true;
 bool renderShadowMap            = false;
@@ -66,6 +88,22 @@ bool drawTransparent            = false;
 bool drawLightbeamsDebug        = false;
 bool drawSkyboxEnabled          = true;
 bool sunColorChangeEnabled      = true;
+bool frontToBackSortingEnabled  = true;
+bool multiDrawIndirectEnabled   = true;
+bool gpuCullingEnabled          = true;
+bool gpuCullingValidationEnabled = false;
+bool hiZCullingEnabled          = true;
+bool cpuOcclusionCullingEnabled = false;
+bool quantizedVerticesEnabled   = true; // takes effect when the meshes are loaded
+TextureCompression textureCompression = TEXTURE_COMPRESSION_BC1_BC7; // takes effect when the textures are loaded
+bool textureStreamingEnabled    = true; // takes effect when the textures are loaded
+bool pboUploadsEnabled          = true;
+bool lodEnabled                 = true;
+bool meshletCullingEnabled      = true;
+bool instancingStressSceneEnabled = false;
+bool waterAdaptiveResolutionEnabled = true;
+bool waterAlternateUpdatesEnabled = false;
+WaterReflectionMode waterReflectionMode = WATER_REFLECTION_PLANAR;
 
 Texture::FilterType textureFilterMethod = Texture::LINEAR_MIPMAP_LINEAR;
 
@@ -80,10 +118,26 @@ GLuint uboTotalSize = uboMatricesBlockSize + uboViewAndCamBlockSize;
 
 Shader *texturedBlinnPhongShader, *flatSingleColorShader;
 Shader *depthMapShader, *vsmDepthMapShader, *debugDepthShader, *blurVSMDepthShader; // shadow mapping
+Shader *hiZOccluderShader;
 Shader *activeShader;
 TextRenderer *textRenderer;
+RenderQueue *renderQueue;
+HiZBuffer *hiZBuffer;
+GpuTimer *hiZPrepassTimer, *mainPassTimer;
+float mainPassMsWithoutHiZ = 0; // last main pass gpu time measured with hi-z culling disabled
+OcclusionRasterizer *occlusionRasterizer;
+const int OCCLUSION_RASTERIZER_WIDTH = 256, OCCLUSION_RASTERIZER_HEIGHT = 128;
+const int OCCLUDER_GRID_RESOLUTION = 32;
+TextureStreamer *textureStreamer;
+const size_t TEXTURE_STREAMING_BUDGET = 32 * 1024 * 1024; // bytes of vram for the streamed mip levels of the texture arrays
+const int FRAME_TIME_HISTORY_SIZE = 240;
+std::vector<float> frameTimesMs(FRAME_TIME_HISTORY_SIZE, 0.0f); // ring buffer of the recent frame times, to find frame time spikes
+int nextFrameTime = 0;
 SSAOEffect *ssaoEffect;
+GpuTimer *ssaoTimers[SSAO_MODE_COUNT]; // each mode keeps its timing, to compare them side by side
 WaterEffect *waterEffect;
+GpuTimer *waterPrepassTimers[WATER_REFLECTION_MODE_COUNT]; // each reflection mode keeps its timings, to compare them side by side
+GpuTimer *waterDrawTimers[WATER_REFLECTION_MODE_COUNT]; // the water shading, including the capture of the main pass for screen space reflections
 LightbeamsEffect *lightbeamsEffect;
 ParticleSystem *particlesFire;
 ParticleSystem *particlesSmoke;
@@ -96,6 +150,14 @@ Geometry *island;
 Geometry *campfire;
 Geometry *ocean;
 
+// transform hierarchy of the scene objects, the campfire is placed relative to the island
+SceneGraph *sceneGraph;
+int sceneGraphUpdatedNodeCount = 0;
+
+// many campfires drawn by instancing, to stress the instanced draw path
+InstancedGeometry *instancedCampfires;
+const int STRESS_SCENE_INSTANCE_COUNT = 4000;
+
 Light *sun; // sun start and end positions are linearly interpolated over time of day
 const glm::vec3 LIGHT_START(glm::vec3(-20, 30, -100));
 const glm::vec3 LIGHT_END(glm::vec3(50, 30, -100));
@@ -206,6 +268,8 @@ int main(int argc, char **argv)
 		time = glfwGetTime(); // seconds
 		deltaT = time - lastTime;
 		lastTime = time;
+		frameTimesMs[nextFrameTime] = float(deltaT * 1000);
+		nextFrameTime = (nextFrameTime + 1) % FRAME_TIME_HISTORY_SIZE;
 
 		// print fps in window title
 		std::stringstream ss;
@@ -287,9 +351,53 @@ void init(GLFWwindow *window)
 	// INIT TEXT RENDERER
 	textRenderer = new TextRenderer("data/fonts/cliff.ttf", width, height);
 
+	// INIT RENDER QUEUE
+	renderQueue = new RenderQueue();
+	renderQueue->setMultiDrawIndirect(multiDrawIndirectEnabled);
+	if (multiDrawIndirectEnabled && !renderQueue->isMultiDrawIndirectEnabled()) {
+		std::cerr << "WARNING: ARB_shader_draw_parameters not supported, multi-draw indirect disabled" << std::endl;
+		multiDrawIndirectEnabled = false;
+	}
+	renderQueue->setGpuCulling(gpuCullingEnabled);
+	renderQueue->setGpuCullingValidation(gpuCullingValidationEnabled);
+
+	// the shadow map and the half resolution water reflection and refraction textures show less detail,
+	// so they use levels of detail as if the surfaces were half as large on screen
+	renderQueue->setLodEnabled(lodEnabled);
+	renderQueue->setLodBias(PASS_SHADOW, 1.0f);
+	renderQueue->setLodBias(PASS_REFLECTION, 1.0f);
+	renderQueue->setLodBias(PASS_REFRACTION, 1.0f);
+
+	// large surfaces are culled per meshlet in the passes drawn from the camera
+	Geometry::meshletCullingEnabled = meshletCullingEnabled;
+
+	// INIT HI-Z OCCLUSION CULLING
+	// the occluder depth is rendered at quarter resolution
+	hiZBuffer = new HiZBuffer(width / 4, height / 4);
+	hiZPrepassTimer = new GpuTimer();
+	mainPassTimer = new GpuTimer();
+
 	// INIT EFFECTS
-	ssaoEffect = new SSAOEffect(width, height, 32);
+	// textures are block compressed once and then loaded precompressed from their texture cache files
+	Texture::setCompression(textureCompression);
+	// only the coarse mip levels of compressed textures are loaded, the finer ones are streamed in as needed
+	Texture::setStreaming(textureStreamingEnabled);
+	// texels are staged in a persistently mapped pixel buffer ring, so the driver uploads them without a synchronous copy
+	if (pboUploadsEnabled) {
+		TextureUploadRing::getInstance();
+	}
+	ssaoEffect = new SSAOEffect(width, height, ssaoSampleCount, ssaoTier);
+	for (int mode = 0; mode < SSAO_MODE_COUNT; ++mode) {
+		ssaoTimers[mode] = new GpuTimer();
+	}
 	waterEffect = new WaterEffect(width, height, 0.5f, 0.8f, "data/models/water/waterDistortionDuDv.png", 0.02f, 0.03f);
+	waterEffect->setAdaptiveResolutionEnabled(waterAdaptiveResolutionEnabled);
+	waterEffect->setAlternateUpdatesEnabled(waterAlternateUpdatesEnabled);
+	waterEffect->setReflectionMode(waterReflectionMode);
+	for (int mode = 0; mode < WATER_REFLECTION_MODE_COUNT; ++mode) {
+		waterPrepassTimers[mode] = new GpuTimer();
+		waterDrawTimers[mode] = new GpuTimer();
+	}
 	lightbeamsEffect = new LightbeamsEffect(width, height);
 
 	// INIT SKYBOX
@@ -313,6 +421,7 @@ void init(GLFWwindow *window)
 	// INIT SHADERS
 	flatSingleColorShader = new Shader("shaders/flat_singlecolor.vert", "shaders/flat_singlecolor.frag");
 	texturedBlinnPhongShader = new Shader("shaders/textured_blinnphong.vert", "shaders/textured_blinnphong.frag");
+	hiZOccluderShader = new Shader("shaders/hiz_occluder.vert", "shaders/hiz_occluder.frag");
 	setActiveShader(texturedBlinnPhongShader); // non-trivial cost
 
 	// INIT UNIFORM BUFFER OBJECT
@@ -355,11 +464,66 @@ void init(GLFWwindow *window)
 	// uvAttribIndex         = 2;
 
 	// INIT WORLD + OBJECTS
+	// all meshes share the vertex buffer of the mesh arena, so its vertex layout is chosen before any mesh is loaded
+	MeshArena::setVertexFormat(quantizedVerticesEnabled ? VERTEX_FORMAT_QUANTIZED : VERTEX_FORMAT_FLOAT);
 	sun = new Light(glm::translate(glm::mat4(1.0f), LIGHT_START), "data/models/sphere.dae", LIGHT_END, dayLength, dayLength/2.0f); // start after noon have nicer sky colors at start;
 	island = new Geometry(glm::scale(glm::mat4(1.0f), glm::vec3(1, 1, 1)), "data/models/island/island.dae");
 	campfire = new Geometry(glm::translate(glm::scale(glm::mat4(1.0f), glm::vec3(1.3, 1.2, 1.3)), glm::vec3(0, 5.7f, 0)), "data/models/campfire/campfire.dae");
 	ocean = new Geometry(glm::scale(glm::mat4(1.0f), glm::vec3(1, 1, 1)), "data/models/water/water.dae");
 
+	sceneGraph = new SceneGraph();
+	sun->attachToSceneGraph(sceneGraph, SceneGraph::ROOT);
+	island->attachToSceneGraph(sceneGraph, SceneGraph::ROOT);
+	campfire->attachToSceneGraph(sceneGraph, island->getSceneNode());
+	ocean->attachToSceneGraph(sceneGraph, SceneGraph::ROOT);
+	waterEffect->setPlaneBounds(ocean->getLargestSurfacePositions());
+
+	MeshArena *meshArena = MeshArena::getInstance();
+	std::cout << "mesh arena: " << meshArena->getUsedVertexCount() << " vertices, "
+	          << meshArena->getUsedVertexCount() * meshArena->getVertexSize() / 1024 << " KB vertex memory ("
+	          << meshArena->getUsedVertexCount() * sizeof(Vertex) / 1024 << " KB unquantized)" << std::endl;
+	std::cout << "depth only passes fetch " << meshArena->getPositionSize() << " instead of "
+	          << meshArena->getVertexSize() << " bytes per vertex" << std::endl;
+
+	// we need to disable back face culling for palm leaves which are not closed meshes
+	island->setBackFaceCulling(false);
+	island->setShininess(64.f);
+	campfire->setShininess(64.f);
+
+	// INIT CPU OCCLUSION CULLING
+	// the occluder is a coarse heightfield that stays below the island ground
+	std::vector<glm::vec3> occluderPositions;
+	std::vector<uint32_t> occluderIndices;
+	OcclusionRasterizer::createHeightfieldOccluder(island->getLargestSurfacePositions(), OCCLUDER_GRID_RESOLUTION, occluderPositions, occluderIndices);
+	occlusionRasterizer = new OcclusionRasterizer(OCCLUSION_RASTERIZER_WIDTH, OCCLUSION_RASTERIZER_HEIGHT);
+	occlusionRasterizer->setOccluder(occluderPositions, occluderIndices);
+
+	// INIT INSTANCING STRESS SCENE
+	// campfires scattered over the island ground above the water, with random orientation and size
+	std::vector<glm::mat4> stressSceneInstances;
+	std::vector<glm::vec3> groundPositions = island->getLargestSurfacePositions();
+	std::mt19937 stressSceneRandom(42);
+	std::uniform_real_distribution<float> unitRandom(0.0f, 1.0f);
+	for (int i = 0; !groundPositions.empty() && i < STRESS_SCENE_INSTANCE_COUNT * 16 && int(stressSceneInstances.size()) < STRESS_SCENE_INSTANCE_COUNT; ++i) {
+		const glm::vec3 &position = groundPositions[size_t(unitRandom(stressSceneRandom) * (groundPositions.size() - 1))];
+		if (position.y < ocean->getLocation().y + 1.0f) {
+			continue;
+		}
+		glm::mat4 instance = glm::translate(glm::mat4(1.0f), position);
+		instance = glm::rotate(instance, unitRandom(stressSceneRandom) * glm::two_pi<float>(), glm::vec3(0, 1, 0));
+		instance = glm::scale(instance, glm::vec3(0.3f + 0.4f * unitRandom(stressSceneRandom)));
+		stressSceneInstances.push_back(instance);
+	}
+	instancedCampfires = new InstancedGeometry("data/models/campfire/campfire.dae", stressSceneInstances);
+	instancedCampfires->setShininess(64.f);
+	std::cout << "instancing stress scene: " << instancedCampfires->getInstanceCount() << " campfires" << std::endl;
+
+	// all textures are shared through the resource manager, so each file is loaded once
+	ResourceManager::getInstance()->printStats();
+
+	// INIT TEXTURE STREAMING
+	textureStreamer = new TextureStreamer(TEXTURE_STREAMING_BUDGET);
+
 	// INIT CAMERA
 
 	// camera bezier path to follow in FOLLOW_PATH mode
@@ -391,6 +555,9 @@ void init(GLFWwindow *window)
 
 	// INIT EAGLE
 	eagle = new Eagle(eagleInitTransform, "data/models/eagle/eagle.dae");
+	eagle->setShininess(32.f);
+	eagle->attachToSceneGraph(sceneGraph, SceneGraph::ROOT);
+	std::cout << "scene graph: " << sceneGraph->getNodeCount() << " nodes in " << sceneGraph->getDepthCount() << " levels" << std::endl;
 
 	printf("FINISHED MODEL LOADING\n");
 
@@ -492,6 +659,14 @@ void update(float timeDelta)
 
 	eagle->update(timeDelta, camera->getLocation() + glm::vec3(0, 2, 0), true, false);
 
+	// propagate the changed transforms to the world matrices of their subtrees in one pass
+	sun->updateSceneNode();
+	eagle->updateSceneNode();
+	island->updateSceneNode();
+	campfire->updateSceneNode();
+	ocean->updateSceneNode();
+	sceneGraphUpdatedNodeCount = sceneGraph->update();
+
 	particlesFire->update(timeDelta, camera->getViewMat());
 	particlesSmoke->update(timeDelta, camera->getViewMat());
 
@@ -525,6 +700,20 @@ void update(float timeDelta)
 
 void draw()
 {
+	renderQueue->resetFrameStatistics();
+	Geometry::occlusionCulledSurfaceCount = 0;
+	Geometry::testedMeshletCount = 0;
+	Geometry::frustumCulledMeshletCount = 0;
+	Geometry::backFacingMeshletCount = 0;
+	Geometry::meshletCulledTriangleCount = 0;
+
+	// rasterize the occluders on worker threads while the gpu prepasses are recorded.
+	// the passes testing against the result wait for it in drawGeometry.
+	if (cpuOcclusionCullingEnabled)
+		occlusionRasterizer->beginRender(camera->getViewMat(), camera->getProjMat());
+
+	if (isHiZCullingActive())
+		hiZPrepass();
 
 	////////////////////////////////////
 	/// PRE PASS
@@ -563,7 +752,12 @@ void draw()
 		skyboxEffect->drawSkybox(camera->getViewMat(), camera->getProjMat());
 
 	// draw geometry that depends on depth test
+	mainPassTimer->begin();
 	mainGeometryDrawPass();
+	mainPassTimer->end();
+	if (!isHiZCullingActive() && mainPassTimer->hasMeasurement()) {
+		mainPassMsWithoutHiZ = mainPassTimer->getAverageMs();
+	}
 
 	// draw screenspace effects
 	drawWater();
@@ -577,6 +771,9 @@ void draw()
 	// draw text
 	drawText();
 
+	// stream texture mip levels for the detail the surfaces of the main pass requested
+	textureStreamer->update(windowHeight);
+
 	// end the current frame (swaps the front and back buffers)
 	glfwSwapBuffers(window);
 
@@ -600,7 +797,7 @@ void shadowPrepass(glm::mat4 &lightViewPro)
 	setActiveShader(vsmDepthMapShader);
 	glUniformMatrix4fv(activeShader->getUniformLocation("lightVPMat"), 1, GL_FALSE, glm::value_ptr(lightViewPro));
 	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-	drawGeometry();
+	drawGeometry(PASS_SHADOW);
 	glGenerateMipmap(GL_TEXTURE_2D);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
@@ -621,6 +818,36 @@ void shadowPrepass(glm::mat4 &lightViewPro)
 	glViewport(0, 0, windowWidth, windowHeight);
 }
 
+bool isHiZCullingActive()
+{
+	// the hi-z test is done by the gpu culling compute shader
+	return hiZCullingEnabled && frustumCullingEnabled && gpuCullingEnabled && multiDrawIndirectEnabled;
+}
+
+void hiZPrepass()
+{
+	hiZPrepassTimer->begin();
+
+	// render the depth of the island as occluder, since its hill and palms hide most of the scene from many angles
+	hiZBuffer->bindOccluderFramebuffer();
+	setActiveShader(hiZOccluderShader);
+	renderQueue->begin(PASS_HIZ, activeShader, RenderQueue::SORT_FRONT_TO_BACK, camera->getFarPlane());
+	renderQueue->cullOnGpu(camera, camera->getViewMat());
+	island->submit(renderQueue, camera, true, camera->getViewMat());
+	renderQueue->sort();
+	renderQueue->execute(textureFilterMethod);
+
+	// reduce the occluder depth to the max depth pyramid tested by the culling in the following passes
+	hiZBuffer->buildPyramid();
+
+	hiZPrepassTimer->end();
+
+	// bind default FB and reset viewport
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+	setActiveShader(texturedBlinnPhongShader);
+}
+
 void vsmBlurPass()
 {
 	GLboolean horizontal = true;
@@ -647,37 +874,55 @@ void vsmBlurPass()
 void waterPrepass()
 {
 
+	// the passes are skipped while the water is off screen, and rendered at the resolution its screen coverage needs
+	waterEffect->updateCoverage(camera->getProjMat() * camera->getViewMat());
+	waterPrepassTimers[waterReflectionMode]->begin();
+
 	// GENERATE REFLECTION TEXTURE
 	// render all geometry above the water surface
 	// see textured blinnphong vertex shader for clipping plane format
-	waterEffect->bindReflectionFrameBuffer();
-	glClearColor(sun->getColor().x, sun->getColor().y, sun->getColor().z, 1.f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glUniform4f(activeShader->getUniformLocation("clippingPlane"), 0, -1, 0, ocean->getLocation().y); // clip all below water
-
-	// use camera to look in the reflected direction from the mirrored position under the water surface
-	glUniform2f(activeShader->getUniformLocation("useYMirroredCamera"), true, ocean->getLocation().y);
-	if (drawSkyboxEnabled)
-		skyboxEffect->drawSkybox(camera->getViewMat(), camera->getProjMat());
-	setActiveShader(texturedBlinnPhongShader);
-	drawGeometry();
-	glUniform2f(activeShader->getUniformLocation("useYMirroredCamera"), false, ocean->getLocation().y);
+	if (waterEffect->needsReflectionUpdate()) {
+		waterEffect->bindReflectionFrameBuffer();
+		glClearColor(sun->getColor().x, sun->getColor().y, sun->getColor().z, 1.f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glUniform4f(activeShader->getUniformLocation("clippingPlane"), 0, -1, 0, ocean->getLocation().y); // clip all below water
+
+		// use camera to look in the reflected direction from the mirrored position under the water surface
+		glUniform2f(activeShader->getUniformLocation("useYMirroredCamera"), true, ocean->getLocation().y);
+		if (drawSkyboxEnabled)
+			skyboxEffect->drawSkybox(camera->getViewMat(), camera->getProjMat());
+		setActiveShader(texturedBlinnPhongShader);
+		drawGeometry(PASS_REFLECTION);
+		glUniform2f(activeShader->getUniformLocation("useYMirroredCamera"), false, ocean->getLocation().y);
+	}
 
 	// GENERATE REFRACTION TEXTURE
 	// render all geometry below the water surface
-	waterEffect->bindRefractionFrameBuffer();
-	glClearColor(sun->getColor().x, sun->getColor().y, sun->getColor().z, 1.f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glUniform4f(activeShader->getUniformLocation("clippingPlane"), 0, 1, 0, -ocean->getLocation().y); // clip all above water
-	if (drawSkyboxEnabled)
-		skyboxEffect->drawSkybox(camera->getViewMat(), camera->getProjMat());
-	setActiveShader(texturedBlinnPhongShader);
-	drawGeometry();
+	if (waterEffect->needsRefractionUpdate()) {
+		waterEffect->bindRefractionFrameBuffer();
+		glClearColor(sun->getColor().x, sun->getColor().y, sun->getColor().z, 1.f);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glUniform4f(activeShader->getUniformLocation("clippingPlane"), 0, 1, 0, -ocean->getLocation().y); // clip all above water
+		if (drawSkyboxEnabled)
+			skyboxEffect->drawSkybox(camera->getViewMat(), camera->getProjMat());
+		setActiveShader(texturedBlinnPhongShader);
+		drawGeometry(PASS_REFRACTION);
+	}
 
+	waterPrepassTimers[waterReflectionMode]->end();
 	waterEffect->bindDefaultFrameBuffer();
 
 }
 
+void resetWaterTimers()
+{
+	// the timings of both reflection modes are compared, so they are discarded together when the settings change
+	for (int mode = 0; mode < WATER_REFLECTION_MODE_COUNT; ++mode) {
+		waterPrepassTimers[mode]->reset();
+		waterDrawTimers[mode]->reset();
+	}
+}
+
 void lightbeamsPrepass()
 {
 	// GENERATE OCCLUSION TEXTURE
@@ -690,7 +935,7 @@ void lightbeamsPrepass()
 	glClearColor(sun->getColor().x, sun->getColor().y, sun->getColor().z, 1.f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glUniform3f(activeShader->getUniformLocation("color"), 0.0f, 0.0f, 0.0f);
-	drawGeometry();
+	drawGeometry(PASS_OCCLUSION);
 
 	// draw light source geometry in white
 	glUniform3f(activeShader->getUniformLocation("color"), 1.0f, 1.0f, 1.0f);
@@ -704,7 +949,7 @@ void ssaoPrepass()
 {
 
 	//// SSAO PREPASS
-	//// draw ssao input data (screen colors and view space positions) to framebuffer textures
+	//// draw ssao input data (screen colors and depth) to framebuffer textures
 	ssaoEffect->bindScreenDataFramebuffer();
 
 	glClearColor(sun->getColor().x, sun->getColor().y, sun->getColor().z, 1.f);
@@ -714,21 +959,62 @@ void ssaoPrepass()
 	glUniform1i(activeShader->getUniformLocation("useSSAO"), 0);
 	glUniform1i(activeShader->getUniformLocation("useVSM"), 0);
 
-	drawGeometry();
+	drawGeometry(PASS_SSAO);
 
 	//// SSAO PASS
 	//// draw ssao output data to framebuffer texture
-	ssaoEffect->calulateSSAOValues(camera->getProjMat());
+	ssaoTimers[ssaoMode]->begin();
+	ssaoEffect->calulateSSAOValues(camera->getProjMat(), camera->getViewMat());
 
 	//// SSAO BLUR PASS
 	if (ssaoBlurEnabled)
 		ssaoEffect->blurSSAOResultTexture();
+	ssaoTimers[ssaoMode]->end();
 
 	setActiveShader(texturedBlinnPhongShader);
 
 }
 
-void drawGeometry()
+void resetSSAOTimers()
+{
+	// the timings of both modes are compared, so they are discarded together when the settings change
+	for (int mode = 0; mode < SSAO_MODE_COUNT; ++mode) {
+		ssaoTimers[mode]->reset();
+	}
+}
+
+/**
+ * Save the ssao results of both modes for the current view as images, to compare their quality side by side.
+ * The ssao is recomputed from the screen data of the last frame, so the scene is not drawn again.
+ * With temporal accumulation, the history is accumulated over several computations of the still view.
+ */
+void captureSSAOModes()
+{
+	if (!ssaoEnabled) {
+		std::cout << "SSAO CAPTURE: enable ssao first" << std::endl;
+		return;
+	}
+
+	const char *modeNames[] = { "sampled", "horizon" };
+	const int TEMPORAL_CAPTURE_FRAMES = 32;
+	for (int mode = 0; mode < SSAO_MODE_COUNT; ++mode) {
+		ssaoEffect->setMode(SSAOMode(mode));
+		int frames = ssaoTemporalEnabled ? TEMPORAL_CAPTURE_FRAMES : 1;
+		for (int frame = 0; frame < frames; ++frame) {
+			ssaoEffect->calulateSSAOValues(camera->getProjMat(), camera->getViewMat());
+		}
+		if (ssaoBlurEnabled)
+			ssaoEffect->blurSSAOResultTexture();
+
+		std::string filePath = std::string("ssao_") + modeNames[mode] + ".png";
+		if (ssaoEffect->saveResultImage(filePath)) {
+			std::cout << "SSAO CAPTURE: saved " << filePath << ", gpu " << ssaoTimers[mode]->getAverageMs() << " ms per frame" << std::endl;
+		}
+	}
+	ssaoEffect->setMode(ssaoMode);
+}
+
+void drawGeometry(RenderPass pass)
 {
 
 	//////////////////////////////////////////////////
@@ -736,6 +1022,8 @@ void drawGeometry()
 	//////////////////////////////////////////////////
 
 	Geometry::drawnSurfaceCount = 0;
+	InstancedGeometry::drawnInstanceCount = 0;
+	InstancedGeometry::culledInstanceCount = 0;
 
 	if (drawWireframe)
 		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); // enable wireframe
@@ -743,16 +1031,37 @@ void drawGeometry()
 	glUniform1f(activeShader->getUniformLocation("drawTransparent"), drawTransparent);
 	glUniform3f(activeShader->getUniformLocation("material.specular"), 0.2f, 0.2f, 0.2f);
 
-	// we need to disable back face culling for palm leaves which are not closed meshes
-	glDisable(GL_CULL_FACE);
-	glUniform1f(activeShader->getUniformLocation("material.shininess"), 64.f);
-	island->draw(activeShader, camera, frustumCullingEnabled, textureFilterMethod, camera->getViewMat());
-	glEnable(GL_CULL_FACE);
+	// opaque geometry is drawn front to back in passes with expensive fragment shading to maximize early-z rejection.
+	// the depth only passes (shadow, occlusion) have trivial fragment shaders and are sorted to minimize state changes.
+	RenderQueue::SortMode sortMode = RenderQueue::SORT_BY_STATE;
+	if (frontToBackSortingEnabled && pass != PASS_SHADOW && pass != PASS_OCCLUSION) {
+		sortMode = RenderQueue::SORT_FRONT_TO_BACK;
+	}
 
-	campfire->draw(activeShader, camera, frustumCullingEnabled, textureFilterMethod, camera->getViewMat());
+	// collect visible surfaces, sort them by their render keys and draw them
+	renderQueue->begin(pass, activeShader, sortMode, camera->getFarPlane());
+	if (frustumCullingEnabled) {
+		// only applies if gpu culling and multi-draw indirect are enabled.
+		// the hi-z pyramid is built from the unmirrored camera, so it is only valid for the passes drawn from that view.
+		bool useHiZ = isHiZCullingActive() && (pass == PASS_MAIN || pass == PASS_SSAO);
+		renderQueue->cullOnGpu(camera, camera->getViewMat(), useHiZ ? hiZBuffer : nullptr);
+	}
 
-	glUniform1f(activeShader->getUniformLocation("material.shininess"), 32.f);
-	eagle->draw(activeShader, camera, frustumCullingEnabled, textureFilterMethod, camera->getViewMat());
+	// the occlusion rasterizer renders from the unmirrored camera, so it is only valid for the passes drawn from that view
+	OcclusionRasterizer *occlusionCuller = nullptr;
+	if (cpuOcclusionCullingEnabled && (pass == PASS_MAIN || pass == PASS_SSAO)) {
+		occlusionRasterizer->waitForRender();
+		occlusionCuller = occlusionRasterizer;
+	}
+
+	island->submit(renderQueue, camera, frustumCullingEnabled, camera->getViewMat(), occlusionCuller);
+	campfire->submit(renderQueue, camera, frustumCullingEnabled, camera->getViewMat(), occlusionCuller);
+	eagle->submit(renderQueue, camera, frustumCullingEnabled, camera->getViewMat(), occlusionCuller);
+	if (instancingStressSceneEnabled) {
+		instancedCampfires->submit(renderQueue, camera, frustumCullingEnabled, camera->getViewMat(), occlusionCuller);
+	}
+	renderQueue->sort();
+	renderQueue->execute(textureFilterMethod);
 
 	if (drawWireframe)
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); // disable wireframe
@@ -762,9 +1071,22 @@ void drawGeometry()
 
 void drawWater()
 {
+	if (!waterEffect->isVisible())
+		return;
+
+	waterDrawTimers[waterReflectionMode]->begin();
+
+	// screen space reflections are traced in the main pass drawn so far, missing rays sample the sky
+	if (waterReflectionMode == WATER_REFLECTION_SCREEN_SPACE) {
+		waterEffect->setSky(skyboxEffect->getCubemap(), drawSkyboxEnabled, sun->getColor());
+		waterEffect->captureMainPass();
+	}
+
 	Shader *waterShader = waterEffect->setupWaterShader();
 	ocean->draw(waterShader, camera, frustumCullingEnabled, textureFilterMethod, camera->getViewMat());
 	waterShader = nullptr;
+
+	waterDrawTimers[waterReflectionMode]->end();
 }
 
 void drawLightbeams()
@@ -793,10 +1115,74 @@ void drawText()
 		int startY = 400;
 		int deltaY = 20;
 		float fontSize = 0.35f;
-		textRenderer->renderText("drawn surface count: " + std::to_string(Geometry::drawnSurfaceCount), 25, startY+2*deltaY, fontSize, glm::vec3(0.2));
+		textRenderer->renderText("render queue sorting: " + std::string(frontToBackSortingEnabled ? "front to back" : "by state") + ", submission: " + std::string(multiDrawIndirectEnabled ? "multi-draw indirect" : "direct"), 25, startY+0*deltaY, fontSize, glm::vec3(0.2));
+		textRenderer->renderText("draw calls: " + std::to_string(renderQueue->getDrawCallCount()) + ", state changes: " + std::to_string(renderQueue->getStateChangeCount()), 25, startY+1*deltaY, fontSize, glm::vec3(0.2));
+		if (frustumCullingEnabled && gpuCullingEnabled && multiDrawIndirectEnabled) {
+			std::string visibleCount = gpuCullingValidationEnabled ? std::to_string(renderQueue->getGpuVisibleCount()) + " visible, " + std::to_string(renderQueue->getGpuCullingMismatchCount()) + " mismatches" : "visible count needs validation";
+			textRenderer->renderText("gpu culled surface count: " + std::to_string(Geometry::drawnSurfaceCount) + " submitted, " + visibleCount, 25, startY+2*deltaY, fontSize, glm::vec3(0.2));
+		}
+		else {
+			textRenderer->renderText("drawn surface count: " + std::to_string(Geometry::drawnSurfaceCount), 25, startY+2*deltaY, fontSize, glm::vec3(0.2));
+		}
 		textRenderer->renderText("delta time: " + std::to_string(int(deltaT*1000 + 0.5)) + " ms", 25, startY+3*deltaY, fontSize, glm::vec3(0.2));
 		textRenderer->renderText("fps: " + std::to_string(int(1/deltaT + 0.5)), 25, startY+4*deltaY, fontSize, glm::vec3(0.2));
 
+		if (cpuOcclusionCullingEnabled) {
+			textRenderer->renderText("cpu occlusion culled: " + std::to_string(Geometry::occlusionCulledSurfaceCount) + " (main and ssao pass), raster time: " + std::to_string(occlusionRasterizer->getRenderTimeMs()) + " ms for " + std::to_string(occlusionRasterizer->getOccluderTriangleCount()) + " triangles at " + std::to_string(OCCLUSION_RASTERIZER_WIDTH) + "x" + std::to_string(OCCLUSION_RASTERIZER_HEIGHT), 25, startY-3*deltaY, fontSize, glm::vec3(0.2));
+		}
+
+		if (lodEnabled) {
+			// triangles saved by the levels of detail, relative to drawing all submitted surfaces at full resolution
+			std::string lodSavings = "lod triangles saved:";
+			const RenderPass lodPasses[] = { PASS_SHADOW, PASS_REFLECTION, PASS_REFRACTION, PASS_MAIN };
+			const char *lodPassNames[] = { "shadow", "reflection", "refraction", "main" };
+			for (int i = 0; i < 4; ++i) {
+				int fullDetail = renderQueue->getFullDetailTriangleCount(lodPasses[i]);
+				int saved = fullDetail - renderQueue->getTriangleCount(lodPasses[i]);
+				lodSavings += std::string(" ") + lodPassNames[i] + " " + std::to_string(saved) + " (" + std::to_string(fullDetail > 0 ? 100 * saved / fullDetail : 0) + "%)";
+			}
+			textRenderer->renderText(lodSavings, 25, startY-4*deltaY, fontSize, glm::vec3(0.2));
+		}
+
+		if (meshletCullingEnabled) {
+			textRenderer->renderText("meshlets culled: " + std::to_string(Geometry::frustumCulledMeshletCount) + " frustum, " + std::to_string(Geometry::backFacingMeshletCount) + " back facing of " + std::to_string(Geometry::testedMeshletCount) + ", " + std::to_string(Geometry::meshletCulledTriangleCount) + " triangles (camera passes)", 25, startY-5*deltaY, fontSize, glm::vec3(0.2));
+		}
+
+		if (instancingStressSceneEnabled) {
+			textRenderer->renderText("instanced campfires: " + std::to_string(InstancedGeometry::drawnInstanceCount) + " drawn, " + std::to_string(InstancedGeometry::culledInstanceCount) + " culled of " + std::to_string(instancedCampfires->getInstanceCount()) + " (main pass)", 25, startY-6*deltaY, fontSize, glm::vec3(0.2));
+		}
+
+		textRenderer->renderText("scene graph: " + std::to_string(sceneGraphUpdatedNodeCount) + " of " + std::to_string(sceneGraph->getNodeCount()) + " world matrices updated", 25, startY-7*deltaY, fontSize, glm::vec3(0.2));
+
+		ResourceManager *resourceManager = ResourceManager::getInstance();
+		textRenderer->renderText("resources: " + std::to_string(resourceManager->getResourceCount()) + " textures, " + std::to_string(resourceManager->getVramSize() / 1024) + " KB, " + std::to_string(resourceManager->getHitCount()) + " shared, " + std::to_string(resourceManager->getMissCount()) + " created", 25, startY-8*deltaY, fontSize, glm::vec3(0.2));
+
+		if (textureStreamingEnabled) {
+			textRenderer->renderText("texture streaming: " + std::to_string(textureStreamer->getResidentSize() / 1024) + " of " + std::to_string(textureStreamer->getBudget() / 1024) + " KB resident, " + std::to_string(textureStreamer->getPendingCount()) + " pending, bias " + std::to_string(textureStreamer->getBudgetBias()) + ", latency " + std::to_string(textureStreamer->getAverageLatencyMs()) + " ms avg " + std::to_string(textureStreamer->getMaxLatencyMs()) + " ms max", 25, startY-9*deltaY, fontSize, glm::vec3(0.2));
+		}
+
+		float frameAverageMs, frameMaxMs;
+		int frameSpikeCount;
+		getFrameTimeStats(frameAverageMs, frameMaxMs, frameSpikeCount);
+		std::string uploads = TextureUploadRing::hasInstance() ? "pbo ring, " + std::to_string(TextureUploadRing::getInstance()->getInFlightCount()) + " in flight, " + std::to_string(TextureUploadRing::getInstance()->getStallCount()) + " stalls, " + std::to_string(textureStreamer->getDeferredUploadCount()) + " deferred" : "direct";
+		textRenderer->renderText("frame time (last " + std::to_string(FRAME_TIME_HISTORY_SIZE) + "): " + std::to_string(frameAverageMs) + " ms avg, " + std::to_string(frameMaxMs) + " ms max, " + std::to_string(frameSpikeCount) + " spikes; texture uploads: " + std::to_string(textureStreamer->getMaxUploadMs()) + " ms max per frame (" + uploads + ")", 25, startY-10*deltaY, fontSize, glm::vec3(0.2));
+
+		if (ssaoEnabled) {
+			const char *ssaoTierNames[] = { "full", "half", "quarter" };
+			std::string samples = ssaoMode == SSAO_MODE_SAMPLED ? "sampled, " + std::to_string(ssaoEffect->getSampleCount()) + " samples" : "horizon";
+			textRenderer->renderText("ssao: " + samples + ", " + std::string(ssaoTierNames[ssaoEffect->getTier()]) + " resolution " + std::to_string(ssaoEffect->getSSAOWidth()) + "x" + std::to_string(ssaoEffect->getSSAOHeight()) + ", gpu: sampled " + std::to_string(ssaoTimers[SSAO_MODE_SAMPLED]->getAverageMs()) + " ms, horizon " + std::to_string(ssaoTimers[SSAO_MODE_HORIZON]->getAverageMs()) + " ms" + (ssaoBlurEnabled ? " (with blur)" : "") + (ssaoLargeRadiusChainEnabled ? ", depth chain for large radii" : "") + (ssaoTemporalEnabled ? ", temporal, " + std::to_string(int(100 * ssaoEffect->getHistoryRejectionRate())) + "% history rejected" : ""), 25, startY-11*deltaY, fontSize, glm::vec3(0.2));
+		}
+
+		glm::ivec2 reflectionSize = waterEffect->getReflectionViewportSize(), refractionSize = waterEffect->getRefractionViewportSize();
+		int waterPassCount = int(waterEffect->needsReflectionUpdate()) + int(waterEffect->needsRefractionUpdate());
+		textRenderer->renderText("water: " + std::to_string(int(100 * waterEffect->getCoverage())) + "% of screen, reflection " + std::to_string(reflectionSize.x) + "x" + std::to_string(reflectionSize.y) + ", refraction " + std::to_string(refractionSize.x) + "x" + std::to_string(refractionSize.y) + ", " + std::to_string(waterPassCount) + " of 2 passes" + (waterAlternateUpdatesEnabled ? " (alternating)" : "") + ", gpu: planar " + std::to_string(waterPrepassTimers[WATER_REFLECTION_PLANAR]->getAverageMs() + waterDrawTimers[WATER_REFLECTION_PLANAR]->getAverageMs()) + " ms, screen space " + std::to_string(waterPrepassTimers[WATER_REFLECTION_SCREEN_SPACE]->getAverageMs() + waterDrawTimers[WATER_REFLECTION_SCREEN_SPACE]->getAverageMs()) + " ms" + (waterReflectionMode == WATER_REFLECTION_SCREEN_SPACE ? " (screen space reflections)" : ""), 25, startY-12*deltaY, fontSize, glm::vec3(0.2));
+
+		if (isHiZCullingActive()) {
+			textRenderer->renderText("hi-z occlusion culled: " + std::to_string(renderQueue->getGpuOcclusionCulledCount()) + ", frustum culled: " + std::to_string(renderQueue->getGpuFrustumCulledCount()) + " (all passes)", 25, startY-1*deltaY, fontSize, glm::vec3(0.2));
+			std::string withoutHiZ = mainPassMsWithoutHiZ > 0 ? std::to_string(mainPassMsWithoutHiZ) + " ms" : "not measured";
+			textRenderer->renderText("main pass gpu: " + std::to_string(mainPassTimer->getAverageMs()) + " ms (without hi-z: " + withoutHiZ + "), hi-z prepass gpu: " + std::to_string(hiZPrepassTimer->getAverageMs()) + " ms", 25, startY-2*deltaY, fontSize, glm::vec3(0.2));
+		}
+
 		if (!paused) {
 			textRenderer->renderText("time until end of day: " + std::to_string(int(dayLength - glfwGetTime())), 25.0f, startY+6*deltaY, fontSize, glm::vec3(0.2));
 		}
@@ -822,7 +1208,7 @@ void mainGeometryDrawPass()
 	glUniform4f(activeShader->getUniformLocation("clippingPlane"), 0.0f, 0.0f, 0.0f, 0.0f); // no clipping
 
 	ssaoEffect->bindSSAOResultTexture(activeShader->getUniformLocation("ssaoTexture"), 2); // tex location 2 of blinn phong shader
-	drawGeometry();
+	drawGeometry(PASS_MAIN);
 
 	// draw light source geometry
 	setActiveShader(flatSingleColorShader);
@@ -892,6 +1278,7 @@ void newGame()
 
 	delete sun;
 	sun = new Light(glm::translate(glm::mat4(1.0f), LIGHT_START), "data/models/sphere.dae", LIGHT_END, dayLength, 0.0f);
+	sun->attachToSceneGraph(sceneGraph, SceneGraph::ROOT);
 
 	// RESET CAMERA
 	camera->setTransform(cameraInitTransform);
@@ -905,6 +1292,61 @@ void newGame()
 	paused = false;
 }
 
+void benchmarkMeshletCulling()
+{
+	// compare culling whole surfaces and culling meshlets of the island from viewpoints along the camera path,
+	// looking at the target of the path like the camera in FOLLOW_PATH mode
+	const int SAMPLES_PER_SEGMENT = 4;
+	int totalSurfaceTriangles = 0, totalMeshletTriangles = 0;
+	double totalMs = 0;
+
+	std::cout << "MESHLET CULLING BENCHMARK (island, full resolution triangles in view)" << std::endl;
+	const std::vector<std::vector<glm::vec3>> &path = camera->getPath();
+	for (size_t segment = 0; segment < path.size(); ++segment) {
+		for (int sample = 0; sample < SAMPLES_PER_SEGMENT; ++sample) {
+			float t = float(sample) / SAMPLES_PER_SEGMENT;
+			glm::vec3 position = glm::mix(glm::mix(path[segment][0], path[segment][1], t), glm::mix(path[segment][1], path[segment][2], t), t);
+			glm::mat4 viewMat = glm::lookAt(position, camera->getTargetLookAtPos(), glm::vec3(0, 1, 0));
+
+			int surfaceTriangles = 0, meshletTriangles = 0;
+			double startTime = glfwGetTime();
+			island->measureMeshletCulling(camera, viewMat, surfaceTriangles, meshletTriangles);
+			double ms = (glfwGetTime() - startTime) * 1000.0;
+
+			totalSurfaceTriangles += surfaceTriangles;
+			totalMeshletTriangles += meshletTriangles;
+			totalMs += ms;
+			std::cout << "segment " << segment << " t " << t << ": surfaces " << surfaceTriangles << ", meshlets " << meshletTriangles
+			          << " triangles (" << (surfaceTriangles > 0 ? 100 * (surfaceTriangles - meshletTriangles) / surfaceTriangles : 0) << "% culled), "
+			          << ms << " ms" << std::endl;
+		}
+	}
+
+	if (totalSurfaceTriangles > 0) {
+		std::cout << "total: meshlet culling removes " << 100.0 * (totalSurfaceTriangles - totalMeshletTriangles) / totalSurfaceTriangles
+		          << "% of the triangles left by surface culling, " << totalMs / (path.size() * SAMPLES_PER_SEGMENT) << " ms per view" << std::endl;
+	}
+}
+
+/**
+ * @brief measure the frame time spikes over the recent frames.
+ * a spike is a frame taking more than twice the median frame time, e.g. when a frame waits for a texture upload.
+ */
+void getFrameTimeStats(float &averageMs, float &maxMs, int &spikeCount)
+{
+	std::vector<float> sortedTimes(frameTimesMs);
+	std::nth_element(sortedTimes.begin(), sortedTimes.begin() + FRAME_TIME_HISTORY_SIZE / 2, sortedTimes.end());
+	float medianMs = sortedTimes[FRAME_TIME_HISTORY_SIZE / 2];
+
+	averageMs = 0;
+	maxMs = 0;
+	spikeCount = 0;
+	for (float frameTimeMs : frameTimesMs) {
+		averageMs += frameTimeMs / FRAME_TIME_HISTORY_SIZE;
+		maxMs = std::max(maxMs, frameTimeMs);
+		spikeCount += frameTimeMs > 2 * medianMs ? 1 : 0;
+	}
+}
 
 void cleanup()
 {
@@ -914,10 +1356,24 @@ void cleanup()
 	delete debugDepthShader;
 	delete vsmDepthMapShader;
 	delete blurVSMDepthShader;
+	delete hiZOccluderShader;
 
 	delete textRenderer;
+	delete renderQueue;
+	delete occlusionRasterizer;
+	delete textureStreamer;
+	delete hiZBuffer;
+	delete hiZPrepassTimer;
+	delete mainPassTimer;
 	delete ssaoEffect;
+	for (int mode = 0; mode < SSAO_MODE_COUNT; ++mode) {
+		delete ssaoTimers[mode];
+	}
 	delete waterEffect;
+	for (int mode = 0; mode < WATER_REFLECTION_MODE_COUNT; ++mode) {
+		delete waterPrepassTimers[mode];
+		delete waterDrawTimers[mode];
+	}
 	delete lightbeamsEffect;
 	delete particlesFire;
 	delete particlesSmoke;
@@ -927,7 +1383,16 @@ void cleanup()
 	delete eagle;
 	delete island;
 	delete campfire;
+	delete instancedCampfires;
 	delete ocean;
+	delete sun;
+	delete sceneGraph;
+
+	MeshArena::destroyInstance();
+	TextureUploadRing::destroyInstance();
+
+	// reports any texture that is still owned after all objects were deleted
+	ResourceManager::destroyInstance();
 }
 
 
@@ -944,6 +1409,8 @@ void frameBufferResize(GLFWwindow *window, int width, int height)
 	windowHeight = height;
 	glViewport(0, 0, windowWidth, windowHeight);
 	ssaoEffect->setupFramebuffers(windowWidth, windowHeight);
+	waterEffect->setupFramebuffers(windowWidth, windowHeight);
+	hiZBuffer->setupFramebuffers(windowWidth / 4, windowHeight / 4);
 }
 
 
@@ -1112,6 +1579,230 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
 			std::cout << "DEBUG DRAW SHADOW MAP DISABLED" << std::endl;
 		}
 	}
+
+	if (glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS) {
+		frontToBackSortingEnabled = !frontToBackSortingEnabled;
+		if (frontToBackSortingEnabled) {
+			std::cout << "FRONT TO BACK SORTING ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "FRONT TO BACK SORTING DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
+		renderQueue->setMultiDrawIndirect(!multiDrawIndirectEnabled);
+		multiDrawIndirectEnabled = renderQueue->isMultiDrawIndirectEnabled();
+		if (multiDrawIndirectEnabled) {
+			std::cout << "MULTI-DRAW INDIRECT ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "MULTI-DRAW INDIRECT DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
+		gpuCullingEnabled = !gpuCullingEnabled;
+		renderQueue->setGpuCulling(gpuCullingEnabled);
+		if (gpuCullingEnabled) {
+			std::cout << "GPU CULLING ENABLED (requires frustum culling and multi-draw indirect)" << std::endl;
+		}
+		else {
+			std::cout << "GPU CULLING DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) {
+		gpuCullingValidationEnabled = !gpuCullingValidationEnabled;
+		renderQueue->setGpuCullingValidation(gpuCullingValidationEnabled);
+		if (gpuCullingValidationEnabled) {
+			std::cout << "GPU CULLING VALIDATION ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "GPU CULLING VALIDATION DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) {
+		hiZCullingEnabled = !hiZCullingEnabled;
+		mainPassTimer->reset(); // compare the main pass time with and without hi-z separately
+		if (hiZCullingEnabled) {
+			std::cout << "HI-Z OCCLUSION CULLING ENABLED (requires gpu culling)" << std::endl;
+		}
+		else {
+			std::cout << "HI-Z OCCLUSION CULLING DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS) {
+		cpuOcclusionCullingEnabled = !cpuOcclusionCullingEnabled;
+		if (cpuOcclusionCullingEnabled) {
+			std::cout << "CPU OCCLUSION CULLING ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "CPU OCCLUSION CULLING DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS) {
+		OcclusionRasterizer::benchmark(island->getLargestSurfacePositions(), camera->getViewMat(), camera->getProjMat());
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS) {
+		lodEnabled = !lodEnabled;
+		renderQueue->setLodEnabled(lodEnabled);
+		if (lodEnabled) {
+			std::cout << "LEVEL OF DETAIL ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "LEVEL OF DETAIL DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS) {
+		meshletCullingEnabled = !meshletCullingEnabled;
+		Geometry::meshletCullingEnabled = meshletCullingEnabled;
+		if (meshletCullingEnabled) {
+			std::cout << "MESHLET CULLING ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "MESHLET CULLING DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS) {
+		benchmarkMeshletCulling();
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS) {
+		instancingStressSceneEnabled = !instancingStressSceneEnabled;
+		if (instancingStressSceneEnabled) {
+			std::cout << "INSTANCING STRESS SCENE ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "INSTANCING STRESS SCENE DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
+		// cycle through the full, half and quarter resolution tiers
+		ssaoTier = SSAOTier((ssaoTier + 1) % 3);
+		ssaoEffect->setTier(ssaoTier);
+		resetSSAOTimers();
+		const char *ssaoTierNames[] = { "FULL", "HALF", "QUARTER" };
+		std::cout << "SSAO TIER " << ssaoTierNames[ssaoTier] << " RESOLUTION" << std::endl;
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
+		// cycle through 8, 16, 32, 64 and 128 samples per pixel
+		ssaoSampleCount = ssaoSampleCount >= SSAOEffect::MAX_SAMPLES ? 8 : ssaoSampleCount * 2;
+		ssaoEffect->setSampleCount(ssaoSampleCount);
+		resetSSAOTimers();
+		std::cout << "SSAO SAMPLES " << ssaoSampleCount << std::endl;
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
+		ssaoLargeRadiusChainEnabled = !ssaoLargeRadiusChainEnabled;
+		ssaoEffect->setLargeRadiusChainEnabled(ssaoLargeRadiusChainEnabled);
+		resetSSAOTimers();
+		if (ssaoLargeRadiusChainEnabled) {
+			std::cout << "SSAO DEPTH CHAIN FOR LARGE RADII ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "SSAO DEPTH CHAIN FOR LARGE RADII DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS) {
+		// temporal accumulation reaches the quality of many samples with few samples per frame,
+		// so the sample count is switched along to compare the cost at similar quality
+		ssaoTemporalEnabled = !ssaoTemporalEnabled;
+		ssaoEffect->setTemporalEnabled(ssaoTemporalEnabled);
+		ssaoSampleCount = ssaoTemporalEnabled ? SSAO_TEMPORAL_SAMPLE_COUNT : 32;
+		ssaoEffect->setSampleCount(ssaoSampleCount);
+		resetSSAOTimers();
+		if (ssaoTemporalEnabled) {
+			std::cout << "SSAO TEMPORAL ACCUMULATION ENABLED, " << ssaoSampleCount << " SAMPLES" << std::endl;
+		}
+		else {
+			std::cout << "SSAO TEMPORAL ACCUMULATION DISABLED, " << ssaoSampleCount << " SAMPLES" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) {
+		// the timer of each mode keeps running only while it is active, so both timings stay visible
+		ssaoMode = SSAOMode((ssaoMode + 1) % SSAO_MODE_COUNT);
+		ssaoEffect->setMode(ssaoMode);
+		if (ssaoMode == SSAO_MODE_HORIZON) {
+			std::cout << "SSAO HORIZON MODE (GTAO COMPUTE)" << std::endl;
+		}
+		else {
+			std::cout << "SSAO SAMPLED MODE" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
+		captureSSAOModes();
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS) {
+		waterAdaptiveResolutionEnabled = !waterAdaptiveResolutionEnabled;
+		waterEffect->setAdaptiveResolutionEnabled(waterAdaptiveResolutionEnabled);
+		resetWaterTimers();
+		if (waterAdaptiveResolutionEnabled) {
+			std::cout << "WATER ADAPTIVE RESOLUTION ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "WATER ADAPTIVE RESOLUTION DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS) {
+		waterAlternateUpdatesEnabled = !waterAlternateUpdatesEnabled;
+		waterEffect->setAlternateUpdatesEnabled(waterAlternateUpdatesEnabled);
+		resetWaterTimers();
+		if (waterAlternateUpdatesEnabled) {
+			std::cout << "WATER ALTERNATE REFLECTION AND REFRACTION UPDATES ENABLED" << std::endl;
+		}
+		else {
+			std::cout << "WATER ALTERNATE REFLECTION AND REFRACTION UPDATES DISABLED" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS) {
+		// report the timing of the mode used so far, the other mode keeps its timing to compare both
+		std::cout << (waterReflectionMode == WATER_REFLECTION_PLANAR ? "planar" : "screen space") << " water reflections: gpu "
+		          << waterPrepassTimers[waterReflectionMode]->getAverageMs() + waterDrawTimers[waterReflectionMode]->getAverageMs() << " ms per frame" << std::endl;
+
+		waterReflectionMode = WaterReflectionMode((waterReflectionMode + 1) % WATER_REFLECTION_MODE_COUNT);
+		waterEffect->setReflectionMode(waterReflectionMode);
+		if (waterReflectionMode == WATER_REFLECTION_SCREEN_SPACE) {
+			std::cout << "WATER SCREEN SPACE REFLECTIONS" << std::endl;
+		}
+		else {
+			std::cout << "WATER PLANAR REFLECTIONS" << std::endl;
+		}
+	}
+
+	if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) {
+		// report the frame times of the upload path used so far, to compare the spikes of both paths
+		float frameAverageMs, frameMaxMs;
+		int frameSpikeCount;
+		getFrameTimeStats(frameAverageMs, frameMaxMs, frameSpikeCount);
+		std::cout << "last " << FRAME_TIME_HISTORY_SIZE << " frames with " << (pboUploadsEnabled ? "pbo ring" : "direct") << " texture uploads: "
+		          << frameAverageMs << " ms avg, " << frameMaxMs << " ms max, " << frameSpikeCount << " spikes, "
+		          << textureStreamer->getMaxUploadMs() << " ms max upload time per frame" << std::endl;
+
+		pboUploadsEnabled = !pboUploadsEnabled;
+		if (pboUploadsEnabled) {
+			TextureUploadRing::getInstance();
+			std::cout << "PBO TEXTURE UPLOADS ENABLED" << std::endl;
+		}
+		else {
+			TextureUploadRing::destroyInstance();
+			std::cout << "PBO TEXTURE UPLOADS DISABLED" << std::endl;
+		}
+	}
 }
 
 void setActiveShader(Shader *shader)
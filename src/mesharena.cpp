@@ -0,0 +1,352 @@
+#include "mesharena.h"
+
+#include <algorithm>
+
+MeshArena *MeshArena::instance = nullptr;
+VertexFormat MeshArena::instanceVertexFormat = VERTEX_FORMAT_FLOAT;
+
+// initial capacities, the buffers grow on demand
+static const GLuint INITIAL_VERTEX_CAPACITY = 256 * 1024;
+static const GLuint INITIAL_INDEX_CAPACITY  = 1024 * 1024;
+
+MeshArena *MeshArena::getInstance()
+{
+    if (!instance) {
+        instance = new MeshArena(instanceVertexFormat, INITIAL_VERTEX_CAPACITY, INITIAL_INDEX_CAPACITY);
+    }
+    return instance;
+}
+
+bool MeshArena::hasInstance()
+{
+    return instance != nullptr;
+}
+
+void MeshArena::destroyInstance()
+{
+    delete instance;
+    instance = nullptr;
+}
+
+void MeshArena::setVertexFormat(VertexFormat format)
+{
+    if (instance && instance->vertexFormat != format) {
+        std::cerr << "ERROR: the vertex format of the mesh arena cannot change after meshes were allocated." << std::endl;
+        return;
+    }
+    instanceVertexFormat = format;
+}
+
+MeshArena::MeshArena(VertexFormat vertexFormat_, GLuint vertexCapacity_, GLuint indexCapacity_)
+    : vertexFormat(vertexFormat_)
+    , vertexSize(vertexFormat_ == VERTEX_FORMAT_QUANTIZED ? sizeof(QuantizedVertex) : sizeof(Vertex))
+    , positionSize(vertexFormat_ == VERTEX_FORMAT_QUANTIZED ? sizeof(QuantizedVertex::position) : sizeof(glm::vec3))
+    , vertexCapacity(vertexCapacity_)
+    , indexCapacity(indexCapacity_)
+{
+    glGenVertexArrays(1, &vao);
+    glGenVertexArrays(1, &depthOnlyVao);
+
+    // allocate vram without assigning data, meshes are copied in on allocation
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexCapacity * vertexSize, NULL, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &positionBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexCapacity * positionSize, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    setupVertexArrays();
+
+    Block vertexBlock = { 0, vertexCapacity };
+    Block indexBlock = { 0, indexCapacity };
+    freeVertexBlocks.push_back(vertexBlock);
+    freeIndexBlocks.push_back(indexBlock);
+}
+
+MeshArena::~MeshArena()
+{
+    // delete buffers (free vram)
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &positionBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+
+    glDeleteVertexArrays(1, &vao);
+    glDeleteVertexArrays(1, &depthOnlyVao);
+}
+
+void MeshArena::setupVertexArrays()
+{
+    // the vao stores the buffer bindings and attribute formats, so binding it
+    // is all that is needed to draw any mesh of the arena.
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    // enable shader attributes at given indices to supply vertex data to them
+    // the indices/layout of the shader attribute are defined in the shader source file
+    GLint positionAttribIndex   = 0;
+    GLint normalAttribIndex     = 1;
+    GLint uvAttribIndex         = 2;
+    glEnableVertexAttribArray(positionAttribIndex);
+    glEnableVertexAttribArray(normalAttribIndex);
+    glEnableVertexAttribArray(uvAttribIndex);
+
+    // attrib index in shader, num elements, type, normalized?, vertex attrib array size, offset within the array
+    if (vertexFormat == VERTEX_FORMAT_QUANTIZED) {
+        // the shaders still read vec3 positions and normals and vec2 uvs, the conversion happens in the vertex fetch.
+        // positions arrive in [0,1] of the surface bounding box and are transformed to object space by the model matrix.
+        glVertexAttribPointer(positionAttribIndex, 3, GL_UNSIGNED_SHORT, GL_TRUE, vertexSize, (GLvoid*)offsetof(QuantizedVertex, position));
+        glVertexAttribPointer(normalAttribIndex, 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexSize, (GLvoid*)offsetof(QuantizedVertex, normal));
+        glVertexAttribPointer(uvAttribIndex, 2, GL_HALF_FLOAT, GL_FALSE, vertexSize, (GLvoid*)offsetof(QuantizedVertex, uv));
+    }
+    else {
+        glVertexAttribPointer(positionAttribIndex, 3, GL_FLOAT, GL_FALSE, vertexSize, (GLvoid*)0);
+        glVertexAttribPointer(normalAttribIndex, 3, GL_FLOAT, GL_FALSE, vertexSize, (GLvoid*)offsetof(Vertex, normal));
+        glVertexAttribPointer(uvAttribIndex, 2, GL_FLOAT, GL_FALSE, vertexSize, (GLvoid*)offsetof(Vertex, uv));
+    }
+
+    // the depth only vao reads the same indices, but only positions from the tightly packed position stream
+    glBindVertexArray(depthOnlyVao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    glEnableVertexAttribArray(positionAttribIndex);
+    if (vertexFormat == VERTEX_FORMAT_QUANTIZED) {
+        glVertexAttribPointer(positionAttribIndex, 3, GL_UNSIGNED_SHORT, GL_TRUE, positionSize, (GLvoid*)0);
+    }
+    else {
+        glVertexAttribPointer(positionAttribIndex, 3, GL_FLOAT, GL_FALSE, positionSize, (GLvoid*)0);
+    }
+
+    // unbind vao before the element buffer, otherwise the vao would forget it
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+int MeshArena::allocate(const void *vertexData, const void *positionData, GLuint vertexCount, const std::vector<GLuint> &indices)
+{
+    GLuint indexCount = indices.size();
+
+    // grow the buffers if the mesh does not fit into a free block.
+    // compacting first may already free a large enough block at the end.
+    GLuint vertexOffset, indexOffset;
+    if (!allocateBlock(freeVertexBlocks, vertexCount, vertexOffset) || !allocateBlock(freeIndexBlocks, indexCount, indexOffset)) {
+
+        // the compacting reallocation below rebuilds the free lists from the live allocations,
+        // which also returns a vertex block that may have been taken above.
+
+        GLuint newVertexCapacity = vertexCapacity, newIndexCapacity = indexCapacity;
+        while (newVertexCapacity < usedVertexCount + vertexCount) newVertexCapacity *= 2;
+        while (newIndexCapacity < usedIndexCount + indexCount) newIndexCapacity *= 2;
+
+        reallocateBuffers(newVertexCapacity, newIndexCapacity, true);
+
+        allocateBlock(freeVertexBlocks, vertexCount, vertexOffset);
+        allocateBlock(freeIndexBlocks, indexCount, indexOffset);
+    }
+
+    // copy data to the allocated ranges in vram
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * vertexSize, vertexCount * vertexSize, vertexData);
+    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, vertexOffset * positionSize, vertexCount * positionSize, positionData);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indexOffset * sizeof(GLuint), indexCount * sizeof(GLuint), indices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    usedVertexCount += vertexCount;
+    usedIndexCount += indexCount;
+
+    Allocation allocation;
+    allocation.range.baseVertex = vertexOffset;
+    allocation.range.firstIndex = indexOffset;
+    allocation.range.vertexCount = vertexCount;
+    allocation.range.indexCount = indexCount;
+    allocation.used = true;
+
+    if (!unusedAllocationIds.empty()) {
+        int id = unusedAllocationIds.back();
+        unusedAllocationIds.pop_back();
+        allocations[id] = allocation;
+        return id;
+    }
+
+    allocations.push_back(allocation);
+    return allocations.size() - 1;
+}
+
+void MeshArena::free(int allocationId)
+{
+    Allocation &allocation = allocations[allocationId];
+    if (!allocation.used) {
+        return;
+    }
+
+    releaseBlock(freeVertexBlocks, allocation.range.baseVertex, allocation.range.vertexCount);
+    releaseBlock(freeIndexBlocks, allocation.range.firstIndex, allocation.range.indexCount);
+
+    usedVertexCount -= allocation.range.vertexCount;
+    usedIndexCount -= allocation.range.indexCount;
+
+    allocation.used = false;
+    unusedAllocationIds.push_back(allocationId);
+
+    // compact once a quarter of the vertex buffer is lost in holes between allocations
+    if (getFragmentedVertexCount() > vertexCapacity / 4) {
+        compact();
+    }
+}
+
+void MeshArena::compact()
+{
+    reallocateBuffers(vertexCapacity, indexCapacity, true);
+}
+
+bool MeshArena::allocateBlock(std::vector<Block> &freeBlocks, GLuint size, GLuint &offset)
+{
+    // first fit
+    for (size_t i = 0; i < freeBlocks.size(); ++i) {
+        if (freeBlocks[i].size >= size) {
+            offset = freeBlocks[i].offset;
+            freeBlocks[i].offset += size;
+            freeBlocks[i].size -= size;
+            if (freeBlocks[i].size == 0) {
+                freeBlocks.erase(freeBlocks.begin() + i);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void MeshArena::releaseBlock(std::vector<Block> &freeBlocks, GLuint offset, GLuint size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    // insert sorted by offset
+    size_t i = 0;
+    while (i < freeBlocks.size() && freeBlocks[i].offset < offset) ++i;
+    Block block = { offset, size };
+    freeBlocks.insert(freeBlocks.begin() + i, block);
+
+    // merge with next and previous block if adjacent
+    if (i + 1 < freeBlocks.size() && freeBlocks[i].offset + freeBlocks[i].size == freeBlocks[i+1].offset) {
+        freeBlocks[i].size += freeBlocks[i+1].size;
+        freeBlocks.erase(freeBlocks.begin() + i + 1);
+    }
+    if (i > 0 && freeBlocks[i-1].offset + freeBlocks[i-1].size == freeBlocks[i].offset) {
+        freeBlocks[i-1].size += freeBlocks[i].size;
+        freeBlocks.erase(freeBlocks.begin() + i);
+    }
+}
+
+GLuint MeshArena::getFragmentedVertexCount() const
+{
+    // all free blocks except one reaching the end of the buffer are holes
+    GLuint fragmented = 0;
+    for (size_t i = 0; i < freeVertexBlocks.size(); ++i) {
+        if (freeVertexBlocks[i].offset + freeVertexBlocks[i].size != vertexCapacity) {
+            fragmented += freeVertexBlocks[i].size;
+        }
+    }
+    return fragmented;
+}
+
+void MeshArena::reallocateBuffers(GLuint newVertexCapacity, GLuint newIndexCapacity, bool compactRanges)
+{
+    GLuint newVertexBuffer, newIndexBuffer;
+
+    glGenBuffers(1, &newVertexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newVertexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newVertexCapacity * vertexSize, NULL, GL_STATIC_DRAW);
+
+    GLuint newPositionBuffer;
+    glGenBuffers(1, &newPositionBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newPositionBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newVertexCapacity * positionSize, NULL, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &newIndexBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newIndexBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newIndexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+
+    // copy the live ranges gpu side. indices are relative to the base vertex,
+    // so they stay valid when a mesh moves within the buffers.
+    GLuint vertexEnd = 0, indexEnd = 0;
+    for (size_t i = 0; i < allocations.size(); ++i) {
+
+        if (!allocations[i].used) {
+            continue;
+        }
+        MeshRange &range = allocations[i].range;
+
+        GLuint newBaseVertex = compactRanges ? vertexEnd : range.baseVertex;
+        GLuint newFirstIndex = compactRanges ? indexEnd : range.firstIndex;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, vertexBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newVertexBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            range.baseVertex * vertexSize, newBaseVertex * vertexSize, range.vertexCount * vertexSize);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, positionBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newPositionBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            range.baseVertex * positionSize, newBaseVertex * positionSize, range.vertexCount * positionSize);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, indexBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newIndexBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            range.firstIndex * sizeof(GLuint), newFirstIndex * sizeof(GLuint), range.indexCount * sizeof(GLuint));
+
+        range.baseVertex = newBaseVertex;
+        range.firstIndex = newFirstIndex;
+        vertexEnd = std::max(vertexEnd, newBaseVertex + range.vertexCount);
+        indexEnd = std::max(indexEnd, newFirstIndex + range.indexCount);
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &positionBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+    vertexBuffer = newVertexBuffer;
+    positionBuffer = newPositionBuffer;
+    indexBuffer = newIndexBuffer;
+
+    // rebuild the free lists from the live ranges
+    if (compactRanges) {
+        freeVertexBlocks.clear();
+        freeIndexBlocks.clear();
+        Block vertexBlock = { vertexEnd, newVertexCapacity - vertexEnd };
+        Block indexBlock = { indexEnd, newIndexCapacity - indexEnd };
+        if (vertexBlock.size > 0) freeVertexBlocks.push_back(vertexBlock);
+        if (indexBlock.size > 0) freeIndexBlocks.push_back(indexBlock);
+    }
+    else {
+        releaseBlock(freeVertexBlocks, vertexCapacity, newVertexCapacity - vertexCapacity);
+        releaseBlock(freeIndexBlocks, indexCapacity, newIndexCapacity - indexCapacity);
+    }
+
+    vertexCapacity = newVertexCapacity;
+    indexCapacity = newIndexCapacity;
+
+    // the vaos still point at the old buffers
+    setupVertexArrays();
+
+    std::cout << "mesh arena reallocated: " << usedVertexCount << "/" << vertexCapacity << " vertices, "
+              << usedIndexCount << "/" << indexCapacity << " indices." << std::endl;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <stddef.h>
+
+#include <GL/glew.h>
+
+#include "vertex.h"
+
+
+//! The location of a mesh within the shared buffers of a MeshArena.
+struct MeshRange
+{
+    GLint baseVertex;   //!< offset added to each index, i.e. first vertex of the mesh
+    GLuint firstIndex;  //!< first index of the mesh in the shared index buffer
+    GLuint vertexCount;
+    GLuint indexCount;
+};
+
+/**
+ * @brief A MeshArena sub-allocates the vertex and index data of all static meshes
+ * from one large vertex buffer and one large index buffer, which are bound by a single shared vao.
+ * Meshes are drawn with glDrawElementsBaseVertex, so switching between meshes needs no vao switch.
+ * The positions are additionally stored as a separate tightly packed stream, bound by a depth only vao.
+ *
+ * Allocations are referred to by a stable id, since their ranges may move when the buffers
+ * are compacted to close the holes left behind by freed meshes.
+ */
+class MeshArena
+{
+public:
+
+    //! Get the arena shared by all surfaces, created on first use.
+    //! Requires an active opengl context.
+    static MeshArena *getInstance();
+
+    //! Whether the shared arena currently exists
+    static bool hasInstance();
+
+    //! Delete the shared arena and free its vram. Must be called before the opengl context is destroyed.
+    static void destroyInstance();
+
+    //! Set the layout of the vertices in vram. Only takes effect before the shared arena is created,
+    //! since all meshes of the arena are drawn through the same vao.
+    static void setVertexFormat(VertexFormat format);
+
+    //! Copy mesh data to the shared buffers, growing them if needed.
+    /// \return the id of the allocation
+    int allocate(
+        const void *vertexData, //!< [in] the vertices of the mesh, in the vertex format of the arena
+        const void *positionData, //!< [in] only the positions of the vertices, tightly packed in the position format of the arena
+        GLuint vertexCount, //!< [in] the number of vertices
+        const std::vector<GLuint> &indices //!< [in] the indices of the mesh, relative to its first vertex
+    );
+
+    //! Release the buffer ranges of an allocation, so they may be reused by other meshes.
+    void free(int allocationId);
+
+    //! Move all allocations to the start of the buffers, closing the holes between them.
+    void compact();
+
+    //! \return the vertex array object binding the shared buffers
+    inline GLuint getVAO() const { return vao; }
+
+    //! \return the vertex array object binding only the position stream, for passes that need no other attributes
+    inline GLuint getDepthOnlyVAO() const { return depthOnlyVao; }
+
+    //! \return the current buffer ranges of the given allocation
+    inline const MeshRange &getRange(int allocationId) const { return allocations[allocationId].range; }
+
+    //! \return the number of vertices stored in live allocations
+    inline GLuint getUsedVertexCount() const { return usedVertexCount; }
+
+    //! \return the number of vertices the vertex buffer can hold
+    inline GLuint getVertexCapacity() const { return vertexCapacity; }
+
+    //! \return the layout of the vertices in vram
+    inline VertexFormat getVertexFormat() const { return vertexFormat; }
+
+    //! \return the size of a vertex in vram in bytes
+    inline GLuint getVertexSize() const { return vertexSize; }
+
+    //! \return the size of a position in the position stream in bytes
+    inline GLuint getPositionSize() const { return positionSize; }
+
+private:
+
+    MeshArena(VertexFormat vertexFormat_, GLuint vertexCapacity_, GLuint indexCapacity_);
+    ~MeshArena();
+
+    static MeshArena *instance;
+    static VertexFormat instanceVertexFormat;
+
+    //! a contiguous range of free buffer elements
+    struct Block
+    {
+        GLuint offset;
+        GLuint size;
+    };
+
+    struct Allocation
+    {
+        MeshRange range;
+        bool used;
+    };
+
+    std::vector<Allocation> allocations;
+    std::vector<int> unusedAllocationIds; // freed ids to recycle
+
+    // free lists of the vertex and index buffers, sorted by offset
+    std::vector<Block> freeVertexBlocks;
+    std::vector<Block> freeIndexBlocks;
+
+    VertexFormat vertexFormat;
+    GLuint vertexSize;
+    GLuint positionSize;
+
+    GLuint vao;
+    GLuint vertexBuffer, indexBuffer;
+
+    // copy of the vertex positions parallel to the vertex buffer, so depth only passes
+    // fetch only the bytes they use. it shares the vertex offsets and the index buffer.
+    GLuint depthOnlyVao;
+    GLuint positionBuffer;
+    GLuint vertexCapacity, indexCapacity;
+    GLuint usedVertexCount = 0, usedIndexCount = 0;
+
+    //! Find the first free block that fits and take the requested size from it.
+    /// \return whether a block was found
+    bool allocateBlock(std::vector<Block> &freeBlocks, GLuint size, GLuint &offset);
+
+    //! Return a range to the free list, merging it with adjacent free blocks.
+    void releaseBlock(std::vector<Block> &freeBlocks, GLuint offset, GLuint size);
+
+    //! Replace the buffers by new ones of given capacity.
+    //! if compactRanges is set, the live allocations are packed to the start of the new buffers,
+    //! otherwise they keep their offsets.
+    void reallocateBuffers(GLuint newVertexCapacity, GLuint newIndexCapacity, bool compactRanges);
+
+    //! Associate the shared buffers with the shader attributes in the vaos.
+    void setupVertexArrays();
+
+    //! \return the number of free elements that lie in holes between allocations
+    GLuint getFragmentedVertexCount() const;
+};
@@ -0,0 +1,174 @@
+#include "meshcache.h"
+
+#include <fstream>
+#include <iostream>
+
+#include "binarycache.h"
+
+namespace MeshCache
+{
+
+using namespace BinaryCache;
+
+static const char MAGIC[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+
+template <typename T>
+static void writeArray(std::ofstream &file, const std::vector<T> &values)
+{
+    writeValue(file, uint64_t(values.size()));
+    if (!values.empty()) {
+        file.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+}
+
+template <typename T>
+static bool readArray(std::ifstream &file, std::vector<T> &values)
+{
+    uint64_t count;
+    if (!readValue(file, count)) {
+        return false;
+    }
+    values.resize(size_t(count));
+    return count == 0 || bool(file.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(T)));
+}
+
+static void writeString(std::ofstream &file, const std::string &value)
+{
+    writeArray(file, std::vector<char>(value.begin(), value.end()));
+}
+
+static bool readString(std::ifstream &file, std::string &value)
+{
+    std::vector<char> characters;
+    if (!readArray(file, characters)) {
+        return false;
+    }
+    value.assign(characters.begin(), characters.end());
+    return true;
+}
+
+static void writeLods(std::ofstream &file, const CachedSurface &surface)
+{
+    writeValue(file, uint64_t(surface.lodIndices.size()));
+    for (const std::vector<GLuint> &lod : surface.lodIndices) {
+        writeArray(file, lod);
+    }
+    writeArray(file, surface.lodErrors);
+}
+
+static bool readLods(std::ifstream &file, CachedSurface &surface)
+{
+    uint64_t lodCount;
+    if (!readValue(file, lodCount)) {
+        return false;
+    }
+    surface.lodIndices.resize(size_t(lodCount));
+    for (std::vector<GLuint> &lod : surface.lodIndices) {
+        if (!readArray(file, lod)) {
+            return false;
+        }
+    }
+    return readArray(file, surface.lodErrors) && surface.lodErrors.size() == surface.lodIndices.size();
+}
+
+std::string getCachePath(const std::string &modelPath)
+{
+    return modelPath + ".meshcache";
+}
+
+bool load(const std::string &modelPath, std::vector<CachedSurface> &surfaces, std::vector<CachedNode> &nodes)
+{
+    SourceStamp sourceStamp;
+    if (!getSourceStamp(modelPath, sourceStamp)) {
+        return false;
+    }
+
+    std::ifstream file(getCachePath(modelPath), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    if (!readHeader(file, MAGIC, VERSION, sourceStamp)) {
+        std::cout << "mesh cache " << getCachePath(modelPath) << " is outdated." << std::endl;
+        return false;
+    }
+
+    uint64_t surfaceCount;
+    if (!readValue(file, surfaceCount)) {
+        return false;
+    }
+
+    std::vector<CachedSurface> loadedSurfaces;
+    loadedSurfaces.resize(size_t(surfaceCount));
+    for (CachedSurface &surface : loadedSurfaces) {
+        if (!readArray(file, surface.vertices) || !readArray(file, surface.indices)
+                || !readString(file, surface.texturePathDiffuse) || !readString(file, surface.texturePathSpecular)
+                || !readString(file, surface.texturePathNormal)
+                || !readValue(file, surface.acmrBefore) || !readValue(file, surface.acmrAfter)
+                || !readValue(file, surface.overdrawBefore) || !readValue(file, surface.overdrawAfter)
+                || !readLods(file, surface) || !readArray(file, surface.meshlets)) {
+            std::cerr << "ERROR: mesh cache " << getCachePath(modelPath) << " is truncated." << std::endl;
+            return false;
+        }
+    }
+
+    uint64_t nodeCount;
+    if (!readValue(file, nodeCount)) {
+        return false;
+    }
+
+    std::vector<CachedNode> loadedNodes;
+    loadedNodes.resize(size_t(nodeCount));
+    for (CachedNode &node : loadedNodes) {
+        if (!readValue(file, node.parent) || !readValue(file, node.transform) || !readArray(file, node.surfaces)) {
+            std::cerr << "ERROR: mesh cache " << getCachePath(modelPath) << " is truncated." << std::endl;
+            return false;
+        }
+    }
+
+    surfaces.swap(loadedSurfaces);
+    nodes.swap(loadedNodes);
+    return true;
+}
+
+bool save(const std::string &modelPath, const std::vector<CachedSurface> &surfaces, const std::vector<CachedNode> &nodes)
+{
+    SourceStamp sourceStamp;
+    if (!getSourceStamp(modelPath, sourceStamp)) {
+        return false;
+    }
+
+    std::ofstream file(getCachePath(modelPath), std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "ERROR: could not write mesh cache " << getCachePath(modelPath) << std::endl;
+        return false;
+    }
+
+    writeHeader(file, MAGIC, VERSION, sourceStamp);
+    writeValue(file, uint64_t(surfaces.size()));
+
+    for (const CachedSurface &surface : surfaces) {
+        writeArray(file, surface.vertices);
+        writeArray(file, surface.indices);
+        writeString(file, surface.texturePathDiffuse);
+        writeString(file, surface.texturePathSpecular);
+        writeString(file, surface.texturePathNormal);
+        writeValue(file, surface.acmrBefore);
+        writeValue(file, surface.acmrAfter);
+        writeValue(file, surface.overdrawBefore);
+        writeValue(file, surface.overdrawAfter);
+        writeLods(file, surface);
+        writeArray(file, surface.meshlets);
+    }
+
+    writeValue(file, uint64_t(nodes.size()));
+    for (const CachedNode &node : nodes) {
+        writeValue(file, node.parent);
+        writeValue(file, node.transform);
+        writeArray(file, node.surfaces);
+    }
+
+    return bool(file);
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include "vertex.h"
+#include "meshoptimize.h"
+
+
+//! The processed mesh data of a surface as stored in the mesh cache.
+struct CachedSurface
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+
+    // simplified levels of detail indexing the same vertices, from fine to coarse, without the full resolution level 0
+    std::vector<std::vector<GLuint>> lodIndices;
+    std::vector<float> lodErrors; // largest distance a surface moved in each level
+
+    // clusters of the full resolution indices for culling parts of the surface, empty for small surfaces
+    std::vector<Meshlet> meshlets;
+
+    // paths of the first diffuse, specular and normal texture, empty if the surface has none
+    std::string texturePathDiffuse, texturePathSpecular, texturePathNormal;
+
+    // vertex pipeline metrics before and after the import time optimization
+    float acmrBefore = 0, acmrAfter = 0;
+    float overdrawBefore = 0, overdrawAfter = 0;
+};
+
+//! A node of the model hierarchy as stored in the mesh cache.
+//! The nodes are stored such that every parent precedes its children.
+struct CachedNode
+{
+    int32_t parent; // index of the parent node, -1 for the root node of the model
+    glm::mat4 transform; // relative to the parent node
+    std::vector<uint32_t> surfaces; // indices of the surfaces drawn at this node, a surface may be drawn at several nodes
+};
+
+/**
+ * @brief The MeshCache stores the surfaces and the node hierarchy of a model file after import and optimization
+ * in a binary file next to the model, so that later runs skip assimp and the mesh optimizations.
+ * A cache file is only used if it was written from a model file of the same size and modification time
+ * by the same cache version.
+ */
+namespace MeshCache
+{
+
+    //! Bump this whenever the stored data or the processing producing it changes.
+    const uint32_t VERSION = 4;
+
+    //! \return the path of the cache file belonging to the given model file
+    std::string getCachePath(const std::string &modelPath);
+
+    //! Load the cached surfaces and nodes of a model file.
+    /// \return false if there is no valid cache for the model file
+    bool load(
+        const std::string &modelPath, //!< [in] path of the model file the cache was written for
+        std::vector<CachedSurface> &surfaces, //!< [out] the cached surfaces
+        std::vector<CachedNode> &nodes //!< [out] the cached node hierarchy
+    );
+
+    //! Write the surfaces and nodes of a model file to its cache file.
+    /// \return false if the cache file could not be written
+    bool save(
+        const std::string &modelPath, //!< [in] path of the model file the surfaces were loaded from
+        const std::vector<CachedSurface> &surfaces, //!< [in] the surfaces to cache
+        const std::vector<CachedNode> &nodes //!< [in] the node hierarchy to cache
+    );
+
+}
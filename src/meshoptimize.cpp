@@ -0,0 +1,789 @@
+#include "meshoptimize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <queue>
+#include <tuple>
+
+namespace MeshOptimize
+{
+
+// size of the vertex cache modelled by the forsyth scoring, larger than real hardware caches on purpose
+static const int FORSYTH_CACHE_SIZE = 32;
+
+// size of the fifo cache used to find cluster boundaries for the overdraw optimization
+static const int CLUSTER_CACHE_SIZE = 16;
+
+// clusters are not split further than this many triangles, to keep the reordering meaningful
+static const size_t MIN_CLUSTER_TRIANGLES = 32;
+
+// meshlets whose triangle normals spread further than this cosine from the average normal are never culled as back facing,
+// since the cone test would rarely succeed
+static const float MIN_MESHLET_CONE_DOT = 0.1f;
+
+// resolution of the depth buffer used to estimate overdraw
+static const int OVERDRAW_RESOLUTION = 256;
+
+static float forsythCacheScore(int cachePosition)
+{
+    // vertices of the last triangle get a fixed score, so that the next triangle does not reuse only them (avoids strips)
+    if (cachePosition < 0) {
+        return 0.0f;
+    }
+    if (cachePosition < 3) {
+        return 0.75f;
+    }
+    float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+    return std::pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+}
+
+static float forsythValenceScore(int valence)
+{
+    // boost vertices with few triangles left, so that no lonely triangles are left behind
+    return valence > 0 ? 2.0f * std::pow(float(valence), -0.5f) : 0.0f;
+}
+
+void optimizeVertexCache(std::vector<GLuint> &indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // precompute the scores, valences above the table size score like the largest entry
+    const int MAX_VALENCE = 64;
+    float cacheScores[FORSYTH_CACHE_SIZE + 3];
+    for (int i = 0; i < FORSYTH_CACHE_SIZE + 3; ++i) {
+        cacheScores[i] = forsythCacheScore(i < FORSYTH_CACHE_SIZE ? i : -1);
+    }
+    float valenceScores[MAX_VALENCE + 1];
+    for (int i = 0; i <= MAX_VALENCE; ++i) {
+        valenceScores[i] = forsythValenceScore(i);
+    }
+
+    // triangle adjacency of each vertex, as offsets into a single list
+    std::vector<GLuint> valence(vertexCount, 0);
+    for (GLuint index : indices) {
+        valence[index] += 1;
+    }
+    std::vector<GLuint> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        adjacencyOffsets[i + 1] = adjacencyOffsets[i] + valence[i];
+    }
+    std::vector<GLuint> adjacency(indices.size());
+    std::vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            adjacency[fill[indices[t * 3 + k]]++] = GLuint(t);
+        }
+    }
+
+    // valence now counts the triangles of a vertex that are not emitted yet
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        vertexScores[i] = valenceScores[std::min<GLuint>(valence[i], MAX_VALENCE)];
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+    }
+
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+
+    GLuint cache[FORSYTH_CACHE_SIZE + 3];
+    int cacheCount = 0;
+
+    // start with the best triangle overall
+    size_t bestTriangle = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+    size_t scanCursor = 0;
+
+    while (bestTriangle != size_t(-1)) {
+
+        emitted[bestTriangle] = true;
+
+        // emit the triangle and remove it from the adjacency of its vertices
+        GLuint newCache[FORSYTH_CACHE_SIZE + 3];
+        int newCacheCount = 0;
+        for (int k = 0; k < 3; ++k) {
+            GLuint v = indices[bestTriangle * 3 + k];
+            result.push_back(v);
+            newCache[newCacheCount++] = v;
+
+            GLuint *begin = &adjacency[adjacencyOffsets[v]];
+            GLuint *end = begin + valence[v];
+            GLuint *found = std::find(begin, end, GLuint(bestTriangle));
+            std::swap(*found, *(end - 1));
+            valence[v] -= 1;
+        }
+
+        // the vertices of the emitted triangle move to the front of the cache, the others shift back
+        for (int i = 0; i < cacheCount; ++i) {
+            GLuint v = cache[i];
+            if (v != newCache[0] && v != newCache[1] && v != newCache[2]) {
+                newCache[newCacheCount++] = v;
+            }
+        }
+        std::copy(newCache, newCache + newCacheCount, cache);
+        cacheCount = std::min(newCacheCount, FORSYTH_CACHE_SIZE);
+
+        // update the scores of all vertices that were in the cache, including the evicted ones
+        for (int i = 0; i < newCacheCount; ++i) {
+            GLuint v = newCache[i];
+            vertexScores[v] = (valence[v] > 0 ? cacheScores[i] : 0.0f) + valenceScores[std::min<GLuint>(valence[v], MAX_VALENCE)];
+        }
+
+        // rescore the remaining triangles of these vertices and pick the best one
+        bestTriangle = size_t(-1);
+        float bestScore = -1;
+        for (int i = 0; i < newCacheCount; ++i) {
+            GLuint v = newCache[i];
+            for (GLuint a = 0; a < valence[v]; ++a) {
+                GLuint t = adjacency[adjacencyOffsets[v] + a];
+                float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                triangleScores[t] = score;
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        // no triangle shares a vertex with the cache, continue with the next one not emitted yet
+        if (bestTriangle == size_t(-1)) {
+            while (scanCursor < triangleCount && emitted[scanCursor]) {
+                scanCursor += 1;
+            }
+            if (scanCursor < triangleCount) {
+                bestTriangle = scanCursor;
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<GLuint> &indices, const std::vector<Vertex> &vertices, float threshold)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // simulate a fifo cache to find the cache misses of each triangle
+    std::vector<int> misses(triangleCount, 0);
+    std::vector<size_t> insertedAt(vertices.size(), 0); // number of the insertion that put the vertex into the cache, 0 if never
+    size_t counter = 0;
+    size_t totalMisses = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            GLuint v = indices[t * 3 + k];
+            if (insertedAt[v] == 0 || counter - insertedAt[v] >= size_t(CLUSTER_CACHE_SIZE)) {
+                insertedAt[v] = ++counter;
+                misses[t] += 1;
+            }
+        }
+        totalMisses += misses[t];
+    }
+    float meshACMR = float(totalMisses) / triangleCount;
+
+    // hard boundaries where all vertices of a triangle miss the cache, i.e. the cache optimizer started a new region.
+    // soft boundaries inside these regions, once a cluster is about as cache efficient as the whole mesh,
+    // so that reordering the clusters costs at most the given threshold.
+    std::vector<size_t> clusterStarts;
+    size_t clusterMisses = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        size_t clusterTriangles = clusterStarts.empty() ? 0 : t - clusterStarts.back();
+        bool hardBoundary = misses[t] == 3;
+        bool softBoundary = clusterTriangles >= MIN_CLUSTER_TRIANGLES && float(clusterMisses) / clusterTriangles <= meshACMR * threshold;
+        if (clusterStarts.empty() || hardBoundary || softBoundary) {
+            clusterStarts.push_back(t);
+            clusterMisses = 0;
+        }
+        clusterMisses += misses[t];
+    }
+    clusterStarts.push_back(triangleCount);
+    size_t clusterCount = clusterStarts.size() - 1;
+
+    // area weighted centroid of the mesh
+    glm::vec3 meshCentroid(0);
+    float meshArea = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const glm::vec3 &a = vertices[indices[t * 3]].position;
+        const glm::vec3 &b = vertices[indices[t * 3 + 1]].position;
+        const glm::vec3 &c = vertices[indices[t * 3 + 2]].position;
+        float area = glm::length(glm::cross(b - a, c - a));
+        meshCentroid += (a + b + c) * (area / 3.0f);
+        meshArea += area;
+    }
+    meshCentroid = meshArea > 0 ? meshCentroid / meshArea : glm::vec3(0);
+
+    // clusters that lie far out along their normal are likely to occlude the rest of the mesh from any view direction
+    std::vector<float> clusterKeys(clusterCount);
+    for (size_t i = 0; i < clusterCount; ++i) {
+        glm::vec3 centroid(0);
+        glm::vec3 normal(0);
+        float area = 0;
+        for (size_t t = clusterStarts[i]; t < clusterStarts[i + 1]; ++t) {
+            const glm::vec3 &a = vertices[indices[t * 3]].position;
+            const glm::vec3 &b = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3 &c = vertices[indices[t * 3 + 2]].position;
+            glm::vec3 areaNormal = glm::cross(b - a, c - a);
+            float triangleArea = glm::length(areaNormal);
+            centroid += (a + b + c) * (triangleArea / 3.0f);
+            normal += areaNormal;
+            area += triangleArea;
+        }
+        centroid = area > 0 ? centroid / area : centroid;
+        float normalLength = glm::length(normal);
+        normal = normalLength > 0 ? normal / normalLength : normal;
+
+        clusterKeys[i] = glm::dot(centroid - meshCentroid, normal);
+    }
+
+    std::vector<size_t> clusterOrder(clusterCount);
+    for (size_t i = 0; i < clusterCount; ++i) {
+        clusterOrder[i] = i;
+    }
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&clusterKeys](size_t a, size_t b) {
+        return clusterKeys[a] > clusterKeys[b];
+    });
+
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+    for (size_t cluster : clusterOrder) {
+        result.insert(result.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+    }
+
+    indices.swap(result);
+}
+
+std::vector<Meshlet> buildMeshlets(std::vector<GLuint> &indices, const std::vector<Vertex> &vertices, size_t maxVertices, size_t maxTriangles)
+{
+    std::vector<Meshlet> meshlets;
+    size_t vertexCount = vertices.size();
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return meshlets;
+    }
+
+    // triangle adjacency of each vertex, as offsets into a single list
+    std::vector<GLuint> adjacencyOffsets(vertexCount + 1, 0);
+    for (GLuint index : indices) {
+        adjacencyOffsets[index + 1] += 1;
+    }
+    for (size_t i = 0; i < vertexCount; ++i) {
+        adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    }
+    std::vector<GLuint> adjacency(indices.size());
+    std::vector<GLuint> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            adjacency[fill[indices[t * 3 + k]]++] = GLuint(t);
+        }
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<size_t> vertexMeshlet(vertexCount, std::numeric_limits<size_t>::max()); // last meshlet referencing the vertex
+    std::vector<GLuint> candidates; // triangles adjacent to the current meshlet, may contain duplicates and emitted triangles
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+
+    size_t seed = 0;
+    while (true) {
+
+        // start the next meshlet at the first remaining triangle of the current order
+        while (seed < triangleCount && emitted[seed]) {
+            ++seed;
+        }
+        if (seed == triangleCount) {
+            break;
+        }
+
+        size_t meshletIndex = meshlets.size();
+        size_t meshletVertexCount = 0;
+        size_t meshletTriangleCount = 0;
+        size_t firstIndex = result.size();
+        candidates.clear();
+
+        GLuint next = GLuint(seed);
+        while (true) {
+            emitted[next] = true;
+            for (int k = 0; k < 3; ++k) {
+                GLuint v = indices[next * 3 + k];
+                if (vertexMeshlet[v] != meshletIndex) {
+                    vertexMeshlet[v] = meshletIndex;
+                    meshletVertexCount += 1;
+                }
+                result.push_back(v);
+
+                for (GLuint i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; ++i) {
+                    if (!emitted[adjacency[i]]) {
+                        candidates.push_back(adjacency[i]);
+                    }
+                }
+            }
+            meshletTriangleCount += 1;
+            if (meshletTriangleCount == maxTriangles) {
+                break;
+            }
+
+            // continue with the adjacent triangle adding the fewest vertices, the earliest one in the current order on ties
+            GLuint best = 0;
+            int bestNewVertices = 4;
+            size_t kept = 0;
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                GLuint t = candidates[i];
+                if (emitted[t]) {
+                    continue;
+                }
+                candidates[kept++] = t;
+
+                int newVertices = 0;
+                for (int k = 0; k < 3; ++k) {
+                    newVertices += vertexMeshlet[indices[t * 3 + k]] != meshletIndex ? 1 : 0;
+                }
+                if (meshletVertexCount + newVertices > maxVertices) {
+                    continue;
+                }
+                if (newVertices < bestNewVertices || (newVertices == bestNewVertices && t < best)) {
+                    best = t;
+                    bestNewVertices = newVertices;
+                }
+            }
+            candidates.resize(kept);
+
+            if (bestNewVertices == 4) {
+                break;
+            }
+            next = best;
+        }
+
+        Meshlet meshlet;
+        meshlet.firstIndex = GLuint(firstIndex);
+        meshlet.indexCount = GLuint(result.size() - firstIndex);
+
+        // bounding sphere around the center of the bounding box
+        glm::vec3 bbMin = vertices[result[firstIndex]].position;
+        glm::vec3 bbMax = bbMin;
+        for (size_t i = firstIndex; i < result.size(); ++i) {
+            bbMin = glm::min(bbMin, vertices[result[i]].position);
+            bbMax = glm::max(bbMax, vertices[result[i]].position);
+        }
+        meshlet.center = (bbMin + bbMax) * 0.5f;
+        meshlet.radius = 0;
+        for (size_t i = firstIndex; i < result.size(); ++i) {
+            meshlet.radius = std::max(meshlet.radius, glm::length(vertices[result[i]].position - meshlet.center));
+        }
+
+        // normal cone around the average of the triangle normals, degenerate triangles do not face anywhere
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshletTriangleCount);
+        glm::vec3 normalSum(0);
+        for (size_t i = firstIndex; i < result.size(); i += 3) {
+            const glm::vec3 &a = vertices[result[i]].position;
+            const glm::vec3 &b = vertices[result[i + 1]].position;
+            const glm::vec3 &c = vertices[result[i + 2]].position;
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length > 0) {
+                normals.push_back(normal / length);
+                normalSum += normals.back();
+            }
+        }
+        float sumLength = glm::length(normalSum);
+        meshlet.coneAxis = sumLength > 0 ? normalSum / sumLength : glm::vec3(0, 1, 0);
+        meshlet.coneCutoff = 1;
+        if (sumLength > 0) {
+            float minDot = 1;
+            for (const glm::vec3 &normal : normals) {
+                minDot = std::min(minDot, glm::dot(normal, meshlet.coneAxis));
+            }
+            if (minDot > MIN_MESHLET_CONE_DOT) {
+                meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+            }
+        }
+
+        meshlets.push_back(meshlet);
+    }
+
+    indices.swap(result);
+    return meshlets;
+}
+
+bool isMeshletBackFacing(const glm::vec3 &center, float radius, const glm::vec3 &coneAxis, float coneCutoff, const glm::vec3 &viewerPosition)
+{
+    // the meshlet is back facing if every direction from the viewer into its bounding sphere
+    // lies within the cone of directions from which all of its triangles are seen from behind
+    glm::vec3 toCenter = center - viewerPosition;
+    return glm::dot(toCenter, coneAxis) >= coneCutoff * glm::length(toCenter) + radius;
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<GLuint> &indices)
+{
+    const GLuint UNUSED = std::numeric_limits<GLuint>::max();
+
+    std::vector<GLuint> remap(vertices.size(), UNUSED);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+
+    for (GLuint &index : indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = GLuint(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(result);
+}
+
+//! symmetric 4x4 matrix measuring the sum of squared distances to a set of planes
+struct Quadric
+{
+    double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+    double weight = 0; // the sum of the plane weights
+
+    void addPlane(double a, double b, double c, double d, double weight)
+    {
+        xx += weight * a * a; xy += weight * a * b; xz += weight * a * c; xw += weight * a * d;
+        yy += weight * b * b; yz += weight * b * c; yw += weight * b * d;
+        zz += weight * c * c; zw += weight * c * d;
+        ww += weight * d * d;
+        this->weight += weight;
+    }
+
+    void add(const Quadric &other)
+    {
+        xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+        yy += other.yy; yz += other.yz; yw += other.yw;
+        zz += other.zz; zw += other.zw;
+        ww += other.ww;
+        weight += other.weight;
+    }
+
+    //! \return the weighted mean of the squared distances of p to the planes
+    double evaluate(const glm::vec3 &p) const
+    {
+        if (weight <= 0) {
+            return 0;
+        }
+        double x = p.x, y = p.y, z = p.z;
+        double error = xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x
+                     + yy * y * y + 2 * yz * y * z + 2 * yw * y
+                     + zz * z * z + 2 * zw * z
+                     + ww;
+        return std::max(error / weight, 0.0);
+    }
+};
+
+//! a candidate collapse of vertex from onto vertex to
+struct Collapse
+{
+    double cost;
+    GLuint from, to;
+    GLuint fromVersion, toVersion;
+
+    bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+std::vector<GLuint> simplify(const std::vector<Vertex> &vertices, const std::vector<GLuint> &indices,
+                             size_t targetIndexCount, float maxError, float *resultError)
+{
+    size_t vertexCount = vertices.size();
+    size_t triangleCount = indices.size() / 3;
+    if (resultError) {
+        *resultError = 0;
+    }
+
+    // vertices sharing a position are split for different normals or uvs.
+    // they must move together, so they are simply kept in place.
+    std::map<std::tuple<float, float, float>, GLuint> positionIds;
+    std::vector<GLuint> positionId(vertexCount);
+    std::vector<GLuint> positionUseCount;
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const glm::vec3 &p = vertices[i].position;
+        auto inserted = positionIds.insert(std::make_pair(std::make_tuple(p.x, p.y, p.z), GLuint(positionUseCount.size())));
+        if (inserted.second) {
+            positionUseCount.push_back(0);
+        }
+        positionId[i] = inserted.first->second;
+        positionUseCount[positionId[i]] += 1;
+    }
+
+    // edges used by a single triangle lie on the border of the mesh
+    std::map<std::pair<GLuint, GLuint>, int> edgeUseCount;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            GLuint a = positionId[indices[t * 3 + k]];
+            GLuint b = positionId[indices[t * 3 + (k + 1) % 3]];
+            edgeUseCount[std::make_pair(std::min(a, b), std::max(a, b))] += 1;
+        }
+    }
+
+    std::vector<bool> locked(vertexCount, false);
+    for (size_t i = 0; i < vertexCount; ++i) {
+        locked[i] = positionUseCount[positionId[i]] > 1;
+    }
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            GLuint a = indices[t * 3 + k];
+            GLuint b = indices[t * 3 + (k + 1) % 3];
+            if (edgeUseCount[std::make_pair(std::min(positionId[a], positionId[b]), std::max(positionId[a], positionId[b]))] == 1) {
+                locked[a] = locked[b] = true;
+            }
+        }
+    }
+
+    // area weighted plane quadrics and triangle adjacency of each vertex.
+    // the quadrics are normalized by their total area, so the collapse cost is a squared distance independent of the triangle size.
+    std::vector<GLuint> triangles(indices.begin(), indices.begin() + triangleCount * 3);
+    std::vector<bool> triangleAlive(triangleCount, true);
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<std::vector<GLuint>> vertexTriangles(vertexCount);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const glm::vec3 &a = vertices[triangles[t * 3]].position;
+        const glm::vec3 &b = vertices[triangles[t * 3 + 1]].position;
+        const glm::vec3 &c = vertices[triangles[t * 3 + 2]].position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float area = glm::length(normal);
+        if (area > 0) {
+            normal /= area;
+            for (int k = 0; k < 3; ++k) {
+                quadrics[triangles[t * 3 + k]].addPlane(normal.x, normal.y, normal.z, -glm::dot(normal, a), area);
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            vertexTriangles[triangles[t * 3 + k]].push_back(GLuint(t));
+        }
+    }
+
+    std::vector<GLuint> version(vertexCount, 0);
+    std::vector<bool> vertexAlive(vertexCount, true);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+
+    auto pushCollapse = [&](GLuint from, GLuint to) {
+        // seam vertices do not move, and vertices do not collapse onto them since their split attributes would be mixed up
+        if (from == to || locked[from] || positionUseCount[positionId[to]] > 1) {
+            return;
+        }
+        Quadric quadric = quadrics[from];
+        quadric.add(quadrics[to]);
+        Collapse collapse = { quadric.evaluate(vertices[to].position), from, to, version[from], version[to] };
+        collapses.push(collapse);
+    };
+
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            GLuint a = triangles[t * 3 + k];
+            GLuint b = triangles[t * 3 + (k + 1) % 3];
+            pushCollapse(a, b);
+            pushCollapse(b, a);
+        }
+    }
+
+    size_t aliveTriangleCount = triangleCount;
+    double maxCost = double(maxError) * double(maxError);
+    double appliedCost = 0;
+
+    while (aliveTriangleCount * 3 > targetIndexCount && !collapses.empty()) {
+
+        Collapse collapse = collapses.top();
+        collapses.pop();
+
+        GLuint from = collapse.from, to = collapse.to;
+        if (!vertexAlive[from] || !vertexAlive[to] || collapse.fromVersion != version[from] || collapse.toVersion != version[to]) {
+            continue; // outdated
+        }
+        if (collapse.cost > maxCost) {
+            break;
+        }
+
+        // reject collapses that flip the remaining triangles around the moved vertex
+        bool flips = false;
+        for (GLuint t : vertexTriangles[from]) {
+            if (!triangleAlive[t]) {
+                continue;
+            }
+            GLuint *triangle = &triangles[t * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+                continue;
+            }
+            glm::vec3 before[3], after[3];
+            for (int k = 0; k < 3; ++k) {
+                before[k] = vertices[triangle[k]].position;
+                after[k] = triangle[k] == from ? vertices[to].position : before[k];
+            }
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0) {
+                flips = true;
+                break;
+            }
+        }
+        if (flips) {
+            continue;
+        }
+
+        // move the triangles of the collapsed vertex to its target, those sharing the edge degenerate
+        for (GLuint t : vertexTriangles[from]) {
+            if (!triangleAlive[t]) {
+                continue;
+            }
+            GLuint *triangle = &triangles[t * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+                triangleAlive[t] = false;
+                aliveTriangleCount -= 1;
+                continue;
+            }
+            for (int k = 0; k < 3; ++k) {
+                if (triangle[k] == from) {
+                    triangle[k] = to;
+                }
+            }
+            vertexTriangles[to].push_back(t);
+        }
+        vertexTriangles[from].clear();
+        vertexAlive[from] = false;
+
+        quadrics[to].add(quadrics[from]);
+        version[to] += 1;
+        appliedCost = std::max(appliedCost, collapse.cost);
+
+        // drop dead triangles from the adjacency of the target and requeue its edges with the new quadric
+        std::vector<GLuint> &targetTriangles = vertexTriangles[to];
+        targetTriangles.erase(std::remove_if(targetTriangles.begin(), targetTriangles.end(), [&triangleAlive](GLuint t) {
+            return !triangleAlive[t];
+        }), targetTriangles.end());
+
+        for (GLuint t : targetTriangles) {
+            for (int k = 0; k < 3; ++k) {
+                GLuint neighbor = triangles[t * 3 + k];
+                pushCollapse(to, neighbor);
+                pushCollapse(neighbor, to);
+            }
+        }
+    }
+
+    if (resultError) {
+        *resultError = float(std::sqrt(appliedCost));
+    }
+
+    std::vector<GLuint> result;
+    result.reserve(aliveTriangleCount * 3);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (triangleAlive[t]) {
+            result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+        }
+    }
+    return result;
+}
+
+float calculateACMR(const std::vector<GLuint> &indices, size_t vertexCount, int cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return 0;
+    }
+
+    // a vertex is in the fifo cache if fewer than cacheSize vertices were inserted after it
+    std::vector<size_t> insertedAt(vertexCount, 0);
+    size_t counter = 0;
+    size_t misses = 0;
+    for (GLuint index : indices) {
+        if (insertedAt[index] == 0 || counter - insertedAt[index] >= size_t(cacheSize)) {
+            insertedAt[index] = ++counter;
+            misses += 1;
+        }
+    }
+
+    return float(misses) / triangleCount;
+}
+
+float calculateOverdraw(const std::vector<GLuint> &indices, const std::vector<Vertex> &vertices)
+{
+    if (indices.empty()) {
+        return 0;
+    }
+
+    glm::vec3 bbMin(std::numeric_limits<float>::max());
+    glm::vec3 bbMax(-std::numeric_limits<float>::max());
+    for (const Vertex &vertex : vertices) {
+        bbMin = glm::min(bbMin, vertex.position);
+        bbMax = glm::max(bbMax, vertex.position);
+    }
+    glm::vec3 extent = glm::max(bbMax - bbMin, glm::vec3(1e-6f));
+
+    std::vector<float> depth(OVERDRAW_RESOLUTION * OVERDRAW_RESOLUTION);
+    size_t shadedFragments = 0;
+    size_t coveredPixels = 0;
+
+    // orthographic views along the positive and negative x, y and z axes
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int sign = -1; sign <= 1; sign += 2) {
+
+            int axisU = (axis + 1) % 3;
+            int axisV = (axis + 2) % 3;
+
+            std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+            std::vector<bool> covered(depth.size(), false);
+
+            for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+
+                // project to pixel coordinates and depth along the view axis
+                glm::vec3 p[3];
+                for (int k = 0; k < 3; ++k) {
+                    glm::vec3 normalized = (vertices[indices[t + k]].position - bbMin) / extent;
+                    p[k] = glm::vec3(normalized[axisU] * OVERDRAW_RESOLUTION, normalized[axisV] * OVERDRAW_RESOLUTION, sign * normalized[axis]);
+                }
+
+                float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+                if (area == 0) {
+                    continue;
+                }
+                // both faces are rasterized, flip to counterclockwise
+                if (area < 0) {
+                    std::swap(p[1], p[2]);
+                    area = -area;
+                }
+
+                int minX = std::max(int(std::floor(std::min(std::min(p[0].x, p[1].x), p[2].x))), 0);
+                int maxX = std::min(int(std::ceil(std::max(std::max(p[0].x, p[1].x), p[2].x))), OVERDRAW_RESOLUTION - 1);
+                int minY = std::max(int(std::floor(std::min(std::min(p[0].y, p[1].y), p[2].y))), 0);
+                int maxY = std::min(int(std::ceil(std::max(std::max(p[0].y, p[1].y), p[2].y))), OVERDRAW_RESOLUTION - 1);
+
+                for (int y = minY; y <= maxY; ++y) {
+                    for (int x = minX; x <= maxX; ++x) {
+                        float px = x + 0.5f;
+                        float py = y + 0.5f;
+                        float w0 = (p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x);
+                        float w1 = (p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x);
+                        float w2 = (p[1].x - p[0].x) * (py - p[0].y) - (p[1].y - p[0].y) * (px - p[0].x);
+                        if (w0 < 0 || w1 < 0 || w2 < 0) {
+                            continue;
+                        }
+
+                        float z = (w0 * p[0].z + w1 * p[1].z + w2 * p[2].z) / area;
+                        size_t pixel = size_t(y) * OVERDRAW_RESOLUTION + x;
+                        if (z < depth[pixel]) {
+                            depth[pixel] = z;
+                            shadedFragments += 1;
+                            if (!covered[pixel]) {
+                                covered[pixel] = true;
+                                coveredPixels += 1;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return coveredPixels > 0 ? float(shadedFragments) / coveredPixels : 0;
+}
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "vertex.h"
+
+
+//! A cluster of neighboring triangles that forms a contiguous range of an index buffer,
+//! with bounds to cull it as a whole.
+struct Meshlet
+{
+    GLuint firstIndex; //!< first index of the meshlet, relative to the start of the index buffer
+    GLuint indexCount;
+    glm::vec3 center;  //!< bounding sphere
+    float radius;
+    glm::vec3 coneAxis; //!< average normal of the triangles
+    float coneCutoff;   //!< sine of the angle between the cone and the plane orthogonal to its axis, 1 if the cone cannot be culled
+};
+
+/**
+ * Import time optimizations of triangle meshes for the gpu vertex pipeline.
+ *
+ * The intended order is optimizeVertexCache, optimizeOverdraw, optimizeVertexFetch:
+ * the cache optimization builds local triangle clusters, the overdraw optimization reorders
+ * whole clusters without destroying their locality, and the fetch optimization finally
+ * reorders the vertices to the order in which they are first referenced.
+ * Simplified levels of detail index the same vertices, so they are generated after the fetch optimization.
+ * Meshlets regroup the triangles of the optimized order into spatially compact clusters and are built before the fetch optimization.
+ */
+namespace MeshOptimize
+{
+
+    //! Reorder triangles for post-transform vertex cache efficiency (Forsyth, "Linear-Speed Vertex Cache Optimisation").
+    void optimizeVertexCache(
+        std::vector<GLuint> &indices, //!< [in,out] three indices per triangle
+        size_t vertexCount //!< [in] the number of vertices referenced by the indices
+    );
+
+    //! Reorder triangle clusters of a cache optimized index buffer to reduce overdraw independently of the view
+    //! (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+    //! Clusters facing away from the mesh center are drawn first, since they tend to occlude the others.
+    void optimizeOverdraw(
+        std::vector<GLuint> &indices, //!< [in,out] three indices per triangle, already cache optimized
+        const std::vector<Vertex> &vertices, //!< [in] the vertices referenced by the indices
+        float threshold //!< [in] how much the vertex cache efficiency may degrade, e.g. 1.05 allows 5% more cache misses
+    );
+
+    //! Partition the triangles into meshlets of neighboring triangles and reorder the indices so that each meshlet
+    //! is a contiguous range. A meshlet is grown from the first remaining triangle of the current order by adding the adjacent
+    //! triangles that reference the fewest new vertices, so each meshlet stays cache friendly and the meshlet order
+    //! follows the current triangle order.
+    /// \return the meshlets in the order of their index ranges
+    std::vector<Meshlet> buildMeshlets(
+        std::vector<GLuint> &indices, //!< [in,out] three indices per triangle, reordered to contiguous meshlets
+        const std::vector<Vertex> &vertices, //!< [in] the vertices referenced by the indices
+        size_t maxVertices, //!< [in] the maximum number of distinct vertices of a meshlet
+        size_t maxTriangles //!< [in] the maximum number of triangles of a meshlet
+    );
+
+    //! Determine whether a meshlet faces away from a viewer, i.e. all of its triangles are back faces for any point of its bounding sphere.
+    /// \return whether the meshlet can be culled when back faces are culled
+    bool isMeshletBackFacing(
+        const glm::vec3 &center, //!< [in] bounding sphere center, in the same space as the viewer
+        float radius, //!< [in] bounding sphere radius
+        const glm::vec3 &coneAxis, //!< [in] normalized cone axis, in the same space as the viewer
+        float coneCutoff, //!< [in] the cone cutoff of the meshlet
+        const glm::vec3 &viewerPosition //!< [in] the position of the viewer
+    );
+
+    //! Reorder vertices in the order they are first referenced by the indices for memory locality of vertex fetches.
+    //! Vertices that are not referenced are removed.
+    void optimizeVertexFetch(
+        std::vector<Vertex> &vertices, //!< [in,out] the vertices
+        std::vector<GLuint> &indices //!< [in,out] three indices per triangle, remapped to the new vertex order
+    );
+
+    //! Reduce the triangle count by collapsing edges in the order of their quadric error (Garland and Heckbert,
+    //! "Surface Simplification Using Quadric Error Metrics"). Vertices are collapsed onto neighboring vertices,
+    //! so the result indexes the same vertex array and no new vertices are created.
+    //! Border vertices and vertices on uv or normal seams stay in place, to keep the silhouette and texture mapping intact.
+    /// \return the indices of the simplified mesh
+    std::vector<GLuint> simplify(
+        const std::vector<Vertex> &vertices, //!< [in] the vertices referenced by the indices
+        const std::vector<GLuint> &indices, //!< [in] three indices per triangle
+        size_t targetIndexCount, //!< [in] stop once the simplified mesh has at most this many indices
+        float maxError, //!< [in] stop before moving a surface further than about this distance
+        float *resultError = nullptr //!< [out] the largest error of an applied collapse, as a distance
+    );
+
+    //! Simulate a fifo post-transform vertex cache.
+    /// \return the average cache miss ratio, i.e. transformed vertices per triangle (0.5 is ideal for regular grids, 3 is worst)
+    float calculateACMR(
+        const std::vector<GLuint> &indices, //!< [in] three indices per triangle
+        size_t vertexCount, //!< [in] the number of vertices referenced by the indices
+        int cacheSize = 16 //!< [in] the number of vertices the simulated cache holds
+    );
+
+    //! Rasterize the mesh with depth test from the 6 axis directions in the order of the indices.
+    /// \return the average number of fragments that pass the depth test per covered pixel (1 is ideal)
+    float calculateOverdraw(
+        const std::vector<GLuint> &indices, //!< [in] three indices per triangle
+        const std::vector<Vertex> &vertices //!< [in] the vertices referenced by the indices
+    );
+
+}
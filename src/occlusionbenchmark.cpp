@@ -0,0 +1,36 @@
+#include <vector>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "occlusionrasterizer.h"
+
+
+/**
+ * Standalone benchmark of the OcclusionRasterizer, which runs without a window, an opengl context or a gpu.
+ * The occluders are built from a synthetic island terrain seen from a camera near its shore,
+ * similar to the view of the island in the main application.
+ */
+int main()
+{
+    // a hilly island of 200x200 units, sampled on a regular grid of vertices
+    const int terrainResolution = 256;
+    const float terrainSize = 200.0f;
+    std::vector<glm::vec3> terrainPositions;
+    terrainPositions.reserve(terrainResolution * terrainResolution);
+    for (int z = 0; z < terrainResolution; ++z) {
+        for (int x = 0; x < terrainResolution; ++x) {
+            glm::vec2 p = (glm::vec2(float(x), float(z)) / float(terrainResolution - 1) - 0.5f) * terrainSize;
+            float island = 30.0f * std::exp(-glm::dot(p, p) / (0.1f * terrainSize * terrainSize)) - 5.0f;
+            float hills = 3.0f * std::sin(p.x * 0.15f) * std::cos(p.y * 0.11f);
+            terrainPositions.push_back(glm::vec3(p.x, island + hills, p.y));
+        }
+    }
+
+    glm::mat4 viewMat = glm::lookAt(glm::vec3(0.0f, 8.0f, 0.6f * terrainSize), glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(0, 1, 0));
+    glm::mat4 projMat = glm::perspective(glm::radians(60.0f), 16.0f / 10.0f, 0.1f, 1000.0f);
+
+    OcclusionRasterizer::benchmark(terrainPositions, viewMat, projMat);
+    return 0;
+}
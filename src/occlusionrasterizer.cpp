@@ -0,0 +1,419 @@
+#include "occlusionrasterizer.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static int64_t currentTicks()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+OcclusionRasterizer::OcclusionRasterizer(int width_, int height_, int threadCount)
+    : width(std::max(width_, 1))
+    , height(std::max(height_, 1))
+{
+    stride = (width + 3) & ~3;
+    depth.assign(size_t(stride) * height, 1.0f);
+
+    if (threadCount <= 0) {
+        threadCount = std::max(int(std::thread::hardware_concurrency()) - 1, 1);
+    }
+    threadCount = std::min(threadCount, height);
+
+    for (int i = 0; i < threadCount; ++i) {
+        workers.push_back(std::thread(&OcclusionRasterizer::workerLoop, this, i));
+    }
+}
+
+OcclusionRasterizer::~OcclusionRasterizer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    workAvailable.notify_all();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void OcclusionRasterizer::setOccluder(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices)
+{
+    waitForRender();
+    occluderPositions = positions;
+    occluderIndices = indices;
+}
+
+void OcclusionRasterizer::beginRender(const glm::mat4 &viewMat_, const glm::mat4 &projMat_)
+{
+    // the workers read the triangles, so a previous render must be done before they are replaced
+    waitForRender();
+
+    renderStartTicks = currentTicks();
+
+    viewMat = viewMat_;
+    projMat = projMat_;
+
+    // TRANSFORM AND SET UP TRIANGLES
+    glm::mat4 viewProjMat = projMat * viewMat;
+    clipPositions.resize(occluderPositions.size());
+    for (size_t i = 0; i < occluderPositions.size(); ++i) {
+        clipPositions[i] = viewProjMat * glm::vec4(occluderPositions[i], 1);
+    }
+
+    triangles.clear();
+    for (size_t i = 0; i + 2 < occluderIndices.size(); i += 3) {
+        setupClippedTriangle(clipPositions[occluderIndices[i]], clipPositions[occluderIndices[i+1]], clipPositions[occluderIndices[i+2]]);
+    }
+
+    // RASTERIZE ON WORKER THREADS
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++frame;
+        pendingWorkers = int(workers.size());
+    }
+    workAvailable.notify_all();
+}
+
+void OcclusionRasterizer::waitForRender()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    workDone.wait(lock, [this]{ return pendingWorkers == 0; });
+}
+
+void OcclusionRasterizer::workerLoop(int workerIndex)
+{
+    uint64_t renderedFrame = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workAvailable.wait(lock, [&]{ return quit || frame != renderedFrame; });
+            if (quit) {
+                return;
+            }
+            renderedFrame = frame;
+        }
+
+        int workerCount = int(workers.size());
+        rasterizeBand(height * workerIndex / workerCount, height * (workerIndex + 1) / workerCount);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pendingWorkers == 0) {
+                renderTimeMs = float(currentTicks() - renderStartTicks) * 1e-3f;
+                workDone.notify_all();
+            }
+        }
+    }
+}
+
+void OcclusionRasterizer::setupClippedTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+{
+    // clip against the near plane z = -w, i.e. keep z + w >= 0 (sutherland hodgman on a single plane)
+    const glm::vec4 input[3] = { a, b, c };
+    glm::vec4 output[4];
+    int outputCount = 0;
+
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec4 &current = input[i];
+        const glm::vec4 &next = input[(i + 1) % 3];
+        float currentDistance = current.z + current.w;
+        float nextDistance = next.z + next.w;
+
+        if (currentDistance >= 0) {
+            output[outputCount++] = current;
+        }
+        if ((currentDistance >= 0) != (nextDistance >= 0)) {
+            float t = currentDistance / (currentDistance - nextDistance);
+            output[outputCount++] = glm::mix(current, next, t);
+        }
+    }
+
+    // the clipped polygon is convex, split it into a fan
+    for (int i = 1; i + 1 < outputCount; ++i) {
+        setupTriangle(output[0], output[i], output[i+1]);
+    }
+}
+
+void OcclusionRasterizer::setupTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c)
+{
+    // vertices lying exactly on the near plane may have w = 0 for orthographic like setups, skip those
+    if (a.w <= 0 || b.w <= 0 || c.w <= 0) {
+        return;
+    }
+
+    // normalized device coordinates to pixel coordinates and window depth
+    glm::vec3 p[3];
+    const glm::vec4 *clip[3] = { &a, &b, &c };
+    for (int i = 0; i < 3; ++i) {
+        glm::vec3 ndc = glm::vec3(*clip[i]) / clip[i]->w;
+        p[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+    }
+
+    // occluders are rasterized two sided, so bring all triangles into counter clockwise order
+    float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+    if (area < 0) {
+        std::swap(p[1], p[2]);
+        area = -area;
+    }
+    if (area < 1e-6f) {
+        return;
+    }
+
+    Triangle triangle;
+    triangle.minX = std::max(int(std::floor(std::min(std::min(p[0].x, p[1].x), p[2].x))), 0);
+    triangle.maxX = std::min(int(std::ceil(std::max(std::max(p[0].x, p[1].x), p[2].x))), width - 1);
+    triangle.minY = std::max(int(std::floor(std::min(std::min(p[0].y, p[1].y), p[2].y))), 0);
+    triangle.maxY = std::min(int(std::ceil(std::max(std::max(p[0].y, p[1].y), p[2].y))), height - 1);
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        return;
+    }
+
+    // edge functions, positive on the inner side of each edge
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec3 &from = p[i];
+        const glm::vec3 &to = p[(i + 1) % 3];
+        triangle.edgeA[i] = from.y - to.y;
+        triangle.edgeB[i] = to.x - from.x;
+        triangle.edgeC[i] = -(triangle.edgeA[i] * from.x + triangle.edgeB[i] * from.y);
+    }
+
+    // window depth is linear in screen space
+    float depthDx = ((p[1].z - p[0].z) * (p[2].y - p[0].y) - (p[2].z - p[0].z) * (p[1].y - p[0].y)) / area;
+    float depthDy = ((p[2].z - p[0].z) * (p[1].x - p[0].x) - (p[1].z - p[0].z) * (p[2].x - p[0].x)) / area;
+    triangle.depthA = depthDx;
+    triangle.depthB = depthDy;
+    triangle.depthC = p[0].z - depthDx * p[0].x - depthDy * p[0].y;
+
+    triangles.push_back(triangle);
+}
+
+void OcclusionRasterizer::rasterizeBand(int minY, int maxY)
+{
+    for (int y = minY; y < maxY; ++y) {
+        std::fill(depth.begin() + size_t(y) * stride, depth.begin() + size_t(y + 1) * stride, 1.0f);
+    }
+
+    for (const Triangle &triangle : triangles) {
+
+        int startY = std::max(triangle.minY, minY);
+        int endY = std::min(triangle.maxY, maxY - 1);
+
+        // start at a multiple of 4 so that each step covers 4 pixels of the padded row
+        int startX = triangle.minX & ~3;
+
+        for (int y = startY; y <= endY; ++y) {
+
+            float *row = &depth[size_t(y) * stride];
+            float py = float(y) + 0.5f; // sample at pixel centers
+
+            float rowEdge0 = triangle.edgeB[0] * py + triangle.edgeC[0];
+            float rowEdge1 = triangle.edgeB[1] * py + triangle.edgeC[1];
+            float rowEdge2 = triangle.edgeB[2] * py + triangle.edgeC[2];
+            float rowDepth = triangle.depthB * py + triangle.depthC;
+
+#ifdef __SSE2__
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]);
+            const __m128 edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+            const __m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]);
+            const __m128 depthA = _mm_set1_ps(triangle.depthA);
+            const __m128 edge0 = _mm_set1_ps(rowEdge0);
+            const __m128 edge1 = _mm_set1_ps(rowEdge1);
+            const __m128 edge2 = _mm_set1_ps(rowEdge2);
+            const __m128 depthRow = _mm_set1_ps(rowDepth);
+            const __m128 step = _mm_set1_ps(4.0f);
+
+            __m128 px = _mm_add_ps(_mm_set1_ps(float(startX)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+
+            for (int x = startX; x <= triangle.maxX; x += 4) {
+
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(edgeA0, px), edge0);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(edgeA1, px), edge1);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(edgeA2, px), edge2);
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+
+                if (_mm_movemask_ps(inside)) {
+                    __m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), depthRow);
+                    __m128 current = _mm_loadu_ps(row + x);
+                    __m128 nearest = _mm_min_ps(current, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+                }
+
+                px = _mm_add_ps(px, step);
+            }
+#else
+            for (int x = startX; x <= triangle.maxX; ++x) {
+                float px = float(x) + 0.5f;
+                if (triangle.edgeA[0] * px + rowEdge0 >= 0 &&
+                    triangle.edgeA[1] * px + rowEdge1 >= 0 &&
+                    triangle.edgeA[2] * px + rowEdge2 >= 0) {
+                    row[x] = std::min(row[x], triangle.depthA * px + rowDepth);
+                }
+            }
+#endif
+        }
+    }
+}
+
+bool OcclusionRasterizer::isSphereVisible(const glm::vec3 &center, float radius) const
+{
+    // same conservative screen rectangle as the hi-z test in cull_frustum.comp
+    glm::vec3 c = glm::vec3(viewMat * glm::vec4(center, 1));
+    float nearestDistance = -c.z - radius;
+
+    // spheres intersecting the near plane cover the whole screen
+    float nearPlane = projMat[3][2] / (projMat[2][2] - 1.0f);
+    if (nearestDistance <= nearPlane) {
+        return true;
+    }
+    float farthestDistance = -c.z + radius;
+
+    // the projected x/z of the bounding box is extremal at one of its corners
+    glm::vec2 rectMin, rectMax;
+    glm::vec2 scale(projMat[0][0], projMat[1][1]);
+    for (int i = 0; i < 2; ++i) {
+        float minNumerator = c[i] - radius;
+        float maxNumerator = c[i] + radius;
+        rectMin[i] = scale[i] * minNumerator / (minNumerator > 0 ? farthestDistance : nearestDistance);
+        rectMax[i] = scale[i] * maxNumerator / (maxNumerator > 0 ? nearestDistance : farthestDistance);
+    }
+
+    int minX = std::max(int(std::floor((rectMin.x * 0.5f + 0.5f) * width)), 0);
+    int maxX = std::min(int(std::floor((rectMax.x * 0.5f + 0.5f) * width)), width - 1);
+    int minY = std::max(int(std::floor((rectMin.y * 0.5f + 0.5f) * height)), 0);
+    int maxY = std::min(int(std::floor((rectMax.y * 0.5f + 0.5f) * height)), height - 1);
+
+    // window depth of the nearest point of the sphere
+    float nearestZ = (projMat[2][2] * -nearestDistance + projMat[3][2]) / nearestDistance;
+    float nearestDepth = nearestZ * 0.5f + 0.5f;
+
+    // visible as soon as one covered pixel has no occluder in front of the sphere
+    for (int y = minY; y <= maxY; ++y) {
+        const float *row = &depth[size_t(y) * stride];
+        for (int x = minX; x <= maxX; ++x) {
+            if (row[x] >= nearestDepth) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void OcclusionRasterizer::createHeightfieldOccluder(const std::vector<glm::vec3> &terrainPositions, int resolution,
+                                                    std::vector<glm::vec3> &positions, std::vector<uint32_t> &indices)
+{
+    positions.clear();
+    indices.clear();
+    if (terrainPositions.empty() || resolution < 1) {
+        return;
+    }
+
+    glm::vec2 min(std::numeric_limits<float>::max());
+    glm::vec2 max(-std::numeric_limits<float>::max());
+    for (const glm::vec3 &p : terrainPositions) {
+        min = glm::min(min, glm::vec2(p.x, p.z));
+        max = glm::max(max, glm::vec2(p.x, p.z));
+    }
+    glm::vec2 cellSize = glm::max((max - min) / float(resolution), glm::vec2(1e-6f));
+
+    // lowest terrain vertex per cell
+    const float EMPTY = std::numeric_limits<float>::max();
+    std::vector<float> cellHeight(size_t(resolution) * resolution, EMPTY);
+    for (const glm::vec3 &p : terrainPositions) {
+        int x = std::min(int((p.x - min.x) / cellSize.x), resolution - 1);
+        int z = std::min(int((p.z - min.y) / cellSize.y), resolution - 1);
+        float &height = cellHeight[size_t(z) * resolution + x];
+        height = std::min(height, p.y);
+    }
+
+    // each grid corner takes the lowest height of its adjacent non empty cells
+    int cornerCount = resolution + 1;
+    positions.resize(size_t(cornerCount) * cornerCount);
+    for (int z = 0; z < cornerCount; ++z) {
+        for (int x = 0; x < cornerCount; ++x) {
+
+            float height = EMPTY;
+            for (int dz = -1; dz <= 0; ++dz) {
+                for (int dx = -1; dx <= 0; ++dx) {
+                    int cx = x + dx, cz = z + dz;
+                    if (cx >= 0 && cz >= 0 && cx < resolution && cz < resolution) {
+                        height = std::min(height, cellHeight[size_t(cz) * resolution + cx]);
+                    }
+                }
+            }
+
+            positions[size_t(z) * cornerCount + x] = glm::vec3(min.x + x * cellSize.x, height == EMPTY ? 0.0f : height, min.y + z * cellSize.y);
+        }
+    }
+
+    // two triangles per non empty cell
+    for (int z = 0; z < resolution; ++z) {
+        for (int x = 0; x < resolution; ++x) {
+
+            if (cellHeight[size_t(z) * resolution + x] == EMPTY) {
+                continue;
+            }
+
+            uint32_t i00 = uint32_t(z * cornerCount + x);
+            uint32_t i10 = i00 + 1;
+            uint32_t i01 = i00 + cornerCount;
+            uint32_t i11 = i01 + 1;
+
+            indices.push_back(i00); indices.push_back(i01); indices.push_back(i10);
+            indices.push_back(i10); indices.push_back(i01); indices.push_back(i11);
+        }
+    }
+}
+
+void OcclusionRasterizer::benchmark(const std::vector<glm::vec3> &terrainPositions, const glm::mat4 &viewMat, const glm::mat4 &projMat)
+{
+    const int gridResolutions[] = { 16, 32, 64, 128 };
+    const int bufferSizes[][2] = { { 128, 64 }, { 256, 128 }, { 512, 256 }, { 1024, 512 } };
+    const int warmupRenders = 5;
+    const int measuredRenders = 50;
+
+#ifdef __SSE2__
+    std::cout << "OCCLUSION RASTERIZER BENCHMARK (SSE2)" << std::endl;
+#else
+    std::cout << "OCCLUSION RASTERIZER BENCHMARK (SCALAR)" << std::endl;
+#endif
+    std::cout << std::setw(12) << "triangles" << std::setw(12) << "resolution" << std::setw(12) << "ms" << std::endl;
+
+    for (int gridResolution : gridResolutions) {
+
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+        createHeightfieldOccluder(terrainPositions, gridResolution, positions, indices);
+
+        for (const auto &size : bufferSizes) {
+
+            OcclusionRasterizer rasterizer(size[0], size[1]);
+            rasterizer.setOccluder(positions, indices);
+
+            float totalMs = 0;
+            for (int i = 0; i < warmupRenders + measuredRenders; ++i) {
+                rasterizer.beginRender(viewMat, projMat);
+                rasterizer.waitForRender();
+                if (i >= warmupRenders) {
+                    totalMs += rasterizer.getRenderTimeMs();
+                }
+            }
+
+            std::cout << std::setw(12) << indices.size() / 3
+                      << std::setw(12) << (std::to_string(size[0]) + "x" + std::to_string(size[1]))
+                      << std::setw(12) << std::fixed << std::setprecision(3) << totalMs / measuredRenders << std::endl;
+        }
+    }
+}
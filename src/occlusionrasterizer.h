@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+
+/**
+ * @brief An OcclusionRasterizer renders a few low poly occluder meshes into a coarse depth buffer on the cpu,
+ * against which bounding spheres can be tested before their surfaces are submitted for drawing.
+ * It does not depend on opengl, so it works (and can be measured) without a gpu.
+ *
+ * Triangles are transformed, clipped against the near plane and set up on the calling thread.
+ * The depth buffer is split into horizontal bands that are cleared and rasterized in parallel by worker threads,
+ * 4 pixels at a time using SSE2 where available.
+ * The depth buffer stores the nearest occluder depth in window space [0,1] per pixel, 1 where there is no occluder.
+ *
+ * Occluders must lie inside the geometry they stand for, since anything behind them is considered hidden.
+ */
+class OcclusionRasterizer
+{
+public:
+
+    //! Create a depth buffer of given size and start the worker threads.
+    //! \param threadCount the number of worker threads, 0 chooses one less than the hardware concurrency
+    OcclusionRasterizer(int width, int height, int threadCount = 0);
+    ~OcclusionRasterizer();
+
+    //! Replace the occluder meshes by a single triangle mesh in world space.
+    void setOccluder(
+        const std::vector<glm::vec3> &positions, //!< [in] world space vertex positions
+        const std::vector<uint32_t> &indices //!< [in] three indices per triangle
+    );
+
+    //! Set up the occluder triangles for the given view and start rasterizing them on the worker threads.
+    //! The depth buffer must not be tested until waitForRender returns.
+    void beginRender(
+        const glm::mat4 &viewMat, //!< [in] the view matrix of the camera
+        const glm::mat4 &projMat //!< [in] the perspective projection matrix of the camera
+    );
+
+    //! Block until the worker threads finished rasterizing.
+    void waitForRender();
+
+    //! Test a bounding sphere against the depth buffer of the last render.
+    //! \return false if the sphere is completely behind the occluders, true otherwise
+    bool isSphereVisible(
+        const glm::vec3 &center, //!< [in] world space sphere center
+        float radius //!< [in] world space sphere radius
+    ) const;
+
+    //! \return the time the last render took on the cpu in milliseconds, including triangle setup
+    inline float getRenderTimeMs() const { return renderTimeMs; }
+
+    //! \return the number of occluder triangles
+    inline size_t getOccluderTriangleCount() const { return occluderIndices.size() / 3; }
+
+    inline int getWidth() const { return width; }
+    inline int getHeight() const { return height; }
+
+    //! \return the depth buffer, rows of getStride() floats from bottom to top
+    inline const std::vector<float> &getDepthBuffer() const { return depth; }
+    inline int getStride() const { return stride; }
+
+    /**
+     * @brief Build a heightfield occluder that stays below the surface of a terrain mesh.
+     * The xz extent of the terrain is divided into a grid of cells, each cell takes the lowest terrain vertex falling into it,
+     * and each grid corner the lowest height of its adjacent cells. Quads touching empty cells are left out,
+     * so the occluder ends where the terrain ends.
+     * @param terrainPositions world space vertex positions of the terrain
+     * @param resolution number of grid cells along each axis
+     * @param positions [out] occluder vertex positions
+     * @param indices [out] occluder triangle indices
+     */
+    static void createHeightfieldOccluder(const std::vector<glm::vec3> &terrainPositions, int resolution,
+                                          std::vector<glm::vec3> &positions, std::vector<uint32_t> &indices);
+
+    /**
+     * @brief Measure the render time for several depth buffer resolutions and occluder grid resolutions
+     * and print a table to stdout. Runs without a gpu, also as the standalone occlusion_benchmark target (occlusionbenchmark.cpp).
+     * @param terrainPositions world space vertex positions of the terrain the occluders are built from
+     * @param viewMat view matrix to render with
+     * @param projMat projection matrix to render with
+     */
+    static void benchmark(const std::vector<glm::vec3> &terrainPositions, const glm::mat4 &viewMat, const glm::mat4 &projMat);
+
+private:
+
+    //! a triangle set up for rasterization in pixel coordinates
+    struct Triangle
+    {
+        int minX, maxX, minY, maxY; // pixel bounds, inclusive
+        float edgeA[3], edgeB[3], edgeC[3]; // edge functions A*x + B*y + C, all >= 0 inside
+        float depthA, depthB, depthC; // depth plane A*x + B*y + C
+    };
+
+    int width, height;
+    int stride; // width rounded up to a multiple of 4 for simd access
+
+    std::vector<float> depth;
+
+    std::vector<glm::vec3> occluderPositions;
+    std::vector<uint32_t> occluderIndices;
+
+    std::vector<glm::vec4> clipPositions;
+    std::vector<Triangle> triangles;
+
+    glm::mat4 viewMat, projMat;
+    float renderTimeMs = 0;
+    int64_t renderStartTicks = 0;
+
+    // worker threads, each owns a band of rows of the depth buffer
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workDone;
+    uint64_t frame = 0;
+    int pendingWorkers = 0;
+    bool quit = false;
+
+    void workerLoop(int workerIndex);
+
+    //! Clear and rasterize all triangles into the rows [minY, maxY).
+    void rasterizeBand(int minY, int maxY);
+
+    //! Clip the triangle against the near plane and add the resulting triangles.
+    void setupClippedTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+
+    //! Add a triangle whose vertices all lie in front of the near plane.
+    void setupTriangle(const glm::vec4 &a, const glm::vec4 &b, const glm::vec4 &c);
+};
@@ -0,0 +1,599 @@
+#include "renderqueue.h"
+#include "surface.h"
+
+// bit widths of the sort key fields, see class description
+static const int PASS_BITS    = 4;
+static const int SHADER_BITS  = 8;
+static const int CULL_BITS    = 1;
+static const int TEXTURE_BITS = 16;
+static const int VAO_BITS     = 16;
+static const int DEPTH_BITS   = 19;
+
+static inline uint64_t maskBits(uint64_t value, int bits)
+{
+    return value & ((uint64_t(1) << bits) - 1);
+}
+
+// shader storage buffer binding point of the per-draw data, see DrawDataBlock in the shaders
+static const GLuint DRAW_DATA_BINDING = 2;
+
+// shader storage buffer binding point of the per-instance data, see InstanceDataBlock in the shaders
+static const GLuint INSTANCE_DATA_BINDING = 10;
+
+// shader storage buffer binding points of the culling compute shader, see cull_frustum.comp
+static const GLuint CANDIDATE_COMMAND_BINDING   = 3;
+static const GLuint CANDIDATE_DRAW_DATA_BINDING = 4;
+static const GLuint CULL_DATA_BINDING           = 5;
+static const GLuint COMMAND_BINDING             = 6;
+static const GLuint DRAW_COUNT_BINDING          = 7;
+static const GLuint VISIBILITY_BINDING          = 8;
+static const GLuint CULL_STATS_BINDING          = 9;
+
+// texture unit the hi-z pyramid is bound to, see HiZBuffer
+static const GLuint HIZ_TEXTURE_UNIT = 3;
+
+// work group size of the culling compute shader
+static const GLuint CULL_GROUP_SIZE = 64;
+
+RenderQueue::RenderQueue()
+    : pass(PASS_MAIN)
+{
+    glGenBuffers(1, &indirectBuffer);
+    glGenBuffers(1, &drawDataBuffer);
+    glGenBuffers(1, &instanceDataBuffer);
+
+    glGenBuffers(1, &candidateCommandBuffer);
+    glGenBuffers(1, &candidateDrawDataBuffer);
+    glGenBuffers(1, &cullDataBuffer);
+    glGenBuffers(1, &drawCountBuffer);
+    glGenBuffers(1, &visibilityBuffer);
+
+    GLuint zeroStats[2] = { 0, 0 };
+    glGenBuffers(CULL_STATS_FRAMES, cullStatsBuffers);
+    for (int i = 0; i < CULL_STATS_FRAMES; ++i) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullStatsBuffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeroStats), zeroStats, GL_DYNAMIC_READ);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    cullShader = new Shader("shaders/cull_frustum.comp");
+}
+
+RenderQueue::~RenderQueue()
+{
+    delete cullShader; cullShader = nullptr;
+
+    glDeleteBuffers(1, &indirectBuffer);
+    glDeleteBuffers(1, &drawDataBuffer);
+    glDeleteBuffers(1, &instanceDataBuffer);
+
+    glDeleteBuffers(1, &candidateCommandBuffer);
+    glDeleteBuffers(1, &candidateDrawDataBuffer);
+    glDeleteBuffers(1, &cullDataBuffer);
+    glDeleteBuffers(1, &drawCountBuffer);
+    glDeleteBuffers(1, &visibilityBuffer);
+    glDeleteBuffers(CULL_STATS_FRAMES, cullStatsBuffers);
+}
+
+void RenderQueue::setMultiDrawIndirect(bool enabled)
+{
+    // the shaders need gl_DrawID to find the per-draw data
+    multiDrawIndirect = enabled && (GLEW_ARB_shader_draw_parameters || GLEW_VERSION_4_6);
+}
+
+void RenderQueue::setGpuCulling(bool enabled)
+{
+    gpuCulling = enabled;
+}
+
+void RenderQueue::cullOnGpu(Camera *camera, const glm::mat4 &viewMat, HiZBuffer *hiZBuffer)
+{
+    cullCamera = camera;
+    cullViewMat = viewMat;
+    cullHiZBuffer = hiZBuffer;
+}
+
+void RenderQueue::setLodEnabled(bool enabled)
+{
+    lodEnabled = enabled;
+}
+
+void RenderQueue::setLodBias(RenderPass pass_, float bias)
+{
+    lodBiases[pass_] = bias;
+}
+
+void RenderQueue::setGpuCullingValidation(bool enabled)
+{
+    gpuCullingValidation = enabled;
+}
+
+void RenderQueue::begin(RenderPass pass_, Shader *shader_, SortMode sortMode_, float farPlane_)
+{
+    pass = pass_;
+    shader = shader_;
+    sortMode = sortMode_;
+    farPlane = farPlane_;
+    cullCamera = nullptr;
+    cullHiZBuffer = nullptr;
+
+    items.clear();
+    sortedIndices.clear();
+    instanceData.clear();
+}
+
+uint64_t RenderQueue::makeSortKey(GLuint textureHandle, GLuint vao, float viewDepth, bool cullBackFaces) const
+{
+    // quantize view depth to [0, 2^DEPTH_BITS - 1], surfaces behind the camera get depth 0
+    float normalizedDepth = glm::clamp(viewDepth / farPlane, 0.0f, 1.0f);
+    uint64_t depth = uint64_t(normalizedDepth * float((1 << DEPTH_BITS) - 1));
+
+    uint64_t key = maskBits(pass, PASS_BITS);
+    key = (key << SHADER_BITS) | maskBits(shader ? shader->programHandle : 0, SHADER_BITS);
+    key = (key << CULL_BITS) | (cullBackFaces ? 1 : 0);
+
+    if (sortMode == SORT_FRONT_TO_BACK) {
+        key = (key << DEPTH_BITS) | depth;
+        key = (key << TEXTURE_BITS) | maskBits(textureHandle, TEXTURE_BITS);
+        key = (key << VAO_BITS) | maskBits(vao, VAO_BITS);
+    }
+    else {
+        key = (key << TEXTURE_BITS) | maskBits(textureHandle, TEXTURE_BITS);
+        key = (key << VAO_BITS) | maskBits(vao, VAO_BITS);
+        key = (key << DEPTH_BITS) | depth;
+    }
+
+    return key;
+}
+
+void RenderQueue::submit(Surface *surface, const glm::mat4 &modelMatrix, const glm::mat3 &normalMatrix,
+                         const glm::vec3 &boundingSphereCenter, const glm::vec3 &boundingSphereFarthestPoint,
+                         float viewDepth, float shininess, bool cullBackFaces, int lod, GLuint firstIndex, GLuint indexCount)
+{
+    DrawItem item;
+    item.surface = surface;
+    item.modelMatrix = modelMatrix;
+    item.normalMatrix = normalMatrix;
+    item.boundingSphereCenter = boundingSphereCenter;
+    item.boundingSphereFarthestPoint = boundingSphereFarthestPoint;
+    item.shininess = shininess;
+    item.diffuseLayer = surface->getDiffuseLayer();
+    item.cullBackFaces = cullBackFaces;
+    item.baseInstance = 0;
+    item.instanceCount = 0;
+    item.range = surface->getMeshRange(lodEnabled ? lod : 0);
+    if (indexCount > 0) {
+        item.range.firstIndex += firstIndex;
+        item.range.indexCount = indexCount;
+    }
+    item.sortKey = makeSortKey(getTexture(surface), getVAO(surface), viewDepth, cullBackFaces);
+
+    items.push_back(item);
+
+    // parts of a surface count as drawn at full resolution, such that culled meshlets do not show up as level of detail savings
+    triangleCounts[pass] += item.range.indexCount / 3;
+    fullDetailTriangleCounts[pass] += (indexCount > 0 ? indexCount : surface->getMeshRange(0).indexCount) / 3;
+}
+
+GLuint RenderQueue::addInstances(const std::vector<InstanceData> &instances)
+{
+    GLuint baseInstance = GLuint(instanceData.size());
+    instanceData.insert(instanceData.end(), instances.begin(), instances.end());
+    return baseInstance;
+}
+
+void RenderQueue::submitInstanced(Surface *surface, const glm::mat4 &modelMatrix, const glm::mat3 &normalMatrix,
+                                  const glm::vec3 &boundingSphereCenter, const glm::vec3 &boundingSphereFarthestPoint,
+                                  float viewDepth, float shininess, bool cullBackFaces, int lod, GLuint baseInstance, GLuint instanceCount)
+{
+    if (instanceCount == 0) {
+        return;
+    }
+    submit(surface, modelMatrix, normalMatrix, boundingSphereCenter, boundingSphereFarthestPoint, viewDepth, shininess, cullBackFaces, lod);
+
+    DrawItem &item = items.back();
+    item.baseInstance = baseInstance;
+    item.instanceCount = instanceCount;
+
+    // submit counted the triangles of one instance
+    triangleCounts[pass] += (instanceCount - 1) * (item.range.indexCount / 3);
+    fullDetailTriangleCounts[pass] += (instanceCount - 1) * (surface->getMeshRange(0).indexCount / 3);
+}
+
+void RenderQueue::uploadInstanceData()
+{
+    if (instanceData.empty()) {
+        return;
+    }
+
+    // orphaned like the per-draw data, since the instances of previous passes may still be read
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceDataBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, instanceData.size() * sizeof(InstanceData), instanceData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_DATA_BINDING, instanceDataBuffer);
+}
+
+void RenderQueue::sort()
+{
+    // least significant digit radix sort on the 64 bit keys, one byte per pass.
+    // keys and item indices are sorted together, the items themselves are not moved.
+    const size_t count = items.size();
+
+    sortedKeys.resize(count);
+    scratchKeys.resize(count);
+    sortedIndices.resize(count);
+    scratchIndices.resize(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        sortedKeys[i] = items[i].sortKey;
+        sortedIndices[i] = uint32_t(i);
+    }
+
+    for (int shift = 0; shift < 64; shift += 8) {
+
+        size_t histogram[256] = {};
+        for (size_t i = 0; i < count; ++i) {
+            ++histogram[(sortedKeys[i] >> shift) & 0xFF];
+        }
+
+        // skip digits that are equal for all keys (e.g. the pass and shader bits)
+        if (count == 0 || histogram[(sortedKeys[0] >> shift) & 0xFF] == count) {
+            continue;
+        }
+
+        // exclusive prefix sum gives the output offset of each digit
+        size_t offset = 0;
+        for (int digit = 0; digit < 256; ++digit) {
+            size_t digitCount = histogram[digit];
+            histogram[digit] = offset;
+            offset += digitCount;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            size_t target = histogram[(sortedKeys[i] >> shift) & 0xFF]++;
+            scratchKeys[target] = sortedKeys[i];
+            scratchIndices[target] = sortedIndices[i];
+        }
+
+        sortedKeys.swap(scratchKeys);
+        sortedIndices.swap(scratchIndices);
+    }
+}
+
+bool RenderQueue::haveSameState(const DrawItem &a, const DrawItem &b) const
+{
+    return a.cullBackFaces == b.cullBackFaces
+        && getTexture(a.surface) == getTexture(b.surface)
+        && getVAO(a.surface) == getVAO(b.surface);
+}
+
+bool RenderQueue::isDepthOnlyPass() const
+{
+    // the hi-z prepass alpha tests against the diffuse texture, so it needs uvs and textures
+    return pass == PASS_SHADOW || pass == PASS_OCCLUSION;
+}
+
+GLuint RenderQueue::getTexture(const Surface *surface) const
+{
+    return isDepthOnlyPass() ? 0 : surface->getDiffuseTextureHandle();
+}
+
+GLuint RenderQueue::getVAO(const Surface *surface) const
+{
+    // depth only passes fetch the positions from a tightly packed stream instead of the interleaved vertices
+    return isDepthOnlyPass() ? surface->getDepthOnlyVAO() : surface->getVAO();
+}
+
+void RenderQueue::applyState(const DrawItem &item, const DrawItem *last, Texture::FilterType filterType)
+{
+    Surface *surface = item.surface;
+
+    if (!last || item.cullBackFaces != last->cullBackFaces) {
+        if (item.cullBackFaces) glEnable(GL_CULL_FACE);
+        else glDisable(GL_CULL_FACE);
+        ++stateChangeCount;
+    }
+
+    // surfaces without texture keep whatever is bound to unit 0, as in Surface::draw
+    GLuint texture = getTexture(surface);
+    if (texture != 0 && (!last || texture != getTexture(last->surface))) {
+        surface->bindTextures(shader, filterType);
+        ++stateChangeCount;
+    }
+
+    GLuint vao = getVAO(surface);
+    if (!last || vao != getVAO(last->surface)) {
+        glBindVertexArray(vao);
+        ++stateChangeCount;
+    }
+}
+
+void RenderQueue::execute(Texture::FilterType filterType)
+{
+    uploadInstanceData();
+
+    if (multiDrawIndirect) {
+        executeIndirect(filterType);
+        return;
+    }
+
+    GLint modelMatLocation = shader->getUniformLocation("modelMat");
+    GLint normalMatLocation = shader->getUniformLocation("normalMat");
+    GLint shininessLocation = shader->getUniformLocation("material.shininess");
+    GLint diffuseLayerLocation = shader->getUniformLocation("material.diffuseLayer");
+    GLint useInstanceDataLocation = shader->getUniformLocation("useInstanceData");
+    GLint baseInstanceLocation = shader->getUniformLocation("baseInstance");
+
+    // there is no previous draw for the first item, so all of its state is set
+    const DrawItem *last = nullptr;
+
+    for (size_t i = 0; i < sortedIndices.size(); ++i) {
+
+        const DrawItem &item = items[sortedIndices[i]];
+        applyState(item, last, filterType);
+
+        if (!last || item.modelMatrix != last->modelMatrix) {
+            glUniformMatrix4fv(modelMatLocation, 1, GL_FALSE, glm::value_ptr(item.modelMatrix));
+            glUniformMatrix3fv(normalMatLocation, 1, GL_FALSE, glm::value_ptr(item.normalMatrix));
+            ++stateChangeCount;
+        }
+
+        if (!last || item.shininess != last->shininess) {
+            glUniform1f(shininessLocation, item.shininess);
+            ++stateChangeCount;
+        }
+
+        // the texture array stays bound, only the layer changes between surfaces sharing it
+        if (!last || item.diffuseLayer != last->diffuseLayer) {
+            glUniform1i(diffuseLayerLocation, item.diffuseLayer);
+            ++stateChangeCount;
+        }
+
+        bool instanced = item.instanceCount > 0;
+        if (!last || instanced != (last->instanceCount > 0)) {
+            glUniform1i(useInstanceDataLocation, instanced);
+            ++stateChangeCount;
+        }
+
+        const GLvoid *indexOffset = (GLvoid*)(item.range.firstIndex * sizeof(GLuint));
+        if (instanced) {
+            // the shaders read the base instance from gl_BaseInstance if available, otherwise from the uniform
+            glUniform1i(baseInstanceLocation, item.baseInstance);
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, item.range.indexCount, GL_UNSIGNED_INT, indexOffset,
+                                                          item.instanceCount, item.range.baseVertex, item.baseInstance);
+        }
+        else {
+            glDrawElementsBaseVertex(GL_TRIANGLES, item.range.indexCount, GL_UNSIGNED_INT, indexOffset, item.range.baseVertex);
+        }
+        ++drawCallCount;
+
+        last = &item;
+    }
+
+    glUniform1i(useInstanceDataLocation, false);
+    glBindVertexArray(0);
+    glEnable(GL_CULL_FACE);
+}
+
+void RenderQueue::executeIndirect(Texture::FilterType filterType)
+{
+    const size_t count = sortedIndices.size();
+    if (count == 0) {
+        return;
+    }
+
+    const bool culling = isCullingOnGpu();
+    const bool compact = culling && (GLEW_ARB_indirect_parameters || GLEW_VERSION_4_6);
+
+    // write indirect commands and per-draw data in sorted order,
+    // so that each state bucket is a contiguous range of both buffers
+    commands.resize(count);
+    drawData.resize(count);
+    cullData.resize(culling ? count : 0);
+    bucketStarts.clear();
+
+    for (size_t i = 0; i < count; ++i) {
+
+        const DrawItem &item = items[sortedIndices[i]];
+        const MeshRange &range = item.range;
+
+        // a new bucket starts wherever the state differs from the previous draw
+        if (i == 0 || !haveSameState(item, items[sortedIndices[i-1]])) {
+            bucketStarts.push_back(GLuint(i));
+        }
+
+        DrawElementsIndirectCommand &command = commands[i];
+        command.count = range.indexCount;
+        command.instanceCount = item.instanceCount > 0 ? item.instanceCount : 1;
+        command.firstIndex = range.firstIndex;
+        command.baseVertex = range.baseVertex;
+        command.baseInstance = item.baseInstance;
+
+        drawData[i].modelMatrix = item.modelMatrix;
+        drawData[i].normalMatrix = glm::mat4(item.normalMatrix);
+        drawData[i].material = glm::vec4(item.shininess, item.instanceCount > 0 ? 1 : 0, item.diffuseLayer, 0);
+
+        if (culling) {
+            cullData[i].boundingSphereCenter = glm::vec4(item.boundingSphereCenter, 1);
+            cullData[i].boundingSphereFarthestPoint = glm::vec4(item.boundingSphereFarthestPoint, 1);
+            cullData[i].bucket = GLuint(bucketStarts.size() - 1);
+            cullData[i].bucketStart = bucketStarts.back();
+        }
+    }
+
+    if (culling) {
+        cullIndirectDraws(bucketStarts.size(), compact);
+    }
+    else {
+        // respecifying the buffer storage orphans the data still used by draws of previous passes,
+        // so the driver does not have to wait for them to finish
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, count * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(DrawData), drawData.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawDataBuffer);
+    if (compact) {
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, drawCountBuffer);
+    }
+
+    glUniform1i(shader->getUniformLocation("useDrawData"), true);
+    GLint drawDataOffsetLocation = shader->getUniformLocation("drawDataOffset");
+
+    for (size_t bucket = 0; bucket < bucketStarts.size(); ++bucket) {
+
+        GLuint bucketStart = bucketStarts[bucket];
+        GLuint bucketEnd = bucket + 1 < bucketStarts.size() ? bucketStarts[bucket+1] : GLuint(count);
+
+        applyState(items[sortedIndices[bucketStart]], bucketStart > 0 ? &items[sortedIndices[bucketStart-1]] : nullptr, filterType);
+
+        // gl_DrawID restarts at 0 for each multi-draw call, so pass where the bucket starts
+        glUniform1i(drawDataOffsetLocation, bucketStart);
+
+        const GLvoid *commandOffset = (GLvoid*)(bucketStart * sizeof(DrawElementsIndirectCommand));
+        if (compact) {
+            // the number of visible draws of the bucket is read from the parameter buffer
+            glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, commandOffset, bucket * sizeof(GLuint), bucketEnd - bucketStart, 0);
+        }
+        else {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, commandOffset, bucketEnd - bucketStart, 0);
+        }
+        ++drawCallCount;
+    }
+
+    glUniform1i(shader->getUniformLocation("useDrawData"), false);
+
+    if (compact) {
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glEnable(GL_CULL_FACE);
+}
+
+void RenderQueue::cullIndirectDraws(size_t bucketCount, bool compact)
+{
+    const size_t count = commands.size();
+
+    // upload all candidate draws, the compute shader writes the visible ones to the output buffers
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, candidateCommandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, candidateDrawDataBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(DrawData), drawData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullDataBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(CullData), cullData.data(), GL_STREAM_DRAW);
+
+    // the visible draw count of each bucket is incremented atomically, so it starts at zero
+    std::vector<GLuint> zeroDrawCounts(bucketCount, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawCountBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bucketCount * sizeof(GLuint), zeroDrawCounts.data(), GL_STREAM_DRAW);
+
+    // output buffers are only written by the gpu
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawDataBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(DrawData), nullptr, GL_STREAM_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(GLuint), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawDataBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CANDIDATE_COMMAND_BINDING, candidateCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CANDIDATE_DRAW_DATA_BINDING, candidateDrawDataBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DATA_BINDING, cullDataBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, indirectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COUNT_BINDING, drawCountBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBILITY_BINDING, visibilityBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_STATS_BINDING, cullStatsBuffers[cullStatsFrame]);
+
+    // use the same matrix product as Camera::checkSphereInFrustum, so both cullers see the same values
+    glm::mat4 projMat = cullCamera->getProjMat();
+    glm::mat4 viewProjMat = projMat * cullViewMat;
+
+    cullShader->useShader();
+    glUniformMatrix4fv(cullShader->getUniformLocation("viewProjMat"), 1, GL_FALSE, glm::value_ptr(viewProjMat));
+    glUniform1ui(cullShader->getUniformLocation("candidateCount"), GLuint(count));
+    glUniform1i(cullShader->getUniformLocation("compact"), compact);
+    glUniformMatrix4fv(cullShader->getUniformLocation("viewMat"), 1, GL_FALSE, glm::value_ptr(cullViewMat));
+    glUniformMatrix4fv(cullShader->getUniformLocation("projMat"), 1, GL_FALSE, glm::value_ptr(projMat));
+
+    glUniform1i(cullShader->getUniformLocation("useHiZ"), cullHiZBuffer != nullptr);
+    if (cullHiZBuffer) {
+        glActiveTexture(GL_TEXTURE0 + HIZ_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, cullHiZBuffer->getPyramidTexture());
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1i(cullShader->getUniformLocation("hiZPyramid"), HIZ_TEXTURE_UNIT);
+        glUniform2i(cullShader->getUniformLocation("hiZSize"), cullHiZBuffer->getWidth(), cullHiZBuffer->getHeight());
+        glUniform1i(cullShader->getUniformLocation("hiZLevelCount"), cullHiZBuffer->getLevelCount());
+    }
+    glDispatchCompute(GLuint((count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE), 1, 1);
+
+    // make the results visible to the indirect draws and the vertex shader fetches
+    // and to the readback of the visibility and statistics
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    if (gpuCullingValidation) {
+        validateGpuCulling();
+    }
+
+    shader->useShader();
+}
+
+void RenderQueue::validateGpuCulling()
+{
+    const size_t count = commands.size();
+
+    visibility.resize(count);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(GLuint), visibility.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    int visibleCount = 0;
+    int mismatchCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+
+        const DrawItem &item = items[sortedIndices[i]];
+        bool visibleOnCpu = cullCamera->checkSphereInFrustum(item.boundingSphereCenter, item.boundingSphereFarthestPoint, cullViewMat);
+        bool visibleOnGpu = visibility[i] != 0;
+
+        if (visibleOnGpu) ++visibleCount;
+        if (visibleOnGpu != visibleOnCpu) ++mismatchCount;
+    }
+
+    if (mismatchCount > 0) {
+        std::cerr << "GPU CULLING VALIDATION FAILED: " << mismatchCount << " of " << count
+                  << " draws differ from the cpu culler in pass " << pass << std::endl;
+    }
+    gpuVisibleCount = visibleCount;
+    gpuCullingMismatchCount += mismatchCount;
+}
+
+void RenderQueue::resetFrameStatistics()
+{
+    drawCallCount = 0;
+    stateChangeCount = 0;
+    gpuVisibleCount = 0;
+    gpuCullingMismatchCount = 0;
+    for (int i = 0; i < RENDER_PASS_COUNT; ++i) {
+        triangleCounts[i] = 0;
+        fullDetailTriangleCounts[i] = 0;
+    }
+
+    // move on to the oldest statistics buffer of the ring, which was written CULL_STATS_FRAMES-1 frames ago,
+    // read its counts and clear it for this frame
+    cullStatsFrame = (cullStatsFrame + 1) % CULL_STATS_FRAMES;
+
+    GLuint stats[2];
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cullStatsBuffers[cullStatsFrame]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), stats);
+    gpuFrustumCulledCount = stats[0];
+    gpuOcclusionCulledCount = stats[1];
+
+    GLuint zeroStats[2] = { 0, 0 };
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeroStats), zeroStats);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "shader.h"
+#include "texture.hpp"
+#include "camera.h"
+#include "hizbuffer.h"
+#include "mesharena.h"
+
+class Surface;
+
+
+//! The render passes that submit geometry to a RenderQueue.
+//! The pass occupies the most significant bits of the sort key.
+enum RenderPass
+{
+    PASS_SHADOW     = 0,
+    PASS_REFLECTION = 1,
+    PASS_REFRACTION = 2,
+    PASS_OCCLUSION  = 3,
+    PASS_SSAO       = 4,
+    PASS_MAIN       = 5,
+    PASS_HIZ        = 6  // occluder depth prepass of the hi-z pyramid
+};
+
+const int RENDER_PASS_COUNT = 7;
+
+//! Command layout consumed by glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+//! Per-draw data of a multi-draw, fetched by the vertex shaders through gl_DrawID.
+//! std430 layout, MAKE SURE TO MAINTAIN THE SAME LAYOUT AS THE DrawData STRUCT IN THE SHADERS!
+struct DrawData
+{
+    glm::mat4 modelMatrix;
+    glm::mat4 normalMatrix; // mat3 padded to mat4
+    glm::vec4 material;     // x: shininess, y: instanced if > 0, z: layer of the diffuse texture array
+};
+
+//! Per-instance data of instanced draws, fetched by the vertex shaders through the base instance and gl_InstanceID.
+//! The instance matrices are applied after the model and normal matrix of the draw.
+//! std430 layout, MAKE SURE TO MAINTAIN THE SAME LAYOUT AS THE InstanceData STRUCT IN THE SHADERS!
+struct InstanceData
+{
+    glm::mat4 modelMatrix;
+    glm::mat4 normalMatrix; // mat3 padded to mat4
+};
+
+//! Bounds of a draw tested by the culling compute shader.
+//! std430 layout, MAKE SURE TO MAINTAIN THE SAME LAYOUT AS THE CullData STRUCT IN cull_frustum.comp!
+struct CullData
+{
+    glm::vec4 boundingSphereCenter;        // world space, w unused
+    glm::vec4 boundingSphereFarthestPoint; // world space, w unused
+    GLuint bucket;      // index of the state bucket, i.e. of the multi-draw call
+    GLuint bucketStart; // first command of the bucket in the indirect buffer
+    GLuint padding[2];
+};
+
+//! A single surface draw submitted to the RenderQueue.
+struct DrawItem
+{
+    uint64_t sortKey;
+    Surface *surface;
+    glm::mat4 modelMatrix;
+    glm::mat3 normalMatrix;
+    glm::vec3 boundingSphereCenter;        // world space
+    glm::vec3 boundingSphereFarthestPoint; // world space
+    float shininess;
+    GLuint diffuseLayer;  // layer of the diffuse texture in the texture array of the surface
+    bool cullBackFaces;
+    MeshRange range; // vertex and index range to draw, the selected level of detail of the surface or a part of it
+    GLuint baseInstance;  // first instance in the instance data of the pass
+    GLuint instanceCount; // 0 for a draw that is not instanced
+};
+
+/**
+ * @brief A RenderQueue collects the surface draws of a render pass, sorts them by
+ * a packed 64 bit key and executes them with as few gl state changes as possible.
+ *
+ * Key layout when sorting by state (most significant bits first):
+ * pass (4) | shader (8) | cull state (1) | texture (16) | vao (16) | depth (19)
+ * When sorting front to back, the depth is moved in front of texture and vao,
+ * such that opaque geometry close to the camera is drawn first to maximize early-z rejection.
+ *
+ * With multi-draw indirect enabled, consecutive draws that share cull state, texture and vao
+ * form a state bucket that is issued by a single glMultiDrawElementsIndirect call.
+ * Surfaces sample their diffuse texture from a layer of a texture array, which is passed per draw,
+ * so all surfaces whose textures share an array fall into the same bucket.
+ * Model matrices and materials are then written to a shader storage buffer per draw.
+ *
+ * With gpu culling enabled, the frustum test of the submitted draws is moved to a compute shader,
+ * which compacts the visible draws of each bucket to the start of its indirect command range
+ * and writes the number of visible draws to a parameter buffer read by glMultiDrawElementsIndirectCount.
+ * Without ARB_indirect_parameters, culled commands are kept in place with an instance count of 0.
+ * Draws inside the frustum can additionally be tested against the max depth pyramid of a HiZBuffer.
+ *
+ * Instanced draws read their per-instance transforms from the instance data added to the pass.
+ * Each is culled as a whole on the gpu, so the instances should already be culled individually when submitting.
+ */
+class RenderQueue
+{
+public:
+
+    enum SortMode
+    {
+        SORT_BY_STATE      = 0, // minimize state changes, depth only breaks ties
+        SORT_FRONT_TO_BACK = 1  // draw closest surfaces first, state changes only break ties
+    };
+
+    RenderQueue();
+    ~RenderQueue();
+
+    //! Clear the queue and start collecting draws for the given pass.
+    //! All draws of a pass are executed using the given shader.
+    void begin(
+        RenderPass pass_, //!< [in] the pass submitting draws
+        Shader *shader_, //!< [in] the shader used to execute the draws
+        SortMode sortMode_, //!< [in] how to order the draws
+        float farPlane_ //!< [in] view depth that maps to the maximum depth key
+    );
+
+    //! Add a surface draw to the queue.
+    void submit(
+        Surface *surface, //!< [in] the surface to draw
+        const glm::mat4 &modelMatrix, //!< [in] model matrix to draw the surface with
+        const glm::mat3 &normalMatrix, //!< [in] normal matrix to draw the surface with
+        const glm::vec3 &boundingSphereCenter, //!< [in] world space bounding sphere center of the surface
+        const glm::vec3 &boundingSphereFarthestPoint, //!< [in] world space point on the bounding sphere
+        float viewDepth, //!< [in] distance of the surface to the camera along the view direction
+        float shininess, //!< [in] blinn-phong shininess of the surface material
+        bool cullBackFaces, //!< [in] whether back face culling should be enabled
+        int lod = 0, //!< [in] level of detail of the surface to draw
+        GLuint firstIndex = 0, //!< [in] first index to draw, relative to the start of the level of detail
+        GLuint indexCount = 0 //!< [in] number of indices to draw, 0 draws the whole level of detail
+    );
+
+    //! Add per-instance data for instanced draws of the current pass.
+    /// \return the index of the first added instance, to pass as base instance to submitInstanced
+    GLuint addInstances(
+        const std::vector<InstanceData> &instances //!< [in] the instances to add
+    );
+
+    //! Add an instanced surface draw to the queue.
+    //! The model and normal matrix of the draw are applied before the matrices of each instance.
+    void submitInstanced(
+        Surface *surface, //!< [in] the surface to draw
+        const glm::mat4 &modelMatrix, //!< [in] model matrix applied before the instance matrices
+        const glm::mat3 &normalMatrix, //!< [in] normal matrix applied before the instance matrices
+        const glm::vec3 &boundingSphereCenter, //!< [in] world space bounding sphere center of all instances
+        const glm::vec3 &boundingSphereFarthestPoint, //!< [in] world space point on the bounding sphere of all instances
+        float viewDepth, //!< [in] distance of the closest instance to the camera along the view direction
+        float shininess, //!< [in] blinn-phong shininess of the surface material
+        bool cullBackFaces, //!< [in] whether back face culling should be enabled
+        int lod, //!< [in] level of detail of the surface to draw
+        GLuint baseInstance, //!< [in] first instance to draw, as returned by addInstances
+        GLuint instanceCount //!< [in] number of instances to draw
+    );
+
+    //! Sort the submitted draws by their keys (radix sort).
+    void sort();
+
+    //! Issue all draws in sorted order, changing gl state only where it differs from the previous draw.
+    void execute(Texture::FilterType filterType);
+
+    //! Enable submitting state buckets via glMultiDrawElementsIndirect.
+    //! This is ignored if the gl implementation lacks ARB_shader_draw_parameters.
+    void setMultiDrawIndirect(bool enabled);
+
+    //! \return whether draws are submitted via glMultiDrawElementsIndirect
+    inline bool isMultiDrawIndirectEnabled() const { return multiDrawIndirect; }
+
+    //! Enable frustum culling of the submitted draws in a compute shader.
+    //! Requires multi-draw indirect, otherwise the draws are expected to be culled on the cpu.
+    void setGpuCulling(bool enabled);
+
+    //! \return whether gpu culling is enabled
+    inline bool isGpuCullingEnabled() const { return gpuCulling; }
+
+    //! Let the compute shader cull the draws of the current pass against the frustum of the given camera.
+    //! Must be called after begin, which resets culling to be done on the cpu.
+    void cullOnGpu(
+        Camera *camera, //!< [in] the camera whose projection is used
+        const glm::mat4 &viewMat, //!< [in] the view matrix to cull with
+        HiZBuffer *hiZBuffer = nullptr //!< [in] if given, draws behind its occluders are culled. it must be built from the same view.
+    );
+
+    //! \return the pass currently collecting draws
+    inline RenderPass getPass() const { return pass; }
+
+    //! \return whether the draws of the current pass are culled on the gpu,
+    //! such that submitting geometry should skip its cpu culling.
+    inline bool isCullingOnGpu() const { return gpuCulling && multiDrawIndirect && cullCamera != nullptr; }
+
+    //! Read back the gpu culling results of every pass and compare them to Camera::checkSphereInFrustum.
+    //! Mismatches are reported on stderr. This stalls the pipeline and is meant for validation only.
+    void setGpuCullingValidation(bool enabled);
+
+    //! \return whether gpu culling results are validated against the cpu culler
+    inline bool isGpuCullingValidationEnabled() const { return gpuCullingValidation; }
+
+    //! \return the number of draws found visible by the gpu culling in the last culled pass.
+    //! only counted if validation is enabled, since counting requires a readback.
+    inline int getGpuVisibleCount() const { return gpuVisibleCount; }
+
+    //! \return the number of draws where gpu and cpu culling disagreed since the last resetFrameStatistics
+    inline int getGpuCullingMismatchCount() const { return gpuCullingMismatchCount; }
+
+    //! \return the number of draws rejected by the gpu frustum test over all passes of a recent frame.
+    //! the statistics are read back with a delay of a few frames to avoid stalling.
+    inline GLuint getGpuFrustumCulledCount() const { return gpuFrustumCulledCount; }
+
+    //! \return the number of draws rejected by the hi-z occlusion test over all passes of a recent frame
+    inline GLuint getGpuOcclusionCulledCount() const { return gpuOcclusionCulledCount; }
+
+    //! The number of draws currently submitted
+    inline size_t size() const { return items.size(); }
+
+    //! Reset draw call and state change counters, should be called once per frame.
+    void resetFrameStatistics();
+
+    //! Enable drawing simplified levels of detail of surfaces that are small on screen.
+    void setLodEnabled(bool enabled);
+
+    //! \return whether simplified levels of detail are drawn
+    inline bool isLodEnabled() const { return lodEnabled; }
+
+    //! Set how much coarser the levels of detail of a pass are chosen.
+    //! each unit of bias selects levels as if the surfaces were half as large on screen.
+    void setLodBias(RenderPass pass_, float bias);
+
+    //! \return the level of detail bias of the current pass
+    inline float getLodBias() const { return lodBiases[pass]; }
+
+    //! \return the number of triangles submitted in the given pass since the last resetFrameStatistics
+    inline int getTriangleCount(RenderPass pass_) const { return triangleCounts[pass_]; }
+
+    //! \return the number of triangles the draws submitted in the given pass would have at full resolution
+    inline int getFullDetailTriangleCount(RenderPass pass_) const { return fullDetailTriangleCounts[pass_]; }
+
+    //! \return the number of draw calls issued since the last resetFrameStatistics
+    inline int getDrawCallCount() const { return drawCallCount; }
+
+    //! \return the number of gl state changes issued since the last resetFrameStatistics
+    inline int getStateChangeCount() const { return stateChangeCount; }
+
+private:
+
+    RenderPass pass;
+    Shader *shader = nullptr;
+    SortMode sortMode = SORT_BY_STATE;
+    float farPlane = 1.0f;
+
+    std::vector<DrawItem> items;
+
+    // sorted permutation of item indices and scratch buffers for the radix sort
+    std::vector<uint32_t> sortedIndices;
+    std::vector<uint32_t> scratchIndices;
+    std::vector<uint64_t> sortedKeys;
+    std::vector<uint64_t> scratchKeys;
+
+    int drawCallCount = 0;
+    int stateChangeCount = 0;
+
+    // level of detail selection and statistics per pass
+    bool lodEnabled = true;
+    float lodBiases[RENDER_PASS_COUNT] = {};
+    int triangleCounts[RENDER_PASS_COUNT] = {};
+    int fullDetailTriangleCounts[RENDER_PASS_COUNT] = {};
+
+    // per-instance data of the instanced draws of the current pass
+    std::vector<InstanceData> instanceData;
+    GLuint instanceDataBuffer;
+
+    //! Upload the instance data of the current pass and bind it for the vertex shaders.
+    void uploadInstanceData();
+
+    // multi-draw indirect state
+    bool multiDrawIndirect = false;
+    GLuint indirectBuffer, drawDataBuffer;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<DrawData> drawData;
+    std::vector<GLuint> bucketStarts;
+
+    // gpu culling state
+    bool gpuCulling = false;
+    bool gpuCullingValidation = false;
+    Camera *cullCamera = nullptr;
+    glm::mat4 cullViewMat;
+    HiZBuffer *cullHiZBuffer = nullptr;
+    Shader *cullShader = nullptr;
+    GLuint candidateCommandBuffer, candidateDrawDataBuffer, cullDataBuffer, drawCountBuffer, visibilityBuffer;
+    std::vector<CullData> cullData;
+    std::vector<GLuint> visibility;
+    int gpuVisibleCount = 0;
+    int gpuCullingMismatchCount = 0;
+
+    // per frame culling statistics written by the compute shader, in a ring of buffers read back with delay
+    static const int CULL_STATS_FRAMES = 3;
+    GLuint cullStatsBuffers[CULL_STATS_FRAMES];
+    int cullStatsFrame = 0;
+    GLuint gpuFrustumCulledCount = 0;
+    GLuint gpuOcclusionCulledCount = 0;
+
+    //! Cull the draws written to commands and drawData in a compute shader
+    //! and write the visible ones to the indirect and per-draw data buffers.
+    void cullIndirectDraws(size_t bucketCount, bool compact);
+
+    //! Compare the visibility written by the compute shader to the cpu culler.
+    void validateGpuCulling();
+
+    //! Issue the sorted draws as one glMultiDrawElementsIndirect per state bucket.
+    void executeIndirect(Texture::FilterType filterType);
+
+    //! Set cull state, texture and vao for the given draw where they differ from the previous draw.
+    void applyState(const DrawItem &item, const DrawItem *last, Texture::FilterType filterType);
+
+    //! \return whether two draws share cull state, texture and vao
+    bool haveSameState(const DrawItem &a, const DrawItem &b) const;
+
+    //! \return whether the current pass only needs vertex positions and no textures (shadow and occlusion pass)
+    bool isDepthOnlyPass() const;
+
+    //! \return the texture bound for a surface in the current pass, 0 if the pass needs none
+    GLuint getTexture(const Surface *surface) const;
+
+    //! \return the vao a surface is drawn with in the current pass
+    GLuint getVAO(const Surface *surface) const;
+
+    //! Pack the state of a draw into a sort key.
+    uint64_t makeSortKey(GLuint textureHandle, GLuint vao, float viewDepth, bool cullBackFaces) const;
+};
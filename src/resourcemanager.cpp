@@ -0,0 +1,245 @@
+#include "resourcemanager.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+ResourceManager *ResourceManager::instance = nullptr;
+
+ResourceManager *ResourceManager::getInstance()
+{
+    if (!instance) {
+        instance = new ResourceManager();
+    }
+    return instance;
+}
+
+bool ResourceManager::hasInstance()
+{
+    return instance != nullptr;
+}
+
+void ResourceManager::destroyInstance()
+{
+    delete instance;
+    instance = nullptr;
+}
+
+ResourceManager::ResourceManager()
+    : hitCount(0)
+    , missCount(0)
+{
+}
+
+ResourceManager::~ResourceManager()
+{
+    // resources still owned at this point are leaked by their owners, or outlive the opengl context
+    purgeExpired();
+    if (getResourceCount() > 0) {
+        std::cerr << "WARNING RESOURCE MANAGER: " << getResourceCount() << " resources are still in use at shutdown" << std::endl;
+        for (const ResourceInfo &info : getResourceInfos()) {
+            std::cerr << "    " << info.key << " (" << info.useCount << " owners)" << std::endl;
+        }
+    }
+}
+
+template <typename T, typename Load>
+std::shared_ptr<T> ResourceManager::acquire(ResourceMap<T> &resources, const std::string &key, Load load)
+{
+    std::weak_ptr<T> &entry = resources[key];
+
+    std::shared_ptr<T> resource = entry.lock();
+    if (resource) {
+        hitCount += 1;
+        return resource;
+    }
+
+    // the entry is new or its resource was released, which is replaced in place
+    resource = load();
+    entry = resource;
+    missCount += 1;
+    return resource;
+}
+
+std::shared_ptr<Texture> ResourceManager::getTexture(const std::string &filePath)
+{
+    if (filePath.empty()) {
+        return nullptr;
+    }
+
+    std::string key = canonicalizePath(filePath);
+    return acquire(textures, key, [&key]() {
+        std::shared_ptr<Texture> texture = std::make_shared<Texture>(key);
+        std::cout << "loaded texture: " << key << std::endl;
+        return texture;
+    });
+}
+
+std::shared_ptr<CubemapTexture> ResourceManager::getCubemap(const std::vector<std::string> &facePaths)
+{
+    std::vector<std::string> canonicalPaths;
+    std::string key;
+    for (const std::string &path : facePaths) {
+        canonicalPaths.push_back(canonicalizePath(path));
+        key += (key.empty() ? "" : "|") + canonicalPaths.back();
+    }
+
+    return acquire(cubemaps, key, [&canonicalPaths]() {
+        return std::make_shared<CubemapTexture>(canonicalPaths);
+    });
+}
+
+std::shared_ptr<TextureArray> ResourceManager::getTextureArray(const std::vector<std::shared_ptr<Texture>> &layers)
+{
+    std::string key;
+    for (const std::shared_ptr<Texture> &layer : layers) {
+        key += (key.empty() ? "" : "|") + layer->getFilePath();
+    }
+
+    return acquire(textureArrays, key, [&layers]() {
+        std::shared_ptr<TextureArray> textureArray = std::make_shared<TextureArray>(layers);
+        std::cout << "built texture array of " << layers.size() << " layers, " << layers[0]->getWidth() << "x" << layers[0]->getHeight() << std::endl;
+        return textureArray;
+    });
+}
+
+std::vector<std::shared_ptr<TextureArray>> ResourceManager::getTextureArrays() const
+{
+    std::vector<std::shared_ptr<TextureArray>> liveTextureArrays;
+    for (const auto &entry : textureArrays) {
+        std::shared_ptr<TextureArray> textureArray = entry.second.lock();
+        if (textureArray) {
+            liveTextureArrays.push_back(textureArray);
+        }
+    }
+    return liveTextureArrays;
+}
+
+template <typename T>
+static void purgeExpiredEntries(std::unordered_map<std::string, std::weak_ptr<T>> &resources)
+{
+    for (auto it = resources.begin(); it != resources.end();) {
+        if (it->second.expired()) {
+            it = resources.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void ResourceManager::purgeExpired()
+{
+    purgeExpiredEntries(textures);
+    purgeExpiredEntries(cubemaps);
+    purgeExpiredEntries(textureArrays);
+}
+
+template <typename T>
+static void gatherResourceInfos(const std::unordered_map<std::string, std::weak_ptr<T>> &resources, std::vector<ResourceManager::ResourceInfo> &infos)
+{
+    for (const auto &entry : resources) {
+        std::shared_ptr<T> resource = entry.second.lock();
+        if (resource) {
+            // the temporary reference taken here is not counted
+            infos.push_back({ entry.first, resource->getVramSize(), resource.use_count() - 1 });
+        }
+    }
+}
+
+std::vector<ResourceManager::ResourceInfo> ResourceManager::getResourceInfos() const
+{
+    std::vector<ResourceInfo> infos;
+    gatherResourceInfos(textures, infos);
+    gatherResourceInfos(cubemaps, infos);
+    gatherResourceInfos(textureArrays, infos);
+
+    std::sort(infos.begin(), infos.end(), [](const ResourceInfo &a, const ResourceInfo &b) {
+        return a.vramSize > b.vramSize;
+    });
+    return infos;
+}
+
+size_t ResourceManager::getResourceCount() const
+{
+    size_t count = 0;
+    for (const auto &entry : textures) {
+        count += entry.second.expired() ? 0 : 1;
+    }
+    for (const auto &entry : cubemaps) {
+        count += entry.second.expired() ? 0 : 1;
+    }
+    for (const auto &entry : textureArrays) {
+        count += entry.second.expired() ? 0 : 1;
+    }
+    return count;
+}
+
+size_t ResourceManager::getVramSize() const
+{
+    size_t vramSize = 0;
+    for (const ResourceInfo &info : getResourceInfos()) {
+        vramSize += info.vramSize;
+    }
+    return vramSize;
+}
+
+void ResourceManager::printStats() const
+{
+    std::vector<ResourceInfo> infos = getResourceInfos();
+
+    size_t vramSize = 0;
+    for (const ResourceInfo &info : infos) {
+        vramSize += info.vramSize;
+    }
+
+    std::cout << "resources: " << infos.size() << " loaded, " << vramSize / 1024 << " KB texture memory, "
+              << hitCount << " requests shared, " << missCount << " created." << std::endl;
+    for (const ResourceInfo &info : infos) {
+        std::cout << "    " << info.vramSize / 1024 << " KB, " << info.useCount << " owners: " << info.key << std::endl;
+    }
+}
+
+std::string ResourceManager::canonicalizePath(const std::string &path)
+{
+    std::string normalized = path;
+    std::replace(normalized.begin(), normalized.end(), '\\', '/');
+#ifdef _WIN32
+    // windows file names are case insensitive
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](unsigned char c) {
+        return char(std::tolower(c));
+    });
+#endif
+
+    bool absolute = !normalized.empty() && normalized[0] == '/';
+
+    // split into components, dropping empty and "." ones and resolving ".." against the previous component
+    std::vector<std::string> components;
+    size_t start = 0;
+    while (start <= normalized.size()) {
+        size_t end = normalized.find('/', start);
+        if (end == std::string::npos) {
+            end = normalized.size();
+        }
+        std::string component = normalized.substr(start, end - start);
+        start = end + 1;
+
+        if (component.empty() || component == ".") {
+            continue;
+        }
+        if (component == ".." && !components.empty() && components.back() != "..") {
+            components.pop_back();
+            continue;
+        }
+        if (component == ".." && absolute) {
+            continue; // nothing above the root
+        }
+        components.push_back(component);
+    }
+
+    std::string canonical = absolute ? "/" : "";
+    for (size_t i = 0; i < components.size(); ++i) {
+        canonical += (i > 0 ? "/" : "") + components[i];
+    }
+    return canonical;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <stddef.h>
+
+#include "texture.hpp"
+
+
+/**
+ * @brief The ResourceManager is the one place textures are loaded from files and texture arrays are built,
+ * so that every file is loaded only once, no matter which subsystem asks for it.
+ * Resources are looked up in a hash map keyed by the canonicalized file path.
+ *
+ * The manager holds only weak references. A resource is owned by the objects using it,
+ * and is freed as soon as the last of them releases it. The expired map entries are evicted
+ * when they are looked up again or when purgeExpired is called.
+ */
+class ResourceManager
+{
+public:
+
+    //! The memory used by one live resource.
+    struct ResourceInfo
+    {
+        std::string key;  //!< the canonicalized path, or the paths of the faces or layers separated by '|'
+        size_t vramSize;  //!< bytes in vram
+        long useCount;    //!< number of owners of the resource
+    };
+
+    //! Get the manager shared by all subsystems, created on first use.
+    static ResourceManager *getInstance();
+
+    //! Whether the shared manager currently exists
+    static bool hasInstance();
+
+    //! Delete the shared manager. Resources that are still owned by other objects stay alive until they are released.
+    static void destroyInstance();
+
+    //! Get the texture of a file, loading it if it is not loaded yet.
+    //! Requires an active opengl context.
+    /// \return the shared texture, nullptr if the path is empty
+    std::shared_ptr<Texture> getTexture(
+        const std::string &filePath //!< [in] the path of the image file
+    );
+
+    //! Get the cubemap of 6 face image files, loading it if it is not loaded yet.
+    //! Requires an active opengl context.
+    /// \return the shared cubemap
+    std::shared_ptr<CubemapTexture> getCubemap(
+        const std::vector<std::string> &facePaths //!< [in] the paths of the face images in the order +X, -X, +Y, -Y, +Z, -Z
+    );
+
+    //! Get the texture array holding the given textures as layers in the given order, building it if it does not exist yet.
+    //! The textures must have the same size, format and mip level count.
+    //! Requires an active opengl context.
+    /// \return the shared texture array
+    std::shared_ptr<TextureArray> getTextureArray(
+        const std::vector<std::shared_ptr<Texture>> &layers //!< [in] the textures to copy into the layers
+    );
+
+    //! \return all live texture arrays
+    std::vector<std::shared_ptr<TextureArray>> getTextureArrays() const;
+
+    //! Remove the map entries of all resources that were released by their owners.
+    void purgeExpired();
+
+    //! \return the key and memory of each live resource, sorted by descending memory
+    std::vector<ResourceInfo> getResourceInfos() const;
+
+    //! \return the number of live resources
+    size_t getResourceCount() const;
+
+    //! \return the bytes in vram of all live resources
+    size_t getVramSize() const;
+
+    //! \return the number of requests served by an already loaded resource
+    inline size_t getHitCount() const { return hitCount; }
+
+    //! \return the number of requests that loaded or built a new resource
+    inline size_t getMissCount() const { return missCount; }
+
+    //! Print the memory of all live resources.
+    void printStats() const;
+
+    //! Normalize a file path lexically, so that different spellings of the same file yield the same key.
+    //! backslashes become slashes, repeated slashes and "." components are removed and ".." components are resolved.
+    /// \return the canonicalized path
+    static std::string canonicalizePath(const std::string &path);
+
+private:
+
+    ResourceManager();
+    ~ResourceManager();
+
+    static ResourceManager *instance;
+
+    template <typename T>
+    using ResourceMap = std::unordered_map<std::string, std::weak_ptr<T>>;
+
+    ResourceMap<Texture> textures;
+    ResourceMap<CubemapTexture> cubemaps;
+    ResourceMap<TextureArray> textureArrays;
+
+    size_t hitCount;
+    size_t missCount;
+
+    //! \return the live resource of the given key in the given map, or the one created by load, which is then added to the map
+    template <typename T, typename Load>
+    std::shared_ptr<T> acquire(ResourceMap<T> &resources, const std::string &key, Load load);
+};
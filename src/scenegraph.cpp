@@ -0,0 +1,216 @@
+#include "scenegraph.h"
+
+#include <iostream>
+
+
+const SceneGraph::NodeId SceneGraph::ROOT;
+const int SceneGraph::SLOT_BITS;
+const int SceneGraph::SLOT_MASK;
+const int SceneGraph::GENERATION_MASK;
+
+SceneGraph::SceneGraph()
+    : changed(false)
+{
+    ids.push_back(ROOT);
+    parentIndices.push_back(-1);
+    depths.push_back(0);
+    localMatrices.push_back(glm::mat4(1.0f));
+    worldMatrices.push_back(glm::mat4(1.0f));
+    normalMatrices.push_back(glm::mat3(1.0f));
+    localMatrixChanged.push_back(false);
+    worldMatrixChanged.push_back(false);
+    depthOffsets = { 0, 1 };
+    indices.push_back(0);
+    generations.push_back(0);
+}
+
+SceneGraph::NodeId SceneGraph::addNode(NodeId parent, const glm::mat4 &localMatrix)
+{
+    int parentIndex = getIndex(parent);
+    if (parentIndex < 0) {
+        std::cerr << "ERROR SCENE GRAPH: cannot add a node to the missing node " << parent << std::endl;
+        return -1;
+    }
+
+    int slot;
+    if (freeSlots.empty()) {
+        if (indices.size() > size_t(SLOT_MASK)) {
+            std::cerr << "ERROR SCENE GRAPH: cannot add more than " << SLOT_MASK + 1 << " nodes" << std::endl;
+            return -1;
+        }
+        slot = int(indices.size());
+        indices.push_back(-1);
+        generations.push_back(0);
+    }
+    else {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    NodeId node = (generations[slot] << SLOT_BITS) | slot;
+
+    std::vector<NodeId> parents(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        parents[i] = parentIndices[i] < 0 ? -1 : ids[parentIndices[i]];
+    }
+
+    // the new node is placed after all nodes of its depth, which keeps the arrays sorted by depth
+    int depth = depths[parentIndex] + 1;
+    size_t position = size_t(depth) + 1 < depthOffsets.size() ? depthOffsets[depth + 1] : ids.size();
+    glm::mat4 worldMatrix = worldMatrices[parentIndex] * localMatrix;
+
+    ids.insert(ids.begin() + position, node);
+    parents.insert(parents.begin() + position, parent);
+    parentIndices.insert(parentIndices.begin() + position, -1);
+    depths.insert(depths.begin() + position, depth);
+    localMatrices.insert(localMatrices.begin() + position, localMatrix);
+    worldMatrices.insert(worldMatrices.begin() + position, worldMatrix);
+    normalMatrices.insert(normalMatrices.begin() + position, glm::transpose(glm::inverse(glm::mat3(worldMatrix))));
+    localMatrixChanged.insert(localMatrixChanged.begin() + position, false);
+    worldMatrixChanged.insert(worldMatrixChanged.begin() + position, false);
+
+    rebuildIndices(parents);
+    return node;
+}
+
+void SceneGraph::removeNode(NodeId node)
+{
+    int index = getIndex(node);
+    if (index <= 0) {
+        return;
+    }
+
+    // parents precede their children, so the subtree is marked in one pass
+    std::vector<unsigned char> removed(ids.size(), false);
+    for (size_t i = size_t(index); i < ids.size(); ++i) {
+        removed[i] = int(i) == index || (parentIndices[i] >= 0 && removed[parentIndices[i]]);
+    }
+
+    std::vector<NodeId> parents;
+    size_t kept = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (removed[i]) {
+            int slot = getSlot(ids[i]);
+            indices[slot] = -1;
+            generations[slot] = (generations[slot] + 1) & GENERATION_MASK;
+            freeSlots.push_back(slot);
+            continue;
+        }
+        parents.push_back(parentIndices[i] < 0 ? -1 : ids[parentIndices[i]]);
+        ids[kept] = ids[i];
+        depths[kept] = depths[i];
+        localMatrices[kept] = localMatrices[i];
+        worldMatrices[kept] = worldMatrices[i];
+        normalMatrices[kept] = normalMatrices[i];
+        localMatrixChanged[kept] = localMatrixChanged[i];
+        kept += 1;
+    }
+
+    ids.resize(kept);
+    parentIndices.resize(kept);
+    depths.resize(kept);
+    localMatrices.resize(kept);
+    worldMatrices.resize(kept);
+    normalMatrices.resize(kept);
+    localMatrixChanged.resize(kept);
+    worldMatrixChanged.resize(kept);
+
+    rebuildIndices(parents);
+}
+
+void SceneGraph::setLocalMatrix(NodeId node, const glm::mat4 &localMatrix)
+{
+    int index = getIndex(node);
+    if (index <= 0 || localMatrices[index] == localMatrix) {
+        return;
+    }
+    localMatrices[index] = localMatrix;
+    localMatrixChanged[index] = true;
+    changed = true;
+}
+
+const glm::mat4& SceneGraph::getLocalMatrix(NodeId node) const
+{
+    return localMatrices[getIndex(node)];
+}
+
+const glm::mat4& SceneGraph::getWorldMatrix(NodeId node) const
+{
+    return worldMatrices[getIndex(node)];
+}
+
+const glm::mat3& SceneGraph::getNormalMatrix(NodeId node) const
+{
+    return normalMatrices[getIndex(node)];
+}
+
+SceneGraph::NodeId SceneGraph::getParent(NodeId node) const
+{
+    int parentIndex = parentIndices[getIndex(node)];
+    return parentIndex < 0 ? -1 : ids[parentIndex];
+}
+
+size_t SceneGraph::getNodeCount() const
+{
+    return ids.size();
+}
+
+size_t SceneGraph::getDepthCount() const
+{
+    return depthOffsets.size() - 1;
+}
+
+int SceneGraph::update()
+{
+    if (!changed) {
+        return 0;
+    }
+    changed = false;
+
+    int updatedCount = 0;
+    worldMatrixChanged[0] = false;
+
+    // the nodes of one depth are independent of each other
+    for (size_t depth = 1; depth + 1 < depthOffsets.size(); ++depth) {
+        for (size_t i = depthOffsets[depth]; i < depthOffsets[depth + 1]; ++i) {
+
+            int parentIndex = parentIndices[i];
+            worldMatrixChanged[i] = localMatrixChanged[i] || worldMatrixChanged[parentIndex];
+            if (!worldMatrixChanged[i]) {
+                continue;
+            }
+
+            worldMatrices[i] = worldMatrices[parentIndex] * localMatrices[i];
+            normalMatrices[i] = glm::transpose(glm::inverse(glm::mat3(worldMatrices[i])));
+            localMatrixChanged[i] = false;
+            updatedCount += 1;
+        }
+    }
+
+    return updatedCount;
+}
+
+int SceneGraph::getIndex(NodeId node) const
+{
+    if (node < 0 || size_t(getSlot(node)) >= indices.size() || generations[getSlot(node)] != (node >> SLOT_BITS)) {
+        return -1;
+    }
+    return indices[getSlot(node)];
+}
+
+void SceneGraph::rebuildIndices(const std::vector<NodeId> &parents)
+{
+    for (size_t i = 0; i < ids.size(); ++i) {
+        indices[getSlot(ids[i])] = int(i);
+    }
+    for (size_t i = 0; i < ids.size(); ++i) {
+        parentIndices[i] = parents[i] < 0 ? -1 : indices[getSlot(parents[i])];
+    }
+
+    depthOffsets.clear();
+    for (size_t i = 0; i < ids.size(); ++i) {
+        while (depthOffsets.size() <= size_t(depths[i])) {
+            depthOffsets.push_back(i);
+        }
+    }
+    depthOffsets.push_back(ids.size());
+}
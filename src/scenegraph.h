@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+/**
+ * @brief A SceneGraph holds the transform hierarchy of the scene.
+ * The transforms of all nodes are stored in contiguous arrays (structure of arrays),
+ * sorted by the depth of the nodes in the hierarchy, such that every parent precedes its children.
+ * The world matrices are thus computed in one linear pass over the arrays, and the nodes of one depth
+ * only read world matrices of the previous depth, so each depth could be split among threads.
+ * Only the subtrees below nodes whose local matrix changed are recomputed.
+ *
+ * Nodes are referred to by a stable id, since their position in the arrays changes when nodes are added or removed.
+ * The slots of removed ids are reused, but each reuse gets a new generation in the id, so the ids of removed nodes
+ * (e.g. held by objects attached below a removed node) do not refer to the nodes added later, and removing them does nothing.
+ */
+class SceneGraph
+{
+public:
+    typedef int NodeId;
+
+    //! The root node of the hierarchy, which always exists and has the identity as transform
+    static const NodeId ROOT = 0;
+
+    SceneGraph();
+
+    //! Add a node to the hierarchy.
+    /// \return the id of the new node
+    NodeId addNode(
+        NodeId parent, //!< [in] the node the new node is attached to
+        const glm::mat4 &localMatrix //!< [in] transform of the new node relative to its parent
+    );
+
+    //! Remove a node together with all nodes below it. The root node cannot be removed.
+    //! Ids of nodes that were already removed are ignored.
+    void removeNode(NodeId node);
+
+    //! Set the transform of a node relative to its parent.
+    //! the world matrices of the node and its subtree are recomputed on the next update, if the matrix changed.
+    void setLocalMatrix(NodeId node, const glm::mat4 &localMatrix);
+
+    //! \return the transform of a node relative to its parent
+    const glm::mat4& getLocalMatrix(NodeId node) const;
+
+    //! \return the transform of a node relative to the world, as of the last update
+    const glm::mat4& getWorldMatrix(NodeId node) const;
+
+    //! \return the transposed inverse of the world matrix of a node, to transform normals into world space
+    const glm::mat3& getNormalMatrix(NodeId node) const;
+
+    //! \return the parent of a node, -1 for the root node
+    NodeId getParent(NodeId node) const;
+
+    //! \return the number of nodes including the root node
+    size_t getNodeCount() const;
+
+    //! \return the number of depths of the hierarchy, i.e. 1 if there is only the root node
+    size_t getDepthCount() const;
+
+    //! Recompute the world matrices of all nodes whose local matrix or one of whose ancestors changed.
+    /// \return the number of world matrices recomputed
+    int update();
+
+private:
+    // node data sorted by depth, the index of a node in these arrays is not stable
+    std::vector<NodeId> ids;
+    std::vector<int> parentIndices; // -1 for the root node
+    std::vector<int> depths;
+    std::vector<glm::mat4> localMatrices;
+    std::vector<glm::mat4> worldMatrices;
+    std::vector<glm::mat3> normalMatrices;
+    std::vector<unsigned char> localMatrixChanged;
+    std::vector<unsigned char> worldMatrixChanged; // written during the update only
+
+    // first index of each depth in the node arrays, followed by the node count
+    std::vector<size_t> depthOffsets;
+
+    // an id consists of its slot in the lower bits and the generation of the slot in the upper bits
+    static const int SLOT_BITS = 20;
+    static const int SLOT_MASK = (1 << SLOT_BITS) - 1;
+    static const int GENERATION_MASK = (1 << (31 - SLOT_BITS)) - 1;
+
+    // the array index of each slot, -1 for slots of removed ids, which are reused.
+    // the generation of a slot is incremented when its id is removed.
+    std::vector<int> indices;
+    std::vector<int> generations;
+    std::vector<int> freeSlots;
+
+    // whether any local matrix changed since the last update
+    bool changed;
+
+    //! \return the array index of a node, -1 if the node was removed
+    int getIndex(NodeId node) const;
+
+    //! \return the slot of a node id in indices and generations
+    static int getSlot(NodeId node) { return node & SLOT_MASK; }
+
+    //! Recompute the array index of each id, the parent indices and the depth offsets after nodes moved
+    void rebuildIndices(const std::vector<NodeId> &parents);
+};
@@ -1,24 +1,30 @@
 #pragma once
 
+#include <cmath>
 #include <sstream>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/matrix_access.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 
 //! A base class for all scene objects.
 
-//! A SceneObject holds the transformation matrix and its inverse and provides
-//! functions to manipulate them.
+//! A SceneObject holds its transformation decomposed into translation, rotation
+//! and scale and provides functions to manipulate them.
+//! The model matrix, its inverse and the normal matrix are only built when
+//! requested and cached until the transformation changes. The inverse and the
+//! normal matrix are computed analytically from the decomposition.
+//! Matrices that cannot be decomposed (e.g. with shear) are kept as they are,
+//! the inverse is then computed by a general matrix inversion.
 class SceneObject
 {
 public:
     SceneObject(const glm::mat4 &modelMatrix_)
-        : modelMatrix(modelMatrix_)
     {
-        inverseMatrix = glm::inverse(modelMatrix_);
+        setTransform(modelMatrix_);
     }
 
     virtual ~SceneObject()
@@ -49,9 +55,37 @@ public:
         const glm::mat4 &new_trans_mat //!< [in] new transformation matrix
     );
 
+    //! Replaces current transformation by the given decomposition
+    void setTransform(
+        const glm::vec3 &translation_, //!< [in] new translation
+        const glm::quat &rotation_, //!< [in] new rotation, must be normalized
+        const glm::vec3 &scale_ //!< [in] new scale factors along the local axes
+    );
+
     //! \return the inverse matrix of the current model matrix
     const glm::mat4& getInverseMatrix() const;
 
+    /**
+     * @brief return the transposed inverse of the upper 3x3 of the model matrix.
+     * this should be used to transform normals into world space.
+     * the inverse is used since the normals of a scaled vector are inversely scaled,
+     * the transpose is used to revert the inversion of the rotational components
+     * while not affecting the scale factors which lie on the main diagonal.
+     * mat3 is used since the translational component is irrelevant for normals.
+     * @return the matrix to transform normals into world space.
+     */
+    const glm::mat3& getNormalMatrix() const;
+
+    //! \return whether the transformation is held as translation, rotation and scale.
+    //! if not, getRotation and getScale are meaningless.
+    bool isDecomposed() const;
+
+    //! \return the rotation of the SceneObject
+    const glm::quat& getRotation() const;
+
+    //! \return the scale factors of the SceneObject along its local axes
+    const glm::vec3& getScale() const;
+
     //! Returns the location of the SceneObject.
 
     //! By convention the location of the SceneObject is the rightmost column
@@ -111,33 +145,132 @@ public:
         const glm::mat4 &matrix //!< [in] matrix to get a string representation
     );
 private:
-    glm::mat4 modelMatrix;
-    glm::mat4 inverseMatrix;
+    // the transformation is M = T * R * S if decomposed, else modelMatrix is authoritative
+    glm::vec3 translation;
+    glm::quat rotation;
+    glm::vec3 scaling;
+    bool decomposed;
+
+    // matrices built on demand, valid until the transformation changes
+    mutable glm::mat4 modelMatrix;
+    mutable glm::mat4 inverseMatrix;
+    mutable glm::mat3 normalMatrix;
+    mutable bool modelMatrixValid;
+    mutable bool inverseMatrixValid;
+    mutable bool normalMatrixValid;
+
+    //! Decompose the given matrix into translation, rotation and scale if it has no shear or projection
+    //! \return whether the matrix could be decomposed
+    bool decompose(const glm::mat4 &matrix);
+
+    //! Replace the transformation by the given matrix and its inverse
+    void setMatrices(const glm::mat4 &matrix, const glm::mat4 &inverse);
+
+    //! Invalidate the cached matrices after a change of the decomposition
+    void invalidateMatrices(bool normalMatrixChanged);
+
+    //! \return whether all scale factors are equal, such that the scale commutes with rotations
+    static bool isUniform(const glm::vec3 &scale);
 };
 
 inline const glm::mat4& SceneObject::getMatrix() const
 {
+    if (!modelMatrixValid) {
+        glm::mat3 rotationMatrix = glm::mat3_cast(rotation);
+        modelMatrix[0] = glm::vec4(rotationMatrix[0] * scaling.x, 0.0f);
+        modelMatrix[1] = glm::vec4(rotationMatrix[1] * scaling.y, 0.0f);
+        modelMatrix[2] = glm::vec4(rotationMatrix[2] * scaling.z, 0.0f);
+        modelMatrix[3] = glm::vec4(translation, 1.0f);
+        modelMatrixValid = true;
+    }
     return modelMatrix;
 }
 
 inline const glm::mat4& SceneObject::getInverseMatrix() const
 {
+    if (!inverseMatrixValid) {
+        if (decomposed) {
+            // (T * R * S)^-1 = S^-1 * R^T * T^-1
+            glm::mat3 inverse3 = glm::transpose(glm::mat3_cast(rotation));
+            for (int i = 0; i < 3; ++i) {
+                inverse3[i] /= scaling;
+            }
+            inverseMatrix = glm::mat4(inverse3);
+            inverseMatrix[3] = glm::vec4(-(inverse3 * translation), 1.0f);
+        }
+        else {
+            inverseMatrix = glm::inverse(modelMatrix);
+        }
+        inverseMatrixValid = true;
+    }
     return inverseMatrix;
 }
 
+inline const glm::mat3& SceneObject::getNormalMatrix() const
+{
+    if (!normalMatrixValid) {
+        if (decomposed) {
+            // (S^-1 * R^T)^T = R * S^-1
+            normalMatrix = glm::mat3_cast(rotation);
+            for (int i = 0; i < 3; ++i) {
+                normalMatrix[i] /= scaling[i];
+            }
+        }
+        else {
+            normalMatrix = glm::transpose(glm::mat3(getInverseMatrix()));
+        }
+        normalMatrixValid = true;
+    }
+    return normalMatrix;
+}
+
+inline bool SceneObject::isDecomposed() const
+{
+    return decomposed;
+}
+
+inline const glm::quat& SceneObject::getRotation() const
+{
+    return rotation;
+}
+
+inline const glm::vec3& SceneObject::getScale() const
+{
+    return scaling;
+}
+
 inline glm::vec3 SceneObject::getLocation() const
 {
-    return modelMatrix[3].xyz;
+    return decomposed ? translation : modelMatrix[3].xyz();
 }
 
 inline void SceneObject::setLocation(const glm::vec3 &location)
 {
-    modelMatrix[3] = glm::vec4(location, 1.0f);
+    if (decomposed) {
+        translation = location;
+        invalidateMatrices(false);
+    }
+    else {
+        modelMatrix[3] = glm::vec4(location, 1.0f);
+        inverseMatrixValid = false;
+    }
 }
 
 inline void SceneObject::setTransform(const glm::mat4 &new_trans_mat) {
+    decomposed = decompose(new_trans_mat);
     modelMatrix = new_trans_mat;
-    inverseMatrix = glm::inverse(modelMatrix);
+    modelMatrixValid = true;
+    inverseMatrixValid = false;
+    normalMatrixValid = false;
+}
+
+inline void SceneObject::setTransform(const glm::vec3 &translation_, const glm::quat &rotation_, const glm::vec3 &scale_)
+{
+    translation = translation_;
+    rotation = rotation_;
+    scaling = scale_;
+    decomposed = true;
+    invalidateMatrices(true);
 }
 
 inline void SceneObject::applyTransformation(
@@ -146,67 +279,147 @@ inline void SceneObject::applyTransformation(
     Order mult_order)
 {
     if (mult_order == LEFT) {
-        modelMatrix = trans_mat * modelMatrix;
-        inverseMatrix = inverseMatrix * invtrans_mat;
+        setMatrices(trans_mat * getMatrix(), getInverseMatrix() * invtrans_mat);
     }
     else {
-        modelMatrix = modelMatrix * trans_mat;
-        inverseMatrix = invtrans_mat * inverseMatrix;
+        setMatrices(getMatrix() * trans_mat, invtrans_mat * getInverseMatrix());
     }
 }
 
 inline void SceneObject::rotateX(float radians, Order mult_order)
 {
-    applyTransformation(
-        glm::rotate(glm::mat4(), radians, glm::vec3(1.0f, 0.0f, 0.0f)),
-        glm::rotate(glm::mat4(), -radians, glm::vec3(1.0f, 0.0f, 0.0f)),
-        mult_order
-    );
+    rotate(radians, mult_order, glm::vec3(1.0f, 0.0f, 0.0f));
 }
 
 inline void SceneObject::rotateY(float radians, Order mult_order)
 {
-    applyTransformation(
-        glm::rotate(glm::mat4(), radians, glm::vec3(0.0f, 1.0f, 0.0f)),
-        glm::rotate(glm::mat4(), -radians, glm::vec3(0.0f, 1.0f, 0.0f)),
-        mult_order
-    );
+    rotate(radians, mult_order, glm::vec3(0.0f, 1.0f, 0.0f));
 }
 
 inline void SceneObject::rotateZ(float radians, Order mult_order)
 {
-    applyTransformation(
-        glm::rotate(glm::mat4(), radians, glm::vec3(0.0f, 0.0f, 1.0f)),
-        glm::rotate(glm::mat4(), -radians, glm::vec3(0.0f, 0.0f, 1.0f)),
-        mult_order
-    );
+    rotate(radians, mult_order, glm::vec3(0.0f, 0.0f, 1.0f));
 }
 
 inline void SceneObject::rotate(float radians, Order mult_order, const glm::vec3 &rot_axis)
 {
-    applyTransformation(
-        glm::rotate(glm::mat4(), radians, rot_axis),
-        glm::rotate(glm::mat4(), -radians, rot_axis),
-        mult_order
-    );
+    glm::quat q = glm::angleAxis(radians, glm::normalize(rot_axis));
+
+    if (decomposed && mult_order == LEFT) {
+        // R_inc * T * R * S = T(R_inc * t) * (R_inc * R) * S
+        translation = q * translation;
+        rotation = glm::normalize(q * rotation);
+        invalidateMatrices(true);
+    }
+    else if (decomposed && isUniform(scaling)) {
+        // T * R * S * R_inc = T * (R * R_inc) * S only if S commutes with R_inc
+        rotation = glm::normalize(rotation * q);
+        invalidateMatrices(true);
+    }
+    else {
+        applyTransformation(
+            glm::rotate(glm::mat4(), radians, rot_axis),
+            glm::rotate(glm::mat4(), -radians, rot_axis),
+            mult_order
+        );
+    }
 }
 
 inline void SceneObject::translate(const glm::vec3 &trans_vec, Order mult_order)
 {
-    applyTransformation(
-        glm::translate(glm::mat4(), trans_vec),
-        glm::translate(glm::mat4(), -trans_vec),
-        mult_order
-    );
+    if (decomposed) {
+        // T_inc * T * R * S = T(t + t_inc) * R * S,  T * R * S * T_inc = T(t + R * S * t_inc) * R * S
+        translation += (mult_order == LEFT) ? trans_vec : rotation * (scaling * trans_vec);
+        invalidateMatrices(false);
+    }
+    else {
+        applyTransformation(
+            glm::translate(glm::mat4(), trans_vec),
+            glm::translate(glm::mat4(), -trans_vec),
+            mult_order
+        );
+    }
 }
 
 inline void SceneObject::scale(const glm::vec3 &scaling_vec, Order mult_order)
 {
-    applyTransformation(
-        glm::scale(glm::mat4(), scaling_vec),
-        glm::scale(glm::mat4(), 1.0f / scaling_vec),
-        mult_order
-    );
+    if (decomposed && mult_order == RIGHT) {
+        scaling *= scaling_vec;
+        invalidateMatrices(true);
+    }
+    else if (decomposed && isUniform(scaling_vec)) {
+        // a uniform scale applied from the left scales the translation and commutes with R
+        translation *= scaling_vec;
+        scaling *= scaling_vec;
+        invalidateMatrices(true);
+    }
+    else {
+        applyTransformation(
+            glm::scale(glm::mat4(), scaling_vec),
+            glm::scale(glm::mat4(), 1.0f / scaling_vec),
+            mult_order
+        );
+    }
+}
+
+inline bool SceneObject::decompose(const glm::mat4 &matrix)
+{
+    if (matrix[0][3] != 0.0f || matrix[1][3] != 0.0f || matrix[2][3] != 0.0f || matrix[3][3] != 1.0f) {
+        return false;
+    }
+
+    glm::mat3 rotationMatrix(matrix);
+    glm::vec3 scale(glm::length(rotationMatrix[0]), glm::length(rotationMatrix[1]), glm::length(rotationMatrix[2]));
+    if (scale.x == 0.0f || scale.y == 0.0f || scale.z == 0.0f) {
+        return false;
+    }
+
+    // the axes must be orthogonal, else the matrix contains shear
+    const float epsilon = 1e-4f;
+    if (std::abs(glm::dot(rotationMatrix[0], rotationMatrix[1])) > epsilon * scale.x * scale.y ||
+        std::abs(glm::dot(rotationMatrix[0], rotationMatrix[2])) > epsilon * scale.x * scale.z ||
+        std::abs(glm::dot(rotationMatrix[1], rotationMatrix[2])) > epsilon * scale.y * scale.z) {
+        return false;
+    }
+
+    rotationMatrix[0] /= scale.x;
+    rotationMatrix[1] /= scale.y;
+    rotationMatrix[2] /= scale.z;
+
+    // a mirroring is expressed by a negative scale, such that the rest is a proper rotation
+    if (glm::determinant(rotationMatrix) < 0.0f) {
+        scale.x = -scale.x;
+        rotationMatrix[0] = -rotationMatrix[0];
+    }
+
+    translation = matrix[3].xyz();
+    rotation = glm::normalize(glm::quat_cast(rotationMatrix));
+    scaling = scale;
+    return true;
+}
+
+inline void SceneObject::setMatrices(const glm::mat4 &matrix, const glm::mat4 &inverse)
+{
+    decomposed = decompose(matrix);
+    modelMatrix = matrix;
+    inverseMatrix = inverse;
+    modelMatrixValid = true;
+    inverseMatrixValid = true;
+    normalMatrixValid = false;
+}
+
+inline void SceneObject::invalidateMatrices(bool normalMatrixChanged)
+{
+    modelMatrixValid = false;
+    inverseMatrixValid = false;
+    if (normalMatrixChanged) {
+        normalMatrixValid = false;
+    }
+}
+
+inline bool SceneObject::isUniform(const glm::vec3 &scale)
+{
+    return scale.x == scale.y && scale.y == scale.z;
 }
 
 inline std::string SceneObject::matrixToString(const glm::mat4 &matrix)
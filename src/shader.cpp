@@ -4,6 +4,7 @@ Shader::Shader(const std::string &vertexShader, const std::string &fragmentShade
     : programHandle(0)
     , vertexHandle(0)
     , fragmentHandle(0)
+    , computeHandle(0)
 {
     programHandle = glCreateProgram();
 
@@ -18,9 +19,28 @@ Shader::Shader(const std::string &vertexShader, const std::string &fragmentShade
     linkShaders();
 }
 
+Shader::Shader(const std::string &computeShader)
+    : programHandle(0)
+    , vertexHandle(0)
+    , fragmentHandle(0)
+    , computeHandle(0)
+{
+    programHandle = glCreateProgram();
+
+    if (programHandle == 0) {
+        std::cerr << "ERROR in Shader::Shader: Could not create glsl shader program" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    loadShader(computeShader, GL_COMPUTE_SHADER, computeHandle);
+
+    linkShaders();
+}
+
 Shader::~Shader()
 {
     glDeleteProgram(programHandle);
+    glDeleteShader(computeHandle);
     glDeleteShader(fragmentHandle);
     glDeleteShader(vertexHandle);
 }
@@ -87,8 +107,9 @@ GLint Shader::getUniformLocation(const std::string& name)
 
 void Shader::linkShaders()
 {
-    glAttachShader(programHandle, vertexHandle);
-    glAttachShader(programHandle, fragmentHandle);
+    if (vertexHandle) glAttachShader(programHandle, vertexHandle);
+    if (fragmentHandle) glAttachShader(programHandle, fragmentHandle);
+    if (computeHandle) glAttachShader(programHandle, computeHandle);
     glLinkProgram(programHandle);
 
     // print log on failure
@@ -17,6 +17,9 @@ class Shader
 public:
 
     Shader(const std::string& vertexShader, const std::string& fragmentShader);
+
+	/// Create a compute shader program.
+	explicit Shader(const std::string& computeShader);
     ~Shader();
 
     GLuint programHandle;
@@ -37,6 +40,7 @@ private:
 
     GLuint vertexHandle;
     GLuint fragmentHandle;
+    GLuint computeHandle;
 
 	/// load and compile glsl shader
     void loadShader(
@@ -45,7 +49,8 @@ private:
         GLuint& handle //!< [in,out] the gl context shader id used for retrieval
     );
 
-	/// link compiled shader objects into shader program object
+	/// link compiled shader objects into shader program object.
+	/// only the shader objects that were loaded are attached.
     void linkShaders();
 
 };
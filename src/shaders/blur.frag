@@ -4,18 +4,33 @@ in vec2 texCoord;
 layout(location = 0) out vec4 outColor;
 
 uniform sampler2D ssaoTexture; // the ssao factor for each fragment
+uniform sampler2D depthTexture; // the depth buffer, to weight the neighbors by their depth
+uniform mat4 invProjMat;
 uniform bool filterHorizontally; // else filter vertically
 
 float offsets[9] = float[](-4, -3, -2, -1, 0, 1, 2, 3, 4);
 float kernel[9] = float[](0.05f, 0.1f, 0.1f, 0.15f, 0.2f, 0.15f, 0.1f, 0.1f, 0.05f);
 
+// how fast the weight of a neighbor falls off with its depth difference relative to the pixel depth
+const float DEPTH_SHARPNESS = 50.0f;
+
+// the view space z of a depth buffer value, which does not depend on the screen position for perspective projections
+float viewDepth(float depth)
+{
+    vec4 viewPos = invProjMat * vec4(0.0f, 0.0f, depth * 2.0f - 1.0f, 1.0f);
+    return viewPos.z / viewPos.w;
+}
+
 void main()
 {
 
     float AO = 0.0f;
+    float weightSum = 0.0f;
+    float depth = viewDepth(texture(depthTexture, texCoord).r);
 
     // blur the ssao factors using the filter kernel
-    // horizontal and vertical filtering separated
+    // horizontal and vertical filtering separated.
+    // neighbors at a different depth lie on another surface and are weighted down, so silhouettes stay sharp.
     for (int i = 0; i < 9; ++i) {
         vec2 tc = texCoord;
 
@@ -25,9 +40,16 @@ void main()
             tc.y = texCoord.y + offsets[i] / textureSize(ssaoTexture, 0).y;
         }
 
-        AO += texture(ssaoTexture, tc).r * kernel[i];
+        float sampleDepth = viewDepth(texture(depthTexture, tc).r);
+        float weight = kernel[i] * exp(-DEPTH_SHARPNESS * abs(sampleDepth - depth) / max(abs(depth), 0.001f));
+
+        AO += texture(ssaoTexture, tc).r * weight;
+        weightSum += weight;
     }
 
+    // the center sample always has full depth weight, so the sum is never zero
+    AO /= weightSum;
+
     outColor = vec4(AO, AO, AO, 1);
 
 }
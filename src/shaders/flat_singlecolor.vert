@@ -1,4 +1,12 @@
 #version 450 core
+#extension GL_ARB_shader_draw_parameters : enable
+#ifdef GL_ARB_shader_draw_parameters
+#define DRAW_ID gl_DrawIDARB
+#define BASE_INSTANCE gl_BaseInstanceARB
+#else
+#define DRAW_ID 0
+#define BASE_INSTANCE baseInstance
+#endif
 
 layout(location = 0) in vec3 position;
 
@@ -22,7 +30,44 @@ layout(std140, binding = 0) uniform Matrices
 
 uniform mat4 modelMat;
 
+// per-draw data of a multi-draw indirect call, indexed by drawDataOffset + gl_DrawID.
+// used instead of the per-object uniforms if useDrawData is set.
+// std430 is the gpu memory layout for shader storage blocks.
+// MAKE SURE TO MAINTAIN THE SAME LAYOUT AS THE DrawData STRUCT IN renderqueue.h AND ALL SHADER FILES!
+struct DrawData
+{
+    mat4 modelMat;
+    mat4 normalMat; // mat3 padded to mat4
+    vec4 material;  // x: shininess, y: instanced if > 0, z: layer of the diffuse texture array
+};
+layout(std430, binding = 2) readonly buffer DrawDataBlock
+{
+    DrawData draws[];
+};
+uniform bool useDrawData;
+uniform int drawDataOffset;
+
+// per-instance transforms of instanced draws, indexed by the base instance of the draw + gl_InstanceID.
+// applied after the model matrix of the draw if the draw is instanced.
+// MAKE SURE TO MAINTAIN THE SAME LAYOUT AS THE InstanceData STRUCT IN renderqueue.h AND ALL SHADER FILES!
+struct InstanceData
+{
+    mat4 modelMat;
+    mat4 normalMat; // mat3 padded to mat4
+};
+layout(std430, binding = 10) readonly buffer InstanceDataBlock
+{
+    InstanceData instances[];
+};
+uniform bool useInstanceData; // whether a draw without per-draw data is instanced
+uniform int baseInstance;     // only used without ARB_shader_draw_parameters
+
 void main()
 {
-    gl_Position = projMat * viewMat * modelMat * vec4(position, 1.0);
+    mat4 M = useDrawData ? draws[drawDataOffset + DRAW_ID].modelMat : modelMat;
+    bool instanced = useDrawData ? draws[drawDataOffset + DRAW_ID].material.y > 0 : useInstanceData;
+    if (instanced) {
+        M = instances[BASE_INSTANCE + gl_InstanceID].modelMat * M;
+    }
+    gl_Position = projMat * viewMat * M * vec4(position, 1.0);
 }
@@ -0,0 +1,23 @@
+#version 450 core
+
+// depth only pass, there are no color outputs
+
+in vec2 texCoord;
+flat in float drawDiffuseLayer;
+
+struct Material {
+    sampler2DArray diffuse; // texture unit 0
+    int diffuseLayer;
+};
+uniform Material material;
+uniform bool useDrawData; // the diffuse layer comes from the per-draw data of a multi-draw
+
+void main()
+{
+    // alpha tested surfaces (e.g. the palm leaves) must only occlude where they are opaque,
+    // see textured_blinnphong.frag
+    float diffuseLayer = useDrawData ? drawDiffuseLayer : float(material.diffuseLayer);
+    if (texture(material.diffuse, vec3(texCoord, diffuseLayer)).a < 0.1f) {
+        discard;
+    }
+}
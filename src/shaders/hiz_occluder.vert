@@ -0,0 +1,79 @@
+#version 450 core
+#extension GL_ARB_shader_draw_parameters : enable
+#ifdef GL_ARB_shader_draw_parameters
+#define DRAW_ID gl_DrawIDARB
+#define BASE_INSTANCE gl_BaseInstanceARB
+#else
+#define DRAW_ID 0
+#define BASE_INSTANCE baseInstance
+#endif
+
+layout(location = 0) in vec3 position;
+layout(location = 2) in vec2 uv;
+
+out vec2 texCoord;
+flat out float drawDiffuseLayer; // only valid if useDrawData is set
+
+// uniforms shared with other shaders via a Uniform Buffer Object
+// note: no need to prepend block name when accessing these uniforms
+// std140 is the gpu memory layout for uniform blocks.
+// the compiler is not allowed to pack this layout for optimization,
+// to ensure it stays the same for all shader programs that use it.
+// MAKE SURE TO MAINTAIN UNIFORM BLOCK LAYOUT ACROSS ALL SHADERS FILES!
+// THIS LAYOUT ONLY ALLOWS VECTORS TO BE VEC2 OR VEC4 !!
+// (VEC3 ARE PADDED, BUT DONT RELY ON GL IMPLEMENTATION FOR IT)
+// ORDER OF UNIFORMS WITHIN BLOCK MUST BE CONSISTENT FOR ALL SHADERS !
+// block will be bound to binding point 0, make sure to bind UBO to same binding point.
+layout(std140, binding = 0) uniform Matrices
+{
+    //                    // offset   // byte size
+    mat4 viewMat;         // 0        // 64 (4*4*4, since 4 byte per float, 4 float per vec, 4 vec per mat)
+    mat4 projMat;         // 64       // 64
+    //                    // 128 (block total bytes)
+};
+
+uniform mat4 modelMat;
+
+// per-draw data of a multi-draw indirect call, indexed by drawDataOffset + gl_DrawID.
+// used instead of the per-object uniforms if useDrawData is set.
+// std430 is the gpu memory layout for shader storage blocks.
+// MAKE SURE TO MAINTAIN THE SAME LAYOUT AS THE DrawData STRUCT IN renderqueue.h AND ALL SHADER FILES!
+struct DrawData
+{
+    mat4 modelMat;
+    mat4 normalMat; // mat3 padded to mat4
+    vec4 material;  // x: shininess, y: instanced if > 0, z: layer of the diffuse texture array
+};
+layout(std430, binding = 2) readonly buffer DrawDataBlock
+{
+    DrawData draws[];
+};
+uniform bool useDrawData;
+uniform int drawDataOffset;
+
+// per-instance transforms of instanced draws, indexed by the base instance of the draw + gl_InstanceID.
+// applied after the model matrix of the draw if the draw is instanced.
+// MAKE SURE TO MAINTAIN THE SAME LAYOUT AS THE InstanceData STRUCT IN renderqueue.h AND ALL SHADER FILES!
+struct InstanceData
+{
+    mat4 modelMat;
+    mat4 normalMat; // mat3 padded to mat4
+};
+layout(std430, binding = 10) readonly buffer InstanceDataBlock
+{
+    InstanceData instances[];
+};
+uniform bool useInstanceData; // whether a draw without per-draw data is instanced
+uniform int baseInstance;     // only used without ARB_shader_draw_parameters
+
+void main()
+{
+    mat4 M = useDrawData ? draws[drawDataOffset + DRAW_ID].modelMat : modelMat;
+    bool instanced = useDrawData ? draws[drawDataOffset + DRAW_ID].material.y > 0 : useInstanceData;
+    if (instanced) {
+        M = instances[BASE_INSTANCE + gl_InstanceID].modelMat * M;
+    }
+    gl_Position = projMat * viewMat * M * vec4(position, 1.0);
+    texCoord = uv;
+    drawDiffuseLayer = useDrawData ? draws[drawDataOffset + DRAW_ID].material.z : 0;
+}
@@ -6,9 +6,18 @@ layout(location = 0) out vec4 outColor;
 
 const float SAMPLE_RADIUS = 2.5f; // reference uses 1.5 [causes issues, currently not used]
 
-uniform sampler2D viewPosTexture; // interpolated vertex positions in view space
+// samples at least this many ssao pixels away read the next coarser level of the depth chain, and so on for each doubling
+const float LARGE_RADIUS_PIXELS = 16.0f;
+
+uniform sampler2D depthTexture; // the depth buffer at window resolution
+uniform sampler2D depthChainTexture; // the nearest depth of 2x2, 4x4, ... pixel blocks in its levels
 uniform mat4 projMat;
+uniform mat4 invProjMat;
+uniform int tierLevel; // the ssao resolution is the window resolution divided by 2^tierLevel
+uniform int maxLevel; // the coarsest level samples may read
 uniform int random_vector_array_size; // reference uses 64 [increase for higher quality]
+uniform bool rotateKernel; // rotate the random vectors per pixel and frame, for temporal accumulation
+uniform int frameIndex; // in [0, 64), offsets the rotation pattern each frame
 
 // we use a uniform buffer object for better performance
 layout (std140) uniform RandomVectors
@@ -16,20 +25,59 @@ layout (std140) uniform RandomVectors
     vec3 randomVectors[128]; // array size must be static, so we just allocate as much as we might need
 };
 
+// level 0 is the depth buffer, level n > 0 is level n-1 of the depth chain
+float depthAt(vec2 uv, int level)
+{
+    return level == 0 ? textureLod(depthTexture, uv, 0).r : textureLod(depthChainTexture, uv, float(level - 1)).r;
+}
+
+// interleaved gradient noise in [0,1), which spreads the values of neighboring pixels evenly,
+// such that a small blur or the temporal accumulation resolves them
+float interleavedGradientNoise(vec2 pixel)
+{
+    return fract(52.9829189f * fract(dot(pixel, vec2(0.06711056f, 0.00583715f))));
+}
+
+// reconstruct the view space position of a depth buffer value by inverting the projection
+vec3 viewPosAt(vec2 uv, float depth)
+{
+    vec4 viewPos = invProjMat * vec4(vec3(uv, depth) * 2.0f - 1.0f, 1.0f);
+    return viewPos.xyz / viewPos.w;
+}
+
 void main()
 {
 
-    vec3 viewPos = texture(viewPosTexture, texCoord).xyz;
+    float depth = depthAt(texCoord, tierLevel);
+
+    // the background is not occluded
+    if (depth >= 1.0f) {
+        outColor = vec4(0, 0, 0, 1);
+        return;
+    }
+
+    vec3 viewPos = viewPosAt(texCoord, depth);
+    vec2 ssaoSize = vec2(textureSize(depthTexture, 0)) / exp2(float(tierLevel));
 
     float AO = 0.0f;
 
+    // rotate the kernel around the view direction, differently for each pixel and frame,
+    // such that the few samples of a frame cover other directions in the neighboring pixels and the following frames
+    mat2 kernelRotation = mat2(1.0f);
+    if (rotateKernel) {
+        float angle = 6.2831853f * interleavedGradientNoise(gl_FragCoord.xy + 5.588238f * float(frameIndex));
+        kernelRotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    }
+
     // sample random points to compare depths around the view space position.
     // the more sampled points lie in front of the actual depth at the sampled position,
     // the higher the probability of the surface point to be occluded.
     for (int i = 0; i < random_vector_array_size; ++i) {
 
         // take a random sample point.
-        vec3 samplePos = viewPos + randomVectors[i];
+        vec3 randomVector = randomVectors[i];
+        randomVector.xy = kernelRotation * randomVector.xy;
+        vec3 samplePos = viewPos + randomVector;
 
         // project sample point onto near clipping plane
         // to find the depth value (i.e. actual surface geometry)
@@ -38,7 +86,14 @@ void main()
         offset = projMat * offset; // project onto near clipping plane
         offset.xy /= offset.w; // perform perspective divide
         offset.xy = offset.xy * 0.5f + vec2(0.5f); // transform to [0,1] range
-        float sampleActualSurfaceDepth = texture(viewPosTexture, offset.xy).z-0.08f;
+
+        // far samples read the nearest depth of larger blocks, fetching fewer and closer texels
+        int level = tierLevel;
+        float offsetPixels = length((offset.xy - texCoord) * ssaoSize);
+        if (offsetPixels >= LARGE_RADIUS_PIXELS) {
+            level = min(level + int(log2(offsetPixels / LARGE_RADIUS_PIXELS)) + 1, maxLevel);
+        }
+        float sampleActualSurfaceDepth = viewPosAt(offset.xy, depthAt(offset.xy, level)).z-0.08f;
 
         // compare depth of random sampled point to actual depth at sampled xy position:
         // the function step(edge, value) returns 1 if value > edge, else 0
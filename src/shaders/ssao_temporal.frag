@@ -0,0 +1,87 @@
+#version 450 core
+
+in vec2 texCoord;
+layout(location = 0) out vec4 outColor; // the accumulated ssao factor
+layout(location = 1) out vec4 outHistory; // the accumulated ssao factor and its view space depth, read in the next frame
+
+uniform sampler2D ssaoTexture; // the ssao factors of this frame at the resolution of the ssao tier
+uniform sampler2D historyTexture; // of the previous frame, r is the accumulated ssao factor and g its view space depth
+uniform sampler2D depthTexture; // the depth buffer at window resolution
+uniform sampler2D depthChainTexture; // the nearest depth of 2x2, 4x4, ... pixel blocks in its levels
+uniform int tierLevel; // the ssao resolution is the window resolution divided by 2^tierLevel
+uniform mat4 invProjMat;
+uniform mat4 invViewMat;
+uniform mat4 prevViewMat;
+uniform mat4 prevProjMat;
+uniform bool historyValid; // false in the first frame and after the framebuffers were recreated
+
+// counts the pixels whose history is rejected
+layout(binding = 0, offset = 0) uniform atomic_uint rejectedCount;
+
+// the weight of the current frame for a still pixel, so roughly the last 2 / CURRENT_WEIGHT frames contribute
+const float CURRENT_WEIGHT = 0.1f;
+
+// the weight of the current frame for pixels moving MOVING_PIXELS ssao pixels or more since the previous frame.
+// the history of moving pixels is resampled and lags behind, which shows as ghosting if it is weighted too high.
+const float MOVING_WEIGHT = 0.5f;
+const float MOVING_PIXELS = 8.0f;
+
+// the history is rejected for pixels moving more than this many ssao pixels since the previous frame,
+// since the resampled history of such fast motion no longer matches the surface closely enough to blend
+const float REJECT_PIXELS = 32.0f;
+
+// the history is rejected if its depth differs more than this from the reprojected depth, relative to the depth
+const float DEPTH_TOLERANCE = 0.05f;
+
+// level 0 is the depth buffer, level n > 0 is level n-1 of the depth chain
+float depthAt(vec2 uv, int level)
+{
+    return level == 0 ? textureLod(depthTexture, uv, 0).r : textureLod(depthChainTexture, uv, float(level - 1)).r;
+}
+
+// reconstruct the view space position of a depth buffer value by inverting the projection
+vec3 viewPosAt(vec2 uv, float depth)
+{
+    vec4 viewPos = invProjMat * vec4(vec3(uv, depth) * 2.0f - 1.0f, 1.0f);
+    return viewPos.xyz / viewPos.w;
+}
+
+void main()
+{
+    float AO = texture(ssaoTexture, texCoord).r;
+    float depth = depthAt(texCoord, tierLevel);
+
+    // the background is not occluded and has no history, its depth of 0 never matches a surface
+    if (depth >= 1.0f) {
+        outColor = vec4(0, 0, 0, 1);
+        outHistory = vec4(0, 0, 0, 1);
+        return;
+    }
+
+    // where the surface point of the pixel was on the screen in the previous frame
+    vec3 viewPos = viewPosAt(texCoord, depth);
+    vec4 prevViewPos = prevViewMat * (invViewMat * vec4(viewPos, 1.0f));
+    vec4 prevClipPos = prevProjMat * prevViewPos;
+    vec2 prevUV = prevClipPos.xy / prevClipPos.w * 0.5f + 0.5f;
+
+    // the history is rejected where the point was off screen, or hidden behind another surface (disocclusion).
+    // the linearly filtered history depth also mixes the depths at silhouettes, which rejects the history there.
+    bool rejected = prevClipPos.w <= 0.0f || any(lessThan(prevUV, vec2(0.0f))) || any(greaterThan(prevUV, vec2(1.0f)));
+    vec2 history = textureLod(historyTexture, prevUV, 0).rg;
+    rejected = rejected || abs(history.g - prevViewPos.z) > DEPTH_TOLERANCE * abs(prevViewPos.z);
+
+    // fast moving pixels are rejected by their velocity, slower ones weight the current frame higher
+    float pixelsMoved = length((texCoord - prevUV) * vec2(textureSize(ssaoTexture, 0)));
+    rejected = rejected || pixelsMoved > REJECT_PIXELS;
+
+    if (historyValid && rejected) {
+        atomicCounterIncrement(rejectedCount);
+    }
+    if (historyValid && !rejected) {
+        float weight = mix(CURRENT_WEIGHT, MOVING_WEIGHT, clamp(pixelsMoved / MOVING_PIXELS, 0.0f, 1.0f));
+        AO = mix(history.r, AO, weight);
+    }
+
+    outColor = vec4(AO, AO, AO, 1);
+    outHistory = vec4(AO, viewPos.z, 0, 1);
+}
@@ -0,0 +1,62 @@
+#version 450 core
+
+in vec2 texCoord;
+layout(location = 0) out vec4 outColor;
+
+uniform sampler2D lowResSSAOTexture; // the ssao factors at the resolution of the ssao tier
+uniform sampler2D depthChainTexture; // the nearest depth of pixel blocks, the ssao factors were computed for level lowResLevel
+uniform sampler2D depthTexture; // the depth buffer at window resolution
+uniform int lowResLevel;
+uniform mat4 invProjMat;
+
+// how fast the weight of a sample falls off with its depth difference relative to the pixel depth
+const float DEPTH_SHARPNESS = 50.0f;
+
+// the view space z of a depth buffer value, which does not depend on the screen position for perspective projections
+float viewDepth(float depth)
+{
+    vec4 viewPos = invProjMat * vec4(0.0f, 0.0f, depth * 2.0f - 1.0f, 1.0f);
+    return viewPos.z / viewPos.w;
+}
+
+void main()
+{
+    float depth = viewDepth(texelFetch(depthTexture, ivec2(gl_FragCoord.xy), 0).r);
+
+    // joint bilateral upsampling over the 4x4 low resolution texels around the pixel.
+    // the spatial weights are gaussian in low resolution texels, which also blurs the noise of the random samples,
+    // the depth weights keep the occlusion of one surface from bleeding onto surfaces in front or behind it.
+    ivec2 lowResSize = textureSize(lowResSSAOTexture, 0);
+    vec2 lowResPos = texCoord * vec2(lowResSize) - 0.5f;
+    ivec2 base = ivec2(floor(lowResPos));
+
+    float AO = 0.0f;
+    float weightSum = 0.0f;
+    float nearestDepthDifference = 1e20f;
+    float nearestAO = 0.0f;
+    for (int y = -1; y <= 2; ++y) {
+        for (int x = -1; x <= 2; ++x) {
+            ivec2 coord = clamp(base + ivec2(x, y), ivec2(0), lowResSize - 1);
+            float sampleAO = texelFetch(lowResSSAOTexture, coord, 0).r;
+            float sampleDepth = viewDepth(texelFetch(depthChainTexture, coord, lowResLevel).r);
+
+            vec2 offset = vec2(base + ivec2(x, y)) - lowResPos;
+            float spatialWeight = exp(-0.5f * dot(offset, offset));
+            float depthDifference = abs(sampleDepth - depth);
+            float depthWeight = exp(-DEPTH_SHARPNESS * depthDifference / max(abs(depth), 0.001f));
+
+            AO += sampleAO * spatialWeight * depthWeight;
+            weightSum += spatialWeight * depthWeight;
+
+            if (depthDifference < nearestDepthDifference) {
+                nearestDepthDifference = depthDifference;
+                nearestAO = sampleAO;
+            }
+        }
+    }
+
+    // pixels of thin features may find no sample of similar depth, they take the sample of the nearest depth
+    AO = weightSum > 1e-4f ? AO / weightSum : nearestAO;
+
+    outColor = vec4(AO, AO, AO, 1);
+}
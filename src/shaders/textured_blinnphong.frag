@@ -1,13 +1,13 @@
 #version 450 core
 
 layout(location = 0) out vec4 outColor;
-layout(location = 1) out vec4 outViewSpacePos;
 
 in vec3 P;
 in vec3 N;
 in vec2 texCoord;
 in vec4 PLightSpace;
-in vec4 PViewSpace;
+flat in float drawShininess;
+flat in float drawDiffuseLayer;
 
 // uniforms shared with other shaders via a Uniform Buffer Object
 // see vertex shader for details on how to work with UBOs !!
@@ -23,7 +23,8 @@ layout(std140, binding = 1) uniform LightAndCamera
 };
 
 struct Material {
-    sampler2D diffuse; // texture unit 0
+    sampler2DArray diffuse; // texture unit 0, the diffuse textures of all surfaces of the same size and format
+    int diffuseLayer;       // layer of the diffuse texture of the surface
     vec3 specular;
     float shininess;
 };
@@ -35,6 +36,7 @@ uniform bool useShadows;
 uniform bool useVSM;
 uniform bool useSSAO;
 uniform bool drawTransparent;
+uniform bool useDrawData; // shininess and diffuse layer come from the per-draw data of a multi-draw
 
 float calcShadow(vec4 lightSpacePos)
 {
@@ -103,7 +105,8 @@ void main()
 
     // if texture has rgb only, alpha is set to 1.
     // if there is no texture, all values are 0.
-    vec4 diffuseColor = texture(material.diffuse, texCoord).rgba;
+    float diffuseLayer = useDrawData ? drawDiffuseLayer : float(material.diffuseLayer);
+    vec4 diffuseColor = texture(material.diffuse, vec3(texCoord, diffuseLayer)).rgba;
 
     // for transparent textures (e.g. the palm leaves)
     // since zbuffer would discard fragments of greater depth than the one already found
@@ -134,7 +137,8 @@ void main()
     // Specular
     vec3 halfVec = normalize(lightDir + viewDir); // half vector of light and view vectors
     vec4 specularColor = vec4(1.0f); //texture(specularTexture, texCoord).rgb;
-    vec4 specular = pow(max(dot(halfVec, normal), 0.0f), material.shininess) * lightSpecular * vec4(material.specular, 1);
+    float shininess = useDrawData ? drawShininess : material.shininess;
+    vec4 specular = pow(max(dot(halfVec, normal), 0.0f), shininess) * lightSpecular * vec4(material.specular, 1);
 
 
     // APPLY EFFECTS
@@ -160,8 +164,6 @@ void main()
     if (drawTransparent)
         color.a = color.a * 0.5;
     outColor = vec4((AO*AO * color).rgb, color.a);
-
-    outViewSpacePos = PViewSpace;
 }
 
 
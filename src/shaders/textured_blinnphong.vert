@@ -1,4 +1,12 @@
 #version 450 core
+#extension GL_ARB_shader_draw_parameters : enable
+#ifdef GL_ARB_shader_draw_parameters
+#define DRAW_ID gl_DrawIDARB
+#define BASE_INSTANCE gl_BaseInstanceARB
+#else
+#define DRAW_ID 0
+#define BASE_INSTANCE baseInstance
+#endif
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
@@ -10,7 +18,8 @@ out vec3 P;
 out vec3 N;
 out vec2 texCoord;
 out vec4 PLightSpace;
-out vec4 PViewSpace;
+flat out float drawShininess; // only valid if useDrawData is set
+flat out float drawDiffuseLayer; // only valid if useDrawData is set
 
 // uniforms use the same value for all vertices
 uniform mat4 modelMat;
@@ -19,6 +28,38 @@ uniform vec4 clippingPlane;
 uniform mat4 lightVPMat;
 uniform vec2 useYMirroredCamera; // first value is a bool (> 0 enabled, <= 0 disabled), second value is y mirror position
 
+// per-draw data of a multi-draw indirect call, indexed by drawDataOffset + gl_DrawID.
+// used instead of the per-object uniforms if useDrawData is set.
+// std430 is the gpu memory layout for shader storage blocks.
+// MAKE SURE TO MAINTAIN THE SAME LAYOUT AS THE DrawData STRUCT IN renderqueue.h AND ALL SHADER FILES!
+struct DrawData
+{
+    mat4 modelMat;
+    mat4 normalMat; // mat3 padded to mat4
+    vec4 material;  // x: shininess, y: instanced if > 0, z: layer of the diffuse texture array
+};
+layout(std430, binding = 2) readonly buffer DrawDataBlock
+{
+    DrawData draws[];
+};
+uniform bool useDrawData;
+uniform int drawDataOffset;
+
+// per-instance transforms of instanced draws, indexed by the base instance of the draw + gl_InstanceID.
+// applied after the model matrix of the draw if the draw is instanced.
+// MAKE SURE TO MAINTAIN THE SAME LAYOUT AS THE InstanceData STRUCT IN renderqueue.h AND ALL SHADER FILES!
+struct InstanceData
+{
+    mat4 modelMat;
+    mat4 normalMat; // mat3 padded to mat4
+};
+layout(std430, binding = 10) readonly buffer InstanceDataBlock
+{
+    InstanceData instances[];
+};
+uniform bool useInstanceData; // whether a draw without per-draw data is instanced
+uniform int baseInstance;     // only used without ARB_shader_draw_parameters
+
 // uniforms shared with other shaders via a Uniform Buffer Object
 // note: no need to prepend block name when accessing these uniforms
 // std140 is the gpu memory layout for uniform blocks.
@@ -40,6 +81,23 @@ layout(std140, binding = 0) uniform Matrices
 void main()
 {
 
+    mat4 M = modelMat;
+    mat3 NM = normalMat;
+    bool instanced = useInstanceData;
+    if (useDrawData) {
+        DrawData draw = draws[drawDataOffset + DRAW_ID];
+        M = draw.modelMat;
+        NM = mat3(draw.normalMat);
+        drawShininess = draw.material.x;
+        drawDiffuseLayer = draw.material.z;
+        instanced = draw.material.y > 0;
+    }
+    if (instanced) {
+        InstanceData instance = instances[BASE_INSTANCE + gl_InstanceID];
+        M = instance.modelMat * M;
+        NM = mat3(instance.normalMat) * NM;
+    }
+
     mat4 camMat = inverse(viewMat);
     // use mirrored camera to draw surface as if reflected from water surface
     // just mirror all camera matrix vectors in y direction, for position mirror and increase y by water surface y.
@@ -53,7 +111,7 @@ void main()
     mat4 viewMat = inverse(camMat);
 
 
-    gl_Position = projMat * viewMat * modelMat * vec4(position, 1);
+    gl_Position = projMat * viewMat * M * vec4(position, 1);
 
     // use clipping plane 0 for vertex clipping
     // we define clipping plane as normalized direction vector and distance
@@ -63,13 +121,12 @@ void main()
     // gl_ClipDistance[0] takes exactly the result of such a dot product clipping all that lies before the plane.
     // HOWEVER it defines the plane pointing towards the origin thus the result must be inverted.
     // the values are then interpolated for the fragment shader.
-    gl_ClipDistance[0] = -dot(modelMat * vec4(position, 1), clippingPlane);
+    gl_ClipDistance[0] = -dot(M * vec4(position, 1), clippingPlane);
 
-    P = (modelMat * vec4(position, 1)).xyz;
-    N = normalMat * normal;
+    P = (M * vec4(position, 1)).xyz;
+    N = NM * normal;
     texCoord = uv;
 
     PLightSpace = lightVPMat * vec4(P, 1.0);
-    PViewSpace = viewMat * vec4(P, 1.0);
 
 }
@@ -5,10 +5,17 @@ layout(location = 0) out vec4 outColor;
 in vec3 P;
 in vec3 N;
 in vec2 texCoord;
-in vec4 clipSpacePos;
 
 // uniforms shared with other shaders via a Uniform Buffer Object
 // see vertex shader for details on how to work with UBOs !!
+layout(std140, binding = 0) uniform Matrices
+{
+    //                    // offset   // byte size
+    mat4 viewMat;         // 0        // 64 (4*4*4, since 4 byte per float, 4 float per vec, 4 vec per mat)
+    mat4 projMat;         // 64       // 64
+    //                    // 128 (block total bytes)
+};
+
 layout(std140, binding = 1) uniform LightAndCamera
 {
     //                     // offset   // byte size
@@ -25,6 +32,148 @@ uniform sampler2D refractionTexture; // texture unit 1
 uniform sampler2D waterDistortionDuDvMap; // texture unit 2
 uniform float waveAmplitude;
 uniform float waveTimeBasedShift;
+uniform mat4 reflectionViewProjMat; // the camera the reflection texture was rendered with, the current one unless it is reprojected
+uniform mat4 refractionViewProjMat; // the camera the refraction texture was rendered with
+uniform vec2 reflectionScale; // the lower left part of the reflection texture that was rendered
+uniform vec2 refractionScale; // the lower left part of the refraction texture that was rendered
+
+// screen space reflections, traced in the main pass instead of sampling the reflection texture
+uniform bool screenSpaceReflections;
+uniform sampler2D sceneColorTexture; // texture unit 3, the main pass without the water
+uniform sampler2D sceneDepthTexture; // texture unit 4, the depth of the main pass
+uniform sampler2D depthPyramidTexture; // texture unit 5, nearest depth of 2x2, 4x4, ... blocks of the main pass
+uniform samplerCube skyCubemap; // texture unit 6, sampled where reflected rays leave the screen or hit nothing
+uniform int depthPyramidLevelCount;
+uniform bool useSkyCubemap;
+uniform vec3 skyColor; // used instead of the cubemap when the skybox is disabled
+
+const float MAX_TRACE_DISTANCE = 300.0; // view space length of the reflected rays
+const float HIT_THICKNESS = 1.5; // how far a ray may pass behind a depth sample and still hit it, in view space
+const int MAX_TRACE_ITERATIONS = 64;
+const float SCREEN_EDGE_FADE = 0.1; // hits closer to the screen border are faded to the sky
+
+// screen space position [0,1] of the water fragment for the given camera
+vec2 screenSpaceCoordsFor(mat4 viewProjMat)
+{
+    vec4 clipSpacePos = viewProjMat * vec4(P, 1);
+    vec2 normDeviceCoords = clipSpacePos.xy / clipSpacePos.w; // perspective divide (homogenization after perspective projection)
+    return normDeviceCoords/2 + 0.5; // ndc [-1,1] to screen space [0,1]
+}
+
+// scale screen space coordinates to the rendered part of a texture, keeping the bilinear filter within it
+vec2 renderedTexCoords(vec2 screenSpaceCoords, vec2 scale, sampler2D tex)
+{
+    vec2 halfTexel = 0.5f / vec2(textureSize(tex, 0));
+    return clamp(screenSpaceCoords * scale, halfTexel, scale - halfTexel);
+}
+
+// window depth [0,1] to view space distance along the view direction
+float viewDistance(float depth)
+{
+    return projMat[3][2] / (depth*2 - 1 + projMat[2][2]);
+}
+
+// level 0 is the main pass depth, level n is level n-1 of the depth pyramid
+vec2 depthLevelSize(int level)
+{
+    return vec2(level == 0 ? textureSize(sceneDepthTexture, 0) : textureSize(depthPyramidTexture, level - 1));
+}
+
+float depthAtLevel(vec2 cell, int level)
+{
+    ivec2 p = min(ivec2(cell), ivec2(depthLevelSize(level)) - 1);
+    return level == 0 ? texelFetch(sceneDepthTexture, p, 0).r : texelFetch(depthPyramidTexture, p, level - 1).r;
+}
+
+// trace a ray given in screen space (uv and window depth) from start to start + dir against the main pass depth.
+// the ray skips the cells of the depth pyramid it passes in front of, and descends to finer levels where it may hit.
+// window depth is linear along a screen space line, so all positions on the ray are start + dir*t for t in [0,1].
+// returns whether the ray hit, and the screen position of the hit
+bool traceScreenSpace(vec3 start, vec3 dir, out vec2 hitCoords)
+{
+    // avoid divisions by zero for rays along a screen axis
+    vec2 safeDir = mix(dir.xy, vec2(1e-7), equal(dir.xy, vec2(0)));
+    vec2 cellDirection = step(0, safeDir);
+
+    int level = 0;
+    float t = 0;
+    for (int i = 0; i < MAX_TRACE_ITERATIONS; ++i) {
+        vec3 pos = start + dir*t;
+        if (t > 1 || any(lessThan(pos.xy, vec2(0))) || any(greaterThan(pos.xy, vec2(1)))) {
+            return false;
+        }
+
+        // t where the ray leaves the cell, just past its border to not get stuck on it
+        vec2 size = depthLevelSize(level);
+        vec2 cell = floor(pos.xy * size);
+        vec2 boundary = (cell + cellDirection + sign(safeDir)*0.01) / size;
+        vec2 tBoundary = (boundary - start.xy) / safeDir;
+        float tExit = min(tBoundary.x, tBoundary.y);
+
+        float minDepth = depthAtLevel(cell, level);
+        bool testHit = false;
+        if (pos.z < minDepth) {
+            // in front of everything in the cell, so the ray can only hit where it crosses the nearest depth
+            float tPlane = dir.z > 0 ? (minDepth - start.z) / dir.z : 2.0;
+            if (tPlane < tExit) {
+                t = max(t, tPlane);
+                testHit = level == 0;
+                level = max(level - 1, 0);
+            }
+            else {
+                t = tExit;
+                level = min(level + 1, depthPyramidLevelCount);
+            }
+        }
+        else {
+            testHit = level == 0;
+            level = max(level - 1, 0);
+        }
+
+        if (testHit) {
+            // the depth buffer only has the front surfaces, so rays passing far behind them continue
+            pos = start + dir*t;
+            if (viewDistance(pos.z) - viewDistance(minDepth) < HIT_THICKNESS) {
+                hitCoords = pos.xy;
+                return true;
+            }
+            t = tExit;
+        }
+    }
+    return false;
+}
+
+// trace the reflection of the view ray at the water surface in the main pass, the sky where it does not hit
+vec4 screenSpaceReflection(vec3 viewDir, vec2 distortion)
+{
+    vec3 reflectedDir = reflect(-viewDir, vec3(0,1,0));
+    vec4 sky = useSkyCubemap ? texture(skyCubemap, reflectedDir + vec3(distortion.x, 0, distortion.y)) : vec4(skyColor, 1);
+
+    // the ray ends in front of the near plane, so both ends can be projected
+    vec3 viewStart = (viewMat * vec4(P, 1)).xyz;
+    vec3 viewDirection = mat3(viewMat) * reflectedDir;
+    float near = projMat[3][2] / (projMat[2][2] - 1);
+    float rayLength = MAX_TRACE_DISTANCE;
+    if (viewDirection.z > 0) {
+        rayLength = min(rayLength, (-near*1.01 - viewStart.z) / viewDirection.z);
+    }
+    vec3 viewEnd = viewStart + viewDirection*rayLength;
+
+    vec4 clipStart = projMat * vec4(viewStart, 1);
+    vec4 clipEnd = projMat * vec4(viewEnd, 1);
+    vec3 screenStart = clipStart.xyz / clipStart.w * 0.5 + 0.5;
+    vec3 screenEnd = clipEnd.xyz / clipEnd.w * 0.5 + 0.5;
+
+    vec2 hitCoords;
+    if (!traceScreenSpace(screenStart, screenEnd - screenStart, hitCoords)) {
+        return sky;
+    }
+
+    vec2 edgeDistance = min(hitCoords, 1 - hitCoords);
+    float edgeFade = smoothstep(0, SCREEN_EDGE_FADE, min(edgeDistance.x, edgeDistance.y));
+    vec4 hitColor = texture(sceneColorTexture, clamp(hitCoords + distortion, vec2(0), vec2(1)));
+    return mix(sky, hitColor, edgeFade);
+}
 
 void main()
 {
@@ -41,11 +190,15 @@ void main()
 
     // use screen space position to sample reflection and refraction textures
     // since these are simply textures of the whole screen from different camera position and angle
-    vec2 normDeviceCoords = clipSpacePos.xy / clipSpacePos.w; // perspective divide (homogenization after perspective projection)
-    vec2 screenSpaceCoords = normDeviceCoords/2 + 0.5; // ndc [-1,1] to screen space [0,1]
-    vec2 reflectTexCoords = clamp(screenSpaceCoords + totalDistortion, 0.0001, 0.9999);
-    vec2 refractTexCoords = clamp(screenSpaceCoords + totalDistortion, 0.0001, 0.9999);
-    vec4 reflectColor = texture(reflectionTexture, reflectTexCoords);
+    vec2 refractTexCoords = renderedTexCoords(screenSpaceCoordsFor(refractionViewProjMat) + totalDistortion, refractionScale, refractionTexture);
+    vec4 reflectColor;
+    if (screenSpaceReflections) {
+        reflectColor = screenSpaceReflection(viewDir, totalDistortion);
+    }
+    else {
+        vec2 reflectTexCoords = renderedTexCoords(screenSpaceCoordsFor(reflectionViewProjMat) + totalDistortion, reflectionScale, reflectionTexture);
+        reflectColor = texture(reflectionTexture, reflectTexCoords);
+    }
     vec4 refractColor = texture(refractionTexture, refractTexCoords);
 
     float reflectionFactor = max(dot(viewDir, vec3(0,1,0)), 0); // fresnel effect reflection attenuation
@@ -9,7 +9,6 @@ layout(location = 2) in vec2 uv;
 out vec3 P;
 out vec3 N;
 out vec2 texCoord;
-out vec4 clipSpacePos;
 
 // uniforms use the same value for all vertices
 uniform mat4 modelMat;
@@ -35,8 +34,7 @@ layout(std140, binding = 0) uniform Matrices
 
 void main()
 {
-    clipSpacePos = projMat * viewMat * modelMat * vec4(position, 1);
-    gl_Position = clipSpacePos;
+    gl_Position = projMat * viewMat * modelMat * vec4(position, 1);
 
     P = (modelMat * vec4(position, 1)).xyz;
     N = normalMat * normal;
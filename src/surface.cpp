@@ -1,57 +1,70 @@
 #include "surface.h"
 
-Surface::Surface(const std::vector<Vertex> &vertices_, const std::vector<GLuint> &indices_, const std::shared_ptr<Texture> &texDiffuse_, const std::shared_ptr<Texture> &texSpecular_, const std::shared_ptr<Texture> &texNormal_)
+#include <cmath>
+
+// a surface switches to level of detail i once its bounding sphere covers less than LOD_SCREEN_SIZES[i] of the screen height
+static const float LOD_SCREEN_SIZES[] = { 1.0f, 0.25f, 0.12f, 0.06f };
+static const int LOD_SCREEN_SIZE_COUNT = sizeof(LOD_SCREEN_SIZES) / sizeof(LOD_SCREEN_SIZES[0]);
+
+Surface::Surface(const std::vector<Vertex> &vertices_, const std::vector<GLuint> &indices_, const std::shared_ptr<Texture> &texDiffuse_, const std::shared_ptr<Texture> &texSpecular_, const std::shared_ptr<Texture> &texNormal_,
+                 const std::vector<std::vector<GLuint>> &lodIndices_, const std::vector<Meshlet> &meshlets_)
     : vertices(vertices_)
     , indices(indices_)
+    , lodIndices(lodIndices_)
+    , meshlets(meshlets_)
+    , uvDensity(0)
     , texDiffuse(texDiffuse_)
     , texSpecular(texSpecular_)
     , texNormal(texNormal_)
+    , diffuseLayer(0)
+    , dequantizationMatrix(1.0f)
 {
     calculateBoundingSphere();
+    calculateUvDensity();
     initBuffers();
 }
 
 void Surface::initBuffers()
 {
-    // generate vertex array object (vao) bindings. the vao simply stores the state of the subsequent bindings
-    // so that they can be reactived quickly later, instead of doing it all over again
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    // copy vertex data to GL_ARRAY_BUFFER in vram.
-    glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer); // bind to active context
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW); // copy data
-
-    // copy indices to GL_ELEMENT_ARRAY_BUFFER in vram. these define the mesh structure.
-    glGenBuffers(1, &indexBuffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
-
-    // enable shader attributes at given indices to supply vertex data to them
-    // the indices/layout of the shader attribute are defined in the shader source file
-    GLint positionAttribIndex   = 0;
-    GLint normalAttribIndex     = 1;
-    GLint uvAttribIndex         = 2;
-    glEnableVertexAttribArray(positionAttribIndex);
-    glEnableVertexAttribArray(normalAttribIndex);
-    glEnableVertexAttribArray(uvAttribIndex);
-
-    // associate data from current bound array buffer with shader program attributes
-    // and specify the format of the vertex attrib array data
-    // PARAMETERS:
-    // attrib index in shader, num elements, type, normalized?, vertex attrib array size, offset within the array
-    glVertexAttribPointer(positionAttribIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-    glVertexAttribPointer(normalAttribIndex, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, normal));
-    glVertexAttribPointer(uvAttribIndex, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, uv));
-
-    // unbind vao. the state of bindings until here are stored in vao.
-    glBindVertexArray(0);
+    // copy vertex data and indices to ranges of the shared buffers in vram.
+    // the indices stay relative to the first vertex of this surface and are offset by the base vertex when drawing.
+    MeshArena *arena = MeshArena::getInstance();
 
-    // unbind buffers
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    // the levels of detail follow the full resolution indices in the same allocation
+    std::vector<GLuint> allIndices(indices);
+    lodFirstIndices.assign(1, 0);
+    lodIndexCounts.assign(1, GLuint(indices.size()));
+    for (const std::vector<GLuint> &lod : lodIndices) {
+        lodFirstIndices.push_back(GLuint(allIndices.size()));
+        lodIndexCounts.push_back(GLuint(lod.size()));
+        allIndices.insert(allIndices.end(), lod.begin(), lod.end());
+    }
+
+    if (arena->getVertexFormat() == VERTEX_FORMAT_QUANTIZED) {
+        glm::vec3 bbMin, bbMax;
+        VertexQuantize::calculateBounds(vertices, bbMin, bbMax);
+        std::vector<QuantizedVertex> quantizedVertices = VertexQuantize::quantize(vertices, bbMin, bbMax);
 
+        dequantizationMatrix = VertexQuantize::getDequantizationMatrix(bbMin, bbMax);
+        quantizationError = VertexQuantize::measureError(vertices, quantizedVertices, bbMin, bbMax);
+        // the position stream holds the quantized positions without normals and uvs
+        std::vector<GLushort> positions;
+        positions.reserve(quantizedVertices.size() * 4);
+        for (const QuantizedVertex &vertex : quantizedVertices) {
+            positions.insert(positions.end(), vertex.position, vertex.position + 4);
+        }
+
+        meshAllocation = arena->allocate(quantizedVertices.data(), positions.data(), quantizedVertices.size(), allIndices);
+    }
+    else {
+        std::vector<glm::vec3> positions;
+        positions.reserve(vertices.size());
+        for (const Vertex &vertex : vertices) {
+            positions.push_back(vertex.position);
+        }
+
+        meshAllocation = arena->allocate(vertices.data(), positions.data(), vertices.size(), allIndices);
+    }
 }
 
 void Surface::calculateBoundingSphere()
@@ -70,11 +83,26 @@ void Surface::calculateBoundingSphere()
     for (Vertex v : vertices) {
         float currentRadius = glm::length(v.position - boundingSphereCenter);
         if (currentRadius > maxRadius) {
+            maxRadius = currentRadius;
             boundingSphereFarthestPoint = v.position;
         }
     }
 }
 
+void Surface::calculateUvDensity()
+{
+    // sum the areas of all triangles in object space and in uv space
+    float area = 0, uvArea = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const Vertex &a = vertices[indices[i]], &b = vertices[indices[i+1]], &c = vertices[indices[i+2]];
+        area += glm::length(glm::cross(b.position - a.position, c.position - a.position)) * 0.5f;
+        glm::vec2 uvAB = b.uv - a.uv, uvAC = c.uv - a.uv;
+        uvArea += std::abs(uvAB.x * uvAC.y - uvAB.y * uvAC.x) * 0.5f;
+    }
+
+    uvDensity = area > 0 ? std::sqrt(uvArea / area) : 0;
+}
+
 glm::vec3 Surface::getBoundingSphereCenter()
 {
     return boundingSphereCenter;
@@ -87,22 +115,44 @@ glm::vec3 Surface::getBoundingSphereFarthestPoint()
 
 Surface::~Surface()
 {
-    // delete buffers (free vram)
-    glDeleteBuffers(1, &vertexBuffer);
-    glDeleteBuffers(1, &indexBuffer);
-
-    glDeleteVertexArrays(1, &vao);
+    // release buffer ranges (free vram for other meshes)
+    if (MeshArena::hasInstance()) {
+        MeshArena::getInstance()->free(meshAllocation);
+    }
 }
 
 void Surface::draw(Shader *shader, Texture::FilterType filterType)
+{
+    bindTextures(shader, filterType);
+
+    // draw triangles from given indices
+    glBindVertexArray(getVAO()); // bind the vertex array used to supply vertices
+    drawElements();
+    glBindVertexArray(0);
+
+    // DEBUG PRINT VERTICES
+    //std::cout << vertices.size() << std::endl;
+    /*
+    for (unsigned int i = 0; i < vertices.size(); ++i) {
+        std::cout << "pos " << vertices[i].position[0] << vertices[i].position[1] << vertices[i].position[2] << std::endl;
+        std::cout << "normal " << vertices[i].normal[0] << vertices[i].normal[1] << vertices[i].normal[2] << std::endl;
+        std::cout << "uv " << vertices[i].uv[0] << vertices[i].uv[1] << std::endl;
+
+    }
+    */
+
+}
+
+void Surface::bindTextures(Shader *shader, Texture::FilterType filterType)
 {
     // pass textures to shader
     // for now just uses the diffuse texture
 
-    if (texDiffuse) {
+    if (diffuseArray) {
 		glUniform1i(shader->getUniformLocation("material.diffuse"), 0); // bind shader texture location with texture unit 0
-        texDiffuse->bind(0); // activate texture unit 0 and bind texture to it
-        texDiffuse->setFilterMode(filterType);
+        diffuseArray->bind(0); // activate texture unit 0 and bind texture array to it
+        diffuseArray->setFilterMode(filterType);
+        glUniform1i(shader->getUniformLocation("material.diffuseLayer"), diffuseLayer);
     }
     /*
     if (texSpecular) {
@@ -115,23 +165,95 @@ void Surface::draw(Shader *shader, Texture::FilterType filterType)
         glUniform1i(normalsTexLocation, 2);
         texNormal->bind(2);
     }*/
+}
 
-    // draw triangles from given indices
-    glBindVertexArray(vao); // bind the vertex array used to supply vertices
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0); // use given indices
-    glBindVertexArray(0);
+void Surface::drawElements(int lod)
+{
+    // use given indices, offset to the ranges of this surface in the shared buffers
+    MeshRange range = getMeshRange(lod);
+    glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (GLvoid*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+}
 
-    // DEBUG PRINT VERTICES
-    //std::cout << vertices.size() << std::endl;
-    /*
-    for (unsigned int i = 0; i < vertices.size(); ++i) {
-        std::cout << "pos " << vertices[i].position[0] << vertices[i].position[1] << vertices[i].position[2] << std::endl;
-        std::cout << "normal " << vertices[i].normal[0] << vertices[i].normal[1] << vertices[i].normal[2] << std::endl;
-        std::cout << "uv " << vertices[i].uv[0] << vertices[i].uv[1] << std::endl;
+MeshRange Surface::getMeshRange(int lod) const
+{
+    MeshRange range = MeshArena::getInstance()->getRange(meshAllocation);
+    lod = glm::clamp(lod, 0, getLodCount() - 1);
+    range.firstIndex += lodFirstIndices[lod];
+    range.indexCount = lodIndexCounts[lod];
+    return range;
+}
 
+int Surface::getLodCount() const
+{
+    return int(lodIndexCounts.size());
+}
+
+int Surface::selectLod(float projectedSize) const
+{
+    int lod = 0;
+    while (lod + 1 < getLodCount() && lod + 1 < LOD_SCREEN_SIZE_COUNT && projectedSize < LOD_SCREEN_SIZES[lod + 1]) {
+        lod += 1;
     }
-    */
+    return lod;
+}
+
+const std::vector<Meshlet> &Surface::getMeshlets() const
+{
+    return meshlets;
+}
+
+GLuint Surface::getVAO() const
+{
+    return MeshArena::getInstance()->getVAO();
+}
+
+GLuint Surface::getDepthOnlyVAO() const
+{
+    return MeshArena::getInstance()->getDepthOnlyVAO();
+}
+
+const glm::mat4 &Surface::getDequantizationMatrix() const
+{
+    return dequantizationMatrix;
+}
+
+const QuantizationError &Surface::getQuantizationError() const
+{
+    return quantizationError;
+}
+
+GLuint Surface::getDiffuseTextureHandle() const
+{
+    return diffuseArray ? diffuseArray->getHandle() : 0;
+}
+
+const std::shared_ptr<TextureArray> &Surface::getDiffuseTextureArray() const
+{
+    return diffuseArray;
+}
+
+float Surface::getUvDensity() const
+{
+    return uvDensity;
+}
+
+GLuint Surface::getDiffuseLayer() const
+{
+    return diffuseLayer;
+}
+
+const std::shared_ptr<Texture> &Surface::getDiffuseTexture() const
+{
+    return texDiffuse;
+}
+
+void Surface::setDiffuseTextureArray(const std::shared_ptr<TextureArray> &textureArray, GLuint layer)
+{
+    diffuseArray = textureArray;
+    diffuseLayer = layer;
 
+    // the array holds a copy, so the texture is freed unless other subsystems still use it
+    texDiffuse.reset();
 }
 
 std::vector<Vertex> Surface::getVertices()
@@ -8,19 +8,16 @@
 
 #include "shader.h"
 #include "texture.hpp"
+#include "vertex.h"
+#include "vertexquantize.h"
+#include "meshoptimize.h"
+#include "mesharena.h"
 
 
-//! Vertex struct for internal representation
-struct Vertex {
-    glm::vec3 position;
-    glm::vec3 normal;
-    glm::vec2 uv;
-};
-
 /**
  * @brief A Surface holds mesh data (vertex data and indices) and textures.
- * This communicates with Vertex Buffer Objects to store vertex data directly on GPU memory
- * and with compiled shader programs for drawing.
+ * The vertex data is stored directly on GPU memory in a range of the buffers shared by the MeshArena,
+ * and drawn with compiled shader programs.
  */
 class Surface
 {
@@ -28,40 +25,159 @@ class Surface
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices; // indices associate vertices to define mesh topology
 
+    // Levels of Detail
+    // simplified index lists of the same vertices are stored after the full resolution indices in the index buffer.
+    // offsets are relative to the first index of the allocation, level 0 is the full resolution mesh.
+    std::vector<std::vector<GLuint>> lodIndices;
+    std::vector<GLuint> lodFirstIndices;
+    std::vector<GLuint> lodIndexCounts;
+
+    // Meshlets
+    // clusters of the full resolution indices with bounds for culling parts of large surfaces.
+    // empty if the surface is culled as a whole.
+    std::vector<Meshlet> meshlets;
+
     // Bounding Sphere
     // for view frustum culling
     glm::vec3 boundingSphereCenter;
     glm::vec3 boundingSphereFarthestPoint;
 
+    // average uv units per object space unit, to estimate the mip level the surface needs at some distance
+    float uvDensity;
+
     // Textures
     std::shared_ptr<Texture> texDiffuse, texSpecular, texNormal;
 
-    // handle for vertex array object (vao). the vao simply stores the bindings set when its active
-    // so that they can be reactived quickly later, instead of setting it up all over again.
-    GLuint vao;
+    // the texture array holding a copy of the diffuse texture, and the layer of the copy.
+    // surfaces whose diffuse textures share an array are drawn without binding another texture.
+    std::shared_ptr<TextureArray> diffuseArray;
+    GLuint diffuseLayer;
+
+    // id of the range in the shared vertex and index buffers of the mesh arena holding the mesh data.
+    // all surfaces are drawn through the single vao of the arena.
+    int meshAllocation;
 
-    // handles for vram buffers.
-    GLuint vertexBuffer, indexBuffer;
+    // transforms the vertex positions stored in vram to object space.
+    // identity unless the mesh arena stores quantized vertices.
+    glm::mat4 dequantizationMatrix;
+    QuantizationError quantizationError;
 
     /**
-     * @brief initialize vba, copy vertex data to vram buffers and associate with shader attributes
+     * @brief copy vertex data to the shared vram buffers of the mesh arena
      */
     void initBuffers();
 
 public:
-    Surface(const std::vector<Vertex> &vertices_, const std::vector<GLuint> &indices_, const std::shared_ptr<Texture> &texDiffuse_, const std::shared_ptr<Texture> &texSpecular_, const std::shared_ptr<Texture> &texNormal_);
+    Surface(const std::vector<Vertex> &vertices_, const std::vector<GLuint> &indices_, const std::shared_ptr<Texture> &texDiffuse_, const std::shared_ptr<Texture> &texSpecular_, const std::shared_ptr<Texture> &texNormal_,
+            const std::vector<std::vector<GLuint>> &lodIndices_ = std::vector<std::vector<GLuint>>(),
+            const std::vector<Meshlet> &meshlets_ = std::vector<Meshlet>());
     ~Surface();
 
     std::vector<Vertex> getVertices();
     std::vector<GLuint> getIndices();
 
     /**
-     * @brief draw triangles from vertex data from buffers bound as specified by the vba.
+     * @brief draw triangles from vertex data from the buffers of the mesh arena.
      * note: the transformation matrices must be set already in shader program!
      * @param shader the compiled shader program to use for drawing
      */
     void draw(Shader *shader, Texture::FilterType filterType);
 
+    /**
+     * @brief bind the textures of this surface to the texture units expected by the shader.
+     * @param shader the compiled shader program to use for drawing
+     */
+    void bindTextures(Shader *shader, Texture::FilterType filterType);
+
+    /**
+     * @brief issue the draw call for this surface.
+     * note: the vao, textures and transformation matrices must be set already!
+     * @param lod the level of detail to draw, 0 is full resolution
+     */
+    void drawElements(int lod = 0);
+
+    /**
+     * @brief get the location of the mesh data in the shared buffers of the mesh arena
+     * @param lod the level of detail whose index range is returned, 0 is full resolution
+     * @return the vertex and index ranges of this surface
+     */
+    MeshRange getMeshRange(int lod = 0) const;
+
+    /**
+     * @brief get the number of levels of detail including the full resolution mesh
+     * @return the number of levels of detail, at least 1
+     */
+    int getLodCount() const;
+
+    /**
+     * @brief select the level of detail for the size of the surface on screen.
+     * a coarser level is chosen each time the projected size halves below a threshold.
+     * @param projectedSize diameter of the bounding sphere on screen as a fraction of the screen height
+     * @return the level of detail to draw
+     */
+    int selectLod(float projectedSize) const;
+
+    /**
+     * @brief get the meshlets of the full resolution mesh.
+     * their index ranges are relative to the first index of getMeshRange(0).
+     * @return the meshlets in index order, empty if the surface has none
+     */
+    const std::vector<Meshlet> &getMeshlets() const;
+
+    /**
+     * @brief get the vertex array object used to supply vertices
+     * @return the vao handle
+     */
+    GLuint getVAO() const;
+
+    /**
+     * @brief get the vertex array object supplying only positions, from a tightly packed stream.
+     * it uses the same mesh range as the full vao.
+     * @return the vao handle
+     */
+    GLuint getDepthOnlyVAO() const;
+
+    /**
+     * @brief get the opengl handle of the texture array holding the diffuse texture
+     * @return the texture array handle, or 0 if the surface has no diffuse texture
+     */
+    GLuint getDiffuseTextureHandle() const;
+
+    /**
+     * @brief get the texture array holding the diffuse texture
+     * @return the texture array, nullptr if the surface has no diffuse texture
+     */
+    const std::shared_ptr<TextureArray> &getDiffuseTextureArray() const;
+
+    /**
+     * @brief get the average texture coordinate density of the surface,
+     * i.e. the square root of the ratio of the uv area to the object space area of its triangles.
+     * multiplied with the texture size it gives the texels per object space unit.
+     * @return the uv units per object space unit
+     */
+    float getUvDensity() const;
+
+    /**
+     * @brief get the layer of the diffuse texture in its texture array
+     * @return the layer index, 0 if the surface has no diffuse texture
+     */
+    GLuint getDiffuseLayer() const;
+
+    /**
+     * @brief get the diffuse texture loaded for this surface.
+     * it is released once the texture is copied into a texture array.
+     * @return the diffuse texture, nullptr if there is none or it was released
+     */
+    const std::shared_ptr<Texture> &getDiffuseTexture() const;
+
+    /**
+     * @brief set the texture array layer the diffuse texture was copied to, and release the individual diffuse texture.
+     * the shaders sample the diffuse texture from its texture array layer.
+     * @param textureArray the texture array holding the diffuse texture
+     * @param layer the layer of the diffuse texture in the array
+     */
+    void setDiffuseTextureArray(const std::shared_ptr<TextureArray> &textureArray, GLuint layer);
+
     /**
      * @brief get the center of the bounding sphere
      * for this surface to be used in view frustum culling
@@ -77,11 +193,29 @@ public:
      */
     glm::vec3 getBoundingSphereFarthestPoint();
 
+    /**
+     * @brief get the matrix transforming the vertex positions stored in vram to object space.
+     * it must be applied before the model matrix, i.e. modelMatrix * dequantizationMatrix.
+     * @return the dequantization matrix, identity if the vertices are not quantized
+     */
+    const glm::mat4 &getDequantizationMatrix() const;
+
+    /**
+     * @brief get the error introduced by quantizing the vertices stored in vram
+     * @return the quantization error, zero if the vertices are not quantized
+     */
+    const QuantizationError &getQuantizationError() const;
+
 private:
     /**
      * @brief calculate parameters defining a bounding sphere
      * for this surface to be used in view frustum culling
      */
     void calculateBoundingSphere();
+
+    /**
+     * @brief calculate the average texture coordinate density over all triangles
+     */
+    void calculateUvDensity();
 };
 
@@ -2,11 +2,30 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <limits>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <FreeImagePlus.h>
 
+#include "texturecache.h"
+#include "textureuploadring.h"
+
+
+/// how textures are stored in vram, chosen when they are loaded
+enum TextureCompression
+{
+	TEXTURE_COMPRESSION_OFF     = 0, ///< uncompressed sRGB, mipmaps generated by opengl at every load
+	TEXTURE_COMPRESSION_BC1_BC3 = 1, ///< opaque textures as BC1, textures with alpha as BC3, compressed once and cached
+	TEXTURE_COMPRESSION_BC1_BC7 = 2  ///< opaque textures as BC1, textures with alpha as BC7, compressed once and cached
+};
+
+/// with texture streaming, only the mip levels of at most this size are uploaded when a compressed texture is loaded.
+/// the finer levels are streamed in from the texture cache when needed, see TextureStreamer.
+const GLuint STREAMING_RESIDENT_SIZE = 64;
 
 /// Texture class.
 /// Creates an opengl texture from an image file and stores a handle to it.
@@ -14,11 +33,44 @@ class Texture
 {
 	GLuint handle;
 	const std::string filePath;
+	size_t vramSize; // bytes of the uploaded mip levels
+	GLuint width, height;
+	GLenum internalFormat;
+	GLint levelCount;
+	GLint residentLevel; // finest uploaded mip level, which is the base level of the texture
+	bool compressed;
+	BlockFormat blockFormat; // only valid if compressed
+	BlockFormat cacheAlphaFormat; // the alpha format of the texture cache file, only valid if compressed
+
+	/// load the block compressed mip chain from the texture cache, or build and cache it
+	/// \return false if the image could not be loaded
+	bool loadCompressed();
+
+	/// load the image uncompressed and let opengl generate the mipmaps
+	void loadUncompressed();
+
+	static TextureCompression &compressionSetting();
+	static bool &streamingSetting();
 
 public:
 	Texture(const std::string &filePath);
 	~Texture();
 
+	/// set how textures are stored in vram. only affects textures loaded afterwards.
+	static void setCompression(TextureCompression compression);
+
+	/// get how textures are stored in vram
+	/// \return the compression of textures loaded from now on
+	static TextureCompression getCompression();
+
+	/// set whether compressed textures load only their coarse mip levels, so the finer ones can be streamed.
+	/// only affects textures loaded afterwards.
+	static void setStreaming(bool enabled);
+
+	/// get whether compressed textures load only their coarse mip levels
+	/// \return whether textures loaded from now on are streamed
+	static bool getStreaming();
+
 	enum FilterType {
 		NEAREST_MIPMAP_OFF     = 0, // use nearest neighbor texel color for interpolated pixel
 		NEAREST_MIPMAP_NEAREST = 1, // nearest with mipmapping (nearest mipmap level)
@@ -41,19 +93,282 @@ public:
 	 */
 	void setFilterMode(FilterType filterType);
 
+	/// set the minification and magnification filters of the texture bound to the given target of the active texture unit
+	static void setFilterMode(GLenum target, FilterType filterType);
+
 	/// get the texture file path
 	/// \return the texture file path
 	std::string getFilePath() const;
+
+	/// get the opengl texture handle
+	/// \return the opengl texture handle
+	GLuint getHandle() const;
+
+	/// get the size of the texture in vram
+	/// \return the bytes of all mip levels
+	size_t getVramSize() const;
+
+	/// get the size of mip level 0
+	/// \return the width in texels
+	GLuint getWidth() const;
+
+	/// get the size of mip level 0
+	/// \return the height in texels
+	GLuint getHeight() const;
+
+	/// get the sized opengl format the texels are stored in
+	/// \return the internal format
+	GLenum getInternalFormat() const;
+
+	/// get the number of mip levels
+	/// \return the mip level count, at least 1
+	GLint getLevelCount() const;
+
+	/// get the finest mip level in vram
+	/// \return the resident level, 0 unless the texture is streamed
+	GLint getResidentLevel() const;
+
+	/// get whether the texture was loaded from the texture cache
+	/// \return whether the texture is block compressed
+	bool isCompressed() const;
+
+	/// get the block format of a compressed texture
+	/// \return the block format, only valid if compressed
+	BlockFormat getBlockFormat() const;
+
+	/// get the alpha format of the texture cache file the texture was loaded from
+	/// \return the alpha format to pass to TextureCache, only valid if compressed
+	BlockFormat getCacheAlphaFormat() const;
+};
+
+/// TextureArray class.
+/// Copies textures of the same size, format and mip count into the layers of a GL_TEXTURE_2D_ARRAY,
+/// so that surfaces using any of them can be drawn without binding another texture.
+/// The shaders select the layer per draw.
+///
+/// If the textures were loaded for streaming, only their coarse mip levels are copied.
+/// The array then uses mutable storage, such that the finer levels can be allocated and uploaded
+/// from the texture cache one at a time and freed again, with the base level clamped to the finest resident level.
+class TextureArray
+{
+	GLuint handle;
+	GLuint layerCount;
+	size_t vramSize; // bytes of the resident mip levels of all layers
+	GLuint width, height;
+	GLenum internalFormat;
+	GLint levelCount;
+	size_t blockSize; // bytes per 4x4 block of compressed layers
+
+	// streaming state
+	bool streamable;
+	GLint residentLevel; // finest level in vram, the base level of the array
+	GLint tailLevel;     // the levels from here to the coarsest one are always resident
+	BlockFormat cacheAlphaFormat;
+	std::vector<std::string> layerPaths;
+	float requestedTexelDensity; // texels of level 0 across the screen height, minimum over the surfaces using the array
+
+public:
+	/// all textures must have the same size, internal format and mip level count
+	TextureArray(const std::vector<std::shared_ptr<Texture>> &layers);
+	~TextureArray();
+
+	/// binds this texture array to the given opengl texture unit
+	void bind(
+	    int unit ///< [in] the opengl texture unit to bind to
+	);
+
+	/// set texture minification and magnification filters, see Texture::setFilterMode
+	void setFilterMode(Texture::FilterType filterType);
+
+	/// get the opengl texture handle
+	/// \return the opengl texture handle
+	GLuint getHandle() const;
+
+	/// get the number of layers
+	/// \return the number of textures copied into the array
+	GLuint getLayerCount() const;
+
+	/// get the size of the texture array in vram
+	/// \return the bytes of the resident mip levels of all layers
+	size_t getVramSize() const;
+
+	/// get the size of mip level 0
+	/// \return the width in texels
+	GLuint getWidth() const;
+
+	/// get the number of mip levels
+	/// \return the mip level count, at least 1
+	GLint getLevelCount() const;
+
+	/// get the size a mip level of all layers takes in vram
+	/// \return the bytes of the level
+	size_t getLevelVramSize(GLint level) const;
+
+	/// get whether the finer mip levels are streamed in from the texture cache
+	/// \return whether the array is streamed
+	bool isStreamable() const;
+
+	/// get the finest mip level in vram
+	/// \return the resident level
+	GLint getResidentLevel() const;
+
+	/// get the finest of the mip levels that are always resident
+	/// \return the tail level
+	GLint getTailLevel() const;
+
+	/// get the texture cache file the layers are streamed from
+	/// \return the path of the image file of each layer
+	const std::vector<std::string> &getLayerPaths() const;
+
+	/// get the alpha format of the texture cache files of the layers
+	/// \return the alpha format to pass to TextureCache
+	BlockFormat getCacheAlphaFormat() const;
+
+	/// request the detail a surface using the array is drawn with in the current frame.
+	/// the finest request of the frame decides which mip level should be resident.
+	void requestTexelDensity(
+	    float texelsPerScreenHeight ///< [in] the texels of mip level 0 the surface would span across the screen height
+	);
+
+	/// get the finest detail requested since the last reset
+	/// \return the texels of level 0 across the screen height, infinity if nothing was requested
+	float getRequestedTexelDensity() const;
+
+	/// forget the requests of the current frame
+	void resetRequestedTexelDensity();
+
+	/// upload the next finer mip level of all layers and make it the base level
+	/// \return false if the level is not the one below the resident level
+	bool uploadLevel(
+	    GLint level, ///< [in] the mip level to upload, must be getResidentLevel() - 1
+	    const std::vector<CompressedMip> &layerMips ///< [in] the compressed level of each layer, in layer order
+	);
+
+	/// free the resident level in vram and make the next coarser level the base level
+	/// \return false if only the tail levels are resident
+	bool evictLevel();
+};
+
+/// CubemapTexture class.
+/// Creates an opengl cubemap texture from 6 image files and stores a handle to it.
+class CubemapTexture
+{
+	GLuint handle;
+	const std::vector<std::string> facePaths;
+	size_t vramSize; // bytes of all faces
+
+public:
+	/// face image paths should be given in following order:
+	/// +X (right), -X (left), +Y (top), -Y (bottom), +Z (front), -Z (back)
+	CubemapTexture(const std::vector<std::string> &facePaths);
+	~CubemapTexture();
+
+	/// binds this cubemap to the given opengl texture unit
+	void bind(
+	    int unit ///< [in] the opengl texture unit to bind to
+	);
+
+	/// get the opengl texture handle
+	/// \return the opengl texture handle
+	GLuint getHandle() const;
+
+	/// get the size of the cubemap in vram
+	/// \return the bytes of all faces
+	size_t getVramSize() const;
 };
 
 
 inline Texture::Texture(const std::string &filePath_)
     : filePath(filePath_)
+    , vramSize(0)
+    , width(0)
+    , height(0)
+    , internalFormat(0)
+    , levelCount(1)
+    , residentLevel(0)
+    , compressed(false)
+    , blockFormat(BLOCK_FORMAT_BC1)
+    , cacheAlphaFormat(BLOCK_FORMAT_BC7)
 {
 	glGenTextures(1, &handle); // generate texture object and get its id (object state not yet initialized)
 	glActiveTexture(GL_TEXTURE0); // select the active texture unit of the context
 	glBindTexture(GL_TEXTURE_2D, handle); // first bind to context initializes object state
 
+	if (getCompression() == TEXTURE_COMPRESSION_OFF || !loadCompressed()) {
+		loadUncompressed();
+	}
+
+	setFilterMode(LINEAR_MIPMAP_LINEAR);
+}
+
+inline bool Texture::loadCompressed()
+{
+	BlockFormat alphaFormat = getCompression() == TEXTURE_COMPRESSION_BC1_BC3 ? BLOCK_FORMAT_BC3 : BLOCK_FORMAT_BC7;
+
+	// the compressed mip chain of a previous run is reused while the image file is unchanged, so the image is not even decoded
+	CompressedTexture texture;
+	if (!TextureCache::load(filePath, alphaFormat, texture)) {
+
+		// errors are reported when loading uncompressed instead
+		fipImage img;
+		if (!img.load(filePath.c_str(), 0)) {
+			return false;
+		}
+		bool transparent = img.isTransparent();
+		if (!img.convertTo32Bits()) {
+			return false;
+		}
+
+		// gather the texels in rgba order, the rows stay in the bottom up order of FreeImage like in the uncompressed upload
+		unsigned imageWidth = img.getWidth(), imageHeight = img.getHeight();
+		std::vector<uint8_t> rgba(size_t(imageWidth) * imageHeight * 4);
+		for (unsigned y = 0; y < imageHeight; ++y) {
+			const BYTE *scanLine = img.getScanLine(y);
+			for (unsigned x = 0; x < imageWidth; ++x) {
+				uint8_t *texel = &rgba[(size_t(y) * imageWidth + x) * 4];
+				texel[0] = scanLine[x * 4 + FI_RGBA_RED];
+				texel[1] = scanLine[x * 4 + FI_RGBA_GREEN];
+				texel[2] = scanLine[x * 4 + FI_RGBA_BLUE];
+				texel[3] = transparent ? scanLine[x * 4 + FI_RGBA_ALPHA] : 255;
+			}
+		}
+
+		texture = TextureCompress::compress(rgba, imageWidth, imageHeight, transparent ? alphaFormat : BLOCK_FORMAT_BC1);
+		TextureCache::save(filePath, alphaFormat, texture);
+		std::cout << "compressed texture to " << TextureCompress::getName(texture.format) << ": " << filePath << std::endl;
+	}
+
+	width = texture.mips[0].width;
+	height = texture.mips[0].height;
+	levelCount = GLint(texture.mips.size());
+	compressed = true;
+	blockFormat = texture.format;
+	cacheAlphaFormat = alphaFormat;
+
+	// streamed textures start with their coarse levels only, the base level points to the finest of them
+	residentLevel = 0;
+	while (getStreaming() && residentLevel + 1 < levelCount && std::max(width >> residentLevel, height >> residentLevel) > STREAMING_RESIDENT_SIZE) {
+		residentLevel += 1;
+	}
+
+	// upload the precomputed mip chain, the compressed formats are sRGB like the uncompressed ones
+	// the blocks are staged in the texture upload ring if it exists, so the driver does not copy them synchronously
+	internalFormat = TextureCompress::getGLFormat(texture.format);
+	for (GLint level = residentLevel; level < levelCount; ++level) {
+		const CompressedMip &mip = texture.mips[level];
+		const void *blocks = TextureUploadRing::stageIfEnabled(mip.data.data(), mip.data.size());
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, mip.width, mip.height, 0, GLsizei(mip.data.size()), blocks);
+		vramSize += mip.data.size();
+	}
+	TextureUploadRing::fenceIfEnabled();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, residentLevel);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+	return true;
+}
+
+inline void Texture::loadUncompressed()
+{
 	// load image from file using FreeImagePlus (the FreeImage C++ wrapper)
 	fipImage img;
 	if (!img.load(filePath.c_str(), 0)) {
@@ -65,22 +380,68 @@ inline Texture::Texture(const std::string &filePath_)
 	// parameters: target, mipmap level, internal format, width, heigth, border width, internal format, data format, image data
 	// note: for some reason it seems that 8 bit RGB images are really stored in BGR format.
 	// color texture are usually stored in sRGB gamma corrected color space
+	// the formats are sized, such that textures can be copied into the layers of a TextureArray
+	// the scanlines of FreeImage are padded to 4 bytes, which matches the default unpack alignment.
+	// the texels are staged in the texture upload ring if it exists, so the driver does not copy them synchronously.
+	width = img.getWidth();
+	height = img.getHeight();
+	const void *pixels = TextureUploadRing::stageIfEnabled(img.accessPixels(), size_t(img.getScanWidth()) * height);
 	if (img.isTransparent()) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB_ALPHA, img.getWidth(), img.getHeight(), 0,
-		             GL_BGRA, GL_UNSIGNED_BYTE, img.accessPixels());
+		internalFormat = GL_SRGB8_ALPHA8;
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+		             GL_BGRA, GL_UNSIGNED_BYTE, pixels);
 		std::cout << "found texture with alpha channel: " << filePath << std::endl;
 	} else {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, img.getWidth(), img.getHeight(), 0,
-		             GL_BGR, GL_UNSIGNED_BYTE, img.accessPixels());
+		internalFormat = GL_SRGB8;
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+		             GL_BGR, GL_UNSIGNED_BYTE, pixels);
 	}
+	TextureUploadRing::fenceIfEnabled();
 
 	// automatically generate mipmaps (mip = multum in parvo, i.e. 'much in little')
 	// mipmaps are filtered and downsampled copies of the texture stored compactly in a single file,
 	// used to avoid aliasing effects when the sampling rate is too low for the texture frequency
 	// e.g. for far away surfaces. by taking a filtered average it doesnt matter where the sample hits.
 	glGenerateMipmap(GL_TEXTURE_2D);
+	levelCount = 1;
+	while ((std::max(width, height) >> levelCount) > 0) {
+		levelCount += 1;
+	}
 
-	setFilterMode(LINEAR_MIPMAP_LINEAR);
+	// rgb is padded to 4 bytes per texel, the mipmaps add a third
+	vramSize = size_t(width) * height * 4 * 4 / 3;
+}
+
+inline TextureCompression &Texture::compressionSetting()
+{
+	static TextureCompression compression = TEXTURE_COMPRESSION_BC1_BC7;
+	return compression;
+}
+
+inline bool &Texture::streamingSetting()
+{
+	static bool streaming = false;
+	return streaming;
+}
+
+inline void Texture::setStreaming(bool enabled)
+{
+	streamingSetting() = enabled;
+}
+
+inline bool Texture::getStreaming()
+{
+	return streamingSetting();
+}
+
+inline void Texture::setCompression(TextureCompression compression)
+{
+	compressionSetting() = compression;
+}
+
+inline TextureCompression Texture::getCompression()
+{
+	return compressionSetting();
 }
 
 inline Texture::~Texture()
@@ -95,45 +456,50 @@ inline void Texture::bind(int unit)
 }
 
 inline void Texture::setFilterMode(FilterType filterType)
+{
+	setFilterMode(GL_TEXTURE_2D, filterType);
+}
+
+inline void Texture::setFilterMode(GLenum target, FilterType filterType)
 {
 	switch (filterType) {
 		case NEAREST_MIPMAP_OFF:
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			    target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			    target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 			break;
 		case NEAREST_MIPMAP_NEAREST:
 			glTexParameterf(
-			    GL_TEXTURE_2D,
+			    target,
 			    GL_TEXTURE_MIN_FILTER,
 			    GL_NEAREST_MIPMAP_NEAREST);
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			    target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 			break;
 		case NEAREST_MIPMAP_LINEAR:
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+			    target, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			    target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 			break;
 		case LINEAR_MIPMAP_OFF:
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			    target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			    target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			break;
 		case LINEAR_MIPMAP_NEAREST:
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+			    target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			    target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			break;
 		case LINEAR_MIPMAP_LINEAR:
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			    target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 			glTexParameterf(
-			    GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			    target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			break;
 	}
 }
@@ -143,3 +509,310 @@ inline std::string Texture::getFilePath() const
 	return filePath;
 }
 
+inline GLuint Texture::getHandle() const
+{
+	return handle;
+}
+
+inline size_t Texture::getVramSize() const
+{
+	return vramSize;
+}
+
+inline GLuint Texture::getWidth() const
+{
+	return width;
+}
+
+inline GLuint Texture::getHeight() const
+{
+	return height;
+}
+
+inline GLenum Texture::getInternalFormat() const
+{
+	return internalFormat;
+}
+
+inline GLint Texture::getLevelCount() const
+{
+	return levelCount;
+}
+
+inline GLint Texture::getResidentLevel() const
+{
+	return residentLevel;
+}
+
+inline bool Texture::isCompressed() const
+{
+	return compressed;
+}
+
+inline BlockFormat Texture::getBlockFormat() const
+{
+	return blockFormat;
+}
+
+inline BlockFormat Texture::getCacheAlphaFormat() const
+{
+	return cacheAlphaFormat;
+}
+
+
+inline TextureArray::TextureArray(const std::vector<std::shared_ptr<Texture>> &layers)
+    : layerCount(GLuint(layers.size()))
+    , vramSize(0)
+    , streamable(false)
+    , residentLevel(0)
+    , tailLevel(0)
+    , cacheAlphaFormat(BLOCK_FORMAT_BC7)
+    , requestedTexelDensity(std::numeric_limits<float>::infinity())
+{
+	const Texture &first = *layers[0];
+	width = first.getWidth();
+	height = first.getHeight();
+	internalFormat = first.getInternalFormat();
+	levelCount = first.getLevelCount();
+	blockSize = first.isCompressed() ? TextureCompress::getBlockSize(first.getBlockFormat()) : 0;
+
+	for (const std::shared_ptr<Texture> &layer : layers) {
+		tailLevel = std::max(tailLevel, layer->getResidentLevel());
+		layerPaths.push_back(layer->getFilePath());
+	}
+	residentLevel = tailLevel;
+	streamable = first.isCompressed() && tailLevel > 0;
+	cacheAlphaFormat = first.getCacheAlphaFormat();
+
+	glGenTextures(1, &handle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+
+	if (streamable) {
+		for (GLint level = tailLevel; level < levelCount; ++level) {
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, std::max(width >> level, 1u), std::max(height >> level, 1u), layerCount,
+			                       0, GLsizei(getLevelVramSize(level)), nullptr);
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, tailLevel);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	}
+	else {
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, internalFormat, width, height, layerCount);
+	}
+
+	// the texels and mip levels are copied on the gpu, in their compressed form if the textures are block compressed.
+	// each copy covers a whole mip level, which is allowed for compressed levels smaller than a block.
+	for (GLuint layer = 0; layer < layerCount; ++layer) {
+		for (GLint level = tailLevel; level < levelCount; ++level) {
+			GLsizei levelWidth = std::max(GLsizei(width) >> level, 1);
+			GLsizei levelHeight = std::max(GLsizei(height) >> level, 1);
+			glCopyImageSubData(layers[layer]->getHandle(), GL_TEXTURE_2D, level, 0, 0, 0,
+			                   handle, GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(layer),
+			                   levelWidth, levelHeight, 1);
+		}
+		vramSize += layers[layer]->getVramSize();
+	}
+
+	Texture::setFilterMode(GL_TEXTURE_2D_ARRAY, Texture::LINEAR_MIPMAP_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+inline TextureArray::~TextureArray()
+{
+	glDeleteTextures(1, &handle);
+}
+
+inline void TextureArray::bind(int unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+}
+
+inline void TextureArray::setFilterMode(Texture::FilterType filterType)
+{
+	Texture::setFilterMode(GL_TEXTURE_2D_ARRAY, filterType);
+}
+
+inline GLuint TextureArray::getHandle() const
+{
+	return handle;
+}
+
+inline GLuint TextureArray::getLayerCount() const
+{
+	return layerCount;
+}
+
+inline size_t TextureArray::getVramSize() const
+{
+	return vramSize;
+}
+
+inline GLuint TextureArray::getWidth() const
+{
+	return width;
+}
+
+inline GLint TextureArray::getLevelCount() const
+{
+	return levelCount;
+}
+
+inline size_t TextureArray::getLevelVramSize(GLint level) const
+{
+	size_t levelWidth = std::max(width >> level, 1u);
+	size_t levelHeight = std::max(height >> level, 1u);
+	if (blockSize == 0) {
+		return levelWidth * levelHeight * 4 * layerCount;
+	}
+	return ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockSize * layerCount;
+}
+
+inline bool TextureArray::isStreamable() const
+{
+	return streamable;
+}
+
+inline GLint TextureArray::getResidentLevel() const
+{
+	return residentLevel;
+}
+
+inline GLint TextureArray::getTailLevel() const
+{
+	return tailLevel;
+}
+
+inline const std::vector<std::string> &TextureArray::getLayerPaths() const
+{
+	return layerPaths;
+}
+
+inline BlockFormat TextureArray::getCacheAlphaFormat() const
+{
+	return cacheAlphaFormat;
+}
+
+inline void TextureArray::requestTexelDensity(float texelsPerScreenHeight)
+{
+	requestedTexelDensity = std::min(requestedTexelDensity, texelsPerScreenHeight);
+}
+
+inline float TextureArray::getRequestedTexelDensity() const
+{
+	return requestedTexelDensity;
+}
+
+inline void TextureArray::resetRequestedTexelDensity()
+{
+	requestedTexelDensity = std::numeric_limits<float>::infinity();
+}
+
+inline bool TextureArray::uploadLevel(GLint level, const std::vector<CompressedMip> &layerMips)
+{
+	if (!streamable || level != residentLevel - 1 || layerMips.size() != layerCount) {
+		return false;
+	}
+
+	GLsizei levelWidth = std::max(GLsizei(width) >> level, 1);
+	GLsizei levelHeight = std::max(GLsizei(height) >> level, 1);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+	glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, levelWidth, levelHeight, layerCount, 0, GLsizei(getLevelVramSize(level)), nullptr);
+	for (GLuint layer = 0; layer < layerCount; ++layer) {
+		const CompressedMip &mip = layerMips[layer];
+		const void *blocks = TextureUploadRing::stageIfEnabled(mip.data.data(), mip.data.size());
+		glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, GLint(layer), levelWidth, levelHeight, 1,
+		                          internalFormat, GLsizei(mip.data.size()), blocks);
+	}
+	TextureUploadRing::fenceIfEnabled();
+
+	// the level is only sampled once it is complete
+	residentLevel = level;
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, residentLevel);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	vramSize += getLevelVramSize(level);
+	return true;
+}
+
+inline bool TextureArray::evictLevel()
+{
+	if (!streamable || residentLevel >= tailLevel) {
+		return false;
+	}
+
+	GLint level = residentLevel;
+	residentLevel += 1;
+
+	// respecifying the level with no texels frees its memory, it is outside the base level range already
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, residentLevel);
+	glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, 0, 0, 0, 0, 0, nullptr);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	vramSize -= getLevelVramSize(level);
+	return true;
+}
+
+
+inline CubemapTexture::CubemapTexture(const std::vector<std::string> &facePaths_)
+    : facePaths(facePaths_)
+    , vramSize(0)
+{
+	glGenTextures(1, &handle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, handle);
+
+	// load and assign 6 cubemap face images
+	// GL_TEXTURE_CUBE_MAP_POSITIVE_X is an integer enum that can be incremented
+	fipImage img;
+	for (GLuint i = 0; i < facePaths.size(); ++i) {
+
+		// load image from file using FreeImagePlus (the FreeImage C++ wrapper)
+		if (!img.load(facePaths[i].c_str(), 0)) {
+			std::cerr << "ERROR: FreeImage could not load image file '" << facePaths[i] << "'." << std::endl;
+		} else {
+			std::cout << "loaded cubemap face " << i << ": " << facePaths[i] << std::endl;
+		}
+
+		// create texture for current cubemap face, staged in the texture upload ring if it exists
+		const void *pixels = TextureUploadRing::stageIfEnabled(img.accessPixels(), size_t(img.getScanWidth()) * img.getHeight());
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
+		             GL_RGB, img.getWidth(), img.getHeight(), 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+		// rgb is padded to 4 bytes per texel
+		vramSize += size_t(img.getWidth()) * img.getHeight() * 4;
+	}
+	TextureUploadRing::fenceIfEnabled();
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+inline CubemapTexture::~CubemapTexture()
+{
+	glDeleteTextures(1, &handle);
+}
+
+inline void CubemapTexture::bind(int unit)
+{
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, handle);
+}
+
+inline GLuint CubemapTexture::getHandle() const
+{
+	return handle;
+}
+
+inline size_t CubemapTexture::getVramSize() const
+{
+	return vramSize;
+}
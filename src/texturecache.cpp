@@ -0,0 +1,125 @@
+#include "texturecache.h"
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "binarycache.h"
+
+namespace TextureCache
+{
+
+using namespace BinaryCache;
+
+static const char MAGIC[8] = { 'T', 'E', 'X', 'C', 'A', 'C', 'H', 'E' };
+
+std::string getCachePath(const std::string &imagePath, BlockFormat alphaFormat)
+{
+    return imagePath + "." + (alphaFormat == BLOCK_FORMAT_BC3 ? "bc3" : "bc7") + ".texcache";
+}
+
+// open the cache file of an image and read its header, if it is valid for the current image file
+static bool openCache(const std::string &imagePath, BlockFormat alphaFormat, std::ifstream &file, uint32_t &format, uint32_t &mipCount)
+{
+    SourceStamp sourceStamp;
+    if (!getSourceStamp(imagePath, sourceStamp)) {
+        return false;
+    }
+
+    file.open(getCachePath(imagePath, alphaFormat), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    if (!readHeader(file, MAGIC, VERSION, sourceStamp)) {
+        std::cout << "texture cache " << getCachePath(imagePath, alphaFormat) << " is outdated." << std::endl;
+        return false;
+    }
+
+    return readValue(file, format) && format <= BLOCK_FORMAT_BC7 && readValue(file, mipCount);
+}
+
+bool load(const std::string &imagePath, BlockFormat alphaFormat, CompressedTexture &texture)
+{
+    std::ifstream file;
+    uint32_t format, mipCount;
+    if (!openCache(imagePath, alphaFormat, file, format, mipCount)) {
+        return false;
+    }
+
+    CompressedTexture loadedTexture;
+    loadedTexture.format = BlockFormat(format);
+    loadedTexture.mips.resize(mipCount);
+    for (CompressedMip &mip : loadedTexture.mips) {
+        uint64_t size;
+        if (!readValue(file, mip.width) || !readValue(file, mip.height) || !readValue(file, size)) {
+            std::cerr << "ERROR: texture cache " << getCachePath(imagePath, alphaFormat) << " is truncated." << std::endl;
+            return false;
+        }
+        mip.data.resize(size_t(size));
+        if (!file.read(reinterpret_cast<char *>(mip.data.data()), mip.data.size())) {
+            std::cerr << "ERROR: texture cache " << getCachePath(imagePath, alphaFormat) << " is truncated." << std::endl;
+            return false;
+        }
+    }
+
+    std::swap(texture, loadedTexture);
+    return true;
+}
+
+bool loadLevel(const std::string &imagePath, BlockFormat alphaFormat, uint32_t level, CompressedMip &mip)
+{
+    std::ifstream file;
+    uint32_t format, mipCount;
+    if (!openCache(imagePath, alphaFormat, file, format, mipCount) || level >= mipCount) {
+        return false;
+    }
+
+    // the levels are stored from the finest to the coarsest, each preceded by its size
+    for (uint32_t i = 0; i <= level; ++i) {
+        uint64_t size;
+        if (!readValue(file, mip.width) || !readValue(file, mip.height) || !readValue(file, size)) {
+            std::cerr << "ERROR: texture cache " << getCachePath(imagePath, alphaFormat) << " is truncated." << std::endl;
+            return false;
+        }
+        if (i < level) {
+            file.seekg(std::streamoff(size), std::ios::cur);
+            continue;
+        }
+        mip.data.resize(size_t(size));
+        if (!file.read(reinterpret_cast<char *>(mip.data.data()), mip.data.size())) {
+            std::cerr << "ERROR: texture cache " << getCachePath(imagePath, alphaFormat) << " is truncated." << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool save(const std::string &imagePath, BlockFormat alphaFormat, const CompressedTexture &texture)
+{
+    SourceStamp sourceStamp;
+    if (!getSourceStamp(imagePath, sourceStamp)) {
+        return false;
+    }
+
+    std::ofstream file(getCachePath(imagePath, alphaFormat), std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "ERROR: could not write texture cache " << getCachePath(imagePath, alphaFormat) << std::endl;
+        return false;
+    }
+
+    writeHeader(file, MAGIC, VERSION, sourceStamp);
+    writeValue(file, uint32_t(texture.format));
+    writeValue(file, uint32_t(texture.mips.size()));
+
+    for (const CompressedMip &mip : texture.mips) {
+        writeValue(file, mip.width);
+        writeValue(file, mip.height);
+        writeValue(file, uint64_t(mip.data.size()));
+        file.write(reinterpret_cast<const char *>(mip.data.data()), mip.data.size());
+    }
+
+    return bool(file);
+}
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+#include "texturecompress.h"
+
+
+/**
+ * @brief The TextureCache stores block compressed textures with their mip chains
+ * in a binary file next to the image file, so that later runs skip decoding, mip generation and compression.
+ * A cache file is only used if it was written from an image file of the same size and modification time
+ * by the same cache version.
+ */
+namespace TextureCache
+{
+
+    //! Bump this whenever the stored data or the processing producing it changes.
+    const uint32_t VERSION = 1;
+
+    //! \return the path of the cache file belonging to the given image file.
+    //! textures with alpha are compressed to the given alpha format, so each alpha format has its own cache file.
+    std::string getCachePath(const std::string &imagePath, BlockFormat alphaFormat);
+
+    //! Load the cached compressed texture of an image file.
+    /// \return false if there is no valid cache for the image file
+    bool load(
+        const std::string &imagePath, //!< [in] path of the image file the cache was written for
+        BlockFormat alphaFormat, //!< [in] the format textures with alpha were compressed to
+        CompressedTexture &texture //!< [out] the cached texture
+    );
+
+    //! Load a single mip level of the cached compressed texture of an image file, skipping the other levels.
+    //! used to stream in finer levels of a texture after its coarse levels were uploaded.
+    /// \return false if there is no valid cache for the image file or it has no such level
+    bool loadLevel(
+        const std::string &imagePath, //!< [in] path of the image file the cache was written for
+        BlockFormat alphaFormat, //!< [in] the format textures with alpha were compressed to
+        uint32_t level, //!< [in] the mip level to load, 0 is the full resolution level
+        CompressedMip &mip //!< [out] the cached mip level
+    );
+
+    //! Write the compressed texture of an image file to its cache file.
+    /// \return false if the cache file could not be written
+    bool save(
+        const std::string &imagePath, //!< [in] path of the image file the texture was compressed from
+        BlockFormat alphaFormat, //!< [in] the format textures with alpha were compressed to
+        const CompressedTexture &texture //!< [in] the texture to cache
+    );
+
+}
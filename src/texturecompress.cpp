@@ -0,0 +1,558 @@
+#include "texturecompress.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace TextureCompress
+{
+
+// resolution of the table converting linear intensities back to sRGB
+static const int LINEAR_TO_SRGB_STEPS = 4096;
+
+// the interpolation weights of BC7 4 bit indices, out of 64
+static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// lookup tables between 8 bit sRGB and linear intensities
+struct SrgbTables
+{
+    float toLinear[256];
+    uint8_t toSrgb[LINEAR_TO_SRGB_STEPS];
+
+    SrgbTables()
+    {
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i < LINEAR_TO_SRGB_STEPS; ++i) {
+            float l = i / float(LINEAR_TO_SRGB_STEPS - 1);
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            toSrgb[i] = uint8_t(std::min(std::max(int(c * 255.0f + 0.5f), 0), 255));
+        }
+    }
+};
+
+static const SrgbTables &getSrgbTables()
+{
+    static const SrgbTables tables;
+    return tables;
+}
+
+//! convert 8 bit sRGB texels to linear floats, alpha is linear already
+static std::vector<float> toLinear(const std::vector<uint8_t> &rgba)
+{
+    const SrgbTables &tables = getSrgbTables();
+    std::vector<float> result(rgba.size());
+    for (size_t i = 0; i < rgba.size(); i += 4) {
+        result[i + 0] = tables.toLinear[rgba[i + 0]];
+        result[i + 1] = tables.toLinear[rgba[i + 1]];
+        result[i + 2] = tables.toLinear[rgba[i + 2]];
+        result[i + 3] = rgba[i + 3] / 255.0f;
+    }
+    return result;
+}
+
+//! convert linear float texels back to 8 bit sRGB
+static std::vector<uint8_t> toSrgb(const std::vector<float> &linearRgba)
+{
+    const SrgbTables &tables = getSrgbTables();
+    std::vector<uint8_t> result(linearRgba.size());
+
+    for (size_t i = 0; i < linearRgba.size(); i += 4) {
+        int steps[4];
+#ifdef __SSE2__
+        // scale rgb to the table resolution and alpha to 8 bit, rounding to nearest
+        const __m128 scale = _mm_setr_ps(LINEAR_TO_SRGB_STEPS - 1, LINEAR_TO_SRGB_STEPS - 1, LINEAR_TO_SRGB_STEPS - 1, 255.0f);
+        __m128 texel = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&linearRgba[i]), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(steps), _mm_cvtps_epi32(_mm_mul_ps(texel, scale)));
+#else
+        for (int c = 0; c < 4; ++c) {
+            float value = std::min(std::max(linearRgba[i + c], 0.0f), 1.0f);
+            steps[c] = int(value * (c < 3 ? LINEAR_TO_SRGB_STEPS - 1 : 255) + 0.5f);
+        }
+#endif
+        result[i + 0] = tables.toSrgb[steps[0]];
+        result[i + 1] = tables.toSrgb[steps[1]];
+        result[i + 2] = tables.toSrgb[steps[2]];
+        result[i + 3] = uint8_t(steps[3]);
+    }
+    return result;
+}
+
+//! copy the 4x4 texels of a block, texels beyond the image border repeat the border
+static void fetchBlock(const std::vector<uint8_t> &rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t block[16][4])
+{
+    for (uint32_t j = 0; j < 4; ++j) {
+        uint32_t y = std::min(blockY * 4 + j, height - 1);
+        for (uint32_t i = 0; i < 4; ++i) {
+            uint32_t x = std::min(blockX * 4 + i, width - 1);
+            const uint8_t *texel = &rgba[(size_t(y) * width + x) * 4];
+            std::copy(texel, texel + 4, block[j * 4 + i]);
+        }
+    }
+}
+
+//! find the texels of a block lying furthest apart along the principal axis of its first N channels
+template <int N>
+static void findExtremeTexels(const uint8_t block[16][4], int &minTexel, int &maxTexel)
+{
+    float mean[N] = {};
+    for (int p = 0; p < 16; ++p) {
+        for (int c = 0; c < N; ++c) {
+            mean[c] += block[p][c] / 16.0f;
+        }
+    }
+
+    float covariance[N][N] = {};
+    for (int p = 0; p < 16; ++p) {
+        for (int a = 0; a < N; ++a) {
+            for (int b = 0; b < N; ++b) {
+                covariance[a][b] += (block[p][a] - mean[a]) * (block[p][b] - mean[b]);
+            }
+        }
+    }
+
+    // power iteration, starting at the channel of largest variance
+    int largest = 0;
+    for (int c = 1; c < N; ++c) {
+        largest = covariance[c][c] > covariance[largest][largest] ? c : largest;
+    }
+    float axis[N];
+    for (int c = 0; c < N; ++c) {
+        axis[c] = covariance[largest][c];
+    }
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[N] = {};
+        float maxComponent = 0;
+        for (int a = 0; a < N; ++a) {
+            for (int b = 0; b < N; ++b) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            maxComponent = std::max(maxComponent, std::abs(next[a]));
+        }
+        if (maxComponent == 0) {
+            break;
+        }
+        for (int c = 0; c < N; ++c) {
+            axis[c] = next[c] / maxComponent;
+        }
+    }
+
+    float minProjection = 0, maxProjection = 0;
+    minTexel = maxTexel = 0;
+    for (int p = 0; p < 16; ++p) {
+        float projection = 0;
+        for (int c = 0; c < N; ++c) {
+            projection += block[p][c] * axis[c];
+        }
+        if (p == 0 || projection < minProjection) {
+            minProjection = projection;
+            minTexel = p;
+        }
+        if (p == 0 || projection > maxProjection) {
+            maxProjection = projection;
+            maxTexel = p;
+        }
+    }
+}
+
+//! \return the index of the palette entry closest to the given texel in the first N channels
+template <int N>
+static int findClosest(const uint8_t texel[4], const int palette[][4], int paletteSize, int &error)
+{
+    int best = 0;
+    error = -1;
+    for (int i = 0; i < paletteSize; ++i) {
+        int distance = 0;
+        for (int c = 0; c < N; ++c) {
+            int d = texel[c] - palette[i][c];
+            distance += d * d;
+        }
+        if (error < 0 || distance < error) {
+            error = distance;
+            best = i;
+        }
+    }
+    return best;
+}
+
+//! least squares fit of the endpoints of the first N channels, given how far each texel lies from endpoint 0 to 1.
+//! \return false if the weights do not determine the endpoints, e.g. if all texels use the same one
+template <int N>
+static bool fitEndpoints(const uint8_t block[16][4], const float weights[16], float endpoint0[4], float endpoint1[4])
+{
+    float a = 0, b = 0, c = 0, x0[N] = {}, x1[N] = {};
+    for (int p = 0; p < 16; ++p) {
+        float w = weights[p];
+        a += (1 - w) * (1 - w);
+        b += (1 - w) * w;
+        c += w * w;
+        for (int k = 0; k < N; ++k) {
+            x0[k] += (1 - w) * block[p][k];
+            x1[k] += w * block[p][k];
+        }
+    }
+
+    float determinant = a * c - b * b;
+    if (std::abs(determinant) < 1e-6f) {
+        return false;
+    }
+    for (int k = 0; k < N; ++k) {
+        endpoint0[k] = std::min(std::max((c * x0[k] - b * x1[k]) / determinant, 0.0f), 255.0f);
+        endpoint1[k] = std::min(std::max((a * x1[k] - b * x0[k]) / determinant, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+static uint16_t packRgb565(const float color[4])
+{
+    return uint16_t(int(color[0] * 31 / 255 + 0.5f) << 11 | int(color[1] * 63 / 255 + 0.5f) << 5 | int(color[2] * 31 / 255 + 0.5f));
+}
+
+static void unpackRgb565(uint16_t packed, int color[4])
+{
+    int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = r << 3 | r >> 2;
+    color[1] = g << 2 | g >> 4;
+    color[2] = b << 3 | b >> 2;
+    color[3] = 255;
+}
+
+//! a BC1 color block and its squared error
+struct BC1Fit
+{
+    uint16_t endpoint0, endpoint1;
+    uint32_t indices;
+    int error;
+    float weights[16]; // of endpoint 1 in the color of each texel
+};
+
+//! quantize the endpoints and choose the indices of a BC1 color block, always using the four color mode
+static BC1Fit fitBC1(const uint8_t block[16][4], const float color0[4], const float color1[4])
+{
+    static const float INDEX_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3, 2.0f / 3 };
+
+    BC1Fit fit;
+    fit.endpoint0 = packRgb565(color0);
+    fit.endpoint1 = packRgb565(color1);
+    bool swapped = fit.endpoint0 < fit.endpoint1;
+    if (swapped) {
+        std::swap(fit.endpoint0, fit.endpoint1);
+    }
+
+    // endpoint0 > endpoint1 selects the four color mode, equal endpoints only need index 0
+    int palette[4][4];
+    unpackRgb565(fit.endpoint0, palette[0]);
+    unpackRgb565(fit.endpoint1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    int paletteSize = fit.endpoint0 == fit.endpoint1 ? 1 : 4;
+
+    fit.indices = 0;
+    fit.error = 0;
+    for (int p = 0; p < 16; ++p) {
+        int error;
+        int index = findClosest<3>(block[p], palette, paletteSize, error);
+        fit.indices |= uint32_t(index) << (2 * p);
+        fit.error += error;
+        fit.weights[p] = swapped ? 1 - INDEX_WEIGHTS[index] : INDEX_WEIGHTS[index];
+    }
+    return fit;
+}
+
+//! encode the colors of a block as BC1, refining the endpoints fitted along the principal axis
+static void encodeBC1Block(const uint8_t block[16][4], uint8_t *out)
+{
+    int minTexel, maxTexel;
+    findExtremeTexels<3>(block, minTexel, maxTexel);
+
+    float color0[4], color1[4];
+    for (int c = 0; c < 4; ++c) {
+        color0[c] = block[minTexel][c];
+        color1[c] = block[maxTexel][c];
+    }
+    BC1Fit best = fitBC1(block, color0, color1);
+
+    for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration) {
+        if (!fitEndpoints<3>(block, best.weights, color0, color1)) {
+            break;
+        }
+        BC1Fit refined = fitBC1(block, color0, color1);
+        if (refined.error >= best.error) {
+            break;
+        }
+        best = refined;
+    }
+
+    out[0] = uint8_t(best.endpoint0);
+    out[1] = uint8_t(best.endpoint0 >> 8);
+    out[2] = uint8_t(best.endpoint1);
+    out[3] = uint8_t(best.endpoint1 >> 8);
+    for (int b = 0; b < 4; ++b) {
+        out[4 + b] = uint8_t(best.indices >> (8 * b));
+    }
+}
+
+//! encode the alpha of a block as in BC3, using the eight value mode
+static void encodeAlphaBlock(const uint8_t block[16][4], uint8_t *out)
+{
+    int alpha0 = 0, alpha1 = 255;
+    for (int p = 0; p < 16; ++p) {
+        alpha0 = std::max(alpha0, int(block[p][3]));
+        alpha1 = std::min(alpha1, int(block[p][3]));
+    }
+
+    uint64_t indices = 0;
+    if (alpha0 > alpha1) {
+        int palette[8][4] = {};
+        palette[0][0] = alpha0;
+        palette[1][0] = alpha1;
+        for (int i = 1; i < 7; ++i) {
+            palette[i + 1][0] = ((7 - i) * alpha0 + i * alpha1) / 7;
+        }
+        for (int p = 0; p < 16; ++p) {
+            uint8_t alpha[4] = { block[p][3], 0, 0, 0 };
+            int error;
+            indices |= uint64_t(findClosest<1>(alpha, palette, 8, error)) << (3 * p);
+        }
+    }
+
+    out[0] = uint8_t(alpha0);
+    out[1] = uint8_t(alpha1);
+    for (int b = 0; b < 6; ++b) {
+        out[2 + b] = uint8_t(indices >> (8 * b));
+    }
+}
+
+//! writes bit fields to a block, starting at the least significant bit of the first byte
+struct BlockBitWriter
+{
+    uint8_t *out;
+    int position;
+
+    void write(uint32_t value, int bitCount)
+    {
+        for (int b = 0; b < bitCount; ++b, ++position) {
+            if ((value >> b) & 1) {
+                out[position >> 3] |= uint8_t(1 << (position & 7));
+            }
+        }
+    }
+};
+
+//! a BC7 mode 6 block and its squared error
+struct BC7Fit
+{
+    int quantized[2][4]; // 7 bit endpoints
+    int pBits[2];
+    int indices[16];
+    int error;
+    float weights[16]; // of endpoint 1 in the color of each texel
+};
+
+//! quantize the endpoints with the p-bits that fit best and choose the indices of a BC7 mode 6 block
+static BC7Fit fitBC7(const uint8_t block[16][4], const float color0[4], const float color1[4])
+{
+    const float *colors[2] = { color0, color1 };
+
+    BC7Fit fit;
+    int endpoints[2][4];
+    for (int e = 0; e < 2; ++e) {
+        float bestError = -1;
+        for (int p = 0; p < 2; ++p) {
+            int q[4];
+            float error = 0;
+            for (int c = 0; c < 4; ++c) {
+                q[c] = std::min(std::max(int((colors[e][c] - p) / 2 + 0.5f), 0), 127);
+                float d = colors[e][c] - (q[c] << 1 | p);
+                error += d * d;
+            }
+            if (bestError < 0 || error < bestError) {
+                bestError = error;
+                fit.pBits[e] = p;
+                std::copy(q, q + 4, fit.quantized[e]);
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            endpoints[e][c] = fit.quantized[e][c] << 1 | fit.pBits[e];
+        }
+    }
+
+    int palette[16][4];
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            palette[i][c] = ((64 - BC7_WEIGHTS[i]) * endpoints[0][c] + BC7_WEIGHTS[i] * endpoints[1][c] + 32) >> 6;
+        }
+    }
+
+    fit.error = 0;
+    for (int p = 0; p < 16; ++p) {
+        int error;
+        fit.indices[p] = findClosest<4>(block[p], palette, 16, error);
+        fit.error += error;
+        fit.weights[p] = BC7_WEIGHTS[fit.indices[p]] / 64.0f;
+    }
+    return fit;
+}
+
+//! encode a block as BC7 mode 6: one subset, 7 bit rgba endpoints with one p-bit each, 4 bit indices.
+//! the endpoints fitted along the principal axis are refined by least squares.
+static void encodeBC7Block(const uint8_t block[16][4], uint8_t *out)
+{
+    int minTexel, maxTexel;
+    findExtremeTexels<4>(block, minTexel, maxTexel);
+
+    float color0[4], color1[4];
+    for (int c = 0; c < 4; ++c) {
+        color0[c] = block[minTexel][c];
+        color1[c] = block[maxTexel][c];
+    }
+    BC7Fit best = fitBC7(block, color0, color1);
+
+    for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration) {
+        if (!fitEndpoints<4>(block, best.weights, color0, color1)) {
+            break;
+        }
+        BC7Fit refined = fitBC7(block, color0, color1);
+        if (refined.error >= best.error) {
+            break;
+        }
+        best = refined;
+    }
+
+    // the most significant bit of the first index is implicitly 0, which is ensured by swapping the endpoints
+    if (best.indices[0] >= 8) {
+        std::swap(best.quantized[0], best.quantized[1]);
+        std::swap(best.pBits[0], best.pBits[1]);
+        for (int p = 0; p < 16; ++p) {
+            best.indices[p] = 15 - best.indices[p];
+        }
+    }
+
+    std::fill(out, out + 16, 0);
+    BlockBitWriter writer = { out, 0 };
+    writer.write(1 << 6, 7); // mode 6
+    for (int c = 0; c < 4; ++c) {
+        writer.write(best.quantized[0][c], 7);
+        writer.write(best.quantized[1][c], 7);
+    }
+    writer.write(best.pBits[0], 1);
+    writer.write(best.pBits[1], 1);
+    writer.write(best.indices[0], 3);
+    for (int p = 1; p < 16; ++p) {
+        writer.write(best.indices[p], 4);
+    }
+}
+
+//! block compress one mip level
+static CompressedMip compressLevel(const std::vector<uint8_t> &rgba, uint32_t width, uint32_t height, BlockFormat format)
+{
+    CompressedMip result;
+    result.width = width;
+    result.height = height;
+
+    uint32_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t blockSize = getBlockSize(format);
+    result.data.resize(size_t(blocksX) * blocksY * blockSize);
+
+    uint8_t block[16][4];
+    for (uint32_t by = 0; by < blocksY; ++by) {
+        for (uint32_t bx = 0; bx < blocksX; ++bx) {
+            fetchBlock(rgba, width, height, bx, by, block);
+            uint8_t *out = &result.data[(size_t(by) * blocksX + bx) * blockSize];
+
+            switch (format) {
+                case BLOCK_FORMAT_BC1:
+                    encodeBC1Block(block, out);
+                    break;
+                case BLOCK_FORMAT_BC3:
+                    encodeAlphaBlock(block, out);
+                    encodeBC1Block(block, out + 8);
+                    break;
+                case BLOCK_FORMAT_BC7:
+                    encodeBC7Block(block, out);
+                    break;
+            }
+        }
+    }
+    return result;
+}
+
+CompressedTexture compress(const std::vector<uint8_t> &rgba, uint32_t width, uint32_t height, BlockFormat format)
+{
+    CompressedTexture result;
+    result.format = format;
+    result.mips.push_back(compressLevel(rgba, width, height, format));
+
+    // each level is filtered from the previous one in linear space, then compressed from its sRGB texels
+    std::vector<float> linearRgba = toLinear(rgba);
+    while (width > 1 || height > 1) {
+        linearRgba = downsample(linearRgba, width, height);
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+        result.mips.push_back(compressLevel(toSrgb(linearRgba), width, height, format));
+    }
+    return result;
+}
+
+std::vector<float> downsample(const std::vector<float> &linearRgba, uint32_t width, uint32_t height)
+{
+    uint32_t halfWidth = std::max(width / 2, 1u), halfHeight = std::max(height / 2, 1u);
+    std::vector<float> result(size_t(halfWidth) * halfHeight * 4);
+
+    for (uint32_t y = 0; y < halfHeight; ++y) {
+
+        // odd sizes and sizes of 1 clamp to the last row or column
+        const float *row0 = &linearRgba[size_t(std::min(2 * y, height - 1)) * width * 4];
+        const float *row1 = &linearRgba[size_t(std::min(2 * y + 1, height - 1)) * width * 4];
+        float *out = &result[size_t(y) * halfWidth * 4];
+
+        for (uint32_t x = 0; x < halfWidth; ++x) {
+            size_t x0 = size_t(std::min(2 * x, width - 1)) * 4;
+            size_t x1 = size_t(std::min(2 * x + 1, width - 1)) * 4;
+#ifdef __SSE2__
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                                    _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+            _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+            for (int c = 0; c < 4; ++c) {
+                out[x * 4 + c] = 0.25f * (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]);
+            }
+#endif
+        }
+    }
+    return result;
+}
+
+size_t getBlockSize(BlockFormat format)
+{
+    return format == BLOCK_FORMAT_BC1 ? 8 : 16;
+}
+
+GLenum getGLFormat(BlockFormat format)
+{
+    switch (format) {
+        case BLOCK_FORMAT_BC1: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case BLOCK_FORMAT_BC3: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        case BLOCK_FORMAT_BC7: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+    }
+    return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+}
+
+const char *getName(BlockFormat format)
+{
+    switch (format) {
+        case BLOCK_FORMAT_BC1: return "BC1";
+        case BLOCK_FORMAT_BC3: return "BC3";
+        case BLOCK_FORMAT_BC7: return "BC7";
+    }
+    return "";
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+
+//! The block compression formats textures are encoded to. All of them store 4x4 texel blocks.
+enum BlockFormat
+{
+    BLOCK_FORMAT_BC1 = 0, //!< 8 bytes per block, rgb with two interpolated endpoints (DXT1)
+    BLOCK_FORMAT_BC3 = 1, //!< 16 bytes per block, BC1 rgb and a separately interpolated alpha (DXT5)
+    BLOCK_FORMAT_BC7 = 2  //!< 16 bytes per block, rgba with finer endpoints and interpolation (BPTC)
+};
+
+//! One mip level of a block compressed texture.
+struct CompressedMip
+{
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint8_t> data; // the blocks row by row, partial blocks at the borders are padded
+};
+
+//! A block compressed texture with its complete mip chain, as stored in the texture cache.
+struct CompressedTexture
+{
+    BlockFormat format;
+    std::vector<CompressedMip> mips; // from the full resolution level 0 down to 1x1
+};
+
+/**
+ * @brief Functions to build block compressed textures with mip chains on the cpu,
+ * so that textures are uploaded precompressed with glCompressedTexImage2D instead of
+ * being decoded and mipmapped at every load.
+ *
+ * The texels are given as 8 bit sRGB colors with linear alpha. Mips are filtered in linear space.
+ * The encoders fit endpoints along the principal axis of the colors of each block,
+ * BC7 uses mode 6 only (one subset, 7 bit rgba endpoints with p-bits, 4 bit indices).
+ */
+namespace TextureCompress
+{
+
+    //! Generate the mip chain of an image and block compress all levels.
+    /// \return the compressed texture
+    CompressedTexture compress(
+        const std::vector<uint8_t> &rgba, //!< [in] the texels of the full resolution image, 4 bytes each in rgba order, row by row
+        uint32_t width, //!< [in] image width in texels
+        uint32_t height, //!< [in] image height in texels
+        BlockFormat format //!< [in] the format to compress to
+    );
+
+    //! Downsample an image to half its size in each dimension by averaging 2x2 texels in linear space.
+    //! uses SSE2 if available.
+    /// \return the texels of the downsampled image, as linear rgba floats
+    std::vector<float> downsample(
+        const std::vector<float> &linearRgba, //!< [in] the texels as linear rgba floats, row by row
+        uint32_t width, //!< [in] image width in texels
+        uint32_t height //!< [in] image height in texels
+    );
+
+    //! \return the number of bytes of a 4x4 block of the given format
+    size_t getBlockSize(BlockFormat format);
+
+    //! \return the sRGB opengl internal format of the given block format
+    GLenum getGLFormat(BlockFormat format);
+
+    //! \return a short name of the given block format
+    const char *getName(BlockFormat format);
+
+}
@@ -0,0 +1,247 @@
+#include "texturestreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "texturecache.h"
+#include "resourcemanager.h"
+#include "textureuploadring.h"
+
+static int64_t currentTicks()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+const size_t TextureStreamer::LATENCY_HISTORY_SIZE;
+const size_t TextureStreamer::UPLOAD_TIME_HISTORY_SIZE;
+
+TextureStreamer::TextureStreamer(size_t budget_, size_t maxUploadSize_)
+    : budget(budget_)
+    , maxUploadSize(maxUploadSize_)
+    , residentSize(0)
+    , budgetBias(0)
+    , nextLatency(0)
+    , uploadTimes(UPLOAD_TIME_HISTORY_SIZE, 0.0f)
+    , nextUploadTime(0)
+    , uploadMs(0)
+    , deferredUploadCount(0)
+    , quit(false)
+{
+    latencies.reserve(LATENCY_HISTORY_SIZE);
+    loader = std::thread(&TextureStreamer::loaderLoop, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    jobAvailable.notify_all();
+    loader.join();
+}
+
+void TextureStreamer::loaderLoop()
+{
+    while (true) {
+        LoadJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this]() { return quit || !jobs.empty(); });
+            if (quit) {
+                return;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        // the file reads happen outside the lock, the render thread only waits for the queues
+        LoadResult result;
+        result.loaded = true;
+        result.layerMips.resize(job.layerPaths.size());
+        for (size_t i = 0; i < job.layerPaths.size() && result.loaded; ++i) {
+            result.loaded = TextureCache::loadLevel(job.layerPaths[i], job.cacheAlphaFormat, uint32_t(job.level), result.layerMips[i]);
+        }
+        result.job = std::move(job);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        results.push_back(std::move(result));
+    }
+}
+
+void TextureStreamer::uploadLoadedLevels()
+{
+    size_t uploadedSize = 0;
+    while (uploadedSize < maxUploadSize) {
+        LoadResult result;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (results.empty()) {
+                return;
+            }
+            result = std::move(results.front());
+            results.pop_front();
+        }
+
+        // the array may have been released while its level was loading
+        std::shared_ptr<TextureArray> textureArray = result.job.textureArray.lock();
+        if (!textureArray) {
+            pendingArrays.erase(result.job.pendingKey);
+            continue;
+        }
+
+        // staging should not wait for the gpu during the frame, so the upload waits for the next frame while the ring is full.
+        // a level larger than the whole ring is staged layer by layer, which may wait.
+        size_t levelSize = textureArray->getLevelVramSize(result.job.level);
+        TextureUploadRing *uploadRing = TextureUploadRing::hasInstance() ? TextureUploadRing::getInstance() : nullptr;
+        if (result.loaded && uploadRing && levelSize <= uploadRing->getCapacity() && !uploadRing->canStage(levelSize)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_front(std::move(result));
+            deferredUploadCount += 1;
+            return;
+        }
+        pendingArrays.erase(result.job.pendingKey);
+
+        if (!result.loaded) {
+            std::cerr << "WARNING TEXTURE STREAMER: could not load mip level " << result.job.level << " from the texture cache of "
+                      << result.job.layerPaths[0] << std::endl;
+            continue;
+        }
+        if (!textureArray->uploadLevel(result.job.level, result.layerMips)) {
+            continue;
+        }
+        uploadedSize += levelSize;
+
+        float latencyMs = float(currentTicks() - result.job.requestTicks) * 1e-3f;
+        if (latencies.size() < LATENCY_HISTORY_SIZE) {
+            latencies.push_back(latencyMs);
+        }
+        else {
+            latencies[nextLatency] = latencyMs;
+        }
+        nextLatency = (nextLatency + 1) % LATENCY_HISTORY_SIZE;
+    }
+}
+
+GLint TextureStreamer::getNeededLevel(const TextureArray &textureArray, int viewportHeight) const
+{
+    // without a request no surface using the array was drawn, so only the tail is needed
+    float density = textureArray.getRequestedTexelDensity();
+    if (std::isinf(density) || viewportHeight <= 0) {
+        return textureArray.getTailLevel();
+    }
+
+    // each level halves the texels, the level with about one texel per pixel is needed
+    float level = std::floor(std::log2(std::max(density / float(viewportHeight), 1.0f)));
+    return std::min(GLint(level), textureArray.getTailLevel());
+}
+
+size_t TextureStreamer::getSizeFromLevel(const TextureArray &textureArray, GLint level) const
+{
+    size_t size = 0;
+    for (GLint i = level; i < textureArray.getLevelCount(); ++i) {
+        size += textureArray.getLevelVramSize(i);
+    }
+    return size;
+}
+
+void TextureStreamer::update(int viewportHeight)
+{
+    int64_t uploadStartTicks = currentTicks();
+    uploadLoadedLevels();
+    uploadMs = float(currentTicks() - uploadStartTicks) * 1e-3f;
+    uploadTimes[nextUploadTime] = uploadMs;
+    nextUploadTime = (nextUploadTime + 1) % UPLOAD_TIME_HISTORY_SIZE;
+
+    std::vector<std::shared_ptr<TextureArray>> textureArrays = ResourceManager::getInstance()->getTextureArrays();
+    textureArrays.erase(std::remove_if(textureArrays.begin(), textureArrays.end(), [](const std::shared_ptr<TextureArray> &textureArray) {
+        return !textureArray->isStreamable();
+    }), textureArrays.end());
+
+    std::vector<GLint> neededLevels;
+    neededLevels.reserve(textureArrays.size());
+    for (const std::shared_ptr<TextureArray> &textureArray : textureArrays) {
+        neededLevels.push_back(getNeededLevel(*textureArray, viewportHeight));
+    }
+
+    // make all arrays coarser until their needed levels fit into the budget, the tails are resident regardless
+    budgetBias = 0;
+    while (true) {
+        size_t neededSize = 0;
+        bool canCoarsen = false;
+        for (size_t i = 0; i < textureArrays.size(); ++i) {
+            GLint level = std::min(neededLevels[i] + budgetBias, textureArrays[i]->getTailLevel());
+            neededSize += getSizeFromLevel(*textureArrays[i], level);
+            canCoarsen = canCoarsen || level < textureArrays[i]->getTailLevel();
+        }
+        if (neededSize <= budget || !canCoarsen) {
+            break;
+        }
+        budgetBias += 1;
+    }
+
+    // move each array one level towards its target level
+    residentSize = 0;
+    std::vector<LoadJob> newJobs;
+    for (size_t i = 0; i < textureArrays.size(); ++i) {
+        TextureArray &textureArray = *textureArrays[i];
+        GLint targetLevel = std::min(neededLevels[i] + budgetBias, textureArray.getTailLevel());
+
+        bool pending = pendingArrays.count(&textureArray) > 0;
+        if (textureArray.getResidentLevel() < targetLevel && !pending) {
+            textureArray.evictLevel();
+        }
+        else if (textureArray.getResidentLevel() > targetLevel && !pending) {
+            LoadJob job;
+            job.textureArray = textureArrays[i];
+            job.pendingKey = &textureArray;
+            job.layerPaths = textureArray.getLayerPaths();
+            job.cacheAlphaFormat = textureArray.getCacheAlphaFormat();
+            job.level = textureArray.getResidentLevel() - 1;
+            job.requestTicks = currentTicks();
+            newJobs.push_back(std::move(job));
+            pendingArrays.insert(&textureArray);
+        }
+
+        residentSize += textureArray.getVramSize();
+        textureArray.resetRequestedTexelDensity();
+    }
+
+    if (!newJobs.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (LoadJob &job : newJobs) {
+                jobs.push_back(std::move(job));
+            }
+        }
+        jobAvailable.notify_one();
+    }
+}
+
+float TextureStreamer::getAverageLatencyMs() const
+{
+    if (latencies.empty()) {
+        return 0.0f;
+    }
+    float sum = 0.0f;
+    for (float latency : latencies) {
+        sum += latency;
+    }
+    return sum / float(latencies.size());
+}
+
+float TextureStreamer::getMaxLatencyMs() const
+{
+    float maxLatency = 0.0f;
+    for (float latency : latencies) {
+        maxLatency = std::max(maxLatency, latency);
+    }
+    return maxLatency;
+}
+
+float TextureStreamer::getMaxUploadMs() const
+{
+    return *std::max_element(uploadTimes.begin(), uploadTimes.end());
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_set>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "texture.hpp"
+
+
+/**
+ * @brief The TextureStreamer keeps the mip levels of the streamed texture arrays in vram that the visible surfaces need,
+ * within a memory budget.
+ *
+ * The surfaces request the detail they are drawn with each frame (see TextureArray::requestTexelDensity).
+ * Once per frame, the needed mip level of each array is derived from its finest request and the viewport height.
+ * If the needed levels of all arrays exceed the budget, all of them are made coarser by the same number of levels.
+ * Arrays needing finer levels than resident get the next finer level read from the texture cache files on a worker thread,
+ * which is uploaded on the render thread once loaded. If the TextureUploadRing exists, the uploads are staged in it,
+ * and an upload is deferred to the next frame instead of waiting while the ring is full. Arrays holding finer levels than needed free their finest level.
+ * Each array changes by at most one level per frame.
+ */
+class TextureStreamer
+{
+public:
+
+    //! Create the streamer and start its loading thread.
+    TextureStreamer(
+        size_t budget_, //!< [in] bytes of vram the streamed mip levels may take
+        size_t maxUploadSize_ = 8 * 1024 * 1024 //!< [in] bytes that may be uploaded per frame, to avoid frame time spikes
+    );
+    ~TextureStreamer();
+
+    //! Upload the loaded levels, decide the resident levels for the requests of this frame, and start loading or evicting levels.
+    //! Must be called on the render thread after the surfaces were submitted, the requests are reset afterwards.
+    void update(
+        int viewportHeight //!< [in] the height of the viewport the surfaces are drawn to, in pixels
+    );
+
+    //! Set the bytes of vram the streamed mip levels may take
+    inline void setBudget(size_t budget_) { budget = budget_; }
+
+    //! \return the bytes of vram the streamed mip levels may take
+    inline size_t getBudget() const { return budget; }
+
+    //! \return the bytes of all resident levels of the streamed texture arrays, after the last update
+    inline size_t getResidentSize() const { return residentSize; }
+
+    //! \return the number of levels currently loading or waiting for upload
+    inline size_t getPendingCount() const { return pendingArrays.size(); }
+
+    //! \return how many levels coarser than needed the arrays are kept to stay within the budget
+    inline int getBudgetBias() const { return budgetBias; }
+
+    //! \return the average time from requesting a level until it is resident, over the recent uploads, in milliseconds
+    float getAverageLatencyMs() const;
+
+    //! \return the longest time from requesting a level until it is resident, over the recent uploads, in milliseconds
+    float getMaxLatencyMs() const;
+
+    //! \return the cpu time the uploads of the last update took on the render thread, in milliseconds
+    inline float getUploadMs() const { return uploadMs; }
+
+    //! \return the longest cpu time the uploads of an update took, over the recent frames, in milliseconds
+    float getMaxUploadMs() const;
+
+    //! \return the number of uploads deferred to the next frame because the upload ring was full
+    inline size_t getDeferredUploadCount() const { return deferredUploadCount; }
+
+private:
+
+    //! a mip level to load for a texture array
+    struct LoadJob
+    {
+        std::weak_ptr<TextureArray> textureArray;
+        const TextureArray *pendingKey; // the entry in pendingArrays, valid even if the array was released
+        std::vector<std::string> layerPaths;
+        BlockFormat cacheAlphaFormat;
+        GLint level;
+        int64_t requestTicks;
+    };
+
+    //! a loaded mip level waiting for upload
+    struct LoadResult
+    {
+        LoadJob job;
+        std::vector<CompressedMip> layerMips;
+        bool loaded;
+    };
+
+    size_t budget;
+    size_t maxUploadSize;
+    size_t residentSize;
+    int budgetBias;
+
+    // the arrays with a level loading or waiting for upload, only accessed on the render thread
+    std::unordered_set<const TextureArray*> pendingArrays;
+
+    // latencies of the recent uploads in milliseconds, as a ring buffer
+    static const size_t LATENCY_HISTORY_SIZE = 32;
+    std::vector<float> latencies;
+    size_t nextLatency;
+
+    // cpu time of the uploads of the recent frames in milliseconds, as a ring buffer
+    static const size_t UPLOAD_TIME_HISTORY_SIZE = 240;
+    std::vector<float> uploadTimes;
+    size_t nextUploadTime;
+    float uploadMs;
+    size_t deferredUploadCount;
+
+    // loading thread and the queues shared with it
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::deque<LoadJob> jobs;
+    std::deque<LoadResult> results;
+    bool quit;
+
+    //! Load the requested levels from the texture cache files, until quit is set.
+    void loaderLoop();
+
+    //! Upload loaded levels, up to the maximum upload size per frame.
+    void uploadLoadedLevels();
+
+    //! \return the mip level an array needs for the detail requested in this frame, without budget bias
+    GLint getNeededLevel(const TextureArray &textureArray, int viewportHeight) const;
+
+    //! \return the bytes of the levels of an array from the given level to the coarsest one
+    size_t getSizeFromLevel(const TextureArray &textureArray, GLint level) const;
+};
@@ -0,0 +1,187 @@
+#include "textureuploadring.h"
+
+#include <cstring>
+#include <iostream>
+
+TextureUploadRing *TextureUploadRing::instance = nullptr;
+size_t TextureUploadRing::instanceCapacity = 32 * 1024 * 1024;
+
+// ranges start at multiples of this, which satisfies any unpack alignment
+static const size_t RANGE_ALIGNMENT = 16;
+
+// waiting for a fence is given up after this many nanoseconds, which only happens if the gpu hangs
+static const GLuint64 FENCE_TIMEOUT = 1000000000;
+
+TextureUploadRing *TextureUploadRing::getInstance()
+{
+    if (!instance) {
+        instance = new TextureUploadRing();
+    }
+    return instance;
+}
+
+bool TextureUploadRing::hasInstance()
+{
+    return instance != nullptr;
+}
+
+void TextureUploadRing::destroyInstance()
+{
+    delete instance;
+    instance = nullptr;
+}
+
+void TextureUploadRing::setCapacity(size_t capacity)
+{
+    if (instance && instance->capacity != capacity) {
+        std::cerr << "ERROR: the capacity of the texture upload ring cannot change after it was created." << std::endl;
+        return;
+    }
+    instanceCapacity = capacity;
+}
+
+const void *TextureUploadRing::stageIfEnabled(const void *data, size_t size)
+{
+    GLintptr offset = instance && data ? instance->stage(data, size, true) : -1;
+    return offset >= 0 ? reinterpret_cast<const void*>(offset) : data;
+}
+
+void TextureUploadRing::fenceIfEnabled()
+{
+    if (instance) {
+        instance->fence();
+    }
+}
+
+TextureUploadRing::TextureUploadRing()
+    : capacity(instanceCapacity)
+    , head(0)
+    , stagedSize(0)
+    , stallCount(0)
+{
+    // immutable storage mapped once for the lifetime of the ring. the mapping is coherent,
+    // so the texel copies are visible to texture calls issued after them without flushing.
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(capacity), nullptr, flags);
+    mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(capacity), flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!mapped) {
+        std::cerr << "ERROR: the texture upload ring could not be mapped." << std::endl;
+    }
+}
+
+TextureUploadRing::~TextureUploadRing()
+{
+    while (!inFlight.empty()) {
+        if (inFlight.front().fence) {
+            popOldest();
+        }
+        else {
+            inFlight.pop_front();
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+}
+
+void TextureUploadRing::popOldest()
+{
+    // the ranges staged for the same upload share its fence
+    GLsync sync = inFlight.front().fence;
+    inFlight.pop_front();
+    if (inFlight.empty() || inFlight.front().fence != sync) {
+        glDeleteSync(sync);
+    }
+    if (inFlight.empty()) {
+        head = 0;
+    }
+}
+
+void TextureUploadRing::retireCompleted()
+{
+    while (!inFlight.empty() && inFlight.front().fence) {
+        GLenum status = glClientWaitSync(inFlight.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return;
+        }
+        popOldest();
+    }
+}
+
+size_t TextureUploadRing::findPlacement(size_t size) const
+{
+    size_t begin = (head + RANGE_ALIGNMENT - 1) / RANGE_ALIGNMENT * RANGE_ALIGNMENT;
+    if (begin + size > capacity) {
+        begin = 0; // wrap around, the end of the buffer stays unused
+    }
+
+    for (const Range &range : inFlight) {
+        if (begin < range.begin + range.size && range.begin < begin + size) {
+            return capacity;
+        }
+    }
+    return begin;
+}
+
+bool TextureUploadRing::canStage(size_t size)
+{
+    if (!mapped || size > capacity) {
+        return false;
+    }
+    retireCompleted();
+    return findPlacement(size) != capacity;
+}
+
+GLintptr TextureUploadRing::stage(const void *data, size_t size, bool wait)
+{
+    // the data is read from client memory instead, which requires no buffer bound
+    if (!mapped || size > capacity) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return -1;
+    }
+
+    retireCompleted();
+    size_t begin = findPlacement(size);
+    while (begin == capacity) {
+        if (!wait) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return -1;
+        }
+
+        // wait for the oldest upload, fencing the current one first if it holds the oldest range
+        if (!inFlight.front().fence) {
+            fence();
+        }
+        stallCount += 1;
+        glClientWaitSync(inFlight.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+        popOldest();
+        begin = findPlacement(size);
+    }
+
+    std::memcpy(mapped + begin, data, size);
+    inFlight.push_back({ begin, size, 0 });
+    head = begin + size;
+    stagedSize += size;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    return GLintptr(begin);
+}
+
+void TextureUploadRing::fence()
+{
+    GLsync sync = 0;
+    for (auto it = inFlight.rbegin(); it != inFlight.rend() && !it->fence; ++it) {
+        if (!sync) {
+            sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        it->fence = sync;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
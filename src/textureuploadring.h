@@ -0,0 +1,106 @@
+#pragma once
+
+#include <deque>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+
+/**
+ * @brief The TextureUploadRing stages texel data for texture uploads in a persistently mapped pixel unpack buffer.
+ *
+ * The texels are copied into the mapped buffer on the cpu, and the glTex(Sub)Image calls read them from the buffer
+ * instead of client memory, so the driver does not have to copy or wait for them synchronously.
+ * The buffer is used as a ring: each upload is fenced, and its range is reused only once the gpu passed the fence.
+ *
+ * Usage: stage the texels of an upload and issue the texture call reading them with the returned offset as pixel pointer
+ * while the ring is bound, before staging the next texels. Fence the upload after its last texture call.
+ */
+class TextureUploadRing
+{
+public:
+
+    //! Get the ring shared by all texture uploads, created on first use.
+    //! Requires an active opengl context.
+    static TextureUploadRing *getInstance();
+
+    //! Whether the shared ring currently exists
+    static bool hasInstance();
+
+    //! Delete the shared ring and free its buffer. Must be called before the opengl context is destroyed.
+    static void destroyInstance();
+
+    //! Set the bytes of the buffer. Only takes effect before the shared ring is created.
+    static void setCapacity(size_t capacity);
+
+    //! Stage texel data in the shared ring if it exists and the data fits into it, waiting for the gpu if needed.
+    /// \return the pixel pointer to pass to the texture call: the offset in the bound ring,
+    /// or the data itself with no pixel unpack buffer bound
+    static const void *stageIfEnabled(const void *data, size_t size);
+
+    //! Fence the texture calls issued since the last fence if the shared ring exists.
+    static void fenceIfEnabled();
+
+    //! Copy texel data into the ring and bind the ring to GL_PIXEL_UNPACK_BUFFER.
+    /// \return the offset of the data in the buffer, to pass as pixel pointer to the texture calls,
+    /// or -1 if the data does not fit into the ring, or if it does not fit now and waiting is not allowed
+    GLintptr stage(
+        const void *data, //!< [in] the texels to upload
+        size_t size, //!< [in] bytes of the texels
+        bool wait //!< [in] whether to wait for the gpu to finish earlier uploads if the ring is full
+    );
+
+    //! \return whether data of the given size could be staged now without waiting
+    bool canStage(size_t size);
+
+    //! Fence the texture calls issued since the last fence, so the ranges they read are reused only once they completed,
+    //! and unbind the ring from GL_PIXEL_UNPACK_BUFFER.
+    void fence();
+
+    //! \return the bytes of the buffer
+    inline size_t getCapacity() const { return capacity; }
+
+    //! \return the number of fenced uploads the gpu has not completed yet, as of the last staging
+    inline size_t getInFlightCount() const { return inFlight.size(); }
+
+    //! \return the bytes staged since the ring was created
+    inline size_t getStagedSize() const { return stagedSize; }
+
+    //! \return how often staging had to wait for the gpu to free a range
+    inline size_t getStallCount() const { return stallCount; }
+
+private:
+
+    TextureUploadRing();
+    ~TextureUploadRing();
+
+    static TextureUploadRing *instance;
+    static size_t instanceCapacity;
+
+    //! a range of the buffer that is read by texture calls, fence is 0 until the calls are fenced
+    struct Range
+    {
+        size_t begin;
+        size_t size;
+        GLsync fence;
+    };
+
+    GLuint buffer;
+    uint8_t *mapped;
+    size_t capacity;
+    size_t head; // where the next range is placed, ranges are placed in ring order
+    std::deque<Range> inFlight; // from oldest to newest
+
+    size_t stagedSize;
+    size_t stallCount;
+
+    //! Free the oldest range, which must be fenced.
+    void popOldest();
+
+    //! Free the ranges of uploads the gpu completed, oldest first.
+    void retireCompleted();
+
+    //! \return where a range of the given size would be placed, or capacity if it overlaps a range in flight
+    size_t findPlacement(size_t size) const;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+
+//! Vertex struct for internal representation
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 uv;
+};
+
+//! Compact vertex layout of 16 instead of 32 bytes, see VertexQuantize
+struct QuantizedVertex {
+    GLushort position[4]; // unsigned normalized, relative to the bounding box of the surface. w is padding
+    GLuint normal;        // signed normalized 10:10:10:2, w unused
+    GLushort uv[2];       // half floats
+};
+
+//! The layout of the vertices stored in vram
+enum VertexFormat
+{
+    VERTEX_FORMAT_FLOAT,    //!< Vertex
+    VERTEX_FORMAT_QUANTIZED //!< QuantizedVertex
+};
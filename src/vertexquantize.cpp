@@ -0,0 +1,194 @@
+#include "vertexquantize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+
+namespace VertexQuantize
+{
+
+static const float UNORM16_MAX = 65535.0f;
+static const float SNORM10_MAX = 511.0f;
+
+static GLuint packSnorm10(float value)
+{
+    int quantized = int(std::round(glm::clamp(value, -1.0f, 1.0f) * SNORM10_MAX));
+    return GLuint(quantized) & 0x3FF;
+}
+
+static float unpackSnorm10(GLuint bits)
+{
+    // sign extend the 10 bit two's complement value
+    int value = int(bits & 0x3FF);
+    if (value & 0x200) {
+        value -= 0x400;
+    }
+    return std::max(value / SNORM10_MAX, -1.0f);
+}
+
+void calculateBounds(const std::vector<Vertex> &vertices, glm::vec3 &bbMin, glm::vec3 &bbMax)
+{
+    bbMin = glm::vec3(std::numeric_limits<float>::max());
+    bbMax = glm::vec3(-std::numeric_limits<float>::max());
+    for (const Vertex &vertex : vertices) {
+        bbMin = glm::min(bbMin, vertex.position);
+        bbMax = glm::max(bbMax, vertex.position);
+    }
+    if (vertices.empty()) {
+        bbMin = bbMax = glm::vec3(0);
+    }
+}
+
+std::vector<QuantizedVertex> quantize(const std::vector<Vertex> &vertices, const glm::vec3 &bbMin, const glm::vec3 &bbMax)
+{
+    glm::vec3 extent = bbMax - bbMin;
+
+    std::vector<QuantizedVertex> result(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const Vertex &vertex = vertices[i];
+        QuantizedVertex &quantized = result[i];
+
+        for (int k = 0; k < 3; ++k) {
+            // flat axes (e.g. of the water plane) have no extent, all positions lie on the min corner
+            float normalized = extent[k] > 0 ? (vertex.position[k] - bbMin[k]) / extent[k] : 0.0f;
+            quantized.position[k] = GLushort(std::round(glm::clamp(normalized, 0.0f, 1.0f) * UNORM16_MAX));
+        }
+        quantized.position[3] = 0;
+
+        quantized.normal = packSnorm10(vertex.normal.x) | (packSnorm10(vertex.normal.y) << 10) | (packSnorm10(vertex.normal.z) << 20);
+
+        quantized.uv[0] = floatToHalf(vertex.uv.x);
+        quantized.uv[1] = floatToHalf(vertex.uv.y);
+    }
+
+    return result;
+}
+
+Vertex dequantize(const QuantizedVertex &quantized, const glm::vec3 &bbMin, const glm::vec3 &bbMax)
+{
+    glm::vec3 extent = bbMax - bbMin;
+
+    Vertex vertex;
+    for (int k = 0; k < 3; ++k) {
+        vertex.position[k] = bbMin[k] + extent[k] * (quantized.position[k] / UNORM16_MAX);
+    }
+    vertex.normal = glm::vec3(unpackSnorm10(quantized.normal), unpackSnorm10(quantized.normal >> 10), unpackSnorm10(quantized.normal >> 20));
+    vertex.uv = glm::vec2(halfToFloat(quantized.uv[0]), halfToFloat(quantized.uv[1]));
+    return vertex;
+}
+
+glm::mat4 getDequantizationMatrix(const glm::vec3 &bbMin, const glm::vec3 &bbMax)
+{
+    // scale [0,1] to the extent of the bounding box, then translate to its min corner
+    glm::vec3 extent = bbMax - bbMin;
+    glm::mat4 matrix(1.0f);
+    matrix[0][0] = extent.x;
+    matrix[1][1] = extent.y;
+    matrix[2][2] = extent.z;
+    matrix[3] = glm::vec4(bbMin, 1.0f);
+    return matrix;
+}
+
+QuantizationError measureError(const std::vector<Vertex> &vertices, const std::vector<QuantizedVertex> &quantized,
+                               const glm::vec3 &bbMin, const glm::vec3 &bbMax)
+{
+    QuantizationError error;
+    if (vertices.empty()) {
+        return error;
+    }
+
+    double positionErrorSum = 0;
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        Vertex restored = dequantize(quantized[i], bbMin, bbMax);
+
+        float positionError = glm::length(restored.position - vertices[i].position);
+        error.maxPositionError = std::max(error.maxPositionError, positionError);
+        positionErrorSum += positionError;
+
+        // the shaders normalize the interpolated normal, so only the direction matters
+        float originalLength = glm::length(vertices[i].normal);
+        float restoredLength = glm::length(restored.normal);
+        if (originalLength > 0 && restoredLength > 0) {
+            float cosAngle = glm::dot(vertices[i].normal, restored.normal) / (originalLength * restoredLength);
+            float angle = std::acos(glm::clamp(cosAngle, -1.0f, 1.0f)) * 180.0f / 3.14159265f;
+            error.maxNormalError = std::max(error.maxNormalError, angle);
+        }
+
+        glm::vec2 uvError = glm::abs(restored.uv - vertices[i].uv);
+        error.maxUvError = std::max(error.maxUvError, std::max(uvError.x, uvError.y));
+    }
+    error.meanPositionError = float(positionErrorSum / vertices.size());
+
+    return error;
+}
+
+GLushort floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t floatExponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    int exponent = int(floatExponent) - 127 + 15;
+
+    // infinity and nan
+    if (floatExponent == 0xFF) {
+        return GLushort(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+    }
+    // too large, round to infinity
+    if (exponent >= 31) {
+        return GLushort(sign | 0x7C00);
+    }
+    // too small for a normalized half, store as subnormal or zero
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return GLushort(sign);
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1))) {
+            half += 1;
+        }
+        return GLushort(sign | half);
+    }
+
+    // round to nearest even, a carry into the exponent is still correct
+    uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        half += 1;
+    }
+    return GLushort(sign | half);
+}
+
+float halfToFloat(GLushort value)
+{
+    uint32_t sign = uint32_t(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+
+    if (exponent == 0) {
+        float subnormal = std::ldexp(float(mantissa), -24);
+        return sign ? -subnormal : subnormal;
+    }
+
+    uint32_t bits;
+    if (exponent == 31) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    }
+    else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vertex.h"
+
+
+//! The error introduced by quantizing the vertices of a mesh
+struct QuantizationError
+{
+    float maxPositionError = 0;  //!< in object space units
+    float meanPositionError = 0; //!< in object space units
+    float maxNormalError = 0;    //!< angle in degrees
+    float maxUvError = 0;        //!< in uv units
+};
+
+/**
+ * Conversion of Vertex to the compact QuantizedVertex layout.
+ *
+ * Positions are stored as 16 bit unsigned normalized integers relative to the bounding box of the mesh,
+ * so the vertex shader reads them in [0,1]. The dequantization to object space is an affine transformation,
+ * which is folded into the model matrix instead of costing extra shader instructions.
+ * Normals are stored as signed normalized 10:10:10:2 and uvs as half floats.
+ */
+namespace VertexQuantize
+{
+
+    //! Compute the bounding box the positions are quantized relative to.
+    void calculateBounds(
+        const std::vector<Vertex> &vertices, //!< [in] the vertices of the mesh
+        glm::vec3 &bbMin, //!< [out] min corner of the bounding box
+        glm::vec3 &bbMax //!< [out] max corner of the bounding box
+    );
+
+    //! Quantize the vertices of a mesh relative to the given bounding box.
+    std::vector<QuantizedVertex> quantize(const std::vector<Vertex> &vertices, const glm::vec3 &bbMin, const glm::vec3 &bbMax);
+
+    //! Convert a quantized vertex back to object space, as the gpu does with the dequantization matrix.
+    Vertex dequantize(const QuantizedVertex &vertex, const glm::vec3 &bbMin, const glm::vec3 &bbMax);
+
+    //! \return the matrix transforming unsigned normalized positions of the bounding box to object space
+    glm::mat4 getDequantizationMatrix(const glm::vec3 &bbMin, const glm::vec3 &bbMax);
+
+    //! Compare the quantized vertices to the original ones.
+    QuantizationError measureError(const std::vector<Vertex> &vertices, const std::vector<QuantizedVertex> &quantized,
+                                   const glm::vec3 &bbMin, const glm::vec3 &bbMax);
+
+    //! \return the half float closest to the given float
+    GLushort floatToHalf(float value);
+
+    //! \return the float value of a half float
+    float halfToFloat(GLushort value);
+
+}